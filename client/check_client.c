@@ -20,11 +20,29 @@
 
 #include "../prestoclient/prestoclient.h"
 #include "../prestoclient/prestoclienttypes.h"
+#include "../prestoclient/resultcache.h"
+#include "../prestoclient/diskcache.h"
+#include "../prestoclient/clientpool.h"
+#include "../prestoclient/curlshare.h"
+#include "../prestoclient/retrypolicy.h"
+#include "../prestoclient/endpoints.h"
+#include "../prestoclient/admission.h"
+#include "../prestoclient/pagescheduler.h"
+#include "../prestoclient/partitions.h"
+#include "../prestoclient/parsepool.h"
+#include "../prestoclient/arrowexport.h"
+#include "../prestoclient/segments.h"
+#include "../prestoclient/multiplexer.h"
+#include "../prestoclient/dictionary.h"
+#include "../prestoclient/pagestore.h"
+#include "../prestoclient/lz4block.h"
 #include <stdlib.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include <check.h>
+#include <pthread.h>
 
 PRESTOCLIENT *pc = NULL;
 
@@ -311,28 +329,1304 @@ exit:
 }
 END_TEST
 
+START_TEST (test_can_share_cached_result)
+{
+	int prc;
+	PRESTOCLIENT_RESULT* result = NULL;
+	PRESTOCLIENT_RESULT* cached = NULL;
+	RESULTCACHE *cache = resultcache_new(0);
+	char *qry = "select * from information_schema.tables";
+	char *key = resultcache_makekey(pc, qry);
+	char *key2 = resultcache_makekey(pc, "  select *   from information_schema.tables ;");
+
+	ck_assert_str_eq(key, key2);
+	ck_assert_ptr_null(resultcache_get(cache, pc, key));
+
+	prc = prestoclient_query(pc, &result, qry, NULL, NULL);
+	if (prc != PRESTO_OK)
+	{
+		printf("Could not execute query '%s'\n", qry);
+		goto exit;
+	}
+	resultcache_put(cache, key, result, 60000);
+
+	cached = resultcache_get(cache, pc, key2);
+	ck_assert_ptr_nonnull(cached);
+	ck_assert_ptr_eq(result->tablebuff, cached->tablebuff);
+	ck_assert_int_eq(result->columncount, cached->columncount);
+
+	// rows stay valid after the producing result is gone
+	prestoclient_deleteresult(pc, result);
+	result = NULL;
+	ck_assert_ptr_nonnull(cached->tablebuff->rowbuff);
+exit:
+	if (result)
+		prestoclient_deleteresult(pc, result);
+	if (cached)
+		prestoclient_deleteresult(pc, cached);
+	resultcache_delete(cache);
+	free(key);
+	free(key2);
+}
+END_TEST
+
+START_TEST (test_can_coalesce_running_query)
+{
+	int prc;
+	bool leader = false, follower = true;
+	volatile bool cancel = false;
+	PRESTOCLIENT_RESULT* result = NULL;
+	PRESTOCLIENT_RESULT* shared = NULL;
+	RESULTCACHE *cache = resultcache_new(0);
+	char *qry = "select * from information_schema.tables";
+	char *key = resultcache_makekey(pc, qry);
+
+	RESULTCACHE_FLIGHT *first = resultcache_join(cache, key, &leader);
+	RESULTCACHE_FLIGHT *second = resultcache_join(cache, key, &follower);
+	ck_assert(leader);
+	ck_assert(!follower);
+	ck_assert_ptr_eq(first, second);
+
+	// a follower gives up at its deadline or when cancelled, the flight goes on
+	RESULTCACHE_FLIGHT *third = resultcache_join(cache, key, &follower);
+	ck_assert_ptr_eq(first, third);
+	ck_assert_int_eq(resultcache_wait(cache, third, pc, util_now_msec() + 50, NULL, &shared), PRESTO_TIMEOUT);
+	ck_assert_ptr_null(shared);
+	third = resultcache_join(cache, key, &follower);
+	cancel = true;
+	ck_assert_int_eq(resultcache_wait(cache, third, pc, 0, &cancel, &shared), PRESTO_CANCELLED);
+	ck_assert_ptr_null(shared);
+
+	prc = prestoclient_query(pc, &result, qry, NULL, NULL);
+	resultcache_leave(cache, first, prc == PRESTO_OK ? result : NULL);
+	ck_assert_int_eq(resultcache_wait(cache, second, pc, 0, NULL, &shared), PRESTO_OK);
+	if (prc != PRESTO_OK)
+	{
+		printf("Could not execute query '%s'\n", qry);
+		ck_assert_ptr_null(shared);
+		goto exit;
+	}
+	ck_assert_ptr_nonnull(shared);
+	ck_assert_ptr_eq(result->tablebuff, shared->tablebuff);
+
+	// the flight is gone, the next caller leads a new query
+	first = resultcache_join(cache, key, &leader);
+	ck_assert(leader);
+	resultcache_leave(cache, first, NULL);
+exit:
+	if (result)
+		prestoclient_deleteresult(pc, result);
+	if (shared)
+		prestoclient_deleteresult(pc, shared);
+	resultcache_delete(cache);
+	free(key);
+}
+END_TEST
+
+START_TEST (test_can_map_disk_cached_result)
+{
+	int prc;
+	PRESTOCLIENT_RESULT* result = NULL;
+	PRESTOCLIENT_RESULT* mapped = NULL;
+	char *qry = "select * from information_schema.tables";
+	char *key = resultcache_makekey(pc, qry);
+	char path[64];
+	FILE *file;
+	uint32_t ncol = 0xffffffff;
+
+	prc = prestoclient_query(pc, &result, qry, NULL, NULL);
+	if (prc != PRESTO_OK)
+	{
+		printf("Could not execute query '%s'\n", qry);
+		goto exit;
+	}
+	ck_assert_int_eq(PRESTO_OK, diskcache_store(".", key, result, 60000));
+
+	mapped = diskcache_load(".", key, pc);
+	ck_assert_ptr_nonnull(mapped);
+	ck_assert_ptr_nonnull(mapped->tablebuff->mapping);
+	ck_assert_int_eq(result->columncount, mapped->columncount);
+	ck_assert_int_eq(result->tablebuff->nrow, mapped->tablebuff->nrow);
+	for (size_t idx = 0; idx < (size_t)result->tablebuff->ndata; idx++)
+	{
+		if (result->tablebuff->rowbuff[idx])
+			ck_assert_str_eq(result->tablebuff->rowbuff[idx], mapped->tablebuff->rowbuff[idx]);
+	}
+
+	// a file claiming more columns than it holds is a miss and removed
+	prestoclient_deleteresult(pc, mapped);
+	ck_assert_int_eq(PRESTO_OK, diskcache_store(".", key, result, 60000));
+	sprintf(path, "./%016llx%s", util_hash(key), DISKCACHE_SUFFIX);
+	file = fopen(path, "r+b");
+	ck_assert_ptr_nonnull(file);
+	fseek(file, 32, SEEK_SET);
+	fwrite(&ncol, sizeof(ncol), 1, file);
+	fclose(file);
+	mapped = diskcache_load(".", key, pc);
+	ck_assert_ptr_null(mapped);
+	file = fopen(path, "rb");
+	ck_assert_ptr_null(file);
+
+	// an expired file is removed on load
+	ck_assert_int_eq(PRESTO_OK, diskcache_store(".", key, result, 1));
+	prestoclient_deleteresult(pc, mapped);
+	mapped = diskcache_load(".", key, pc);
+	ck_assert_ptr_null(mapped);
+exit:
+	if (result)
+		prestoclient_deleteresult(pc, result);
+	if (mapped)
+		prestoclient_deleteresult(pc, mapped);
+	free(key);
+}
+END_TEST
+
+START_TEST (test_can_pool_client)
+{
+	int prc;
+	PRESTOCLIENT_RESULT* result = NULL;
+	CLIENTPOOL *pool = clientpool_new(1, 0);
+	PRESTOCLIENT *first, *second, *other;
+
+	first = clientpool_checkout(pool, "http", "localhost", NULL, "system", "runtime", NULL, NULL, NULL, NULL, false);
+	ck_assert_ptr_nonnull(first);
+
+	prc = prestoclient_query(first, &result, "use system.metadata", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_str_eq(first->schema, "metadata");
+	prestoclient_deleteresult(first, result);
+
+	clientpool_checkin(pool, first);
+	ck_assert_int_eq(clientpool_idle(pool), 1);
+
+	// same attributes get the idle client back with the schema it was opened with
+	second = clientpool_checkout(pool, "http", "localhost", NULL, "system", "runtime", NULL, NULL, NULL, NULL, false);
+	ck_assert_ptr_eq(first, second);
+	ck_assert_str_eq(second->schema, "runtime");
+	ck_assert_int_eq(clientpool_idle(pool), 0);
+
+	other = clientpool_checkout(pool, "http", "localhost", NULL, "system", "metadata", NULL, NULL, NULL, NULL, false);
+	ck_assert_ptr_ne(second, other);
+
+	clientpool_checkin(pool, second);
+	clientpool_checkin(pool, other);
+	ck_assert_int_eq(clientpool_idle(pool), 2);
+
+	clientpool_delete(pool);
+}
+END_TEST
+
+START_TEST (test_can_share_curl)
+{
+	int prc;
+	PRESTOCLIENT_RESULT* result = NULL;
+	CURLSHARE *share = curlshare_new();
+	PRESTOCLIENT *clients[2];
+	char *qry = "select * from information_schema.tables";
+
+	ck_assert_ptr_nonnull(share);
+
+	// both clients resolve and connect through the same caches
+	for (int i = 0; i < 2; i++)
+	{
+		clients[i] = prestoclient_init("http", "localhost", NULL, NULL, NULL, NULL, NULL, NULL, NULL, false);
+		ck_assert_ptr_nonnull(clients[i]);
+		curlshare_attach(share, clients[i]);
+
+		prc = prestoclient_query(clients[i], &result, qry, NULL, NULL);
+		ck_assert_int_eq(prc, PRESTO_OK);
+		ck_assert_int_eq(prestoclient_getstatus(result), PRESTOCLIENT_STATUS_SUCCEEDED);
+		prestoclient_deleteresult(clients[i], result);
+	}
+
+	for (int i = 0; i < 2; i++)
+		prestoclient_close(clients[i]);
+
+	curlshare_delete(share);
+}
+END_TEST
+
+static void *cancel_later(void *marker)
+{
+	util_sleep(300);
+	prestoclient_cancelqueries(pc, marker);
+	return NULL;
+}
+
+START_TEST (test_can_cancel_from_other_thread)
+{
+	int prc, marker = 0;
+	pthread_t canceller;
+	PRESTOCLIENT_RESULT* result = NULL;
+	long long started;
+	char *qry = "select count(*) from tpch.sf100.lineitem /* rows=1000 per=10 delay=100 */";
+
+	pthread_create(&canceller, NULL, cancel_later, &marker);
+	started = util_now_msec();
+
+	prc = prestoclient_query(pc, &result, qry, NULL, &marker);
+	pthread_join(canceller, NULL);
+
+	ck_assert_int_eq(prc, PRESTO_CANCELLED);
+	ck_assert_ptr_null(result);
+	ck_assert_int_eq(pc->active_results, 0);
+	ck_assert_int_lt(util_now_msec() - started, 2000);
+}
+END_TEST
+
+START_TEST (test_can_close_streamed_query)
+{
+	int prc;
+	size_t rows;
+	PRESTOCLIENT_RESULT* result = NULL;
+	char *qry = "select * from tpch.sf1.lineitem /* rows=1000 per=10 */";
+
+	prc = prestoclient_querystart(pc, &result, qry, NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(prestoclient_getstatus(result), PRESTOCLIENT_STATUS_RUNNING);
+	ck_assert_ptr_nonnull(result->tablebuff);
+
+	rows = result->tablebuff->nrow;
+	ck_assert_int_gt(rows, 0);
+
+	prc = prestoclient_fetchmore(result);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_gt(result->tablebuff->nrow, rows);
+
+	// the rest of the result is never pulled
+	prestoclient_closequery(result);
+	ck_assert(result->abandoned);
+	ck_assert_ptr_null(result->tablebuff);
+	ck_assert_int_eq(prestoclient_fetchmore(result), PRESTO_BAD_REQUEST);
+
+	prestoclient_deleteresult(pc, result);
+}
+END_TEST
+
+START_TEST (test_can_limit_rows)
+{
+	int prc;
+	PRESTOCLIENT_RESULT* result = NULL;
+	char *qry = "select * from tpch.sf1.lineitem /* rows=1000 per=10 */";
+
+	prc = prestoclient_querystart(pc, &result, qry, NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(prestoclient_getstatus(result), PRESTOCLIENT_STATUS_RUNNING);
+
+	prestoclient_setmaxrows(result, 25);
+	while (prestoclient_getstatus(result) == PRESTOCLIENT_STATUS_RUNNING)
+	{
+		prc = prestoclient_fetchmore(result);
+		ck_assert_int_eq(prc, PRESTO_OK);
+	}
+
+	// stopped after the page holding row 25, the query is gone on the server
+	ck_assert_int_eq(prestoclient_getstatus(result), PRESTOCLIENT_STATUS_SUCCEEDED);
+	ck_assert_int_eq(result->tablebuff->nrow, 25);
+	ck_assert_int_lt(result->rowsreceived, 1000);
+	ck_assert(!result->lastnexturi || !result->lastnexturi[0]);
+
+	prestoclient_deleteresult(pc, result);
+}
+END_TEST
+
+START_TEST (test_can_timeout_query)
+{
+	int prc;
+	PRESTOCLIENT_RESULT* result = NULL;
+	long long started;
+	char *qry = "select count(*) from tpch.sf100.lineitem /* rows=1000 per=10 delay=2000 */";
+
+	prestoclient_setquerytimeout(pc, 300);
+	started = util_now_msec();
+
+	prc = prestoclient_query(pc, &result, qry, NULL, NULL);
+	prestoclient_setquerytimeout(pc, 0);
+
+	// the hanging request is aborted at the deadline, not when the server answers
+	ck_assert_int_eq(prc, PRESTO_TIMEOUT);
+	ck_assert_ptr_null(result);
+	ck_assert_int_eq(pc->active_results, 0);
+	ck_assert_int_lt(util_now_msec() - started, 1000);
+}
+END_TEST
+
+START_TEST (test_can_retry_and_break_circuit)
+{
+	int prc;
+	unsigned int port = 1;
+	size_t retries, rejected;
+	long long started;
+	PRESTOCLIENT_RESULT* result = NULL;
+	RETRYPOLICY *policy = retrypolicy_new();
+	PRESTOCLIENT *down;
+	char *qry = "select * from information_schema.tables /* busy=1 */";
+
+	// every other post is answered with 503, the retry makes it succeed anyway
+	retrypolicy_attach(policy, pc);
+	prc = prestoclient_query(pc, &result, qry, NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	prestoclient_deleteresult(pc, result);
+	prc = prestoclient_query(pc, &result, qry, NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	prestoclient_deleteresult(pc, result);
+	retrypolicy_stats(policy, &retries, &rejected);
+	ck_assert_int_ge(retries, 1);
+	ck_assert_int_eq(rejected, 0);
+
+	// nothing listens on port 1, after two failed connects the breaker opens
+	down = prestoclient_init("http", "localhost", &port, NULL, NULL, NULL, NULL, NULL, NULL, false);
+	ck_assert_ptr_nonnull(down);
+	retrypolicy_attach(policy, down);
+	retrypolicy_configure(policy, 1, 10, 20, -1, 2, 60000);
+
+	prc = prestoclient_query(down, &result, "select 1", NULL, NULL);
+	ck_assert_int_ne(prc, PRESTO_OK);
+
+	started = util_now_msec();
+	prc = prestoclient_query(down, &result, "select 1", NULL, NULL);
+	ck_assert_int_ne(prc, PRESTO_OK);
+	retrypolicy_stats(policy, NULL, &rejected);
+	ck_assert_int_ge(rejected, 1);
+	ck_assert_int_lt(util_now_msec() - started, 100);
+
+	prestoclient_close(down);
+	retrypolicy_attach(NULL, pc);
+	retrypolicy_delete(policy);
+}
+END_TEST
+
+START_TEST (test_can_resume_broken_page)
+{
+	int prc;
+	PRESTOCLIENT_RESULT* result = NULL;
+	char *qry[2] = {
+		"select * from tpch.sf1.lineitem /* rows=30 per=10 cut=0 */",
+		"select * from tpch.sf1.lineitem /* rows=30 per=10 cut=1 */"
+	};
+
+	// the server drops the connection in the middle of a page, the page is requested again
+	for (int q = 0; q < 2; q++)
+	{
+		prc = prestoclient_query(pc, &result, qry[q], NULL, NULL);
+		ck_assert_int_eq(prc, PRESTO_OK);
+		ck_assert_int_eq(result->resumes, 1);
+		ck_assert_int_eq(result->columncount, 3);
+		ck_assert_int_eq(result->tablebuff->nrow, 30);
+
+		// no row is lost or repeated
+		for (size_t r = 0; r < 30; r++)
+			ck_assert_int_eq(atoi(result->tablebuff->rowbuff[r * 3]), r);
+
+		prestoclient_deleteresult(pc, result);
+	}
+}
+END_TEST
+
+START_TEST (test_can_balance_endpoints)
+{
+	int prc;
+	unsigned int port = 8080;
+	PRESTOCLIENT_RESULT *first = NULL, *second = NULL;
+	PRESTOCLIENT *list;
+	char *qry = "select * from tpch.sf1.lineitem /* rows=100 per=10 */";
+
+	// two names of the same coordinator count as two coordinators, running queries are spread over them
+	list = prestoclient_init("http", "localhost, http://127.0.0.1:8080", &port, NULL, NULL, NULL, NULL, NULL, NULL, false);
+	ck_assert_ptr_nonnull(list);
+	ck_assert_int_eq(list->ncandidates, 2);
+	ck_assert_str_eq(list->baseurl, "http://localhost:8080/");
+
+	prc = prestoclient_querystart(list, &first, qry, NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	prc = prestoclient_querystart(list, &second, qry, NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_ptr_nonnull(first->endpoint);
+	ck_assert_ptr_nonnull(second->endpoint);
+	ck_assert_ptr_ne(first->endpoint, second->endpoint);
+	prestoclient_deleteresult(list, first);
+	prestoclient_deleteresult(list, second);
+	prestoclient_close(list);
+
+	// nothing listens on port 1, its queries fail over and it is dropped after three failures
+	list = prestoclient_init("http", "localhost:1,localhost", &port, NULL, NULL, NULL, NULL, NULL, NULL, false);
+	ck_assert_ptr_nonnull(list);
+	for (int q = 0; q < 6; q++)
+	{
+		prc = prestoclient_query(list, &first, "select 1", NULL, NULL);
+		ck_assert_int_eq(prc, PRESTO_OK);
+		prestoclient_deleteresult(list, first);
+	}
+	ck_assert_int_eq(endpoints_healthy(list), 1);
+	prestoclient_close(list);
+}
+END_TEST
+
+static void *query_waiting(void *client)
+{
+	PRESTOCLIENT_RESULT *result = NULL;
+	long prc = prestoclient_query((PRESTOCLIENT *)client, &result, "select 1", NULL, NULL);
+
+	prestoclient_deleteresult((PRESTOCLIENT *)client, result);
+	return (void *)prc;
+}
+
+START_TEST (test_can_queue_for_admission)
+{
+	int prc;
+	void *threadrc;
+	pthread_t waiter;
+	ADMISSION_STATS stats;
+	PRESTOCLIENT_RESULT *first = NULL, *second = NULL;
+	ADMISSION *admission = admission_new(1, ADMISSION_FIFO);
+	PRESTOCLIENT *other = prestoclient_init("http", "localhost", NULL, NULL, NULL, NULL, NULL, NULL, NULL, false);
+
+	admission_attach(admission, pc);
+	admission_attach(admission, other);
+
+	// one query may run on the coordinator, the streamed one holds it until it is deleted
+	prc = prestoclient_querystart(pc, &first, "select * from tpch.sf1.lineitem /* rows=100 per=10 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(prestoclient_getstatus(first), PRESTOCLIENT_STATUS_RUNNING);
+
+	// a query that cannot wait long enough gives up at its deadline without reaching the server
+	prestoclient_setquerytimeout(other, 200);
+	prc = prestoclient_query(other, &second, "select 1", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_TIMEOUT);
+	prestoclient_setquerytimeout(other, 0);
+
+	// a waiting query starts as soon as the running one ends
+	pthread_create(&waiter, NULL, query_waiting, other);
+	util_sleep(300);
+	admission_stats(admission, &stats);
+	ck_assert_int_eq(stats.running, 1);
+	ck_assert_int_eq(stats.waiting, 1);
+
+	prestoclient_deleteresult(pc, first);
+	pthread_join(waiter, &threadrc);
+	ck_assert_int_eq((long)threadrc, PRESTO_OK);
+
+	admission_stats(admission, &stats);
+	ck_assert_int_eq(stats.admitted, 2);
+	ck_assert_int_eq(stats.queued, 1);
+	ck_assert_int_eq(stats.abandoned, 1);
+	ck_assert_int_eq(stats.running, 0);
+	ck_assert_int_ge(stats.maxqueuetime, 250);
+
+	admission_attach(NULL, pc);
+	prestoclient_close(other);
+	admission_delete(admission);
+}
+END_TEST
+
+static void *query_bulk(void *client)
+{
+	PRESTOCLIENT_RESULT *result = NULL;
+	long prc = prestoclient_query((PRESTOCLIENT *)client, &result,
+								  "select * from tpch.sf1.lineitem /* rows=30 per=10 delay=200 */", NULL, NULL);
+
+	prestoclient_deleteresult((PRESTOCLIENT *)client, result);
+	return (void *)prc;
+}
+
+START_TEST (test_can_schedule_interactive_pages_first)
+{
+	int prc;
+	void *threadrc;
+	long long started, elapsed;
+	pthread_t bulk[2];
+	PRESTOCLIENT *bulkclient[2];
+	PRESTOCLIENT_RESULT *result = NULL;
+	PAGESCHEDULER_STATS stats;
+	PAGESCHEDULER *scheduler = pagescheduler_new(1, 0);
+
+	// two extracts share a single bulk page slot
+	for (int i = 0; i < 2; i++)
+	{
+		bulkclient[i] = prestoclient_init("http", "localhost", NULL, NULL, NULL, NULL, NULL, NULL, NULL, false);
+		pagescheduler_attach(scheduler, bulkclient[i]);
+		pthread_create(&bulk[i], NULL, query_bulk, bulkclient[i]);
+	}
+	util_sleep(100);
+
+	// the interactive lookup does not wait for the extracts
+	pagescheduler_attach(scheduler, pc);
+	prestoclient_setpriority(pc, 1);
+	started = util_now_msec();
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.nation /* rows=10 per=10 */", NULL, NULL);
+	elapsed = util_now_msec() - started;
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 10);
+	ck_assert_int_lt(elapsed, 200);
+	prestoclient_deleteresult(pc, result);
+
+	for (int i = 0; i < 2; i++)
+	{
+		pthread_join(bulk[i], &threadrc);
+		ck_assert_int_eq((long)threadrc, PRESTO_OK);
+		prestoclient_close(bulkclient[i]);
+	}
+
+	pagescheduler_stats(scheduler, &stats);
+	ck_assert_int_ge(stats.pages[PAGECLASS_INTERACTIVE], 1);
+	ck_assert_int_eq(stats.waits[PAGECLASS_INTERACTIVE], 0);
+	ck_assert_int_ge(stats.waits[PAGECLASS_BULK], 1);
+	ck_assert_int_eq(stats.inflight[PAGECLASS_BULK], 0);
+
+	prestoclient_setpriority(pc, 0);
+	pagescheduler_attach(NULL, pc);
+	pagescheduler_delete(scheduler);
+}
+END_TEST
+
+START_TEST (test_can_extract_partitioned)
+{
+	int prc, marker = 0;
+	PRESTOCLIENT_RESULT *result = NULL;
+
+	// three range queries, the mock answers each with all of its 30 rows
+	prc = partitions_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=30 per=10 */;", "id", 0, 29, 3, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	while (prestoclient_getstatus(result) == PRESTOCLIENT_STATUS_RUNNING)
+		ck_assert_int_eq(prestoclient_fetchmore(result), PRESTO_OK);
+	ck_assert_int_eq(prestoclient_getstatus(result), PRESTOCLIENT_STATUS_SUCCEEDED);
+	ck_assert_int_eq(result->columncount, 3);
+	ck_assert_int_eq(result->tablebuff->nrow, 90);
+	ck_assert_int_eq(result->tablebuff->ncol, 3);
+	prestoclient_deleteresult(pc, result);
+
+	// a range of hashed keys spanning all of bigint is still split in three
+	prc = partitions_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=30 per=10 */;", "id", LLONG_MIN, LLONG_MAX, 3, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	while (prestoclient_getstatus(result) == PRESTOCLIENT_STATUS_RUNNING)
+		ck_assert_int_eq(prestoclient_fetchmore(result), PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 90);
+	prestoclient_deleteresult(pc, result);
+
+	// cancelling the merged result stops every range query
+	result = NULL;
+	prc = partitions_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=100 per=10 delay=100 */", "id", 0, 99, 4, &marker);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	prestoclient_cancelqueries(pc, &marker);
+	ck_assert_int_eq(prestoclient_fetchmore(result), PRESTO_CANCELLED);
+	ck_assert_int_eq(prestoclient_getstatus(result), PRESTOCLIENT_STATUS_FAILED);
+	prestoclient_deleteresult(pc, result);
+	ck_assert_int_eq(pc->active_results, 0);
+}
+END_TEST
+
+START_TEST (test_can_parse_pages_on_pool)
+{
+	int prc;
+	PRESTOCLIENT_RESULT *result = NULL;
+	PARSEPOOL_STATS stats;
+	PARSEPOOL *pool = parsepool_new(3);
+
+	parsepool_attach(pool, pc);
+	ck_assert_ptr_eq(pc->parsepool, pool);
+
+	// the pages come back in the order of the server
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=200 per=10 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->columncount, 3);
+	ck_assert_int_eq(result->tablebuff->nrow, 200);
+	for (size_t i = 0; i < 200; i++)
+		ck_assert_int_eq(strtol(result->tablebuff->rowbuff[i * 3], NULL, 10), i);
+	ck_assert_str_eq(result->tablebuff->rowbuff[7 * 3 + 1], "null");
+	ck_assert_str_eq(prestoclient_getlastserverstate(result), "FINISHED");
+	prestoclient_deleteresult(pc, result);
+
+	// a streamed query and a page cut off in the middle
+	result = NULL;
+	prc = prestoclient_querystart(pc, &result, "select * from tpch.sf1.lineitem /* rows=100 per=10 cut=3 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	while (prestoclient_getstatus(result) == PRESTOCLIENT_STATUS_RUNNING)
+		ck_assert_int_eq(prestoclient_fetchmore(result), PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 100);
+	ck_assert_int_eq(strtol(result->tablebuff->rowbuff[99 * 3], NULL, 10), 99);
+	ck_assert_int_eq(result->resumes, 1);
+	prestoclient_deleteresult(pc, result);
+
+	// an error of the last page
+	result = NULL;
+	prc = prestoclient_query(pc, &result, "select fail from tpch.sf1.lineitem", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_BACKEND_ERROR);
+
+	// closing a streamed query drops the pages not yet parsed
+	result = NULL;
+	prc = prestoclient_querystart(pc, &result, "select * from tpch.sf1.lineitem /* rows=1000 per=10 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	prestoclient_closequery(result);
+	prestoclient_deleteresult(pc, result);
+
+	parsepool_stats(pool, &stats);
+	ck_assert_int_eq(stats.workers, 3);
+	ck_assert_int_ge(stats.pages, 30);
+	ck_assert_int_eq(stats.queued, 0);
+
+	parsepool_attach(NULL, pc);
+	ck_assert_ptr_null(pc->parsepool);
+	parsepool_delete(pool);
+}
+END_TEST
+
+// Checks the rows of every page against the rows the mock coordinator sends
+typedef struct ST_PAGECHECK
+{
+	size_t pages;
+	size_t rows;
+	size_t wrong;
+} PAGECHECK;
+
+static void check_page(PRESTOCLIENT_RESULT *result, const PRESTOCLIENT_PAGE *page, void *in_check)
+{
+	PAGECHECK *check = (PAGECHECK *)in_check;
+	const int64_t *ids = prestoclient_getcolumn_int64(page, 0);
+	const PRESTOCLIENT_STRING_VIEW *names = prestoclient_getcolumn_string_view(page, 1);
+	const double *scores = prestoclient_getcolumn_double(page, 2);
+	char name[16];
+
+	if (!ids || !names || !scores || prestoclient_getcolumn_int64(page, 1) || prestoclient_getcolumncount(result) != 3)
+		check->wrong++;
+
+	for (size_t row = 0; ids && names && scores && row < prestoclient_getpagerowcount(page); row++)
+	{
+		int64_t id = (int64_t)(check->rows + row);
+		bool isnull = id % 7 == 0;
+
+		sprintf(name, "n%d", (int)(id % 3));
+		if (ids[row] != id || scores[row] != (isnull ? 0.0 : id * 0.5) ||
+			prestoclient_getcolumn_isnull(page, 1, row) != isnull ||
+			((prestoclient_getcolumn_validity(page, 2)[row / 8] >> (row % 8)) & 1) == isnull ||
+			(isnull ? names[row].data != NULL : names[row].length != strlen(name) || memcmp(names[row].data, name, strlen(name)) != 0))
+			check->wrong++;
+	}
+
+	check->pages++;
+	check->rows += prestoclient_getpagerowcount(page);
+}
+
+START_TEST (test_can_deliver_pages)
+{
+	int prc;
+	PRESTOCLIENT_RESULT *result = NULL;
+	PAGECHECK check = { 0, 0, 0 };
+	PARSEPOOL *pool = parsepool_new(2);
+
+	prestoclient_on_page(pc, &check_page);
+
+	// every page in one call, no rows are kept in the result
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=200 per=10 */", NULL, &check);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(check.rows, 200);
+	ck_assert_int_eq(check.pages, 20);
+	ck_assert_int_eq(check.wrong, 0);
+	ck_assert_ptr_null(result->tablebuff);
+	prestoclient_deleteresult(pc, result);
+
+	// a page cut off in the middle is delivered once
+	memset(&check, 0, sizeof(check));
+	result = NULL;
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=100 per=10 cut=3 */", NULL, &check);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->resumes, 1);
+	ck_assert_int_eq(check.rows, 100);
+	ck_assert_int_eq(check.wrong, 0);
+	prestoclient_deleteresult(pc, result);
+
+	// pages parsed on the parse pool arrive in order
+	parsepool_attach(pool, pc);
+	memset(&check, 0, sizeof(check));
+	result = NULL;
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=200 per=10 */", NULL, &check);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(check.rows, 200);
+	ck_assert_int_eq(check.wrong, 0);
+	prestoclient_deleteresult(pc, result);
+	parsepool_attach(NULL, pc);
+	parsepool_delete(pool);
+
+	// without a page callback the rows are buffered again
+	prestoclient_on_page(pc, NULL);
+	memset(&check, 0, sizeof(check));
+	result = NULL;
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=20 per=10 */", NULL, &check);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(check.pages, 0);
+	ck_assert_int_eq(result->tablebuff->nrow, 20);
+	prestoclient_deleteresult(pc, result);
+}
+END_TEST
+
+START_TEST (test_can_export_arrow_stream)
+{
+	int prc;
+	struct ArrowArrayStream stream;
+	struct ArrowSchema schema;
+	struct ArrowArray batch, moved;
+	size_t rows = 0, batches = 0, nulls = 0;
+
+	prc = arrowexport_query(pc, "select * from tpch.sf1.lineitem /* rows=200 per=10 */", &stream);
+	ck_assert_int_eq(prc, PRESTO_OK);
+
+	ck_assert_int_eq(stream.get_schema(&stream, &schema), 0);
+	ck_assert_str_eq(schema.format, "+s");
+	ck_assert_int_eq(schema.n_children, 3);
+	ck_assert_str_eq(schema.children[0]->name, "id");
+	ck_assert_str_eq(schema.children[0]->format, "l");
+	ck_assert_str_eq(schema.children[1]->format, "U");
+	ck_assert_str_eq(schema.children[2]->format, "g");
+	ck_assert_int_eq(schema.children[1]->flags, ARROW_FLAG_NULLABLE);
+	schema.release(&schema);
+	ck_assert_ptr_null(schema.release);
+
+	// every page is one batch, the values are those of the page
+	while (stream.get_next(&stream, &batch) == 0 && batch.release)
+	{
+		const int64_t *ids = (const int64_t *)batch.children[0]->buffers[1];
+		const int64_t *offsets = (const int64_t *)batch.children[1]->buffers[1];
+		const char *text = (const char *)batch.children[1]->buffers[2];
+		const double *scores = (const double *)batch.children[2]->buffers[1];
+
+		ck_assert_int_eq(batch.n_children, 3);
+		ck_assert_int_eq(batch.children[0]->length, batch.length);
+		for (int64_t row = 0; row < batch.length; row++)
+		{
+			int64_t id = (int64_t)rows + row;
+
+			ck_assert_int_eq(ids[row], id);
+			if (id % 7 != 0)
+			{
+				ck_assert_int_eq(offsets[row + 1] - offsets[row], 2);
+				ck_assert_int_eq(text[offsets[row] + 1], '0' + id % 3);
+				ck_assert(scores[row] == id * 0.5);
+			}
+		}
+		nulls += (size_t)batch.children[1]->null_count;
+		rows += (size_t)batch.length;
+		batches++;
+
+		// a child moved out of the batch outlives it
+		moved = *batch.children[0];
+		batch.children[0]->release = NULL;
+		batch.release(&batch);
+		ck_assert_int_eq(((const int64_t *)moved.buffers[1])[0], (int64_t)rows - moved.length);
+		moved.release(&moved);
+	}
+	ck_assert_int_eq(rows, 200);
+	ck_assert_int_eq(batches, 20);
+	ck_assert_int_eq(nulls, 29);
+	stream.release(&stream);
+	ck_assert_ptr_null(stream.release);
+
+	// releasing the stream early cancels the query
+	prc = arrowexport_query(pc, "select * from tpch.sf1.lineitem /* rows=1000 per=10 */", &stream);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(stream.get_next(&stream, &batch), 0);
+	batch.release(&batch);
+	stream.release(&stream);
+	ck_assert_int_eq(pc->active_results, 0);
+
+	// integers and reals keep their width
+	ck_assert_str_eq(arrowexport_format(PRESTOCLIENT_TYPE_TINYINT), "c");
+	ck_assert_str_eq(arrowexport_format(PRESTOCLIENT_TYPE_SMALLINT), "s");
+	prc = arrowexport_query(pc, "select * from tpch.sf1.lineitem /* rows=20 per=10 narrow=1 */", &stream);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(stream.get_schema(&stream, &schema), 0);
+	ck_assert_str_eq(schema.children[0]->format, "i");
+	ck_assert_str_eq(schema.children[2]->format, "f");
+	schema.release(&schema);
+	rows = 0;
+	while (stream.get_next(&stream, &batch) == 0 && batch.release)
+	{
+		const int32_t *ids = (const int32_t *)batch.children[0]->buffers[1];
+		const float *scores = (const float *)batch.children[2]->buffers[1];
+
+		for (int64_t row = 0; row < batch.length; row++)
+		{
+			int64_t id = (int64_t)rows + row;
+
+			ck_assert_int_eq(ids[row], id);
+			if (id % 7 != 0)
+				ck_assert(scores[row] == (float)(id * 0.5));
+		}
+		rows += (size_t)batch.length;
+		batch.release(&batch);
+	}
+	ck_assert_int_eq(rows, 20);
+	stream.release(&stream);
+
+	// a failed query ends with an error
+	prc = arrowexport_query(pc, "select fail from tpch.sf1.lineitem", &stream);
+	ck_assert_int_ne(prc, PRESTO_OK);
+}
+END_TEST
+
+START_TEST (test_can_decode_arrow_pages)
+{
+	int prc;
+	PRESTOCLIENT_RESULT *json = NULL, *arrow = NULL;
+	PAGECHECK check = { 0, 0, 0 };
+	char *qry = "select * from tpch.sf1.lineitem /* rows=200 per=10 */";
+
+	ck_assert_int_eq(prestoclient_setencoding(pc, "parquet"), PRESTO_BAD_REQUEST);
+	ck_assert_int_eq(prestoclient_setencoding(pc, "json"), PRESTO_OK);
+	ck_assert_ptr_null(pc->accept);
+
+	prc = prestoclient_query(pc, &json, qry, NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+
+	// json stays acceptable behind the preferred encoding
+	ck_assert_int_eq(prestoclient_setencoding(pc, "arrow"), PRESTO_OK);
+	ck_assert_str_eq(pc->accept, "application/vnd.apache.arrow.stream, application/json;q=0.1");
+
+	// the same rows as json, the numbers are formatted from their binary values
+	prc = prestoclient_query(pc, &arrow, qry, NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(arrow->columncount, 3);
+	ck_assert_str_eq(arrow->columns[0]->name, "id");
+	ck_assert_int_eq(arrow->columns[0]->type, PRESTOCLIENT_TYPE_BIGINT);
+	ck_assert_int_eq(arrow->columns[1]->type, PRESTOCLIENT_TYPE_VARCHAR);
+	ck_assert_int_eq(arrow->columns[2]->type, PRESTOCLIENT_TYPE_DOUBLE);
+	ck_assert_int_eq(arrow->tablebuff->nrow, json->tablebuff->nrow);
+	for (size_t i = 0; i < 200 * 3; i++)
+	{
+		if (i % 3 == 2 && strcmp(json->tablebuff->rowbuff[i], "null") != 0)
+			ck_assert(strtod(arrow->tablebuff->rowbuff[i], NULL) == strtod(json->tablebuff->rowbuff[i], NULL));
+		else
+			ck_assert_str_eq(arrow->tablebuff->rowbuff[i], json->tablebuff->rowbuff[i]);
+	}
+	ck_assert_str_eq(arrow->tablebuff->rowbuff[2 * 3 + 2], "1");
+	ck_assert_str_eq(prestoclient_getlastserverstate(arrow), "FINISHED");
+	prestoclient_deleteresult(pc, json);
+	prestoclient_deleteresult(pc, arrow);
+
+	// a page cut off in the middle is decoded again, pages go to the page callback
+	prestoclient_on_page(pc, &check_page);
+	arrow = NULL;
+	prc = prestoclient_query(pc, &arrow, "select * from tpch.sf1.lineitem /* rows=100 per=10 cut=3 */", NULL, &check);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(arrow->resumes, 1);
+	ck_assert_int_eq(check.rows, 100);
+	ck_assert_int_eq(check.wrong, 0);
+	prestoclient_deleteresult(pc, arrow);
+	prestoclient_on_page(pc, NULL);
+
+	// errors are json
+	arrow = NULL;
+	prc = prestoclient_query(pc, &arrow, "select fail from tpch.sf1.lineitem", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_BACKEND_ERROR);
+
+	// a batch whose buffers are too short for its rows is refused, not decoded from the next buffer
+	prestoclient_on_page(pc, &check_page);
+	memset(&check, 0, sizeof(check));
+	prc = prestoclient_query(pc, &arrow, "select * from tpch.sf1.lineitem /* rows=30 per=10 short=1 */", NULL, &check);
+	ck_assert_int_ne(prc, PRESTO_OK);
+	ck_assert_ptr_null(arrow);
+	ck_assert_int_eq(check.rows, 10);
+	ck_assert_int_eq(check.wrong, 0);
+	prestoclient_on_page(pc, NULL);
+
+	ck_assert_int_eq(prestoclient_setencoding(pc, NULL), PRESTO_OK);
+	ck_assert_ptr_null(pc->accept);
+}
+END_TEST
+
+START_TEST (test_can_fetch_spooled_segments)
+{
+	int prc;
+	PRESTOCLIENT_RESULT *result = NULL;
+	SEGMENTS_STATS stats;
+	PAGECHECK check = { 0, 0, 0 };
+
+	ck_assert_int_eq(prestoclient_setspooling(pc, SEGMENTS_MAXPARALLEL + 1), PRESTO_BAD_REQUEST);
+	ck_assert_int_eq(prestoclient_setspooling(pc, 4), PRESTO_OK);
+
+	// the later segments of a page arrive first, the rows keep the order of the server
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=200 per=50 seg=5 segdelay=20 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->columncount, 3);
+	ck_assert_int_eq(result->tablebuff->nrow, 200);
+	for (size_t i = 0; i < 200; i++)
+		ck_assert_int_eq(strtol(result->tablebuff->rowbuff[i * 3], NULL, 10), i);
+	ck_assert_str_eq(result->tablebuff->rowbuff[7 * 3 + 1], "null");
+	ck_assert_str_eq(result->tablebuff->rowbuff[8 * 3 + 1], "n2");
+
+	segments_stats(result, &stats);
+	ck_assert_int_eq(stats.inlined, 4);
+	ck_assert_int_eq(stats.spooled, 16);
+	ck_assert_int_eq(stats.acknowledged, 16);
+	ck_assert_int_gt(stats.bytes, 0);
+	ck_assert_int_gt(stats.maxactive, 1);
+	ck_assert_int_le(stats.maxactive, 4);
+	prestoclient_deleteresult(pc, result);
+
+	// a failed download is asked again, pages go to the page callback
+	prestoclient_on_page(pc, &check_page);
+	result = NULL;
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=20 per=10 seg=2 segerr=1 */", NULL, &check);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(check.rows, 20);
+	ck_assert_int_eq(check.wrong, 0);
+	segments_stats(result, &stats);
+	ck_assert_int_eq(stats.retries, 2);
+	ck_assert_int_eq(stats.spooled, 2);
+	prestoclient_deleteresult(pc, result);
+	prestoclient_on_page(pc, NULL);
+
+	// without spooling the rows are in the pages again
+	ck_assert_int_eq(prestoclient_setspooling(pc, 0), PRESTO_OK);
+	result = NULL;
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=20 per=10 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 20);
+	segments_stats(result, &stats);
+	ck_assert_int_eq(stats.inlined + stats.spooled, 0);
+	prestoclient_deleteresult(pc, result);
+}
+END_TEST
+
+START_TEST (test_can_compress_responses)
+{
+	int prc;
+	PRESTOCLIENT_RESULT *result = NULL;
+	size_t wirebytes, bodybytes;
+
+	ck_assert_int_eq(prestoclient_setcompression(pc, "zstd,lz77"), PRESTO_BAD_REQUEST);
+	ck_assert_int_eq(prestoclient_setcompression(pc, "zstd, gzip"), PRESTO_OK);
+	ck_assert_ptr_nonnull(strstr(pc->compression, "gzip"));
+
+	// the pages come gzip'ed and are inflated on their way to the parser
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=500 per=100 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 500);
+	ck_assert_int_eq(strtol(result->tablebuff->rowbuff[499 * 3], NULL, 10), 499);
+	prestoclient_getbytes(result, &wirebytes, &bodybytes);
+	ck_assert_int_gt(wirebytes, 0);
+	ck_assert_int_gt(bodybytes, 2 * wirebytes);
+	prestoclient_deleteresult(pc, result);
+
+	// uncompressed both counts are the same
+	ck_assert_int_eq(prestoclient_setcompression(pc, NULL), PRESTO_OK);
+	ck_assert_ptr_null(pc->compression);
+	result = NULL;
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=500 per=100 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	prestoclient_getbytes(result, &wirebytes, &bodybytes);
+	ck_assert_int_gt(wirebytes, 0);
+	ck_assert_int_eq(wirebytes, bodybytes);
+	prestoclient_deleteresult(pc, result);
+}
+END_TEST
+
+// Stops a multiplexer while a query of the test client runs on it
+static void *stop_multiplexer(void *multiplexer)
+{
+	long long started;
+
+	util_sleep(150);
+	started = util_now_msec();
+	multiplexer_stop((MULTIPLEXER *)multiplexer);
+
+	return (void *)(intptr_t)(util_now_msec() - started);
+}
+
+START_TEST (test_can_multiplex_statements)
+{
+	int prc;
+	PRESTOCLIENT_RESULT *result = NULL;
+	MULTIPLEXER *multiplexer = multiplexer_new(MULTIPLEXER_HTTP2);
+	MULTIPLEXER_STATS stats;
+	MULTIPLEXER_CONNECTION connections[8];
+	size_t count;
+	pthread_t stopper;
+	void *stopmsec;
+
+	// a multiplexer stopped under a running request ends it instead of leaving it waiting
+	multiplexer_attach(multiplexer, pc);
+	pthread_create(&stopper, NULL, stop_multiplexer, multiplexer);
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=30 per=10 delay=300 */", NULL, NULL);
+	pthread_join(stopper, &stopmsec);
+	ck_assert_int_lt((intptr_t)stopmsec, 1000);
+	ck_assert(!multiplexer_active(pc));
+	if (result)
+		prestoclient_deleteresult(pc, result);
+	multiplexer_attach(NULL, pc);
+	multiplexer_delete(multiplexer);
+
+	// plain http negotiates no http/2, the requests still run on the multi handle
+	multiplexer = multiplexer_new(MULTIPLEXER_HTTP2);
+	multiplexer_attach(multiplexer, pc);
+	result = NULL;
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=20 per=10 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 20);
+	prestoclient_deleteresult(pc, result);
+	count = multiplexer_connections(multiplexer, connections, 8);
+	ck_assert_int_eq(count, 1);
+	ck_assert_int_eq(connections[0].version, CURL_HTTP_VERSION_1_1);
+	multiplexer_stats(multiplexer, &stats);
+	ck_assert_int_eq(connections[0].streams, stats.transfers);
+	multiplexer_attach(NULL, pc);
+	multiplexer_delete(multiplexer);
+}
+END_TEST
+
+START_TEST (test_can_multiplex_over_http2)
+{
+	int prc;
+	unsigned int port = 18444;
+	PRESTOCLIENT *h2client = prestoclient_init("https", "localhost", &port, NULL, NULL, NULL, NULL, NULL, NULL, 1);
+	PRESTOCLIENT_RESULT *result = NULL;
+	MULTIPLEXER *multiplexer = multiplexer_new(MULTIPLEXER_HTTP2);
+	MULTIPLEXER_STATS stats;
+	MULTIPLEXER_CONNECTION connections[8];
+	size_t count;
+	char *info;
+
+	// mockpresto.py --run starts the proxy with a certificate of its own when nghttpx and openssl are installed
+	prestoclient_setcafile(h2client, getenv("MOCKPRESTO_CA"));
+	info = prestoclient_serverinfo(h2client);
+	if (!info)
+	{
+		printf("no http/2 proxy on port %u, skipping the multiplexed requests\n", port);
+		goto exit;
+	}
+	free(info);
+
+	// four range queries at once through an http/2 proxy in front of the mock share one connection
+	multiplexer_attach(multiplexer, h2client);
+	ck_assert(multiplexer_active(h2client));
+	prc = partitions_query(h2client, &result, "select * from tpch.sf1.lineitem /* rows=100 per=10 delay=20 */", "id", 0, 99, 4, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	while (prestoclient_getstatus(result) == PRESTOCLIENT_STATUS_RUNNING)
+		ck_assert_int_eq(prestoclient_fetchmore(result), PRESTO_OK);
+	ck_assert_int_eq(prestoclient_getstatus(result), PRESTOCLIENT_STATUS_SUCCEEDED);
+	ck_assert_int_eq(result->tablebuff->nrow, 400);
+	prestoclient_deleteresult(h2client, result);
+
+	multiplexer_stats(multiplexer, &stats);
+	ck_assert_int_gt(stats.transfers, 40);
+	ck_assert_int_eq(stats.active, 0);
+	ck_assert_int_gt(stats.maxactive, 1);
+	ck_assert_int_eq(stats.connections, 1);
+	count = multiplexer_connections(multiplexer, connections, 8);
+	ck_assert_int_eq(count, 1);
+	ck_assert_int_eq(connections[0].version, CURL_HTTP_VERSION_2_0);
+	ck_assert_int_eq(connections[0].streams, stats.transfers);
+	ck_assert_int_gt(connections[0].maxactive, 1);
+	ck_assert_int_gt(connections[0].bytes, 0);
+
+	// a stream over its window is paused until the query took what was queued
+	multiplexer_configure(multiplexer, MULTIPLEXER_HTTP2, 1024);
+	result = NULL;
+	prc = prestoclient_query(h2client, &result, "select * from tpch.sf1.lineitem /* rows=3000 per=3000 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 3000);
+	ck_assert_int_eq(strtol(result->tablebuff->rowbuff[2999 * 3], NULL, 10), 2999);
+	prestoclient_deleteresult(h2client, result);
+	multiplexer_stats(multiplexer, &stats);
+	ck_assert_int_gt(stats.pauses, 0);
+
+exit:
+	prestoclient_close(h2client);
+	multiplexer_delete(multiplexer);
+}
+END_TEST
+
+START_TEST (test_can_size_pages_adaptively)
+{
+	int prc;
+	size_t rows;
+	PRESTOCLIENT_RESULT *result = NULL;
+
+	ck_assert_int_eq(prestoclient_setpagesize(pc, 4096, 1024), PRESTO_BAD_REQUEST);
+	ck_assert_int_eq(prestoclient_setpagesize(pc, 1024, 16384), PRESTO_OK);
+
+	// a buffered query keeps up with its pages, they double up to the limit
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=3000 per=1000 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 3000);
+	ck_assert_int_eq(strtol(result->tablebuff->rowbuff[2999 * 3], NULL, 10), 2999);
+	ck_assert_int_eq(prestoclient_getpagesize(result), 16384);
+	prestoclient_deleteresult(pc, result);
+
+	// the first page is small, a consumer slower than the client keeps the pages at their size
+	result = NULL;
+	prc = prestoclient_querystart(pc, &result, "select * from tpch.sf1.lineitem /* rows=3000 per=1000 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	rows = result->tablebuff->nrow;
+	ck_assert_int_gt(rows, 0);
+	ck_assert_int_lt(rows, 100);
+	for (int i = 0; i < 3; i++)
+	{
+		util_sleep(200);
+		ck_assert_int_eq(prestoclient_fetchmore(result), PRESTO_OK);
+		ck_assert_int_eq(prestoclient_getpagesize(result), 1024);
+	}
+	ck_assert_int_lt(result->tablebuff->nrow, 4 * 100);
+	prestoclient_deleteresult(pc, result);
+
+	// without a size the coordinator sends its default pages
+	ck_assert_int_eq(prestoclient_setpagesize(pc, 0, 0), PRESTO_OK);
+	result = NULL;
+	prc = prestoclient_querystart(pc, &result, "select * from tpch.sf1.lineitem /* rows=3000 per=1000 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 1000);
+	ck_assert_int_eq(prestoclient_getpagesize(result), 0);
+	prestoclient_deleteresult(pc, result);
+}
+END_TEST
+
+START_TEST (test_can_share_repeating_values)
+{
+	int prc;
+	char value[32];
+	PRESTOCLIENT_RESULT *result = NULL;
+	PRESTOCLIENT_TABLEBUFFER *tab;
+	DICTIONARY *dictionary = dictionary_new();
+
+	// the varchar column repeats three values, its cells point into one dictionary
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=2000 per=500 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	tab = result->tablebuff;
+	ck_assert_int_eq(tab->nrow, 2000);
+	ck_assert_str_eq(tab->rowbuff[1 * 3 + 1], "n1");
+	ck_assert_ptr_eq(tab->rowbuff[1 * 3 + 1], tab->rowbuff[1999 * 3 + 1]);
+	ck_assert_ptr_ne(tab->rowbuff[1 * 3 + 1], tab->rowbuff[2 * 3 + 1]);
+	ck_assert_ptr_null(tab->dictionaries[0]);
+	ck_assert(dictionary_active(tab->dictionaries[1]));
+	ck_assert_int_le(dictionary_count(tab->dictionaries[1]), 4);
+	ck_assert_int_eq(strtol(tab->rowbuff[1999 * 3], NULL, 10), 1999);
+	prestoclient_deleteresult(pc, result);
+
+	// mostly distinct values are left to malloc'ed cells
+	for (int i = 0; i < DICTIONARY_PROBEVALUES / 2; i++)
+	{
+		sprintf(value, "v%d", i);
+		ck_assert_str_eq(dictionary_intern(dictionary, value, strlen(value)), value);
+	}
+	ck_assert_ptr_eq(dictionary_intern(dictionary, "v7", 2), dictionary_intern(dictionary, "v7x", 2));
+	ck_assert_ptr_null(dictionary_intern(dictionary, "w", 1));
+	ck_assert(!dictionary_active(dictionary));
+	ck_assert_ptr_null(dictionary_intern(dictionary, "v7", 2));
+	dictionary_delete(dictionary);
+}
+END_TEST
+
+START_TEST (test_can_keep_cold_pages_compressed)
+{
+	int prc;
+	char **row, *cell;
+	unsigned char block[4096], packed[4096 + 4096 / 255 + 16], unpacked[4096];
+	PRESTOCLIENT_RESULT *result = NULL;
+	PAGESTORE_STATS stats;
+
+	// a block round trips and a damaged one is refused
+	for (size_t i = 0; i < sizeof(block); i++)
+		block[i] = (unsigned char)(i % 100 < 60 ? 'a' + i % 7 : i * 31);
+	size_t size = lz4block_compress(block, sizeof(block), packed);
+	ck_assert_int_lt(size, sizeof(block));
+	ck_assert_int_eq(lz4block_decompress(packed, size, unpacked, sizeof(unpacked)), sizeof(block));
+	ck_assert(memcmp(block, unpacked, sizeof(block)) == 0);
+	ck_assert_int_eq(lz4block_decompress(packed, size, unpacked, 100), -1);
+
+	// reading a result through compresses the pages the cursor left behind
+	prestoclient_sethotpages(pc, 2);
+	prc = prestoclient_query(pc, &result, "select * from tpch.sf1.lineitem /* rows=20000 per=2000 */", NULL, NULL);
+	ck_assert_int_eq(prc, PRESTO_OK);
+	ck_assert_int_eq(result->tablebuff->nrow, 20000);
+	cell = strdup(prestoclient_getrow(result, 7)[2]);
+	for (size_t i = 0; i < 20000; i++)
+	{
+		row = prestoclient_getrow(result, i);
+		ck_assert_ptr_nonnull(row);
+		ck_assert_int_eq(strtol(row[0], NULL, 10), i);
+	}
+	pagestore_stats(result->tablebuff->store, &stats);
+	ck_assert_int_ge(stats.pages, 15);
+	ck_assert_int_lt(stats.packedbytes, stats.rawbytes);
+	ck_assert_int_eq(stats.thaws, 0);
+
+	// scrolling back decompresses a page with the cells as they were
+	row = prestoclient_getrow(result, 7);
+	ck_assert_int_eq(strtol(row[0], NULL, 10), 7);
+	ck_assert_str_eq(row[2], cell);
+	free(cell);
+	row = prestoclient_getrow(result, 5);
+	ck_assert_str_eq(row[1], "n2");
+	ck_assert_str_eq(row[2], "2.5");
+	row = prestoclient_getrow(result, 3000);
+	row = prestoclient_getrow(result, 5000);
+	row = prestoclient_getrow(result, 7000);
+	pagestore_stats(result->tablebuff->store, &stats);
+	ck_assert_int_le(stats.thawed, 2);
+	ck_assert_int_eq(stats.thaws, 4);
+	ck_assert_int_eq(strtol(prestoclient_getrow(result, 5)[0], NULL, 10), 5);
+	prestoclient_deleteresult(pc, result);
+	prestoclient_sethotpages(pc, 0);
+}
+END_TEST
+
 Suite * prestoclient_suite(void)
 {
     Suite *s;
-    TCase *tc_core;
+    TCase *tc_core, *tc_mock, *tc_http2;
 
     s = suite_create("prestoclient");
 
-    /* Core test case */
+    /* Core test case, against a Presto server on localhost:8080 */
     tc_core = tcase_create("Core");
 
 	tcase_add_checked_fixture(tc_core, setup, teardown);
-    tcase_add_test(tc_core, test_can_serverinfo);
+	tcase_add_test(tc_core, test_can_serverinfo);
 	tcase_add_test(tc_core, test_can_query_mass_test);
-	tcase_add_test(tc_core, test_can_query_information_schema);		
-	tcase_add_test(tc_core, test_bad_query_fails_with_errorcode);	
-	tcase_add_test(tc_core, test_bad_prepare_fails_with_errorcode);			
+	tcase_add_test(tc_core, test_can_query_information_schema);
+	tcase_add_test(tc_core, test_bad_query_fails_with_errorcode);
+	tcase_add_test(tc_core, test_bad_prepare_fails_with_errorcode);
 	tcase_add_test(tc_core, test_can_use_schema);
 	tcase_add_test(tc_core, test_can_prepare);
 	tcase_add_test(tc_core, test_can_use_and_then_query);
-	
     suite_add_tcase(s, tc_core);
 
+    /* Mock test case, against mockpresto.py, run it with CK_RUN_CASE=Mock */
+    tc_mock = tcase_create("Mock");
+
+	tcase_add_checked_fixture(tc_mock, setup, teardown);
+	tcase_add_test(tc_mock, test_can_share_cached_result);
+	tcase_add_test(tc_mock, test_can_coalesce_running_query);
+	tcase_add_test(tc_mock, test_can_map_disk_cached_result);
+	tcase_add_test(tc_mock, test_can_pool_client);
+	tcase_add_test(tc_mock, test_can_share_curl);
+	tcase_add_test(tc_mock, test_can_cancel_from_other_thread);
+	tcase_add_test(tc_mock, test_can_close_streamed_query);
+	tcase_add_test(tc_mock, test_can_limit_rows);
+	tcase_add_test(tc_mock, test_can_timeout_query);
+	tcase_add_test(tc_mock, test_can_retry_and_break_circuit);
+	tcase_add_test(tc_mock, test_can_resume_broken_page);
+	tcase_add_test(tc_mock, test_can_balance_endpoints);
+	tcase_add_test(tc_mock, test_can_queue_for_admission);
+	tcase_add_test(tc_mock, test_can_schedule_interactive_pages_first);
+	tcase_add_test(tc_mock, test_can_extract_partitioned);
+	tcase_add_test(tc_mock, test_can_parse_pages_on_pool);
+	tcase_add_test(tc_mock, test_can_deliver_pages);
+	tcase_add_test(tc_mock, test_can_export_arrow_stream);
+	tcase_add_test(tc_mock, test_can_decode_arrow_pages);
+	tcase_add_test(tc_mock, test_can_fetch_spooled_segments);
+	tcase_add_test(tc_mock, test_can_compress_responses);
+	tcase_add_test(tc_mock, test_can_multiplex_statements);
+	tcase_add_test(tc_mock, test_can_size_pages_adaptively);
+	tcase_add_test(tc_mock, test_can_share_repeating_values);
+	tcase_add_test(tc_mock, test_can_keep_cold_pages_compressed);
+    suite_add_tcase(s, tc_mock);
+
+    /* Http2 test case, against mockpresto.py behind an http/2 proxy, run it with CK_RUN_CASE=Http2 */
+    tc_http2 = tcase_create("Http2");
+
+	tcase_add_checked_fixture(tc_http2, setup, teardown);
+	tcase_add_test(tc_http2, test_can_multiplex_over_http2);
+    suite_add_tcase(s, tc_http2);
+
     return s;
 }
 
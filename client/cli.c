@@ -36,85 +36,70 @@ PRESTOCLIENT *pc = NULL;
 typedef struct ST_QUERYDATA
 {
 	bool hdr_printed;
-	char *cache;
-	size_t cache_size;
+	size_t rows;
 } QUERYDATA;
 
 void querydata_delete(QUERYDATA* qdata) {
-	if (qdata && qdata->cache)
-		free(qdata->cache);
-
 	if (qdata)
 		free(qdata);
 }
 
 QUERYDATA* querydata_new() {
 	QUERYDATA* qdata = (QUERYDATA *)malloc(sizeof(QUERYDATA));
+	if (!qdata)
+		exit(1);
 	qdata->hdr_printed = false;
-	qdata->cache_size = 1;
-	qdata->cache = (char *)malloc(qdata->cache_size);
-	qdata->cache[0] = 0;
+	qdata->rows = 0;
 	return qdata;
 } 
 
 /*
- * The write callback function. This function will be called for every row of
- * query data.
+ * The page callback function. This function will be called for every page of
+ * query data, the values of a page are stored column by column.
  */
-static void write_callback_function(void *in_querydata, void *in_result)
+static void page_callback_function(PRESTOCLIENT_RESULT *result, const PRESTOCLIENT_PAGE *page, void *in_querydata)
 {
 	QUERYDATA *qdata = (QUERYDATA *)in_querydata;
-	PRESTOCLIENT_RESULT *result = (PRESTOCLIENT_RESULT *)in_result;
-	size_t newdatalen; 
 	size_t columncount = prestoclient_getcolumncount(result);
+	size_t rowcount = prestoclient_getpagerowcount(page);
 
 	/*
-	 * Output one data row
+	 * Output the column names once
 	 */
-	for (size_t idx = 0; idx < columncount; idx++)
+	if (!qdata->hdr_printed)
 	{
-		/*
-		 * Check cache size first
-		 */
-		newdatalen = strlen(prestoclient_getcolumndata(result, idx));
+		for (size_t idx = 0; idx < columncount; idx++)
+			printf("%s%s", prestoclient_getcolumnname(result, idx), idx < columncount - 1 ? ";" : "\n");
+		qdata->hdr_printed = true;
+	}
 
-		if (qdata->cache_size < strlen(qdata->cache) + newdatalen + 3)
+	/*
+	 * Output the data rows of the page. Numbers come converted with
+	 * prestoclient_getcolumn_int64 and prestoclient_getcolumn_double,
+	 * the text of every value with prestoclient_getcolumn_string_view
+	 */
+	for (size_t row = 0; row < rowcount; row++)
+	{
+		for (size_t idx = 0; idx < columncount; idx++)
 		{
+			const int64_t *ints = prestoclient_getcolumn_int64(page, idx);
+			const PRESTOCLIENT_STRING_VIEW *text = prestoclient_getcolumn_string_view(page, idx);
+
+			if (prestoclient_getcolumn_isnull(page, idx, row))
+				printf("NULL");
+			else if (ints && prestoclient_getcolumntype(result, idx) != PRESTOCLIENT_TYPE_BOOLEAN)
+				printf("%lld", (long long)ints[row]);
+			else
+				printf("%.*s", (int)text[row].length, text[row].data);
+
 			/*
-			 * Add memory block of 1 Kb to cache
+			 * Add a field separator or a row separator
 			 */
-			qdata->cache_size = ((qdata->cache_size + newdatalen + 1027) / 1024) * 1024;
-			qdata->cache = (char *)realloc((char *)qdata->cache, qdata->cache_size);
-			if (!qdata->cache)
-				exit(1);
+			printf("%s", idx < columncount - 1 ? ";" : "\n");
 		}
-
-		/*
-		 * Add field value as string, prestoclient doesn't do any type conversions (yet)
-		 */
-		strcat(qdata->cache, prestoclient_getcolumndata(result, idx));
-
-		/*
-		 * You can use prestoclient_getnullcolumnvalue here
-		 * to test if value is NULL in the database
-		 */
-
-		/*
-		 * Add a field separator
-		 */
-		if (idx < columncount - 1)
-			strcat(qdata->cache, ";");
 	}
 
-	/*
-	 * Print rowdata and a row separator
-	 */
-	printf("%s\n", qdata->cache);
-
-	/*
-	 * Clear cache
-	 */
-	qdata->cache[0] = 0;
+	qdata->rows += rowcount;
 }
 
 /*
@@ -148,7 +133,12 @@ int main(int argc, char** argv)
 		goto exit;		
 	}
 	
-	prc = prestoclient_query(pc, &result, argv[2], &write_callback_function, (void *)qdata);
+	/*
+	 * Receive the rows page by page instead of row by row
+	 */
+	prestoclient_on_page(pc, &page_callback_function);
+
+	prc = prestoclient_query(pc, &result, argv[2], NULL, (void *)qdata);
 	if (prc != PRESTO_OK)
 	{
 		printf("Could not start query '%s' on server '%s'\n", argv[2], argv[1]);
@@ -161,6 +151,9 @@ int main(int argc, char** argv)
 		if (prestoclient_getstatus(result) != PRESTOCLIENT_STATUS_SUCCEEDED) {
 			printf("Query failed\n");
 		}
+		else {
+			printf("%zu rows\n", qdata->rows);
+		}
 
 		// Messages from presto server
 		if (prestoclient_getlastservererror(result))
@@ -0,0 +1,438 @@
+#!/usr/bin/env python3
+#
+# This file is part of cPrestoClient
+#
+# cPrestoClient is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""Stand-in for a Presto coordinator, the server of the "Mock" test case of prestotests.
+
+    python3 mockpresto.py [port]             serve on 127.0.0.1:port, 8080 by default
+    python3 mockpresto.py --run command ...  serve on 8080 while command runs, exit with its code
+
+The "Http2" test case wants the mock over TLS and HTTP/2 on port 18444. With nghttpx and openssl on the path,
+--run makes a throwaway key and certificate for localhost, starts nghttpx with them in front of the mock and passes
+the certificate to the command in MOCKPRESTO_CA; without them the test reports itself skipped. By hand:
+
+    nghttpx -f127.0.0.1,18444 -b127.0.0.1,8080 --no-ocsp key.pem cert.pem
+    MOCKPRESTO_CA=cert.pem CK_RUN_CASE=Http2 ./prestotests
+
+Every query answers with the columns id bigint, name varchar and score double. Row i is
+[i, "n<i%3>", i*0.5], every 7th row has NULL name and score. Directives in a comment of the
+query shape the answer:
+
+    rows=N    rows of the result, 25 by default
+    per=N     rows per page, 10 by default, X-Presto-Max-Size of the request overrides it
+    delay=N   milliseconds before every page is sent
+    cut=N     page N is cut off after 60 percent of its bytes once per query
+    short=N   the Arrow batch of page N declares a values buffer too short for its rows
+    busy=1    every other POST is answered with 503
+    narrow=1  id is an integer and score a real column in JSON pages
+
+A client asking for X-Presto-Query-Data-Encoding: json gets the rows of a page as spooled
+segments: the first one inline, base64 in the page, the others to download from the mock with
+the X-Segment-Token header the page names, each with an ackUri. Directives for spooled pages:
+
+    seg=N       segments per page, 3 by default
+    segdelay=N  segment k of n is sent after (n - k) * N milliseconds, so the last arrives first
+    segerr=1    every spooled segment fails once with 503
+
+A query containing "fail" ends with a USER_ERROR. "use catalog.schema" answers with the
+X-Presto-Set-Catalog and X-Presto-Set-Schema headers. Pages are JSON, or an Arrow IPC stream
+when the Accept header asks for application/vnd.apache.arrow.stream; errors are always JSON.
+JSON pages are gzip compressed when the client accepts it.
+"""
+
+import base64
+import gzip
+import json
+import os
+import re
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+ARROW = "application/vnd.apache.arrow.stream"
+H2PORT = 18444
+
+lock = threading.Lock()
+queries = {}
+counter = [0]
+
+
+def directive(sql, name, default):
+    m = re.search(r"/\*.*\b%s=(\d+)" % name, sql)
+    return int(m.group(1)) if m else default
+
+
+def make_rows(start, end):
+    return [[i, "n%d" % (i % 3), i * 0.5] if i % 7 else [i, None, None] for i in range(start, end)]
+
+
+class FlatBuffer:
+    """Forward flatbuffer writer: vtables before their tables, children after their parents."""
+
+    def __init__(self):
+        self.b = bytearray(4)
+
+    def align(self, n):
+        while len(self.b) % n:
+            self.b.append(0)
+
+    def patch(self, at, target):
+        struct.pack_into("<I", self.b, at, target - at)
+
+    def table(self, fields):
+        # fields: indexed by field id, None or (struct code, value) or ("o", writer of a child)
+        self.align(4)
+        layout, size = [], 4
+        for f in fields:
+            if f is None:
+                layout.append(0)
+                continue
+            layout.append(size)
+            size += 4 if f[0] == "o" else struct.calcsize("<" + f[0])
+        vtable = len(self.b)
+        self.b += struct.pack("<HH", 4 + 2 * len(fields), size)
+        for o in layout:
+            self.b += struct.pack("<H", o)
+        self.align(4)
+        table = len(self.b)
+        self.b += struct.pack("<i", table - vtable)
+        children = []
+        for f, o in zip(fields, layout):
+            if f is None:
+                continue
+            if f[0] == "o":
+                children.append((table + o, f[1]))
+                self.b += bytes(4)
+            else:
+                self.b += struct.pack("<" + f[0], f[1])
+        for at, child in children:
+            self.patch(at, child())
+        return table
+
+    def string(self, text):
+        self.align(4)
+        at = len(self.b)
+        raw = text.encode()
+        self.b += struct.pack("<I", len(raw)) + raw + b"\0"
+        return at
+
+    def vector(self, children):
+        self.align(4)
+        at = len(self.b)
+        self.b += struct.pack("<I", len(children)) + bytes(4 * len(children))
+        for i, child in enumerate(children):
+            self.patch(at + 4 + 4 * i, child())
+        return at
+
+    def structs(self, raw, count):
+        self.align(8)
+        if (len(self.b) + 4) % 8:
+            self.b += bytes(4)
+        at = len(self.b)
+        self.b += struct.pack("<I", count) + raw
+        return at
+
+    def finish(self, root):
+        self.patch(0, root())
+        self.align(8)
+        return bytes(self.b)
+
+
+def arrow_message(header_type, header, bodylength):
+    fb = FlatBuffer()
+    meta = fb.finish(lambda: fb.table([("h", 4), ("B", header_type), ("o", lambda: header(fb)), ("q", bodylength)]))
+    return struct.pack("<Ii", 0xFFFFFFFF, len(meta)) + meta
+
+
+def arrow_page(out, data, short=False):
+    """Schema with the state of the query as metadata, one record batch of the rows, end of stream."""
+    metadata = [(k, out[k]) for k in ("nextUri", "infoUri", "partialCancelUri") if k in out]
+    metadata.append(("state", out["stats"]["state"]))
+
+    def field(name, type_type, type_fields):
+        return lambda fb: fb.table([("o", lambda: fb.string(name)), ("B", 1), ("B", type_type),
+                                    ("o", lambda: fb.table(type_fields)), None, ("o", lambda: fb.vector([]))])
+
+    # Int(64, signed), Utf8, FloatingPoint(DOUBLE)
+    fields = [field("id", 2, [("i", 64), ("B", 1)]), field("name", 5, []), field("score", 3, [("h", 2)])]
+
+    def schema(fb):
+        return fb.table([("h", 0), ("o", lambda: fb.vector([lambda f=f: f(fb) for f in fields])),
+                         ("o", lambda: fb.vector([lambda k=k, v=v: fb.table([("o", lambda: fb.string(k)),
+                                                                             ("o", lambda: fb.string(v))])
+                                                  for k, v in metadata]))])
+
+    stream = arrow_message(1, schema, 0)
+    if data:
+        n = len(data)
+        body, buffers, nodes = bytearray(), [], []
+
+        def add(raw):
+            buffers.append((len(body), len(raw)))
+            body.extend(raw)
+            while len(body) % 8:
+                body.append(0)
+
+        for c in range(3):
+            values = [r[c] for r in data]
+            nulls = sum(v is None for v in values)
+            nodes.append((n, nulls))
+            if nulls:
+                bits = bytearray((n + 7) // 8)
+                for i, v in enumerate(values):
+                    if v is not None:
+                        bits[i // 8] |= 1 << (i % 8)
+                add(bytes(bits))
+            else:
+                buffers.append((0, 0))
+            if c == 0:
+                add(struct.pack("<%dq" % n, *values))
+                if short:
+                    buffers[-1] = (buffers[-1][0], 8 * (n - 1))
+            elif c == 2:
+                add(struct.pack("<%dd" % n, *[v or 0.0 for v in values]))
+            else:
+                text, offsets = b"", [0]
+                for v in values:
+                    text += (v or "").encode()
+                    offsets.append(len(text))
+                add(struct.pack("<%di" % (n + 1), *offsets))
+                add(text)
+
+        def batch(fb):
+            return fb.table([("q", n),
+                             ("o", lambda: fb.structs(b"".join(struct.pack("<qq", *x) for x in nodes), len(nodes))),
+                             ("o", lambda: fb.structs(b"".join(struct.pack("<qq", *x) for x in buffers), len(buffers)))])
+
+        stream += arrow_message(3, batch, len(body)) + bytes(body)
+    return stream + struct.pack("<Ii", 0xFFFFFFFF, 0)
+
+
+class Coordinator(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, *args):
+        pass
+
+    def base(self):
+        return "%s://%s" % (self.headers.get("X-Forwarded-Proto") or "http", self.headers.get("Host"))
+
+    def send_body(self, body, contenttype, code=200, headers=None):
+        self.send_response(code)
+        self.send_header("Content-Type", contenttype)
+        for k, v in (headers or {}).items():
+            self.send_header(k, v)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def send_json(self, obj, code=200, headers=None):
+        body = json.dumps(obj).encode()
+        headers = dict(headers or {})
+        if "gzip" in (self.headers.get("Accept-Encoding") or ""):
+            body = gzip.compress(body)
+            headers["Content-Encoding"] = "gzip"
+        self.send_body(body, "application/json", code, headers)
+
+    def do_POST(self):
+        sql = self.rfile.read(int(self.headers.get("Content-Length", 0))).decode()
+        with lock:
+            counter[0] += 1
+            qid = "q%d" % counter[0]
+            queries[qid] = {"sql": sql, "offsets": {}, "segments": {}, "failed": set(),
+                            "spool": self.headers.get("X-Presto-Query-Data-Encoding") == "json"}
+            posts = counter[0]
+        if directive(sql, "busy", 0) and posts % 2 == 1:
+            self.send_json({}, 503)
+            return
+        self.send_json({"id": qid, "infoUri": self.base() + "/ui/" + qid,
+                        "nextUri": self.base() + "/v1/statement/%s/0" % qid,
+                        "stats": {"state": "QUEUED"}})
+
+    def do_DELETE(self):
+        self.send_body(b"", "text/plain", 204)
+
+    def do_GET(self):
+        if self.path.startswith("/v1/info"):
+            self.send_json({"nodeVersion": {"version": "mock"}, "coordinator": True})
+            return
+        if re.match(r"/v1/spooled/ack/", self.path):
+            self.send_json({})
+            return
+        m = re.match(r"/v1/spooled/(q\d+)/(\d+)/(\d+)", self.path)
+        if m:
+            self.send_segment(m.group(1), int(m.group(2)), int(m.group(3)))
+            return
+        m = re.match(r"/v1/statement/(q\d+)/(\d+)", self.path)
+        if not m or m.group(1) not in queries:
+            self.send_json({}, 404)
+            return
+        qid, page = m.group(1), int(m.group(2))
+        q = queries[qid]
+        sql = q["sql"]
+        rows, per = directive(sql, "rows", 25), directive(sql, "per", 10)
+        time.sleep(directive(sql, "delay", 0) / 1000.0)
+
+        if "fail" in sql:
+            self.send_json({"id": qid, "stats": {"state": "FAILED"},
+                            "error": {"message": "boom", "errorType": "USER_ERROR"}})
+            return
+
+        # a page of about 20 bytes per row fills the size the client asks for
+        maxsize = re.match(r"(\d+)\s*(B|kB|MB|GB)", self.headers.get("X-Presto-Max-Size") or "")
+        if maxsize:
+            size = int(maxsize.group(1)) * {"B": 1, "kB": 1 << 10, "MB": 1 << 20, "GB": 1 << 30}[maxsize.group(2)]
+            per = max(1, size // 20)
+        start = q["offsets"].get(page, page * per)
+        q["offsets"][page + 1] = start + per
+        data = make_rows(start, min(rows, start + per))
+
+        idtype, scoretype = ("integer", "real") if directive(sql, "narrow", 0) else ("bigint", "double")
+        out = {"id": qid, "infoUri": self.base() + "/ui/" + qid,
+               "partialCancelUri": self.base() + "/v1/stage/%s" % qid,
+               "columns": [{"name": "id", "type": idtype,
+                            "typeSignature": {"rawType": idtype, "arguments": []}},
+                           {"name": "name", "type": "varchar",
+                            "typeSignature": {"rawType": "varchar",
+                                              "arguments": [{"kind": "LONG", "value": 2147483647}]}},
+                           {"name": "score", "type": scoretype,
+                            "typeSignature": {"rawType": scoretype, "arguments": []}}]}
+        if data and q["spool"]:
+            out["data"] = {"encoding": "json", "segments": self.spool(qid, page, start, data)}
+        elif data:
+            out["data"] = data
+        if start + per < rows:
+            out["nextUri"] = self.base() + "/v1/statement/%s/%d" % (qid, page + 1)
+            out["stats"] = {"state": "RUNNING"}
+        else:
+            out["stats"] = {"state": "FINISHED"}
+
+        arrow = ARROW in (self.headers.get("Accept") or "")
+        if directive(sql, "cut", -1) == page and not q.get("cut"):
+            # part of the page, then the connection is dropped
+            q["cut"] = True
+            body = arrow_page(out, data) if arrow else json.dumps(out).encode()
+            self.send_response(200)
+            self.send_header("Content-Type", ARROW if arrow else "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body[:int(len(body) * 0.6)])
+            self.wfile.flush()
+            self.close_connection = True
+            return
+
+        headers = {}
+        use = re.match(r"\s*use\s+(\w+)\.(\w+)", sql, re.I)
+        if use:
+            headers = {"X-Presto-Set-Catalog": use.group(1), "X-Presto-Set-Schema": use.group(2)}
+        if arrow:
+            self.send_body(arrow_page(out, data, directive(sql, "short", -1) == page), ARROW, headers=headers)
+        else:
+            self.send_json(out, headers=headers)
+
+
+    def spool(self, qid, page, start, data):
+        """Segments of the rows of a page, the first inline, the others kept for their download."""
+        q = queries[qid]
+        count = directive(q["sql"], "seg", 3)
+        size = (len(data) + count - 1) // count
+        segments = []
+        for k, first in enumerate(range(0, len(data), size)):
+            part = data[first:first + size]
+            metadata = {"rowOffset": start + first, "rowsCount": len(part), "segmentSize": len(json.dumps(part))}
+            if k == 0:
+                segments.append({"type": "inline", "data": base64.b64encode(json.dumps(part).encode()).decode(),
+                                 "metadata": metadata})
+                continue
+            q["segments"][(page, k)] = part
+            path = "%s/%d/%d" % (qid, page, k)
+            segments.append({"type": "spooled", "uri": self.base() + "/v1/spooled/" + path,
+                             "ackUri": self.base() + "/v1/spooled/ack/" + path,
+                             "headers": {"X-Segment-Token": ["tok-" + qid]}, "metadata": metadata})
+        return segments
+
+    def send_segment(self, qid, page, k):
+        q = queries.get(qid)
+        if not q or (page, k) not in q["segments"]:
+            self.send_json({}, 404)
+            return
+        if self.headers.get("X-Segment-Token") != "tok-" + qid:
+            self.send_json({}, 403)
+            return
+        time.sleep((directive(q["sql"], "seg", 3) - k) * directive(q["sql"], "segdelay", 0) / 1000.0)
+        with lock:
+            fail = directive(q["sql"], "segerr", 0) and (page, k) not in q["failed"]
+            q["failed"].add((page, k))
+        if fail:
+            self.send_json({}, 503)
+            return
+        self.send_body(json.dumps(q["segments"][(page, k)]).encode(), "application/octet-stream")
+
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+
+    def handle_error(self, request, client_address):
+        # cancelled and closed queries drop their connections in the middle of a page
+        if not isinstance(sys.exc_info()[1], ConnectionError):
+            super().handle_error(request, client_address)
+
+
+def serve(port):
+    return Server(("127.0.0.1", port), Coordinator)
+
+
+def start_h2proxy(workdir):
+    """nghttpx on H2PORT in front of the mock with a certificate made in workdir, (proxy, certificate) or None."""
+    if not shutil.which("nghttpx") or not shutil.which("openssl"):
+        return None
+    key, cert = os.path.join(workdir, "key.pem"), os.path.join(workdir, "cert.pem")
+    if subprocess.call(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "1",
+                        "-subj", "/CN=localhost", "-addext", "subjectAltName=DNS:localhost,IP:127.0.0.1",
+                        "-keyout", key, "-out", cert], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL):
+        return None
+    proxy = subprocess.Popen(["nghttpx", "-f127.0.0.1,%d" % H2PORT, "-b127.0.0.1,8080", "--no-ocsp", "--workers=1",
+                              "-L", "ERROR", key, cert])
+    for _ in range(50):
+        try:
+            socket.create_connection(("127.0.0.1", H2PORT), timeout=1).close()
+            break
+        except OSError:
+            time.sleep(0.1)
+    return proxy, cert
+
+
+if __name__ == "__main__":
+    if len(sys.argv) > 2 and sys.argv[1] == "--run":
+        server = serve(8080)
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+        with tempfile.TemporaryDirectory() as workdir:
+            started = start_h2proxy(workdir)
+            env = dict(os.environ, MOCKPRESTO_CA=started[1]) if started else None
+            try:
+                rc = subprocess.call(sys.argv[2:], env=env)
+            finally:
+                if started:
+                    started[0].terminate()
+                    started[0].wait()
+        sys.exit(rc)
+    serve(int(sys.argv[1]) if len(sys.argv) > 1 else 8080).serve_forever()
@@ -0,0 +1,257 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "admission.h"
+#include <assert.h>
+
+typedef struct ST_ADMISSION_WAITER
+{
+	int							  priority;						//!< Priority of the query
+	struct ST_ADMISSION_WAITER	 *next;							//!< Next waiter, the first one is admitted next
+} ADMISSION_WAITER;
+
+struct ST_ADMISSION_GATE
+{
+	ADMISSION					 *owner;						//!< Admission control the gate belongs to
+	char						 *coordinator;					//!< Base url of the coordinator
+	size_t						  running;						//!< Queries running on the coordinator
+	ADMISSION_WAITER			 *waiters;						//!< Queries waiting for the coordinator
+	struct ST_ADMISSION_GATE	 *next;							//!< Next gate
+};
+
+struct ST_ADMISSION
+{
+	UTIL_MUTEX					  lock;							//!< Protects everything below
+	UTIL_COND					  changed;						//!< Signals a query that ended or a new limit
+	size_t						  maxrunning;					//!< Queries per coordinator, 0 for no limit
+	enum E_ADMISSIONORDER		  order;						//!< Order of the waiting queries
+	ADMISSION_STATS				  stats;						//!< Counts and queue times, running and waiting are summed up on request
+	ADMISSION_GATE				 *gates;						//!< One gate per coordinator
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+// Gate of the coordinator, created on first use, caller holds the lock
+static ADMISSION_GATE *find_gate(ADMISSION *admission, const char *coordinator)
+{
+	ADMISSION_GATE *gate;
+
+	for (gate = admission->gates; gate; gate = gate->next)
+		if (strcmp(gate->coordinator, coordinator) == 0)
+			return gate;
+
+	gate = (ADMISSION_GATE *)malloc(sizeof(ADMISSION_GATE));
+	if (!gate)
+		exit(1);
+
+	gate->owner = admission;
+	gate->coordinator = NULL;
+	alloc_copy(&gate->coordinator, coordinator);
+	gate->running = 0;
+	gate->waiters = NULL;
+	gate->next = admission->gates;
+	admission->gates = gate;
+
+	return gate;
+}
+
+// Queue a waiter behind all waiters of the same or a higher priority, caller holds the lock
+static void enqueue(ADMISSION *admission, ADMISSION_GATE *gate, ADMISSION_WAITER *waiter)
+{
+	ADMISSION_WAITER **pos = &gate->waiters;
+
+	if (admission->order == ADMISSION_PRIORITY)
+		while (*pos && (*pos)->priority >= waiter->priority)
+			pos = &(*pos)->next;
+	else
+		while (*pos)
+			pos = &(*pos)->next;
+
+	waiter->next = *pos;
+	*pos = waiter;
+}
+
+static void dequeue(ADMISSION_GATE *gate, ADMISSION_WAITER *waiter)
+{
+	ADMISSION_WAITER **pos;
+
+	for (pos = &gate->waiters; *pos; pos = &(*pos)->next)
+	{
+		if (*pos == waiter)
+		{
+			*pos = waiter->next;
+			return;
+		}
+	}
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+ADMISSION *admission_new(size_t maxrunning, enum E_ADMISSIONORDER order)
+{
+	ADMISSION *admission = (ADMISSION *)malloc(sizeof(ADMISSION));
+
+	if (!admission)
+		exit(1);
+
+	util_mutex_init(&admission->lock);
+	util_cond_init(&admission->changed);
+	admission->maxrunning = maxrunning;
+	admission->order = order;
+	memset(&admission->stats, 0, sizeof(admission->stats));
+	admission->gates = NULL;
+
+	return admission;
+}
+
+void admission_delete(ADMISSION *admission)
+{
+	if (!admission)
+		return;
+
+	while (admission->gates)
+	{
+		ADMISSION_GATE *next = admission->gates->next;
+
+		free(admission->gates->coordinator);
+		free(admission->gates);
+		admission->gates = next;
+	}
+
+	util_cond_destroy(&admission->changed);
+	util_mutex_destroy(&admission->lock);
+	free(admission);
+}
+
+void admission_configure(ADMISSION *admission, size_t maxrunning, enum E_ADMISSIONORDER order)
+{
+	assert(admission);
+
+	util_mutex_lock(&admission->lock);
+	admission->maxrunning = maxrunning;
+	admission->order = order;
+	util_cond_broadcast(&admission->changed);
+	util_mutex_unlock(&admission->lock);
+}
+
+void admission_attach(ADMISSION *admission, PRESTOCLIENT *client)
+{
+	if (!client)
+		return;
+
+	client->admission = admission;
+}
+
+int admission_enter(ADMISSION *admission, const char *coordinator, int priority, long long deadline,
+					volatile bool *cancel, ADMISSION_GATE **gate)
+{
+	ADMISSION_WAITER waiter;
+	ADMISSION_GATE *found;
+	long long started, waited;
+	int rc = PRESTO_OK;
+
+	assert(gate);
+	*gate = NULL;
+
+	if (!admission || !coordinator)
+		return PRESTO_OK;
+
+	util_mutex_lock(&admission->lock);
+
+	found = find_gate(admission, coordinator);
+
+	// Free slot and nobody in front: no wait at all
+	if (admission->maxrunning == 0 || (found->running < admission->maxrunning && !found->waiters))
+	{
+		found->running++;
+		admission->stats.admitted++;
+		util_mutex_unlock(&admission->lock);
+		*gate = found;
+		return PRESTO_OK;
+	}
+
+	waiter.priority = priority;
+	enqueue(admission, found, &waiter);
+	started = util_now_msec();
+
+	while (admission->maxrunning > 0 && (found->waiters != &waiter || found->running >= admission->maxrunning))
+	{
+		if (cancel && *cancel)
+			rc = PRESTO_CANCELLED;
+		else if (deadline > 0 && util_now_msec() >= deadline)
+			rc = PRESTO_TIMEOUT;
+		if (rc != PRESTO_OK)
+			break;
+
+		util_cond_timedwait(&admission->changed, &admission->lock, ADMISSION_CHECKMSEC);
+	}
+
+	dequeue(found, &waiter);
+	waited = util_now_msec() - started;
+
+	if (rc == PRESTO_OK)
+	{
+		found->running++;
+		admission->stats.admitted++;
+		admission->stats.queued++;
+		admission->stats.queuetime += waited;
+		if (waited > admission->stats.maxqueuetime)
+			admission->stats.maxqueuetime = waited;
+		*gate = found;
+	}
+	else
+		admission->stats.abandoned++;
+
+	// The next waiter may fit as well, or is now first in line
+	util_cond_broadcast(&admission->changed);
+	util_mutex_unlock(&admission->lock);
+
+	return rc;
+}
+
+void admission_leave(ADMISSION_GATE *gate)
+{
+	if (!gate)
+		return;
+
+	util_mutex_lock(&gate->owner->lock);
+	if (gate->running > 0)
+		gate->running--;
+	util_cond_broadcast(&gate->owner->changed);
+	util_mutex_unlock(&gate->owner->lock);
+}
+
+void admission_stats(ADMISSION *admission, ADMISSION_STATS *stats)
+{
+	ADMISSION_GATE *gate;
+
+	assert(admission && stats);
+
+	util_mutex_lock(&admission->lock);
+
+	*stats = admission->stats;
+	stats->running = 0;
+	stats->waiting = 0;
+	for (gate = admission->gates; gate; gate = gate->next)
+	{
+		stats->running += gate->running;
+		for (ADMISSION_WAITER *waiter = gate->waiters; waiter; waiter = waiter->next)
+			stats->waiting++;
+	}
+
+	util_mutex_unlock(&admission->lock);
+}
@@ -0,0 +1,120 @@
+/**
+ * \file admission.h
+ *
+ * \brief admission control of new queries per coordinator
+ *
+ * Hundreds of threads posting their queries at the same moment make a coordinator answer
+ * 503 and send every client into its retry loop. An ADMISSION object shared by the clients
+ * of a process lets at most a configured number of queries run on each coordinator, a query
+ * over the limit waits in the client before it is posted. A query runs from its first
+ * request until its last page arrived or it was cancelled.
+ *
+ * Waiting queries are admitted in arrival order, or by priority and within one priority in
+ * arrival order. A waiting query gives up when it is cancelled or its deadline passes.
+ *
+ * All functions are thread safe.
+ */
+
+#ifndef EASYPTORA_ADMISSION_HH
+#define EASYPTORA_ADMISSION_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define ADMISSION_CHECKMSEC               100             //!< Millisec between two checks of a waiting query for cancel and deadline
+
+/* --- Enums ---------------------------------------------------------------------------------------------------------- */
+enum E_ADMISSIONORDER
+{
+	ADMISSION_FIFO = 0,				  //!< Waiting queries are admitted in arrival order
+	ADMISSION_PRIORITY				  //!< Higher priority first, arrival order within a priority
+};
+
+/* --- Structs -------------------------------------------------------------------------------------------------------- */
+typedef struct ST_ADMISSION_STATS
+{
+	size_t						  admitted;						//!< Queries admitted so far
+	size_t						  queued;						//!< Admitted queries that had to wait
+	size_t						  abandoned;					//!< Waiting queries that were cancelled or timed out
+	size_t						  running;						//!< Queries running now on all coordinators
+	size_t						  waiting;						//!< Queries waiting now
+	long long					  queuetime;					//!< Millisec all admitted queries waited together
+	long long					  maxqueuetime;					//!< Longest wait of an admitted query in millisec
+} ADMISSION_STATS;
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create an admission control
+ *
+ * \param maxrunning  Queries that may run at the same time on one coordinator, 0 for no limit
+ * \param order       ADMISSION_FIFO or ADMISSION_PRIORITY
+ *
+ * \return A handle to the admission control
+ */
+extern ADMISSION *admission_new(size_t maxrunning, enum E_ADMISSIONORDER order);
+
+/**
+ * \brief Free the admission control. All attached clients must be closed first.
+ *
+ * \param admission  A handle to the admission control
+ */
+extern void admission_delete(ADMISSION *admission);
+
+/**
+ * \brief Change the limit and the order, waiting queries are admitted at once when the limit grows
+ *
+ * \param admission   A handle to the admission control
+ * \param maxrunning  Queries that may run at the same time on one coordinator, 0 for no limit
+ * \param order       ADMISSION_FIFO or ADMISSION_PRIORITY
+ */
+extern void admission_configure(ADMISSION *admission, size_t maxrunning, enum E_ADMISSIONORDER order);
+
+/**
+ * \brief Let all future queries of a client pass the admission control
+ *
+ * \param admission  A handle to the admission control, NULL lets the queries of the client start at once
+ * \param client     The client
+ */
+extern void admission_attach(ADMISSION *admission, PRESTOCLIENT *client);
+
+/**
+ * \brief Wait until a new query may run on a coordinator
+ *
+ * \param admission    A handle to the admission control
+ * \param coordinator  Base url of the coordinator
+ * \param priority     Priority of the query, only used with ADMISSION_PRIORITY
+ * \param deadline     util_now_msec() when the query times out, 0 for no limit
+ * \param cancel       Set by another thread to cancel the query, may be NULL
+ * \param gate         Out: pass to admission_leave when the query ended
+ *
+ * \return PRESTO_OK when admitted, PRESTO_CANCELLED or PRESTO_TIMEOUT when the query gave up waiting
+ */
+extern int admission_enter(ADMISSION *admission, const char *coordinator, int priority, long long deadline,
+						   volatile bool *cancel, ADMISSION_GATE **gate);
+
+/**
+ * \brief The query admitted by admission_enter has ended, the next waiting query may run
+ *
+ * \param gate  Returned by admission_enter, may be NULL
+ */
+extern void admission_leave(ADMISSION_GATE *gate);
+
+/**
+ * \brief Queue time and counts of the queries so far
+ *
+ * \param admission  A handle to the admission control
+ * \param stats      Out: the numbers
+ */
+extern void admission_stats(ADMISSION *admission, ADMISSION_STATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_ADMISSION_HH
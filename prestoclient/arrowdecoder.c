@@ -0,0 +1,538 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Decoder of Arrow IPC streams, see decoder.h. The flatbuffers of the messages are read in place,
+// see https://arrow.apache.org/docs/format/Columnar.html#serialization-and-interprocess-communication-ipc
+
+#include "decoder.h"
+#include <stdint.h>
+
+#define ARROWDECODER_FIRSTALLOC           65536           // Bytes allocated for the first chunk of a response
+#define ARROWDECODER_CONTINUATION         0xFFFFFFFFu     // Marker in front of the length of an encapsulated message
+
+// Message headers and types of the Arrow schema (Message.fbs, Schema.fbs)
+enum E_ARROWHEADER
+{
+	ARROWHEADER_SCHEMA = 1,
+	ARROWHEADER_DICTIONARYBATCH = 2,
+	ARROWHEADER_RECORDBATCH = 3
+};
+
+enum E_ARROWTYPE
+{
+	ARROWTYPE_INT = 2,
+	ARROWTYPE_FLOATINGPOINT = 3,
+	ARROWTYPE_UTF8 = 5,
+	ARROWTYPE_BOOL = 6,
+	ARROWTYPE_DATE = 8,
+	ARROWTYPE_LARGEUTF8 = 20
+};
+
+typedef struct ST_ARROWFIELD
+{
+	enum E_ARROWTYPE			  type;							//!< Arrow type of the column
+	int							  width;						//!< Bytes per value of int, floating point and date columns
+} ARROWFIELD;
+
+typedef struct ST_ARROWDECODER
+{
+	PRESTOCLIENT_RESULT			 *result;						//!< Result the rows go to
+	unsigned char				 *body;							//!< The response, decoded once complete
+	size_t						  size;							//!< Bytes in body
+	size_t						  alloc;						//!< Bytes allocated for body
+	ARROWFIELD					 *fields;						//!< Columns of the schema of the response
+	size_t						  fieldcount;					//!< Number of fields
+	bool						  bad;							//!< A read went past the end of the body
+} ARROWDECODER;
+
+/* --- Flatbuffers ---------------------------------------------------------------------------------------------------- */
+
+// Little endian reads with bounds checks, a read out of bounds returns 0 and marks the response bad
+static uint64_t rd(ARROWDECODER *d, size_t pos, size_t bytes)
+{
+	uint64_t value = 0;
+
+	if (pos + bytes > d->size || pos + bytes < pos)
+	{
+		d->bad = true;
+		return 0;
+	}
+
+	for (size_t i = bytes; i > 0; i--)
+		value = (value << 8) | d->body[pos + i - 1];
+
+	return value;
+}
+
+// Position of a field of a table, 0 when the field is not present
+static size_t fb_field(ARROWDECODER *d, size_t table, int index)
+{
+	size_t vtable, voffset;
+
+	if (!table)
+		return 0;
+
+	vtable = table - (size_t)(int64_t)(int32_t)rd(d, table, 4);
+	if (2 * (size_t)index + 6 > rd(d, vtable, 2))
+		return 0;
+
+	voffset = (size_t)rd(d, vtable + 4 + 2 * (size_t)index, 2);
+	return voffset ? table + voffset : 0;
+}
+
+// Target of an offset field
+static size_t fb_deref(ARROWDECODER *d, size_t pos)
+{
+	size_t offset;
+
+	if (!pos)
+		return 0;
+
+	offset = (size_t)rd(d, pos, 4);
+	return offset ? pos + offset : 0;
+}
+
+static uint64_t fb_scalar(ARROWDECODER *d, size_t table, int index, size_t bytes, uint64_t defaultvalue)
+{
+	size_t pos = fb_field(d, table, index);
+
+	return pos ? rd(d, pos, bytes) : defaultvalue;
+}
+
+// Length of a vector or string, its elements follow
+static size_t fb_length(ARROWDECODER *d, size_t vector)
+{
+	return vector ? (size_t)rd(d, vector, 4) : 0;
+}
+
+/* --- Decoding ------------------------------------------------------------------------------------------------------- */
+
+static void set_value(PRESTOCLIENT_COLUMN *column, const char *data, size_t size, bool isnull)
+{
+	if (size + 1 > column->databuffersize)
+	{
+		column->data = (char *)realloc(column->data, size + 1);
+		if (!column->data)
+			exit(1);
+		column->databuffersize = size + 1;
+	}
+
+	memcpy(column->data, data, size);
+	column->data[size] = 0;
+	column->dataactualsize = size;
+	column->dataisnull = isnull;
+}
+
+static void civil_from_days(long long days, char *out, size_t size)
+{
+	long long z = days + 719468, era, doe, yoe, y, doy, mp, d, m;
+
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = z - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	y = yoe + era * 400;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+
+	snprintf(out, size, "%04lld-%02lld-%02lld", y + (m <= 2), m, d);
+}
+
+// Shortest text that reads back as the same double
+static void format_double(double value, char *out, size_t size)
+{
+	snprintf(out, size, "%.15g", value);
+	if (strtod(out, NULL) != value)
+		snprintf(out, size, "%.17g", value);
+}
+
+// Schema of the response, the first one also gives the result its columns
+static bool read_schema(ARROWDECODER *d, size_t schema)
+{
+	PRESTOCLIENT_RESULT *result = d->result;
+	size_t fields = fb_deref(d, fb_field(d, schema, 1));
+	size_t metadata = fb_deref(d, fb_field(d, schema, 2));
+	size_t count = fb_length(d, fields);
+	bool newcolumns = result->columncount == 0;
+
+	if (!newcolumns && result->columncount != count)
+		return false;
+
+	free(d->fields);
+	d->fields = (ARROWFIELD *)calloc(count + 1, sizeof(ARROWFIELD));
+	if (!d->fields)
+		exit(1);
+	d->fieldcount = count;
+
+	if (newcolumns && count > 0)
+	{
+		result->columns = (PRESTOCLIENT_COLUMN **)calloc(count, sizeof(PRESTOCLIENT_COLUMN *));
+		if (!result->columns)
+			exit(1);
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t field = fb_deref(d, fields + 4 + 4 * i);
+		size_t name = fb_deref(d, fb_field(d, field, 0));
+		size_t type = fb_deref(d, fb_field(d, field, 3));
+		ARROWFIELD *f = &d->fields[i];
+		enum E_FIELDTYPES fieldtype;
+
+		f->type = (enum E_ARROWTYPE)fb_scalar(d, field, 2, 1, 0);
+		switch (f->type)
+		{
+		case ARROWTYPE_INT:
+			f->width = (int)fb_scalar(d, type, 0, 4, 0) / 8;
+			fieldtype = f->width == 1 ? PRESTOCLIENT_TYPE_TINYINT : f->width == 2 ? PRESTOCLIENT_TYPE_SMALLINT :
+						f->width == 4 ? PRESTOCLIENT_TYPE_INTEGER : PRESTOCLIENT_TYPE_BIGINT;
+			if (f->width != 1 && f->width != 2 && f->width != 4 && f->width != 8)
+				return false;
+			break;
+		case ARROWTYPE_FLOATINGPOINT:
+			// HALF = 0, SINGLE = 1, DOUBLE = 2
+			f->width = fb_scalar(d, type, 0, 2, 0) == 1 ? 4 : 8;
+			fieldtype = f->width == 4 ? PRESTOCLIENT_TYPE_REAL : PRESTOCLIENT_TYPE_DOUBLE;
+			if (fb_scalar(d, type, 0, 2, 0) == 0)
+				return false;
+			break;
+		case ARROWTYPE_BOOL:
+			fieldtype = PRESTOCLIENT_TYPE_BOOLEAN;
+			break;
+		case ARROWTYPE_UTF8:
+		case ARROWTYPE_LARGEUTF8:
+			fieldtype = PRESTOCLIENT_TYPE_VARCHAR;
+			break;
+		case ARROWTYPE_DATE:
+			// DAY = 0 as int32, MILLISECOND = 1 as int64 and the default
+			f->width = fb_scalar(d, type, 0, 2, 1) == 0 ? 4 : 8;
+			fieldtype = PRESTOCLIENT_TYPE_DATE;
+			break;
+		default:
+			return false;
+		}
+
+		if (newcolumns)
+		{
+			PRESTOCLIENT_COLUMN *column = new_prestocolumn();
+
+			alloc_copy(&column->name, "");
+			if (name && fb_length(d, name) > 0 && !d->bad)
+				set_value(column, (const char *)&d->body[name + 4], fb_length(d, name), false);
+			alloc_copy(&column->name, column->data);
+			alloc_copy(&column->catalog, "unknown");
+			alloc_copy(&column->schema, "unknown");
+			alloc_copy(&column->table, "unknown");
+			column->type = fieldtype;
+			column->bytesize = E_FIELDTYPES_SIZES[fieldtype];
+			column->dataactualsize = 0;
+			result->columns[i] = column;
+			result->columncount = i + 1;
+		}
+		else if (result->columns[i]->type != fieldtype)
+			return false;
+	}
+
+	// The state of the query
+	for (size_t i = 0; i < fb_length(d, metadata); i++)
+	{
+		size_t keyvalue = fb_deref(d, metadata + 4 + 4 * i);
+		size_t key = fb_deref(d, fb_field(d, keyvalue, 0));
+		size_t value = fb_deref(d, fb_field(d, keyvalue, 1));
+		size_t keylen = fb_length(d, key), valuelen = fb_length(d, value);
+		char **target = NULL;
+
+		if (!key || !value || d->bad || value + 4 + valuelen > d->size || key + 4 + keylen > d->size)
+			return false;
+
+		if (keylen == 7 && memcmp(&d->body[key + 4], "nextUri", 7) == 0)
+			target = &result->lastnexturi;
+		else if (keylen == 7 && memcmp(&d->body[key + 4], "infoUri", 7) == 0)
+			target = &result->lastinfouri;
+		else if (keylen == 16 && memcmp(&d->body[key + 4], "partialCancelUri", 16) == 0)
+			target = &result->lastcanceluri;
+		else if (keylen == 5 && memcmp(&d->body[key + 4], "state", 5) == 0)
+			target = &result->laststate;
+
+		if (target)
+		{
+			*target = (char *)realloc(*target, valuelen + 1);
+			if (!*target)
+				exit(1);
+			memcpy(*target, &d->body[value + 4], valuelen);
+			(*target)[valuelen] = 0;
+		}
+	}
+
+	return !d->bad;
+}
+
+// Whether buffer j of a column is long enough for the rows of a batch, a validity buffer may be left out
+static bool buffer_fits(const ARROWFIELD *f, size_t j, size_t count, size_t rows, size_t length)
+{
+	size_t bits = rows / 8 + (rows % 8 != 0);
+
+	if (rows == 0)
+		return true;
+	if (j == 0)
+		return length == 0 || length >= bits;
+	if (count == 3 && j == 1)
+		return length / (f->type == ARROWTYPE_UTF8 ? 4 : 8) > rows;
+	if (count == 3)
+		return true;
+	if (f->type == ARROWTYPE_BOOL)
+		return length >= bits;
+
+	return length / f->width >= rows;
+}
+
+// Rows of a record batch, one write callback per row like the json parser
+static bool read_batch(ARROWDECODER *d, size_t batch, size_t body, size_t bodylength)
+{
+	PRESTOCLIENT_RESULT *result = d->result;
+	size_t rows = (size_t)fb_scalar(d, batch, 0, 8, 0);
+	size_t nodes = fb_deref(d, fb_field(d, batch, 1));
+	size_t buffers = fb_deref(d, fb_field(d, batch, 2));
+	size_t nbuffers = fb_length(d, buffers), b = 0;
+	size_t *validity, *values, *offsets;
+	char text[64];
+
+	// Compressed bodies are not supported
+	if (fb_field(d, batch, 3) || !d->fields || fb_length(d, nodes) != d->fieldcount || d->fieldcount != result->columncount)
+		return false;
+
+	validity = (size_t *)calloc(3 * d->fieldcount + 1, sizeof(size_t));
+	if (!validity)
+		exit(1);
+	values = validity + d->fieldcount;
+	offsets = values + d->fieldcount;
+
+	// Start of the buffers of every column in the response, 0 for a validity buffer left out
+	for (size_t i = 0; i < d->fieldcount && !d->bad; i++)
+	{
+		size_t count = d->fields[i].type == ARROWTYPE_UTF8 || d->fields[i].type == ARROWTYPE_LARGEUTF8 ? 3 : 2;
+
+		if (b + count > nbuffers || (size_t)rd(d, nodes + 4 + 16 * i, 8) < rows)
+		{
+			d->bad = true;
+			break;
+		}
+
+		for (size_t j = 0; j < count; j++, b++)
+		{
+			size_t offset = (size_t)rd(d, buffers + 4 + 16 * b, 8), length = (size_t)rd(d, buffers + 12 + 16 * b, 8);
+			size_t start = length > 0 ? body + offset : 0;
+
+			// a short buffer would read its neighbour's bytes as values
+			if (offset + length > bodylength || body + offset + length > d->size ||
+				!buffer_fits(&d->fields[i], j, count, rows, length))
+				d->bad = true;
+			if (j == 0)
+				validity[i] = start;
+			else if (j == 1 && count == 3)
+				offsets[i] = start;
+			else
+				values[i] = start;
+		}
+	}
+
+	for (size_t row = 0; row < rows && !d->bad && !result->cancelquery; row++)
+	{
+		for (size_t i = 0; i < d->fieldcount; i++)
+		{
+			ARROWFIELD *f = &d->fields[i];
+			PRESTOCLIENT_COLUMN *column = result->columns[i];
+
+			if (validity[i] && (rd(d, validity[i] + row / 8, 1) & (1u << (row % 8))) == 0)
+			{
+				set_value(column, "null", 4, true);
+				continue;
+			}
+
+			switch (f->type)
+			{
+			case ARROWTYPE_INT:
+			{
+				uint64_t raw = rd(d, values[i] + row * f->width, f->width);
+				long long value = f->width == 1 ? (int8_t)raw : f->width == 2 ? (int16_t)raw :
+								  f->width == 4 ? (int32_t)raw : (long long)(int64_t)raw;
+
+				snprintf(text, sizeof(text), "%lld", value);
+				break;
+			}
+			case ARROWTYPE_FLOATINGPOINT:
+			{
+				uint64_t raw = rd(d, values[i] + row * f->width, f->width);
+				double value;
+
+				if (f->width == 4)
+				{
+					uint32_t bits = (uint32_t)raw;
+					float single;
+
+					memcpy(&single, &bits, sizeof(single));
+					value = single;
+				}
+				else
+					memcpy(&value, &raw, sizeof(value));
+				format_double(value, text, sizeof(text));
+				break;
+			}
+			case ARROWTYPE_BOOL:
+				snprintf(text, sizeof(text), "%s", rd(d, values[i] + row / 8, 1) & (1u << (row % 8)) ? "true" : "false");
+				break;
+			case ARROWTYPE_DATE:
+			{
+				uint64_t raw = rd(d, values[i] + row * f->width, f->width);
+				long long days = f->width == 4 ? (int32_t)raw : (int64_t)raw / 86400000 - ((int64_t)raw % 86400000 < 0);
+
+				civil_from_days(days, text, sizeof(text));
+				break;
+			}
+			default:
+			{
+				size_t width = f->type == ARROWTYPE_UTF8 ? 4 : 8;
+				size_t start = (size_t)rd(d, offsets[i] + row * width, width);
+				size_t end = (size_t)rd(d, offsets[i] + (row + 1) * width, width);
+
+				if (end < start || (!values[i] && end > start) || values[i] + end > d->size)
+				{
+					d->bad = true;
+					break;
+				}
+				set_value(column, end > start ? (const char *)&d->body[values[i] + start] : "", end - start, false);
+				continue;
+			}
+			}
+
+			set_value(column, text, strlen(text), false);
+		}
+
+		if (d->bad)
+			break;
+
+		result->rowsreceived++;
+		result->write_callback_function(result->user_data, result);
+	}
+
+	free(validity);
+	return !d->bad;
+}
+
+/* --- Decoder -------------------------------------------------------------------------------------------------------- */
+
+static void *arrow_open(PRESTOCLIENT_RESULT *result)
+{
+	ARROWDECODER *d = (ARROWDECODER *)calloc(1, sizeof(ARROWDECODER));
+
+	if (!d)
+		exit(1);
+
+	d->result = result;
+	return d;
+}
+
+// The flatbuffers point anywhere in their message, the response is decoded once it is complete
+static int arrow_feed(void *state, const char *data, size_t size)
+{
+	ARROWDECODER *d = (ARROWDECODER *)state;
+
+	if (d->size + size > d->alloc)
+	{
+		size_t alloc = d->alloc ? d->alloc : ARROWDECODER_FIRSTALLOC;
+
+		while (alloc < d->size + size)
+			alloc *= 2;
+		d->body = (unsigned char *)realloc(d->body, alloc);
+		if (!d->body)
+			exit(1);
+		d->alloc = alloc;
+	}
+
+	memcpy(d->body + d->size, data, size);
+	d->size += size;
+
+	return 0;
+}
+
+static int arrow_finish(void *state)
+{
+	ARROWDECODER *d = (ARROWDECODER *)state;
+	size_t pos = 0;
+
+	while (pos + 4 <= d->size && !d->bad)
+	{
+		size_t length, message, header, body;
+		uint64_t bodylength;
+		unsigned int type;
+
+		// Encapsulated message: continuation marker, length of the metadata, metadata, body
+		length = (size_t)rd(d, pos, 4);
+		pos += 4;
+		if (length == ARROWDECODER_CONTINUATION)
+		{
+			length = (size_t)rd(d, pos, 4);
+			pos += 4;
+		}
+
+		// End of stream
+		if (length == 0)
+			return 0;
+
+		if (pos + length > d->size)
+			break;
+
+		message = pos + (size_t)rd(d, pos, 4);
+		type = (unsigned int)fb_scalar(d, message, 1, 1, 0);
+		header = fb_deref(d, fb_field(d, message, 2));
+		bodylength = fb_scalar(d, message, 3, 8, 0);
+		body = pos + length;
+		pos = body + (size_t)bodylength;
+		if (pos > d->size || pos < body)
+			break;
+
+		if (type == ARROWHEADER_SCHEMA && !read_schema(d, header))
+			return PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+		if (type == ARROWHEADER_RECORDBATCH && !read_batch(d, header, body, (size_t)bodylength))
+			return PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+		if (type == ARROWHEADER_DICTIONARYBATCH)
+			return PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+	}
+
+	// A stream without its end marker was cut off
+	printf("Unable to decode arrow stream, %zu of %zu bytes read\n", pos, d->size);
+	return PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+}
+
+static void arrow_close(void *state)
+{
+	ARROWDECODER *d = (ARROWDECODER *)state;
+
+	free(d->body);
+	free(d->fields);
+	free(d);
+}
+
+const DECODER decoder_arrow = {
+	"arrow",
+	"application/vnd.apache.arrow.stream",
+	arrow_open,
+	arrow_feed,
+	arrow_finish,
+	arrow_close
+};
@@ -0,0 +1,506 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "arrowexport.h"
+#include "pagebuffer.h"
+#include <assert.h>
+#include <errno.h>
+
+// A page received and not yet handed out as a batch
+typedef struct ST_ARROWPAGE
+{
+	PRESTOCLIENT_PAGE			 *page;							//!< Vectors taken from the parser
+	struct ST_ARROWPAGE			 *next;							//!< Next page of the query
+} ARROWPAGE;
+
+typedef struct ST_ARROWSTREAM
+{
+	PRESTOCLIENT				 *client;						//!< Client running the query
+	PRESTOCLIENT_RESULT			 *result;						//!< The query
+	ARROWPAGE					 *first;						//!< Oldest page not yet handed out
+	ARROWPAGE					 *last;							//!< Newest page
+	char						 *lasterror;					//!< Message of the last get_next that failed
+} ARROWSTREAM;
+
+// Memory of a batch, freed when the batch and all children moved out of it are released
+typedef struct ST_ARROWBATCH
+{
+	volatile long				  refcount;						//!< The batch and each of its children
+	PRESTOCLIENT_PAGE			 *page;							//!< Vectors the buffers point into
+	size_t						  columncount;					//!< Number of children
+	struct ArrowArray			 *children;						//!< Array of each column
+	struct ArrowArray			**childptrs;					//!< Pointers to children
+	const void					**buffers;						//!< Buffer of the batch and three per child
+	void						**converted;					//!< Buffer built for a child or NULL
+} ARROWBATCH;
+
+// Memory of a schema, freed like ARROWBATCH
+typedef struct ST_ARROWSCHEMA
+{
+	volatile long				  refcount;						//!< The schema and each of its children
+	size_t						  columncount;					//!< Number of children
+	struct ArrowSchema			 *children;						//!< Schema of each column
+	struct ArrowSchema			**childptrs;					//!< Pointers to children
+	char						**names;						//!< Names of the columns
+} ARROWSCHEMA;
+
+const char *arrowexport_format(enum E_FIELDTYPES type)
+{
+	switch (type)
+	{
+	case PRESTOCLIENT_TYPE_TINYINT:
+		return "c";
+	case PRESTOCLIENT_TYPE_SMALLINT:
+		return "s";
+	case PRESTOCLIENT_TYPE_INTEGER:
+		return "i";
+	case PRESTOCLIENT_TYPE_BIGINT:
+		return "l";
+	case PRESTOCLIENT_TYPE_REAL:
+		return "f";
+	case PRESTOCLIENT_TYPE_DOUBLE:
+		return "g";
+	case PRESTOCLIENT_TYPE_BOOLEAN:
+		return "b";
+	case PRESTOCLIENT_TYPE_DATE:
+		return "tdD";
+	default:
+		return "U";
+	}
+}
+
+// Days since 1970-01-01 of a date of the proleptic gregorian calendar
+static int32_t days_from_civil(long long y, int m, int d)
+{
+	long long era, yoe, doy, doe;
+
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = y - era * 400;
+	doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return (int32_t)(era * 146097 + doe - 719468);
+}
+
+// The int64 values of a page narrowed to width bytes each
+static void *narrow_int64(const int64_t *values, size_t rows, size_t width)
+{
+	void *narrowed = malloc((rows + 1) * width);
+
+	if (!narrowed)
+		exit(1);
+	for (size_t row = 0; row < rows; row++)
+	{
+		if (width == 1)
+			((int8_t *)narrowed)[row] = (int8_t)values[row];
+		else if (width == 2)
+			((int16_t *)narrowed)[row] = (int16_t)values[row];
+		else
+			((int32_t *)narrowed)[row] = (int32_t)values[row];
+	}
+
+	return narrowed;
+}
+
+static int64_t count_nulls(const unsigned char *validity, size_t rows)
+{
+	int64_t nulls = 0;
+
+	for (size_t row = 0; row < rows; row++)
+	{
+		if ((validity[row / 8] & (1u << (row % 8))) == 0)
+			nulls++;
+	}
+
+	return nulls;
+}
+
+static void unref_batch(ARROWBATCH *batch)
+{
+	if (util_atomic_add(&batch->refcount, -1) > 0)
+		return;
+
+	for (size_t i = 0; i < batch->columncount; i++)
+		free(batch->converted[i]);
+	pagebuffer_delete(batch->page);
+	free(batch->converted);
+	free(batch->buffers);
+	free(batch->childptrs);
+	free(batch->children);
+	free(batch);
+}
+
+static void release_column(struct ArrowArray *array)
+{
+	ARROWBATCH *batch = (ARROWBATCH *)array->private_data;
+
+	array->release = NULL;
+	unref_batch(batch);
+}
+
+static void release_batch(struct ArrowArray *array)
+{
+	ARROWBATCH *batch = (ARROWBATCH *)array->private_data;
+
+	// Children moved out of the batch have their release cleared here and are released on their own
+	for (size_t i = 0; i < batch->columncount; i++)
+	{
+		if (batch->childptrs[i]->release)
+			batch->childptrs[i]->release(batch->childptrs[i]);
+	}
+
+	array->release = NULL;
+	unref_batch(batch);
+}
+
+// Turn a page into a struct array with a child per column. The buffers point into the page
+// except for the narrower integers, reals, booleans and dates, which are converted
+static void build_batch(PRESTOCLIENT_PAGE *page, struct ArrowArray *out)
+{
+	ARROWBATCH *batch = (ARROWBATCH *)malloc(sizeof(ARROWBATCH));
+	size_t rows = pagebuffer_rows(page);
+	size_t columncount = pagebuffer_columns(page);
+
+	if (!batch)
+		exit(1);
+
+	batch->refcount = (long)columncount + 1;
+	batch->page = page;
+	batch->columncount = columncount;
+	batch->children = (struct ArrowArray *)calloc(columncount + 1, sizeof(struct ArrowArray));
+	batch->childptrs = (struct ArrowArray **)calloc(columncount + 1, sizeof(struct ArrowArray *));
+	batch->buffers = (const void **)calloc(3 * columncount + 1, sizeof(void *));
+	batch->converted = (void **)calloc(columncount + 1, sizeof(void *));
+	if (!batch->children || !batch->childptrs || !batch->buffers || !batch->converted)
+		exit(1);
+
+	for (size_t i = 0; i < columncount; i++)
+	{
+		struct ArrowArray *child = &batch->children[i];
+		const void **buffers = &batch->buffers[1 + 3 * i];
+		const char *format = arrowexport_format(pagebuffer_type(page, i));
+		const unsigned char *validity = prestoclient_getcolumn_validity(page, i);
+
+		child->length = (int64_t)rows;
+		child->null_count = count_nulls(validity, rows);
+		child->offset = 0;
+		child->n_buffers = 2;
+		child->n_children = 0;
+		child->buffers = buffers;
+		child->children = NULL;
+		child->dictionary = NULL;
+		child->release = &release_column;
+		child->private_data = batch;
+		buffers[0] = validity;
+
+		if (strcmp(format, "l") == 0)
+			buffers[1] = prestoclient_getcolumn_int64(page, i);
+		else if (strcmp(format, "g") == 0)
+			buffers[1] = prestoclient_getcolumn_double(page, i);
+		else if (strcmp(format, "c") == 0 || strcmp(format, "s") == 0 || strcmp(format, "i") == 0)
+		{
+			size_t width = format[0] == 'c' ? 1 : format[0] == 's' ? 2 : 4;
+
+			batch->converted[i] = narrow_int64(prestoclient_getcolumn_int64(page, i), rows, width);
+			buffers[1] = batch->converted[i];
+		}
+		else if (strcmp(format, "f") == 0)
+		{
+			const double *values = prestoclient_getcolumn_double(page, i);
+			float *reals = (float *)malloc((rows + 1) * sizeof(float));
+
+			if (!reals)
+				exit(1);
+			for (size_t row = 0; row < rows; row++)
+				reals[row] = (float)values[row];
+			batch->converted[i] = reals;
+			buffers[1] = reals;
+		}
+		else if (strcmp(format, "b") == 0)
+		{
+			const int64_t *values = prestoclient_getcolumn_int64(page, i);
+			unsigned char *bits = (unsigned char *)calloc((rows + 7) / 8 + 1, 1);
+
+			if (!bits)
+				exit(1);
+			for (size_t row = 0; row < rows; row++)
+			{
+				if (values[row])
+					bits[row / 8] |= (unsigned char)(1u << (row % 8));
+			}
+			batch->converted[i] = bits;
+			buffers[1] = bits;
+		}
+		else if (strcmp(format, "tdD") == 0)
+		{
+			const int64_t *offsets = pagebuffer_offsets(page, i);
+			const char *text = pagebuffer_text(page, i);
+			int32_t *days = (int32_t *)malloc((rows + 1) * sizeof(int32_t));
+			char date[32];
+
+			if (!days)
+				exit(1);
+			for (size_t row = 0; row < rows; row++)
+			{
+				size_t length = (size_t)(offsets[row + 1] - offsets[row]);
+				long long y = 1970;
+				int m = 1, d = 1;
+
+				if (length >= sizeof(date))
+					length = sizeof(date) - 1;
+				if (text)
+					memcpy(date, text + offsets[row], length);
+				date[length] = 0;
+				sscanf(date, "%lld-%d-%d", &y, &m, &d);
+				days[row] = days_from_civil(y, m, d);
+			}
+			batch->converted[i] = days;
+			buffers[1] = days;
+		}
+		else
+		{
+			const char *text = pagebuffer_text(page, i);
+
+			child->n_buffers = 3;
+			buffers[1] = pagebuffer_offsets(page, i);
+			buffers[2] = text ? text : "";
+		}
+
+		batch->childptrs[i] = child;
+	}
+
+	out->length = (int64_t)rows;
+	out->null_count = 0;
+	out->offset = 0;
+	out->n_buffers = 1;
+	out->n_children = (int64_t)columncount;
+	out->buffers = batch->buffers;
+	out->children = batch->childptrs;
+	out->dictionary = NULL;
+	out->release = &release_batch;
+	out->private_data = batch;
+}
+
+static void unref_schema(ARROWSCHEMA *schema)
+{
+	if (util_atomic_add(&schema->refcount, -1) > 0)
+		return;
+
+	for (size_t i = 0; i < schema->columncount; i++)
+		free(schema->names[i]);
+	free(schema->names);
+	free(schema->childptrs);
+	free(schema->children);
+	free(schema);
+}
+
+static void release_field(struct ArrowSchema *field)
+{
+	ARROWSCHEMA *schema = (ARROWSCHEMA *)field->private_data;
+
+	field->release = NULL;
+	unref_schema(schema);
+}
+
+static void release_schema(struct ArrowSchema *root)
+{
+	ARROWSCHEMA *schema = (ARROWSCHEMA *)root->private_data;
+
+	for (size_t i = 0; i < schema->columncount; i++)
+	{
+		if (schema->childptrs[i]->release)
+			schema->childptrs[i]->release(schema->childptrs[i]);
+	}
+
+	root->release = NULL;
+	unref_schema(schema);
+}
+
+static int stream_schema(struct ArrowArrayStream *self, struct ArrowSchema *out)
+{
+	ARROWSTREAM *stream = (ARROWSTREAM *)self->private_data;
+	PRESTOCLIENT_RESULT *result = stream->result;
+	size_t columncount = prestoclient_getcolumncount(result);
+	ARROWSCHEMA *schema = (ARROWSCHEMA *)malloc(sizeof(ARROWSCHEMA));
+
+	if (!schema)
+		exit(1);
+
+	schema->refcount = (long)columncount + 1;
+	schema->columncount = columncount;
+	schema->children = (struct ArrowSchema *)calloc(columncount + 1, sizeof(struct ArrowSchema));
+	schema->childptrs = (struct ArrowSchema **)calloc(columncount + 1, sizeof(struct ArrowSchema *));
+	schema->names = (char **)calloc(columncount + 1, sizeof(char *));
+	if (!schema->children || !schema->childptrs || !schema->names)
+		exit(1);
+
+	for (size_t i = 0; i < columncount; i++)
+	{
+		struct ArrowSchema *field = &schema->children[i];
+
+		alloc_copy(&schema->names[i], prestoclient_getcolumnname(result, i) ? prestoclient_getcolumnname(result, i) : "");
+		field->format = arrowexport_format((enum E_FIELDTYPES)prestoclient_getcolumntype(result, i));
+		field->name = schema->names[i];
+		field->metadata = NULL;
+		field->flags = ARROW_FLAG_NULLABLE;
+		field->n_children = 0;
+		field->children = NULL;
+		field->dictionary = NULL;
+		field->release = &release_field;
+		field->private_data = schema;
+		schema->childptrs[i] = field;
+	}
+
+	out->format = "+s";
+	out->name = "";
+	out->metadata = NULL;
+	out->flags = 0;
+	out->n_children = (int64_t)columncount;
+	out->children = schema->childptrs;
+	out->dictionary = NULL;
+	out->release = &release_schema;
+	out->private_data = schema;
+
+	return 0;
+}
+
+static int stream_next(struct ArrowArrayStream *self, struct ArrowArray *out)
+{
+	ARROWSTREAM *stream = (ARROWSTREAM *)self->private_data;
+	PRESTOCLIENT_RESULT *result = stream->result;
+	ARROWPAGE *entry;
+	int rc = PRESTO_OK;
+
+	// Pages are requested until one with rows arrived or the query ended
+	while (!stream->first && rc == PRESTO_OK && prestoclient_getstatus(result) == PRESTOCLIENT_STATUS_RUNNING)
+		rc = prestoclient_fetchmore(result);
+
+	if (stream->first)
+	{
+		entry = stream->first;
+		stream->first = entry->next;
+		if (!stream->first)
+			stream->last = NULL;
+		build_batch(entry->page, out);
+		free(entry);
+		return 0;
+	}
+
+	if (rc != PRESTO_OK || prestoclient_getstatus(result) != PRESTOCLIENT_STATUS_SUCCEEDED)
+	{
+		if (prestoclient_getlastservererror(result) && strlen(prestoclient_getlastservererror(result)) > 0)
+			alloc_copy(&stream->lasterror, prestoclient_getlastservererror(result));
+		else if (prestoclient_getlastclienterror(result))
+			alloc_copy(&stream->lasterror, prestoclient_getlastclienterror(result));
+		else
+			alloc_copy(&stream->lasterror, "Query failed");
+		return EIO;
+	}
+
+	// End of the stream
+	memset(out, 0, sizeof(*out));
+	out->release = NULL;
+	return 0;
+}
+
+static const char *stream_error(struct ArrowArrayStream *self)
+{
+	ARROWSTREAM *stream = (ARROWSTREAM *)self->private_data;
+
+	return stream->lasterror;
+}
+
+static void stream_release(struct ArrowArrayStream *self)
+{
+	ARROWSTREAM *stream = (ARROWSTREAM *)self->private_data;
+	ARROWPAGE *entry;
+
+	// Deleting a running result cancels its query
+	if (stream->result)
+		prestoclient_deleteresult(stream->client, stream->result);
+
+	while (stream->first)
+	{
+		entry = stream->first;
+		stream->first = entry->next;
+		pagebuffer_delete(entry->page);
+		free(entry);
+	}
+
+	free(stream->lasterror);
+	free(stream);
+	self->release = NULL;
+}
+
+// Page callback of the query, the page waits for get_next with the vectors of the parser
+static void receive_page(PRESTOCLIENT_RESULT *result, const PRESTOCLIENT_PAGE *page, void *in_stream)
+{
+	ARROWSTREAM *stream = (ARROWSTREAM *)in_stream;
+	ARROWPAGE *entry = (ARROWPAGE *)malloc(sizeof(ARROWPAGE));
+
+	(void)result;
+	if (!entry)
+		exit(1);
+
+	// The page is owned by the library, taking its vectors leaves the parser an empty page
+	entry->page = pagebuffer_take((PRESTOCLIENT_PAGE *)page);
+	entry->next = NULL;
+
+	if (stream->last)
+		stream->last->next = entry;
+	else
+		stream->first = entry;
+	stream->last = entry;
+}
+
+int arrowexport_query(PRESTOCLIENT *client, const char *sql, struct ArrowArrayStream *out)
+{
+	ARROWSTREAM *stream;
+	int rc;
+
+	if (!client || !sql || !out)
+		return PRESTO_BAD_REQUEST;
+
+	stream = (ARROWSTREAM *)malloc(sizeof(ARROWSTREAM));
+	if (!stream)
+		exit(1);
+
+	stream->client = client;
+	stream->result = NULL;
+	stream->first = NULL;
+	stream->last = NULL;
+	stream->lasterror = NULL;
+
+	rc = start_paged_query(client, &stream->result, sql, &receive_page, stream);
+	if (rc != PRESTO_OK)
+	{
+		struct ArrowArrayStream failed;
+
+		failed.private_data = stream;
+		stream_release(&failed);
+		return rc;
+	}
+
+	out->get_schema = &stream_schema;
+	out->get_next = &stream_next;
+	out->get_last_error = &stream_error;
+	out->release = &stream_release;
+	out->private_data = stream;
+
+	return PRESTO_OK;
+}
@@ -0,0 +1,123 @@
+/**
+ * \file arrowexport.h
+ *
+ * \brief a query is read as an ArrowArrayStream of the Arrow C data interface
+ *
+ * Dataframe libraries (pyarrow, polars, DuckDB) import the structs of the Arrow C data and
+ * stream interfaces without a dependency on a particular Arrow library. arrowexport_query
+ * starts a query whose pages are collected as column vectors (see pagebuffer.h) and hands
+ * every page out as one record batch: a struct array with a child per column of the query.
+ *
+ * The types of the columns map to Arrow types as follows:
+ *   bigint                              int64   ("l")   values of the page, no copy
+ *   integer, smallint, tinyint          int32 ("i"), int16 ("s"), int8 ("c") narrowed from the values
+ *   double                              float64 ("g")   values of the page, no copy
+ *   real                                float32 ("f")   narrowed from the values
+ *   boolean                             bool    ("b")   bits built from the values
+ *   date                                date32  ("tdD") days since 1970-01-01 built from the text
+ *   all other types                     large utf8 ("U") text of the page, no copy
+ * Decimals, timestamps, intervals and the structural types keep the text of Presto so no
+ * precision is lost. The null bitmaps of all columns are those of the page.
+ *
+ * The stream reads the next page when the consumer asks for the next batch. The stream and
+ * its batches may be released in any order and on any thread; the stream belongs to one thread.
+ */
+
+#ifndef EASYPTORA_ARROWEXPORT_HH
+#define EASYPTORA_ARROWEXPORT_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Arrow C data interface, see https://arrow.apache.org/docs/format/CDataInterface.html -------------------------- */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+	// Array type description
+	const char* format;
+	const char* name;
+	const char* metadata;
+	int64_t flags;
+	int64_t n_children;
+	struct ArrowSchema** children;
+	struct ArrowSchema* dictionary;
+
+	// Release callback
+	void (*release)(struct ArrowSchema*);
+	// Opaque producer-specific data
+	void* private_data;
+};
+
+struct ArrowArray {
+	// Array data description
+	int64_t length;
+	int64_t null_count;
+	int64_t offset;
+	int64_t n_buffers;
+	int64_t n_children;
+	const void** buffers;
+	struct ArrowArray** children;
+	struct ArrowArray* dictionary;
+
+	// Release callback
+	void (*release)(struct ArrowArray*);
+	// Opaque producer-specific data
+	void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+	// Callbacks providing stream functionality
+	int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema* out);
+	int (*get_next)(struct ArrowArrayStream*, struct ArrowArray* out);
+	const char* (*get_last_error)(struct ArrowArrayStream*);
+
+	// Release callback
+	void (*release)(struct ArrowArrayStream*);
+
+	// Opaque producer-specific data
+	void* private_data;
+};
+
+#endif  // ARROW_C_STREAM_INTERFACE
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Start a query and hand its rows out as a stream of record batches
+ *
+ * Like prestoclient_querystart the call returns once the first rows arrived. The query is
+ * cancelled when the stream is released before its last batch was read. A query failing
+ * later ends the stream with EIO, get_last_error returns the message of the server.
+ *
+ * \param client  A handle to a PRESTOCLIENT object, it must stay open until the stream is released
+ * \param sql     The query
+ * \param stream  Out: the stream, released by the consumer
+ *
+ * \return PRESTO_OK or the error of prestoclient_querystart, the stream is only set on PRESTO_OK
+ */
+extern int arrowexport_query(PRESTOCLIENT *client, const char *sql, struct ArrowArrayStream *stream);
+
+/**
+ * \brief Arrow format string of a column type, see the table above
+ */
+extern const char *arrowexport_format(enum E_FIELDTYPES type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_ARROWEXPORT_HH
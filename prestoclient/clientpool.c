@@ -0,0 +1,360 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "clientpool.h"
+#include <assert.h>
+
+typedef struct ST_CLIENTPOOL_ENTRY
+{
+	char						 *key;							//!< Connection attributes
+	char						 *catalog;						//!< Catalog at checkout, restored on checkin
+	char						 *schema;						//!< Schema at checkout, restored on checkin
+	PRESTOCLIENT				 *client;						//!< The pooled client
+	bool						  idle;							//!< Client is in the pool, not checked out
+	long long					  idlesince;					//!< util_now_msec() of the last checkin
+	struct ST_CLIENTPOOL_ENTRY	 *next;							//!< Next entry
+} CLIENTPOOL_ENTRY;
+
+struct ST_CLIENTPOOL
+{
+	UTIL_MUTEX					  lock;							//!< Protects everything below
+	CLIENTPOOL_ENTRY			 *entries;						//!< Idle and checked out clients
+	size_t						  maxperkey;					//!< Idle clients kept per key
+	long long					  maxidle;						//!< Milliseconds an idle client is kept
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+static void free_entry(CLIENTPOOL_ENTRY *entry)
+{
+	if (entry->client)
+		prestoclient_close(entry->client);
+
+	if (entry->key)
+		free(entry->key);
+
+	if (entry->catalog)
+		free(entry->catalog);
+
+	if (entry->schema)
+		free(entry->schema);
+
+	free(entry);
+}
+
+// Join the connection attributes, fields are separated by a unit separator so they cannot run into each other
+static char *make_key(const char *protocol, const char *server, const unsigned int *port, const char *catalog,
+					  const char *schema, const char *user, const char *timezone, const char *language)
+{
+	const char *fields[7];
+	char portstr[16];
+	char *key, *p;
+	size_t length = 0;
+
+	sprintf(portstr, "%u", port ? *port : 0);
+
+	fields[0] = protocol;
+	fields[1] = server;
+	fields[2] = portstr;
+	fields[3] = catalog;
+	fields[4] = schema;
+	fields[5] = user;
+	fields[6] = timezone;
+
+	for (int i = 0; i < 7; i++)
+		length += (fields[i] ? strlen(fields[i]) : 0) + 1;
+	length += (language ? strlen(language) : 0) + 1;
+
+	key = (char *)malloc(length);
+	if (!key)
+		exit(1);
+
+	p = key;
+	for (int i = 0; i < 7; i++)
+	{
+		if (fields[i])
+		{
+			strcpy(p, fields[i]);
+			p += strlen(fields[i]);
+		}
+		*p++ = '\x1f';
+	}
+	strcpy(p, language ? language : "");
+
+	return key;
+}
+
+// Unlink the entry from the pool, caller holds the lock
+static void unlink_entry(CLIENTPOOL *pool, CLIENTPOOL_ENTRY *entry)
+{
+	CLIENTPOOL_ENTRY **link;
+
+	for (link = &pool->entries; *link; link = &(*link)->next)
+	{
+		if (*link == entry)
+		{
+			*link = entry->next;
+			entry->next = NULL;
+			return;
+		}
+	}
+}
+
+// Move idle entries past their idle time to the expired list, caller holds the lock
+static void prune_expired(CLIENTPOOL *pool, long long now, CLIENTPOOL_ENTRY **expired)
+{
+	CLIENTPOOL_ENTRY **link = &pool->entries;
+
+	while (*link)
+	{
+		CLIENTPOOL_ENTRY *entry = *link;
+
+		if (entry->idle && now - entry->idlesince > pool->maxidle)
+		{
+			*link = entry->next;
+			entry->next = *expired;
+			*expired = entry;
+		}
+		else
+		{
+			link = &entry->next;
+		}
+	}
+}
+
+static void free_list(CLIENTPOOL_ENTRY *list)
+{
+	while (list)
+	{
+		CLIENTPOOL_ENTRY *next = list->next;
+		free_entry(list);
+		list = next;
+	}
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+CLIENTPOOL *clientpool_new(size_t maxperkey, long long maxidle_msec)
+{
+	CLIENTPOOL *pool = (CLIENTPOOL *)malloc(sizeof(CLIENTPOOL));
+
+	if (!pool)
+		exit(1);
+
+	util_mutex_init(&pool->lock);
+	pool->entries = NULL;
+	pool->maxperkey = maxperkey > 0 ? maxperkey : CLIENTPOOL_DEFAULT_MAXPERKEY;
+	pool->maxidle = maxidle_msec > 0 ? maxidle_msec : CLIENTPOOL_DEFAULT_MAXIDLE;
+
+	return pool;
+}
+
+void clientpool_delete(CLIENTPOOL *pool)
+{
+	if (!pool)
+		return;
+
+	free_list(pool->entries);
+	util_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+void clientpool_configure(CLIENTPOOL *pool, size_t maxperkey, long long maxidle_msec)
+{
+	assert(pool);
+
+	util_mutex_lock(&pool->lock);
+	if (maxperkey > 0)
+		pool->maxperkey = maxperkey;
+	if (maxidle_msec > 0)
+		pool->maxidle = maxidle_msec;
+	util_mutex_unlock(&pool->lock);
+}
+
+PRESTOCLIENT *clientpool_checkout(CLIENTPOOL *pool, const char *protocol, const char *server, const unsigned int *port,
+								  const char *catalog, const char *schema, const char *user, const char *pwd,
+								  const char *timezone, const char *language, bool trace_http)
+{
+	CLIENTPOOL_ENTRY *entry, *expired = NULL;
+	PRESTOCLIENT *client;
+	char *key, *info;
+	long long now;
+
+	assert(pool);
+
+	key = make_key(protocol, server, port, catalog, schema, user, timezone, language);
+
+	for (;;)
+	{
+		now = util_now_msec();
+
+		util_mutex_lock(&pool->lock);
+		prune_expired(pool, now, &expired);
+		for (entry = pool->entries; entry; entry = entry->next)
+		{
+			if (entry->idle && strcmp(entry->key, key) == 0)
+			{
+				entry->idle = false;
+				break;
+			}
+		}
+		util_mutex_unlock(&pool->lock);
+
+		free_list(expired);
+		expired = NULL;
+
+		if (!entry)
+			break;
+
+		if (now - entry->idlesince < CLIENTPOOL_CHECKINTERVAL)
+			break;
+
+		// Idle for a while, make sure the coordinator still answers before handing it out
+		info = prestoclient_serverinfo(entry->client);
+		if (info)
+		{
+			free(info);
+			break;
+		}
+
+		util_mutex_lock(&pool->lock);
+		unlink_entry(pool, entry);
+		util_mutex_unlock(&pool->lock);
+		free_entry(entry);
+	}
+
+	if (entry)
+	{
+		free(key);
+		return entry->client;
+	}
+
+	client = prestoclient_init(protocol, server, port, catalog, schema, user, pwd, timezone, language, trace_http);
+	if (!client)
+	{
+		free(key);
+		return NULL;
+	}
+
+	entry = (CLIENTPOOL_ENTRY *)malloc(sizeof(CLIENTPOOL_ENTRY));
+	if (!entry)
+		exit(1);
+
+	entry->key = key;
+	entry->catalog = NULL;
+	entry->schema = NULL;
+	if (catalog)
+		alloc_copy(&entry->catalog, catalog);
+	if (schema)
+		alloc_copy(&entry->schema, schema);
+	entry->client = client;
+	entry->idle = false;
+	entry->idlesince = now;
+
+	util_mutex_lock(&pool->lock);
+	entry->next = pool->entries;
+	pool->entries = entry;
+	util_mutex_unlock(&pool->lock);
+
+	return client;
+}
+
+void clientpool_checkin(CLIENTPOOL *pool, PRESTOCLIENT *client)
+{
+	CLIENTPOOL_ENTRY *entry, *other;
+	size_t idle = 0;
+
+	assert(pool);
+
+	if (!client)
+		return;
+
+	util_mutex_lock(&pool->lock);
+
+	for (entry = pool->entries; entry; entry = entry->next)
+		if (entry->client == client && !entry->idle)
+			break;
+
+	if (!entry)
+	{
+		// Not from this pool
+		util_mutex_unlock(&pool->lock);
+		prestoclient_close(client);
+		return;
+	}
+
+	for (other = pool->entries; other; other = other->next)
+		if (other->idle && strcmp(other->key, entry->key) == 0)
+			idle++;
+
+	// A client with open results cannot be handed to another connection
+	if (client->active_results > 0 || idle >= pool->maxperkey)
+	{
+		unlink_entry(pool, entry);
+		util_mutex_unlock(&pool->lock);
+		free_entry(entry);
+		return;
+	}
+
+	// Undo "use catalog.schema" of the previous owner
+	if (entry->catalog)
+		alloc_copy(&client->catalog, entry->catalog);
+	else if (client->catalog)
+	{
+		free(client->catalog);
+		client->catalog = NULL;
+	}
+
+	if (entry->schema)
+		alloc_copy(&client->schema, entry->schema);
+	else if (client->schema)
+	{
+		free(client->schema);
+		client->schema = NULL;
+	}
+
+	prestoclient_setquerytimeout(client, 0);
+	prestoclient_setpriority(client, 0);
+	prestoclient_on_page(client, NULL);
+	prestoclient_setencoding(client, NULL);
+	prestoclient_setspooling(client, 0);
+	prestoclient_setcompression(client, NULL);
+	prestoclient_setcafile(client, NULL);
+	prestoclient_setpagesize(client, 0, 0);
+	prestoclient_sethotpages(client, 0);
+
+	entry->idle = true;
+	entry->idlesince = util_now_msec();
+
+	util_mutex_unlock(&pool->lock);
+}
+
+size_t clientpool_idle(CLIENTPOOL *pool)
+{
+	CLIENTPOOL_ENTRY *entry;
+	size_t idle = 0;
+
+	assert(pool);
+
+	util_mutex_lock(&pool->lock);
+	for (entry = pool->entries; entry; entry = entry->next)
+		if (entry->idle)
+			idle++;
+	util_mutex_unlock(&pool->lock);
+
+	return idle;
+}
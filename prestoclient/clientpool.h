@@ -0,0 +1,93 @@
+/**
+ * \file clientpool.h
+ *
+ * \brief pool of idle presto clients shared by connections with the same attributes
+ *
+ * Clients are keyed by protocol, server, port, user, catalog, schema, timezone and
+ * language. A client handed back by a closing connection is kept idle together with
+ * its finished curl handles, so the next connection with the same attributes reuses
+ * its open http connections. Idle clients are closed after a maximum idle time and at
+ * most a fixed number of idle clients is kept per key. A client that was idle for a
+ * while is checked with prestoclient_serverinfo before it is handed out again.
+ *
+ * All functions are thread safe.
+ */
+
+#ifndef EASYPTORA_CLIENTPOOL_HH
+#define EASYPTORA_CLIENTPOOL_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define CLIENTPOOL_DEFAULT_MAXPERKEY      4               //!< Default number of idle clients kept per key
+#define CLIENTPOOL_DEFAULT_MAXIDLE        60000           //!< Default milliseconds an idle client is kept
+#define CLIENTPOOL_CHECKINTERVAL          5000            //!< Clients idle for longer than this are health checked on checkout
+
+/* --- Typedefs ------------------------------------------------------------------------------------------------------- */
+typedef struct ST_CLIENTPOOL CLIENTPOOL;
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create an empty pool
+ *
+ * \param maxperkey     Idle clients kept per key, 0 selects CLIENTPOOL_DEFAULT_MAXPERKEY
+ * \param maxidle_msec  Milliseconds an idle client is kept, 0 selects CLIENTPOOL_DEFAULT_MAXIDLE
+ *
+ * \return A handle to the pool
+ */
+extern CLIENTPOOL *clientpool_new(size_t maxperkey, long long maxidle_msec);
+
+/**
+ * \brief Close all idle clients and free the pool. Clients still checked out are closed too.
+ *
+ * \param pool  A handle to the pool
+ */
+extern void clientpool_delete(CLIENTPOOL *pool);
+
+/**
+ * \brief Change the limits, 0 keeps the current value
+ *
+ * \param pool          A handle to the pool
+ * \param maxperkey     Idle clients kept per key
+ * \param maxidle_msec  Milliseconds an idle client is kept
+ */
+extern void clientpool_configure(CLIENTPOOL *pool, size_t maxperkey, long long maxidle_msec);
+
+/**
+ * \brief Get a client for the connection attributes, reusing an idle one when possible
+ *
+ * The parameters are the same as for prestoclient_init.
+ *
+ * \return A client that must be returned with clientpool_checkin or NULL if no client could be created
+ */
+extern PRESTOCLIENT *clientpool_checkout(CLIENTPOOL *pool, const char *protocol, const char *server, const unsigned int *port,
+										 const char *catalog, const char *schema, const char *user, const char *pwd,
+										 const char *timezone, const char *language, bool trace_http);
+
+/**
+ * \brief Return a client to the pool. Catalog and schema are reset to the values used on checkout.
+ *        The client is closed when it still has results or enough idle clients are pooled for its key.
+ *
+ * \param pool    A handle to the pool
+ * \param client  Client returned by clientpool_checkout
+ */
+extern void clientpool_checkin(CLIENTPOOL *pool, PRESTOCLIENT *client);
+
+/**
+ * \brief Number of idle clients in the pool
+ *
+ * \param pool  A handle to the pool
+ */
+extern size_t clientpool_idle(CLIENTPOOL *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_CLIENTPOOL_HH
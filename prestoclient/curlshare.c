@@ -0,0 +1,100 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "curlshare.h"
+#include <assert.h>
+
+struct ST_CURLSHARE
+{
+	CURLSH						 *handle;						//!< The libcurl share
+	UTIL_MUTEX					  locks[CURL_LOCK_DATA_LAST];	//!< One lock per kind of shared data
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+static void lock_callback(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+	CURLSHARE *share = (CURLSHARE *)userptr;
+
+	(void)handle;
+	(void)access; // Shared and single locks are the same for a mutex
+
+	util_mutex_lock(&share->locks[data]);
+}
+
+static void unlock_callback(CURL *handle, curl_lock_data data, void *userptr)
+{
+	CURLSHARE *share = (CURLSHARE *)userptr;
+
+	(void)handle;
+
+	util_mutex_unlock(&share->locks[data]);
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+CURLSHARE *curlshare_new(void)
+{
+	CURLSHARE *share = (CURLSHARE *)malloc(sizeof(CURLSHARE));
+
+	if (!share)
+		exit(1);
+
+	share->handle = curl_share_init();
+	if (!share->handle)
+	{
+		free(share);
+		return NULL;
+	}
+
+	for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+		util_mutex_init(&share->locks[i]);
+
+	curl_share_setopt(share->handle, CURLSHOPT_LOCKFUNC, lock_callback);
+	curl_share_setopt(share->handle, CURLSHOPT_UNLOCKFUNC, unlock_callback);
+	curl_share_setopt(share->handle, CURLSHOPT_USERDATA, (void *)share);
+
+	curl_share_setopt(share->handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(share->handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+	curl_share_setopt(share->handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+
+	return share;
+}
+
+void curlshare_delete(CURLSHARE *share)
+{
+	if (!share)
+		return;
+
+	// Still in use by a curl handle, leaking is better than pulling the locks away under it
+	if (curl_share_cleanup(share->handle) != CURLSHE_OK)
+		return;
+
+	for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+		util_mutex_destroy(&share->locks[i]);
+
+	free(share);
+}
+
+void curlshare_attach(CURLSHARE *share, PRESTOCLIENT *client)
+{
+	assert(client);
+
+	client->share = share ? share->handle : NULL;
+}
@@ -0,0 +1,57 @@
+/**
+ * \file curlshare.h
+ *
+ * \brief curl share object for the curl handles of many clients
+ *
+ * Every request of a client runs on its own curl easy handle. Attaching the clients
+ * to one share lets all those handles use a common dns cache, tls session cache and,
+ * with libcurl 7.57.0 or newer, a common connection cache. A statement started on a
+ * new handle then skips the name lookup and resumes the tls session or reuses an open
+ * connection to the coordinator.
+ *
+ * The share is protected by one mutex per kind of shared data, so clients attached to
+ * the same share can run in different threads.
+ */
+
+#ifndef EASYPTORA_CURLSHARE_HH
+#define EASYPTORA_CURLSHARE_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Typedefs ------------------------------------------------------------------------------------------------------- */
+typedef struct ST_CURLSHARE CURLSHARE;
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create a share for dns, tls sessions and connections
+ *
+ * \return A handle to the share or NULL if libcurl could not create it
+ */
+extern CURLSHARE *curlshare_new(void);
+
+/**
+ * \brief Free the share. All attached clients must be closed first.
+ *
+ * \param share  A handle to the share
+ */
+extern void curlshare_delete(CURLSHARE *share);
+
+/**
+ * \brief Let all future requests of a client use the share
+ *
+ * \param share   A handle to the share, NULL detaches the client
+ * \param client  The client
+ */
+extern void curlshare_attach(CURLSHARE *share, PRESTOCLIENT *client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_CURLSHARE_HH
@@ -0,0 +1,201 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "decoder.h"
+#include "prestojson.h"
+#include <ctype.h>
+
+// Decoders in the order they are looked up
+static const DECODER *decoders[] = { &decoder_json, &decoder_arrow };
+
+#define DECODER_COUNT (sizeof(decoders) / sizeof(decoders[0]))
+
+/* --- Json ----------------------------------------------------------------------------------------------------------- */
+
+typedef struct ST_JSONDECODER
+{
+	PRESTOCLIENT_RESULT			 *result;						//!< Result the parser writes to
+	JSON_PARSER					  parser;						//!< Parser of the response
+	PARSINGSTATE				  pstate;						//!< State of presto_json_parser
+	bool						  finished;						//!< json_fini was called
+} JSONDECODER;
+
+static void *json_open(PRESTOCLIENT_RESULT *result)
+{
+	static const JSON_CALLBACKS callbacks = {
+		presto_json_parser
+	};
+	JSONDECODER *decoder = (JSONDECODER *)calloc(1, sizeof(JSONDECODER));
+	JSON_CONFIG config;
+
+	if (!decoder)
+		exit(1);
+
+	// inline segments of a spooled result are base64 strings longer than any value
+	json_default_config(&config);
+	if (result->client && result->client->spooling > 0)
+		config.max_string_len = 0;
+
+	decoder->result = result;
+	json_init(&decoder->parser, &callbacks, &config, result);
+	result->jsonparser = &decoder->parser;
+	result->parserstate = &decoder->pstate;
+
+	return decoder;
+}
+
+static int json_decode(void *state, const char *data, size_t size)
+{
+	JSONDECODER *decoder = (JSONDECODER *)state;
+
+	return json_feed(&decoder->parser, data, size);
+}
+
+static int json_finish(void *state)
+{
+	JSONDECODER *decoder = (JSONDECODER *)state;
+	JSON_INPUT_POS pos = {0};
+	int ret;
+
+	decoder->finished = true;
+	ret = json_fini(&decoder->parser, &pos);
+	if (ret != 0)
+		printf("Unable to finish parser, retcode %i (offset: %li, column %i, line %i)\n", ret, pos.offset, pos.column_number, pos.line_number);
+
+	return ret;
+}
+
+static void json_close(void *state)
+{
+	JSONDECODER *decoder = (JSONDECODER *)state;
+
+	if (!decoder->finished)
+		json_fini(&decoder->parser, NULL);
+
+	// the parser is transient in the result, it lives as long as the response
+	decoder->result->jsonparser = NULL;
+	decoder->result->parserstate = NULL;
+	free(decoder);
+}
+
+const DECODER decoder_json = {
+	"json",
+	"application/json",
+	json_open,
+	json_decode,
+	json_finish,
+	json_close
+};
+
+/* --- Negotiation ---------------------------------------------------------------------------------------------------- */
+
+// Compare a media type with the start of a Content-Type, which may carry parameters like a charset
+static bool media_matches(const char *mediatype, const char *contenttype)
+{
+	size_t len = strlen(mediatype);
+
+	while (*contenttype == ' ')
+		contenttype++;
+
+	for (size_t i = 0; i < len; i++)
+	{
+		if (tolower((unsigned char)contenttype[i]) != mediatype[i])
+			return false;
+	}
+
+	return contenttype[len] == 0 || contenttype[len] == ';' || contenttype[len] == ' ';
+}
+
+const DECODER *decoder_find(const char *contenttype)
+{
+	if (!contenttype)
+		return &decoder_json;
+
+	for (size_t i = 0; i < DECODER_COUNT; i++)
+	{
+		if (media_matches(decoders[i]->mediatype, contenttype))
+			return decoders[i];
+	}
+
+	return &decoder_json;
+}
+
+bool decoder_accept(const char *encodings, char **accept)
+{
+	const char *name = encodings;
+	char header[512];
+	size_t used = 0, count = 0;
+	bool other = false;
+
+	header[0] = 0;
+
+	while (name && *name)
+	{
+		size_t len = strcspn(name, ",");
+		const DECODER *decoder = NULL;
+
+		for (size_t i = 0; i < DECODER_COUNT; i++)
+		{
+			if (strlen(decoders[i]->name) == len && strncmp(decoders[i]->name, name, len) == 0)
+				decoder = decoders[i];
+		}
+
+		if (!decoder)
+			return false;
+
+		// Most preferred first, every later one with a lower quality
+		if (used < sizeof(header))
+		{
+			if (count == 0)
+				used += snprintf(header + used, sizeof(header) - used, "%s", decoder->mediatype);
+			else
+				used += snprintf(header + used, sizeof(header) - used, ", %s;q=0.%d", decoder->mediatype, count < 9 ? 10 - (int)count : 1);
+		}
+		if (decoder != &decoder_json)
+			other = true;
+
+		count++;
+		name += len;
+		if (*name == ',')
+			name++;
+	}
+
+	// Json is always understood
+	if (other && !strstr(header, decoder_json.mediatype) && used < sizeof(header))
+		snprintf(header + used, sizeof(header) - used, ", %s;q=0.1", decoder_json.mediatype);
+
+	if (*accept)
+	{
+		free(*accept);
+		*accept = NULL;
+	}
+	if (other)
+		alloc_copy(accept, header);
+
+	return true;
+}
+
+int prestoclient_setencoding(PRESTOCLIENT *prestoclient, const char *encodings)
+{
+	if (!prestoclient)
+		return PRESTO_BAD_REQUEST;
+
+	if (!decoder_accept(encodings, &prestoclient->accept))
+		return PRESTO_BAD_REQUEST;
+
+	return PRESTO_OK;
+}
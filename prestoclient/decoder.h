@@ -0,0 +1,79 @@
+/**
+ * \file decoder.h
+ *
+ * \brief responses are decoded by the decoder matching their content type
+ *
+ * A DECODER turns the body of a response into the state of the query (next uri, state, error)
+ * and into rows: it fills the columns of the result and calls its write callback once per row,
+ * like presto_json_parser always did. Each response gets a decoder state of its own, opened
+ * before the first byte arrives, fed with every chunk curl hands over and finished once the
+ * transfer is complete.
+ *
+ * Which decoder is used is negotiated with the coordinator: prestoclient_setencoding makes the
+ * client send an Accept header listing the encodings it prefers, and every response is decoded
+ * by the decoder of its Content-Type. Json remains the fallback, a coordinator that does not know
+ * an encoding, an error page or a response without rows is decoded as json.
+ *
+ *   json   application/json                      the Presto client protocol
+ *   arrow  application/vnd.apache.arrow.stream   an Arrow IPC stream per response, the uris and the
+ *                                                state of the query are the custom metadata (keys
+ *                                                nextUri, infoUri, partialCancelUri and state) of
+ *                                                its schema, every record batch holds rows of the page
+ *
+ * The arrow decoder reads bigint, integer, smallint, tinyint, double, real, boolean, varchar and
+ * date columns (Arrow int, floating point, bool, utf8, large utf8 and date). Other Arrow types and
+ * compressed or dictionary encoded batches fail the page with PRESTOCLIENT_RESULT_PARSE_JSON_ERROR.
+ * Pages of a query accepting other encodings than json are not parsed on a parse pool (see parsepool.h).
+ */
+
+#ifndef EASYPTORA_DECODER_HH
+#define EASYPTORA_DECODER_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Structs -------------------------------------------------------------------------------------------------------- */
+struct ST_DECODER
+{
+	const char					 *name;							//!< Name of the encoding for prestoclient_setencoding
+	const char					 *mediatype;					//!< Content-Type of the responses it decodes
+	void *(*open)(PRESTOCLIENT_RESULT *result);					//!< State for one response of the query
+	int (*feed)(void *state, const char *data, size_t size);	//!< Decode a chunk of the body, 0 when it was accepted
+	int (*finish)(void *state);									//!< The body is complete, 0 when it was decoded
+	void (*close)(void *state);									//!< Free the state
+};
+
+/* --- Variables ------------------------------------------------------------------------------------------------------ */
+extern const DECODER decoder_json;								//!< The Presto json protocol
+extern const DECODER decoder_arrow;								//!< Arrow IPC streams
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Decoder of a response
+ *
+ * \param contenttype  Content-Type of the response, may be NULL
+ *
+ * \return The decoder of the media type, decoder_json when none matches
+ */
+extern const DECODER *decoder_find(const char *contenttype);
+
+/**
+ * \brief Accept header for a list of encodings
+ *
+ * \param encodings  Comma separated names of encodings, most preferred first
+ * \param accept     Out: malloc'ed header value, NULL when only json is accepted
+ *
+ * \return false when a name is unknown
+ */
+extern bool decoder_accept(const char *encodings, char **accept);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_DECODER_HH
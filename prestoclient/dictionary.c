@@ -0,0 +1,228 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dictionary.h"
+#include <stdint.h>
+
+#define DICTIONARY_FIRSTSLOTS             64              // Hash slots of a new dictionary, a power of two
+#define DICTIONARY_FIRSTBLOCK             256             // Bytes of the first block of text, the next ones double
+
+typedef struct ST_DICTIONARY_ENTRY
+{
+	const char					 *text;							//!< Terminated text of the value in a block
+	uint32_t					  length;						//!< Bytes of the value
+	uint32_t					  hash;							//!< Hash of the value
+} DICTIONARY_ENTRY;
+
+struct ST_DICTIONARY
+{
+	DICTIONARY_ENTRY			 *entries;						//!< Distinct values, the index is the code of a value
+	size_t						  count;						//!< Entries used
+	size_t						  entryalloc;					//!< Entries allocated
+	uint32_t					 *slots;						//!< Open addressing hash of code + 1, 0 for a free slot
+	size_t						  slotcount;					//!< Slots allocated, a power of two
+	char						**blocks;						//!< Blocks holding the text of the values
+	size_t						  nblocks;						//!< Blocks allocated
+	size_t						  blocksize;					//!< Bytes of the last block
+	size_t						  blockused;					//!< Bytes used in the last block
+	size_t						  textbytes;					//!< Bytes of all blocks
+	size_t						  values;						//!< Values interned so far, repeats included
+	bool						  active;						//!< Still takes values
+};
+
+static void *grow(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr)
+		exit(1);
+	return ptr;
+}
+
+// FNV-1a
+static uint32_t hash_value(const char *value, size_t length)
+{
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)value[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static void insert_slot(DICTIONARY *dictionary, uint32_t hash, uint32_t code)
+{
+	size_t mask = dictionary->slotcount - 1;
+	size_t slot = hash & mask;
+
+	while (dictionary->slots[slot] != 0)
+		slot = (slot + 1) & mask;
+	dictionary->slots[slot] = code + 1;
+}
+
+// Keep the hash at most half full
+static void grow_slots(DICTIONARY *dictionary)
+{
+	free(dictionary->slots);
+	dictionary->slotcount *= 2;
+	dictionary->slots = (uint32_t *)calloc(dictionary->slotcount, sizeof(uint32_t));
+	if (!dictionary->slots)
+		exit(1);
+
+	for (size_t code = 0; code < dictionary->count; code++)
+		insert_slot(dictionary, dictionary->entries[code].hash, (uint32_t)code);
+}
+
+// Copy a value to the text blocks, a full block is left as it is and a larger one started
+static const char *store_text(DICTIONARY *dictionary, const char *value, size_t length)
+{
+	char *text;
+
+	if (dictionary->nblocks == 0 || dictionary->blocksize - dictionary->blockused < length + 1)
+	{
+		size_t size = dictionary->nblocks == 0 ? DICTIONARY_FIRSTBLOCK : dictionary->blocksize * 2;
+
+		if (size > DICTIONARY_BLOCKSIZE)
+			size = DICTIONARY_BLOCKSIZE;
+		if (size < length + 1)
+			size = length + 1;
+
+		dictionary->blocks = (char **)grow(dictionary->blocks, (dictionary->nblocks + 1) * sizeof(char *));
+		dictionary->blocks[dictionary->nblocks] = (char *)grow(NULL, size);
+		dictionary->nblocks++;
+		dictionary->blocksize = size;
+		dictionary->blockused = 0;
+		dictionary->textbytes += size;
+	}
+
+	text = dictionary->blocks[dictionary->nblocks - 1] + dictionary->blockused;
+	memcpy(text, value, length);
+	text[length] = 0;
+	dictionary->blockused += length + 1;
+
+	return text;
+}
+
+DICTIONARY *dictionary_new()
+{
+	DICTIONARY *dictionary = (DICTIONARY *)calloc(1, sizeof(DICTIONARY));
+
+	if (!dictionary)
+		exit(1);
+
+	dictionary->slotcount = DICTIONARY_FIRSTSLOTS;
+	dictionary->slots = (uint32_t *)calloc(dictionary->slotcount, sizeof(uint32_t));
+	if (!dictionary->slots)
+		exit(1);
+	dictionary->active = true;
+
+	return dictionary;
+}
+
+void dictionary_delete(DICTIONARY *dictionary)
+{
+	if (!dictionary)
+		return;
+
+	dictionary_seal(dictionary);
+	for (size_t i = 0; i < dictionary->nblocks; i++)
+		free(dictionary->blocks[i]);
+	free(dictionary->blocks);
+	free(dictionary);
+}
+
+const char *dictionary_intern(DICTIONARY *dictionary, const char *value, size_t length)
+{
+	DICTIONARY_ENTRY *entry;
+	uint32_t hash, code;
+	size_t mask, slot;
+
+	if (!dictionary || !dictionary->active || length > UINT32_MAX)
+		return NULL;
+
+	dictionary->values++;
+	hash = hash_value(value, length);
+	mask = dictionary->slotcount - 1;
+	for (slot = hash & mask; dictionary->slots[slot] != 0; slot = (slot + 1) & mask)
+	{
+		entry = &dictionary->entries[dictionary->slots[slot] - 1];
+		if (entry->hash == hash && entry->length == length && memcmp(entry->text, value, length) == 0)
+			return entry->text;
+	}
+
+	// A column of mostly distinct values gains nothing from its dictionary
+	if (dictionary->count >= DICTIONARY_MAXENTRIES ||
+		(dictionary->values <= DICTIONARY_PROBEVALUES && dictionary->count >= DICTIONARY_PROBEVALUES / 2))
+	{
+		dictionary_seal(dictionary);
+		return NULL;
+	}
+
+	if (dictionary->count == dictionary->entryalloc)
+	{
+		dictionary->entryalloc = dictionary->entryalloc ? dictionary->entryalloc * 2 : DICTIONARY_FIRSTSLOTS / 2;
+		dictionary->entries = (DICTIONARY_ENTRY *)grow(dictionary->entries, dictionary->entryalloc * sizeof(DICTIONARY_ENTRY));
+	}
+
+	code = (uint32_t)dictionary->count++;
+	entry = &dictionary->entries[code];
+	entry->text = store_text(dictionary, value, length);
+	entry->length = (uint32_t)length;
+	entry->hash = hash;
+
+	if (dictionary->count * 2 > dictionary->slotcount)
+		grow_slots(dictionary);
+	else
+		dictionary->slots[slot] = code + 1;
+
+	return entry->text;
+}
+
+void dictionary_seal(DICTIONARY *dictionary)
+{
+	if (!dictionary)
+		return;
+
+	free(dictionary->entries);
+	free(dictionary->slots);
+	dictionary->entries = NULL;
+	dictionary->slots = NULL;
+	dictionary->entryalloc = 0;
+	dictionary->slotcount = 0;
+	dictionary->active = false;
+}
+
+size_t dictionary_count(const DICTIONARY *dictionary)
+{
+	return dictionary ? dictionary->count : 0;
+}
+
+bool dictionary_active(const DICTIONARY *dictionary)
+{
+	return dictionary && dictionary->active;
+}
+
+size_t dictionary_bytes(const DICTIONARY *dictionary)
+{
+	if (!dictionary)
+		return 0;
+
+	return sizeof(DICTIONARY) + dictionary->entryalloc * sizeof(DICTIONARY_ENTRY) +
+		   dictionary->slotcount * sizeof(uint32_t) + dictionary->nblocks * sizeof(char *) + dictionary->textbytes;
+}
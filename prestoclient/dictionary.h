@@ -0,0 +1,86 @@
+/**
+ * \file dictionary.h
+ *
+ * \brief repeating values of a varchar column share one copy in the rows of a tablebuffer
+ *
+ * Status, country or category columns repeat a handful of distinct strings over millions of rows.
+ * Every varchar and char column of a PRESTOCLIENT_TABLEBUFFER gets a DICTIONARY: a hash of the
+ * values seen, each distinct value stored once in blocks of text and known by a 32 bit code. The
+ * cell of a row points at the text of its value in the dictionary instead of a malloc'ed copy, so
+ * readers of rowbuff see no difference and a fetch copies straight from the dictionary.
+ *
+ * A column turns out to have too many distinct values once more than half of the first
+ * DICTIONARY_PROBEVALUES values or more than DICTIONARY_MAXENTRIES values in all are distinct. Its
+ * dictionary then stops taking values and the following cells of the column are malloc'ed as
+ * before. Cells already pointing into the dictionary keep their text until the dictionary is
+ * deleted with the tablebuffer.
+ *
+ * A DICTIONARY is not thread safe, it is used by whoever fills its tablebuffer.
+ */
+
+#ifndef EASYPTORA_DICTIONARY_HH
+#define EASYPTORA_DICTIONARY_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define DICTIONARY_MAXENTRIES             65536           //!< Distinct values a dictionary takes at most
+#define DICTIONARY_PROBEVALUES            1024            //!< Values seen before the cardinality of a column is judged
+#define DICTIONARY_BLOCKSIZE              65536           //!< Bytes of a block of text, a longer value gets a block of its own
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create an empty dictionary
+ */
+extern DICTIONARY *dictionary_new();
+
+/**
+ * \brief Free a dictionary and the text of its values
+ *
+ * \param dictionary  The dictionary, may be NULL
+ */
+extern void dictionary_delete(DICTIONARY *dictionary);
+
+/**
+ * \brief The copy of a value in the dictionary, added when it is new
+ *
+ * \param dictionary  The dictionary
+ * \param value       The value, not necessarily terminated
+ * \param length      Bytes of the value
+ *
+ * \return The terminated text of the value in the dictionary, NULL once the column has too many
+ *         distinct values and its cells are to be malloc'ed
+ */
+extern const char *dictionary_intern(DICTIONARY *dictionary, const char *value, size_t length);
+
+/**
+ * \brief Stop taking values, the text stays for the cells pointing into it
+ */
+extern void dictionary_seal(DICTIONARY *dictionary);
+
+/**
+ * \brief Number of distinct values in the dictionary
+ */
+extern size_t dictionary_count(const DICTIONARY *dictionary);
+
+/**
+ * \brief Whether the dictionary still takes values
+ */
+extern bool dictionary_active(const DICTIONARY *dictionary);
+
+/**
+ * \brief Heap bytes of the dictionary, its text included
+ */
+extern size_t dictionary_bytes(const DICTIONARY *dictionary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_DICTIONARY_HH
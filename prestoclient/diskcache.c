@@ -0,0 +1,491 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "diskcache.h"
+#include <stdint.h>
+#include <time.h>
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define DISKCACHE_BYTEORDER   0x01020304		// Files are written in native byte order, this detects foreign files
+#define DISKCACHE_NULLCELL    0xFFFFFFFF		// Cell offset of a cell without data
+#define DISKCACHE_NOSTRING    0xFFFFFFFF		// String length of a missing column attribute
+#define DISKCACHE_ALIGN(x)    (((x) + 7) & ~(uint64_t)7)
+
+/*
+ * File layout, every section starts 8 byte aligned:
+ *
+ * DISKCACHE_HEADER
+ * key + '\0'
+ * ncol x (DISKCACHE_COLUMN + name, catalog, schema, table strings each '\0' terminated)
+ * npage x page block:
+ *     DISKCACHE_PAGE
+ *     uint64_t columnoffset[ncol]      offset of the column sections relative to the page block
+ *     ncol x column section:
+ *         uint32_t celloffset[nrow]    offset of the cell relative to the column section or DISKCACHE_NULLCELL
+ *         cell strings, each '\0' terminated, followed by one extra '\0'
+ */
+typedef struct ST_DISKCACHE_HEADER
+{
+	char						  magic[8];						//!< DISKCACHE_MAGIC
+	uint32_t					  byteorder;					//!< DISKCACHE_BYTEORDER
+	uint32_t					  version;						//!< DISKCACHE_VERSION
+	int64_t						  expires;						//!< Wall clock time in seconds after which the file is stale
+	uint64_t					  nrow;							//!< Total number of rows
+	uint32_t					  ncol;							//!< Number of columns
+	uint32_t					  npage;						//!< Number of page blocks
+	uint32_t					  keylength;					//!< Length of the key following the header
+	uint32_t					  reserved;						//!< Padding, always 0
+	uint64_t					  columnsoffset;				//!< File offset of the first column descriptor
+	uint64_t					  pagesoffset;					//!< File offset of the first page block
+} DISKCACHE_HEADER;
+
+typedef struct ST_DISKCACHE_COLUMN
+{
+	uint32_t					  type;							//!< E_FIELDTYPES
+	uint32_t					  alias;						//!< Column is an alias
+	uint64_t					  bytesize;						//!< Max length of the datatype
+	uint64_t					  precision;					//!< Precision of float / timestamp
+	uint64_t					  scale;						//!< Scale of decimals
+	uint32_t					  length[4];					//!< Lengths of name, catalog, schema, table or DISKCACHE_NOSTRING
+} DISKCACHE_COLUMN;
+
+typedef struct ST_DISKCACHE_PAGE
+{
+	uint64_t					  nrow;							//!< Rows in this page block
+	uint64_t					  blocksize;					//!< Size of the page block including this header
+} DISKCACHE_PAGE;
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+// returnvalue must be freed by caller
+static char *diskcache_path(const char *dir, const char *key)
+{
+	size_t length = strlen(dir);
+	char *path = (char *)malloc(length + 40);
+
+	if (!path)
+		exit(1);
+
+	strcpy(path, dir);
+	if (length > 0 && path[length - 1] != '/' && path[length - 1] != '\\')
+		strcat(path, "/");
+
+	sprintf(path + strlen(path), "%016llx%s", util_hash(key), DISKCACHE_SUFFIX);
+
+	return path;
+}
+
+static bool write_bytes(FILE *file, const void *data, size_t size, uint64_t *pos)
+{
+	if (size > 0 && fwrite(data, 1, size, file) != size)
+		return false;
+
+	*pos += size;
+	return true;
+}
+
+static bool write_padding(FILE *file, uint64_t *pos)
+{
+	static const char zeros[8] = {0};
+
+	return write_bytes(file, zeros, (size_t)(DISKCACHE_ALIGN(*pos) - *pos), pos);
+}
+
+// Size of one column section of a page block
+static uint64_t column_section_size(PRESTOCLIENT_TABLEBUFFER *tab, size_t firstrow, size_t nrow, size_t col)
+{
+	uint64_t size = nrow * sizeof(uint32_t) + 1;
+
+	for (size_t row = firstrow; row < firstrow + nrow; row++)
+	{
+		char *cell = tab->rowbuff[row * tab->ncol + col];
+		if (cell)
+			size += strlen(cell) + 1;
+	}
+
+	return DISKCACHE_ALIGN(size);
+}
+
+static bool write_column(FILE *file, const PRESTOCLIENT_COLUMN *column, uint64_t *pos)
+{
+	DISKCACHE_COLUMN desc;
+	const char *strings[4];
+
+	strings[0] = column->name;
+	strings[1] = column->catalog;
+	strings[2] = column->schema;
+	strings[3] = column->table;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.type = (uint32_t)column->type;
+	desc.alias = column->alias ? 1 : 0;
+	desc.bytesize = column->bytesize;
+	desc.precision = column->precision;
+	desc.scale = column->scale;
+	for (int i = 0; i < 4; i++)
+		desc.length[i] = strings[i] ? (uint32_t)strlen(strings[i]) : DISKCACHE_NOSTRING;
+
+	if (!write_bytes(file, &desc, sizeof(desc), pos))
+		return false;
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (strings[i] && !write_bytes(file, strings[i], strlen(strings[i]) + 1, pos))
+			return false;
+	}
+
+	return write_padding(file, pos);
+}
+
+static bool write_page(FILE *file, PRESTOCLIENT_TABLEBUFFER *tab, size_t firstrow, size_t nrow, uint64_t *pos)
+{
+	DISKCACHE_PAGE page;
+	uint64_t *columnoffset;
+	uint64_t offset, headersize;
+	bool ok = false;
+
+	columnoffset = (uint64_t *)malloc((tab->ncol + 1) * sizeof(uint64_t));
+	if (!columnoffset)
+		exit(1);
+
+	headersize = DISKCACHE_ALIGN(sizeof(DISKCACHE_PAGE) + tab->ncol * sizeof(uint64_t));
+	offset = headersize;
+	for (size_t col = 0; col < tab->ncol; col++)
+	{
+		uint64_t size = column_section_size(tab, firstrow, nrow, col);
+
+		// cell offsets are 32 bit
+		if (size >= DISKCACHE_NULLCELL)
+			goto exit;
+
+		columnoffset[col] = offset;
+		offset += size;
+	}
+
+	page.nrow = nrow;
+	page.blocksize = offset;
+
+	if (!write_bytes(file, &page, sizeof(page), pos) ||
+		!write_bytes(file, columnoffset, tab->ncol * sizeof(uint64_t), pos) ||
+		!write_padding(file, pos))
+		goto exit;
+
+	for (size_t col = 0; col < tab->ncol; col++)
+	{
+		uint32_t cell = (uint32_t)(nrow * sizeof(uint32_t));
+
+		for (size_t row = firstrow; row < firstrow + nrow; row++)
+		{
+			char *data = tab->rowbuff[row * tab->ncol + col];
+			uint32_t celloffset = data ? cell : DISKCACHE_NULLCELL;
+
+			if (!write_bytes(file, &celloffset, sizeof(celloffset), pos))
+				goto exit;
+
+			if (data)
+				cell += (uint32_t)strlen(data) + 1;
+		}
+
+		for (size_t row = firstrow; row < firstrow + nrow; row++)
+		{
+			char *data = tab->rowbuff[row * tab->ncol + col];
+
+			if (data && !write_bytes(file, data, strlen(data) + 1, pos))
+				goto exit;
+		}
+
+		// terminating zero guarantees every cell string ends inside the section
+		if (!write_bytes(file, "", 1, pos) || !write_padding(file, pos))
+			goto exit;
+	}
+
+	ok = true;
+exit:
+	free(columnoffset);
+	return ok;
+}
+
+// Read a '\0' terminated string of known length from the mapping, NULL if missing. Advances offset
+static bool read_string(const char *map, size_t size, uint32_t length, uint64_t *offset, char **value)
+{
+	*value = NULL;
+
+	if (length == DISKCACHE_NOSTRING)
+		return true;
+
+	if (*offset + length + 1 > size || map[*offset + length] != '\0')
+		return false;
+
+	alloc_copy(value, map + *offset);
+	*offset += length + 1;
+	return true;
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+int diskcache_store(const char *dir, const char *key, PRESTOCLIENT_RESULT *result, long long ttl_msec)
+{
+	DISKCACHE_HEADER header;
+	PRESTOCLIENT_TABLEBUFFER *tab;
+	FILE *file = NULL;
+	char *path = NULL, *tmppath = NULL;
+	uint64_t pos = 0;
+	size_t nrow;
+	int rc = PRESTO_BAD_REQUEST;
+
+	if (!dir || !key || !result || ttl_msec <= 0)
+		return PRESTO_BAD_REQUEST;
+
+	if (result->clientstatus != PRESTOCLIENT_STATUS_SUCCEEDED ||
+		result->errorcode != PRESTOCLIENT_RESULT_OK ||
+		(result->lasterrormessage && strlen(result->lasterrormessage) > 0))
+		return PRESTO_BAD_REQUEST;
+
+	tab = result->tablebuff;
+	nrow = tab ? tab->nrow : 0;
+	if (tab && tab->ncol != result->columncount)
+		return PRESTO_BAD_REQUEST;
+
+	path = diskcache_path(dir, key);
+	tmppath = (char *)malloc(strlen(path) + 40);
+	if (!tmppath)
+		exit(1);
+
+	// unique per writer so concurrent stores of the same key don't mix
+	sprintf(tmppath, "%s.%p.%lld.tmp", path, (void *)result, util_now_msec());
+
+	file = fopen(tmppath, "wb");
+	if (!file)
+		goto exit;
+
+	memset(&header, 0, sizeof(header));
+	strcpy(header.magic, DISKCACHE_MAGIC);
+	header.byteorder = DISKCACHE_BYTEORDER;
+	header.version = DISKCACHE_VERSION;
+	header.expires = (int64_t)time(NULL) + (int64_t)(ttl_msec / 1000);
+	header.nrow = nrow;
+	header.ncol = (uint32_t)result->columncount;
+	header.npage = (uint32_t)((nrow + DISKCACHE_PAGEROWS - 1) / DISKCACHE_PAGEROWS);
+	header.keylength = (uint32_t)strlen(key);
+
+	// header is written again once the offsets are known
+	if (!write_bytes(file, &header, sizeof(header), &pos) ||
+		!write_bytes(file, key, strlen(key) + 1, &pos) ||
+		!write_padding(file, &pos))
+		goto exit;
+
+	header.columnsoffset = pos;
+	for (size_t col = 0; col < result->columncount; col++)
+	{
+		if (!write_column(file, result->columns[col], &pos))
+			goto exit;
+	}
+
+	header.pagesoffset = pos;
+	for (size_t firstrow = 0; firstrow < nrow; firstrow += DISKCACHE_PAGEROWS)
+	{
+		size_t pagerows = nrow - firstrow < DISKCACHE_PAGEROWS ? nrow - firstrow : DISKCACHE_PAGEROWS;
+
+		if (!write_page(file, tab, firstrow, pagerows, &pos))
+			goto exit;
+	}
+
+	if (fseek(file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, file) != 1)
+		goto exit;
+
+	if (fclose(file) != 0)
+	{
+		file = NULL;
+		goto exit;
+	}
+	file = NULL;
+
+#ifdef _WIN32
+	// rename doesn't replace an existing file on windows
+	remove(path);
+#endif
+	if (rename(tmppath, path) == 0)
+		rc = PRESTO_OK;
+
+exit:
+	if (file)
+		fclose(file);
+	if (rc != PRESTO_OK)
+		remove(tmppath);
+	free(tmppath);
+	free(path);
+	return rc;
+}
+
+PRESTOCLIENT_RESULT *diskcache_load(const char *dir, const char *key, PRESTOCLIENT *client)
+{
+	const DISKCACHE_HEADER *header;
+	PRESTOCLIENT_RESULT *result = NULL;
+	PRESTOCLIENT_TABLEBUFFER *tab = NULL;
+	PRESTOCLIENT_COLUMN **columns = NULL;
+	const char *map;
+	char *path;
+	size_t size = 0, ncol = 0, row = 0;
+	uint64_t offset;
+	bool drop = true;
+
+	if (!dir || !key || !client)
+		return NULL;
+
+	path = diskcache_path(dir, key);
+	map = (const char *)util_map_file(path, &size);
+	if (!map)
+	{
+		free(path);
+		return NULL;
+	}
+
+	header = (const DISKCACHE_HEADER *)map;
+	if (size < sizeof(DISKCACHE_HEADER) ||
+		memcmp(header->magic, DISKCACHE_MAGIC, sizeof(DISKCACHE_MAGIC)) != 0 ||
+		header->byteorder != DISKCACHE_BYTEORDER ||
+		header->version != DISKCACHE_VERSION ||
+		header->expires <= (int64_t)time(NULL))
+		goto exit;
+
+	// another key with the same hash owns this file, leave it alone
+	if (sizeof(DISKCACHE_HEADER) + header->keylength + 1 > size ||
+		header->keylength != strlen(key) ||
+		memcmp(map + sizeof(DISKCACHE_HEADER), key, header->keylength) != 0)
+	{
+		drop = false;
+		goto exit;
+	}
+
+	// a truncated or foreign file must not size the allocations: every column has a description in the
+	// columns section and every cell an offset in the pages
+	if (header->columnsoffset > header->pagesoffset || header->pagesoffset > size ||
+		header->ncol > (header->pagesoffset - header->columnsoffset) / sizeof(DISKCACHE_COLUMN) ||
+		(header->ncol > 0 && header->nrow > (size - header->pagesoffset) / sizeof(uint32_t) / header->ncol))
+		goto exit;
+
+	ncol = header->ncol;
+	if (ncol > 0)
+	{
+		columns = (PRESTOCLIENT_COLUMN **)calloc(ncol, sizeof(PRESTOCLIENT_COLUMN *));
+		if (!columns)
+			exit(1);
+	}
+
+	offset = header->columnsoffset;
+	for (size_t col = 0; col < ncol; col++)
+	{
+		const DISKCACHE_COLUMN *desc = (const DISKCACHE_COLUMN *)(map + offset);
+		PRESTOCLIENT_COLUMN *column;
+
+		if (offset + sizeof(DISKCACHE_COLUMN) > size)
+			goto exit;
+
+		column = columns[col] = new_prestocolumn();
+		column->type = (enum E_FIELDTYPES)desc->type;
+		column->alias = desc->alias ? true : false;
+		column->bytesize = (size_t)desc->bytesize;
+		column->precision = (size_t)desc->precision;
+		column->scale = (size_t)desc->scale;
+
+		offset += sizeof(DISKCACHE_COLUMN);
+		if (!read_string(map, size, desc->length[0], &offset, &column->name) ||
+			!read_string(map, size, desc->length[1], &offset, &column->catalog) ||
+			!read_string(map, size, desc->length[2], &offset, &column->schema) ||
+			!read_string(map, size, desc->length[3], &offset, &column->table))
+			goto exit;
+
+		offset = DISKCACHE_ALIGN(offset);
+	}
+
+	if (offset != header->pagesoffset || (ncol == 0 && header->nrow > 0))
+		goto exit;
+
+	// Point the row buffer into the mapping, only the pointer array is allocated
+	tab = new_tablebuffer(header->nrow * ncol > 0 ? header->nrow * ncol : 1);
+	tab->ncol = ncol;
+	tab->mapping = (void *)map;
+	tab->mappingsize = size;
+
+	for (uint32_t pageidx = 0; pageidx < header->npage; pageidx++)
+	{
+		const DISKCACHE_PAGE *page = (const DISKCACHE_PAGE *)(map + offset);
+		const uint64_t *columnoffset = (const uint64_t *)(map + offset + sizeof(DISKCACHE_PAGE));
+
+		if (offset + sizeof(DISKCACHE_PAGE) + ncol * sizeof(uint64_t) > size ||
+			page->blocksize > size - offset ||
+			page->nrow > header->nrow - row)
+			goto exit;
+
+		for (size_t col = 0; col < ncol; col++)
+		{
+			uint64_t start = offset + columnoffset[col];
+			uint64_t end = col + 1 < ncol ? offset + columnoffset[col + 1] : offset + page->blocksize;
+			const uint32_t *celloffset = (const uint32_t *)(map + start);
+
+			if (start > end || end > offset + page->blocksize ||
+				start + page->nrow * sizeof(uint32_t) >= end)
+				goto exit;
+
+			// the section ends with a zero padded terminator, see write_page
+			if (map[end - 1] != '\0')
+				goto exit;
+
+			for (size_t r = 0; r < page->nrow; r++)
+			{
+				if (celloffset[r] == DISKCACHE_NULLCELL)
+					tab->rowbuff[(row + r) * ncol + col] = NULL;
+				else if (celloffset[r] < end - start)
+					tab->rowbuff[(row + r) * ncol + col] = (char *)(map + start + celloffset[r]);
+				else
+					goto exit;
+			}
+		}
+
+		row += page->nrow;
+		offset += page->blocksize;
+	}
+
+	if (row != header->nrow)
+		goto exit;
+
+	tab->nrow = row;
+	tab->ndata = row * ncol;
+	result = new_prestoresult_shared(client, columns, ncol, tab);
+	drop = false;
+
+exit:
+	if (columns)
+	{
+		for (size_t col = 0; col < ncol; col++)
+			delete_prestocolumn(columns[col]);
+		free(columns);
+	}
+
+	// the result holds its own reference, releasing the last one unmaps the file
+	if (tab)
+		tablebuffer_release(tab);
+	else
+		util_unmap_file((void *)map, size);
+
+	// expired or damaged
+	if (drop)
+		remove(path);
+
+	free(path);
+	return result;
+}
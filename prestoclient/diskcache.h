@@ -0,0 +1,63 @@
+/**
+ * \file diskcache.h
+ *
+ * \brief persistent cache of finished query results in memory mappable files
+ *
+ * Every result is stored in its own file in a cache directory, the file name is
+ * the hash of the result cache key (see resultcache_makekey). The file starts with
+ * a header holding the full key and the expiry time, followed by the column
+ * descriptors and then the rows in page blocks. Within a page block the cells
+ * are stored column by column as NUL terminated strings with an offset table,
+ * so a loaded result points straight into the mapped file and no cell is copied.
+ *
+ * Files are written to a temporary name and renamed into place, readers never
+ * see a partially written file.
+ */
+
+#ifndef EASYPTORA_DISKCACHE_HH
+#define EASYPTORA_DISKCACHE_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define DISKCACHE_MAGIC                   "PRCACHE"       //!< First 8 bytes of a cache file (including terminating zero)
+#define DISKCACHE_VERSION                 1               //!< File format version, files with another version are ignored
+#define DISKCACHE_PAGEROWS                4096            //!< Maximum number of rows in a page block
+#define DISKCACHE_SUFFIX                  ".prc"          //!< File name suffix of cache files
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Write a finished result to the cache directory
+ *
+ * \param dir       Cache directory, must exist
+ * \param key       Key returned by resultcache_makekey
+ * \param result    Finished result, failed results are not stored
+ * \param ttl_msec  Time to live of the file in milliseconds
+ *
+ * \return PRESTO_OK or PRESTO_BAD_REQUEST when the result could not be stored
+ */
+extern int diskcache_store(const char *dir, const char *key, PRESTOCLIENT_RESULT *result, long long ttl_msec);
+
+/**
+ * \brief Map a cached result
+ *
+ * \param dir     Cache directory
+ * \param key     Key returned by resultcache_makekey
+ * \param client  Client the returned result is attached to
+ *
+ * \return A finished result reading from the mapped file or NULL when there is no valid,
+ *         unexpired file for key. Expired and damaged files are removed.
+ */
+extern PRESTOCLIENT_RESULT *diskcache_load(const char *dir, const char *key, PRESTOCLIENT *client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_DISKCACHE_HH
@@ -0,0 +1,419 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "endpoints.h"
+#include <assert.h>
+#include <ctype.h>
+
+#define ENDPOINTS_WEIGHT 0.2										// Weight of a new sample in the moving averages
+
+struct ST_ENDPOINT
+{
+	ENDPOINTS					 *owner;						//!< Set the coordinator belongs to
+	char						 *baseurl;						//!< protocol://host:port/
+	long						  active;						//!< Queries running on the coordinator
+	double						  latency;						//!< Moving average of the answer time in millisec
+	double						  errorrate;					//!< Moving average of failed requests, between 0 and 1
+	int							  failures;						//!< Consecutive failed requests
+	bool						  healthy;						//!< Gets new queries
+	struct ST_ENDPOINT			 *next;							//!< Next coordinator
+};
+
+struct ST_ENDPOINTS
+{
+	UTIL_MUTEX					  lock;							//!< Protects everything below
+	UTIL_COND					  wake;							//!< Signals the probe thread
+	UTIL_THREAD					  prober;						//!< Probes unhealthy coordinators
+	bool						  probing;						//!< prober was started
+	bool						  stop;							//!< Tells prober to end
+	long long					  probeinterval;				//!< Millisec between two probes
+	size_t						  rotation;						//!< Start of the next search, spreads equally loaded coordinators
+	ENDPOINT					 *endpoints;					//!< All coordinators
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+// Coordinator with the base url, created on first use, caller holds the lock
+static ENDPOINT *find_endpoint(ENDPOINTS *endpoints, const char *baseurl)
+{
+	ENDPOINT *endpoint;
+
+	for (endpoint = endpoints->endpoints; endpoint; endpoint = endpoint->next)
+		if (strcmp(endpoint->baseurl, baseurl) == 0)
+			return endpoint;
+
+	endpoint = (ENDPOINT *)malloc(sizeof(ENDPOINT));
+	if (!endpoint)
+		exit(1);
+
+	endpoint->owner = endpoints;
+	endpoint->baseurl = NULL;
+	alloc_copy(&endpoint->baseurl, baseurl);
+	endpoint->active = 0;
+	endpoint->latency = 0;
+	endpoint->errorrate = 0;
+	endpoint->failures = 0;
+	endpoint->healthy = true;
+	endpoint->next = endpoints->endpoints;
+	endpoints->endpoints = endpoint;
+
+	return endpoint;
+}
+
+// Base url of one entry of a server list, NULL for an empty entry. Returns a malloc'ed string.
+static char *entry_baseurl(const char *entry, size_t length, const char *protocol, unsigned int port)
+{
+	const char *host, *end = entry + length, *colon;
+	size_t protocollength = strlen(protocol), hostlength;
+	char *baseurl;
+
+	while (entry < end && isspace((unsigned char)*entry))
+		entry++;
+	while (end > entry && (isspace((unsigned char)end[-1]) || end[-1] == '/'))
+		end--;
+
+	host = entry;
+	for (const char *p = entry; p + 3 <= end; p++)
+	{
+		if (strncmp(p, "://", 3) == 0)
+		{
+			protocol = entry;
+			protocollength = (size_t)(p - entry);
+			host = p + 3;
+			break;
+		}
+	}
+
+	colon = memchr(host, ':', (size_t)(end - host));
+	if (colon)
+	{
+		port = (unsigned int)strtoul(colon + 1, NULL, 10);
+		hostlength = (size_t)(colon - host);
+	}
+	else
+		hostlength = (size_t)(end - host);
+
+	if (hostlength == 0 || port == 0 || port > 65535)
+		return NULL;
+
+	baseurl = (char *)malloc(protocollength + hostlength + 3 + 1 + 5 + 2);
+	if (!baseurl)
+		exit(1);
+
+	sprintf(baseurl, "%.*s://%.*s:%u/", (int)protocollength, protocol, (int)hostlength, host, port);
+
+	return baseurl;
+}
+
+static size_t discard(char *contents, size_t size, size_t nmemb, void *user_data)
+{
+	(void)contents;
+	(void)user_data;
+
+	return size * nmemb;
+}
+
+// Ask the coordinator for v1/info, true when it answers
+static bool probe(CURL *hcurl, const char *baseurl)
+{
+	char *url = (char *)malloc(strlen(baseurl) + strlen(PRESTOCLIENT_INFO_URL) + 1);
+	long http_code = 0;
+	CURLcode status;
+
+	if (!url)
+		exit(1);
+
+	strcpy(url, baseurl);
+	strcat(url, PRESTOCLIENT_INFO_URL);
+
+	curl_easy_setopt(hcurl, CURLOPT_URL, url);
+	status = curl_easy_perform(hcurl);
+	if (status == CURLE_OK)
+		curl_easy_getinfo(hcurl, CURLINFO_RESPONSE_CODE, &http_code);
+
+	free(url);
+
+	return status == CURLE_OK && http_code == 200;
+}
+
+// Probe thread: every probe interval ask the unhealthy coordinators if they are back
+static void probe_loop(void *arg)
+{
+	ENDPOINTS *endpoints = (ENDPOINTS *)arg;
+	ENDPOINT *endpoint;
+	CURL *hcurl;
+
+	hcurl = curl_easy_init();
+	if (!hcurl)
+		return;
+
+	curl_easy_setopt(hcurl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(hcurl, CURLOPT_CONNECTTIMEOUT_MS, (long)ENDPOINTS_PROBETIMEOUT);
+	curl_easy_setopt(hcurl, CURLOPT_TIMEOUT_MS, (long)ENDPOINTS_PROBETIMEOUT);
+	curl_easy_setopt(hcurl, CURLOPT_WRITEFUNCTION, discard);
+
+	util_mutex_lock(&endpoints->lock);
+
+	while (!endpoints->stop)
+	{
+		util_cond_timedwait(&endpoints->wake, &endpoints->lock, (int)endpoints->probeinterval);
+
+		// Coordinators are only freed after this thread ended, so they can be probed without the lock
+		for (endpoint = endpoints->endpoints; endpoint && !endpoints->stop; endpoint = endpoint->next)
+		{
+			bool alive;
+
+			if (endpoint->healthy)
+				continue;
+
+			util_mutex_unlock(&endpoints->lock);
+			alive = probe(hcurl, endpoint->baseurl);
+			util_mutex_lock(&endpoints->lock);
+
+			if (alive)
+			{
+				endpoint->healthy = true;
+				endpoint->failures = 0;
+				endpoint->errorrate = 0;
+			}
+		}
+	}
+
+	util_mutex_unlock(&endpoints->lock);
+
+	curl_easy_cleanup(hcurl);
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+ENDPOINTS *endpoints_new(long long probeinterval_msec)
+{
+	ENDPOINTS *endpoints = (ENDPOINTS *)malloc(sizeof(ENDPOINTS));
+
+	if (!endpoints)
+		exit(1);
+
+	util_mutex_init(&endpoints->lock);
+	util_cond_init(&endpoints->wake);
+	endpoints->probing = false;
+	endpoints->stop = false;
+	endpoints->probeinterval = probeinterval_msec > 0 ? probeinterval_msec : ENDPOINTS_DEFAULT_PROBEINTERVAL;
+	endpoints->rotation = 0;
+	endpoints->endpoints = NULL;
+
+	return endpoints;
+}
+
+void endpoints_delete(ENDPOINTS *endpoints)
+{
+	if (!endpoints)
+		return;
+
+	util_mutex_lock(&endpoints->lock);
+	endpoints->stop = true;
+	util_cond_broadcast(&endpoints->wake);
+	util_mutex_unlock(&endpoints->lock);
+
+	if (endpoints->probing)
+		util_thread_join(endpoints->prober);
+
+	while (endpoints->endpoints)
+	{
+		ENDPOINT *next = endpoints->endpoints->next;
+
+		free(endpoints->endpoints->baseurl);
+		free(endpoints->endpoints);
+		endpoints->endpoints = next;
+	}
+
+	util_cond_destroy(&endpoints->wake);
+	util_mutex_destroy(&endpoints->lock);
+	free(endpoints);
+}
+
+bool endpoints_islist(const char *server)
+{
+	return server && strchr(server, ENDPOINTS_SEPARATOR) != NULL;
+}
+
+int endpoints_attach(ENDPOINTS *endpoints, PRESTOCLIENT *client)
+{
+	ENDPOINT **candidates = NULL;
+	size_t ncandidates = 0;
+	const char *entry, *end;
+	bool created = endpoints == NULL;
+
+	if (!client || !client->server)
+		return PRESTO_BAD_REQUEST;
+
+	if (created)
+		endpoints = endpoints_new(0);
+
+	util_mutex_lock(&endpoints->lock);
+
+	for (entry = client->server; *entry; entry = *end ? end + 1 : end)
+	{
+		char *baseurl;
+
+		end = strchr(entry, ENDPOINTS_SEPARATOR);
+		if (!end)
+			end = entry + strlen(entry);
+
+		baseurl = entry_baseurl(entry, (size_t)(end - entry), client->protocol ? client->protocol : "http", client->port);
+		if (!baseurl)
+			continue;
+
+		candidates = (ENDPOINT **)realloc(candidates, (ncandidates + 1) * sizeof(ENDPOINT *));
+		if (!candidates)
+			exit(1);
+
+		candidates[ncandidates++] = find_endpoint(endpoints, baseurl);
+		free(baseurl);
+	}
+
+	if (ncandidates > 0 && !endpoints->probing)
+		endpoints->probing = util_thread_start(&endpoints->prober, probe_loop, endpoints) == 0;
+
+	util_mutex_unlock(&endpoints->lock);
+
+	if (ncandidates == 0)
+	{
+		if (created)
+			endpoints_delete(endpoints);
+		return PRESTO_BAD_REQUEST;
+	}
+
+	// The candidates of the previous set point into it, so it goes after they are replaced
+	if (client->ownendpoints && client->endpoints != endpoints)
+		endpoints_delete(client->endpoints);
+
+	free(client->candidates);
+	client->endpoints = endpoints;
+	client->ownendpoints = created;
+	client->candidates = candidates;
+	client->ncandidates = ncandidates;
+
+	return PRESTO_OK;
+}
+
+ENDPOINT *endpoints_choose(PRESTOCLIENT *client, ENDPOINT *avoid)
+{
+	ENDPOINTS *endpoints;
+	ENDPOINT *best = NULL;
+	double bestscore = 0;
+
+	if (!client || !client->endpoints || client->ncandidates == 0)
+		return NULL;
+
+	endpoints = client->endpoints;
+
+	util_mutex_lock(&endpoints->lock);
+
+	// First pass over the healthy coordinators only, second pass over all when none is healthy
+	for (int pass = 0; pass < 2 && !best; pass++)
+	{
+		for (size_t n = 0; n < client->ncandidates; n++)
+		{
+			ENDPOINT *endpoint = client->candidates[(endpoints->rotation + n) % client->ncandidates];
+			double score;
+
+			if (endpoint == avoid && client->ncandidates > 1)
+				continue;
+			if (pass == 0 && !endpoint->healthy)
+				continue;
+
+			score = (endpoint->active + 1) * (endpoint->latency + 1) * (1 + 4 * endpoint->errorrate);
+			if (!best || score < bestscore)
+			{
+				best = endpoint;
+				bestscore = score;
+			}
+		}
+	}
+
+	endpoints->rotation++;
+	if (best)
+		best->active++;
+
+	util_mutex_unlock(&endpoints->lock);
+
+	return best;
+}
+
+void endpoints_release(ENDPOINT *endpoint)
+{
+	if (!endpoint)
+		return;
+
+	util_mutex_lock(&endpoint->owner->lock);
+	if (endpoint->active > 0)
+		endpoint->active--;
+	util_mutex_unlock(&endpoint->owner->lock);
+}
+
+void endpoints_report(ENDPOINT *endpoint, long long latency_msec, bool success)
+{
+	if (!endpoint)
+		return;
+
+	util_mutex_lock(&endpoint->owner->lock);
+
+	if (success && latency_msec >= 0)
+	{
+		if (endpoint->latency == 0)
+			endpoint->latency = (double)latency_msec;
+		else
+			endpoint->latency += ENDPOINTS_WEIGHT * ((double)latency_msec - endpoint->latency);
+	}
+
+	endpoint->errorrate += ENDPOINTS_WEIGHT * ((success ? 0.0 : 1.0) - endpoint->errorrate);
+
+	if (success)
+	{
+		endpoint->failures = 0;
+		endpoint->healthy = true;
+	}
+	else if (++endpoint->failures >= ENDPOINTS_UNHEALTHY && endpoint->healthy)
+	{
+		endpoint->healthy = false;
+	}
+
+	util_mutex_unlock(&endpoint->owner->lock);
+}
+
+const char *endpoints_baseurl(ENDPOINT *endpoint)
+{
+	assert(endpoint);
+
+	return endpoint->baseurl;
+}
+
+size_t endpoints_healthy(PRESTOCLIENT *client)
+{
+	size_t healthy = 0;
+
+	if (!client || !client->endpoints)
+		return 0;
+
+	util_mutex_lock(&client->endpoints->lock);
+	for (size_t n = 0; n < client->ncandidates; n++)
+		if (client->candidates[n]->healthy)
+			healthy++;
+	util_mutex_unlock(&client->endpoints->lock);
+
+	return healthy;
+}
@@ -0,0 +1,115 @@
+/**
+ * \file endpoints.h
+ *
+ * \brief coordinators of a client with load balancing, failover and health probes
+ *
+ * A client created with a comma separated list of servers, for instance
+ * "coord1:8080,coord2:8080,https://gateway:443", sends every new query to the least
+ * loaded healthy coordinator of the list. The load of a coordinator is the number of
+ * queries running on it, weighted with the moving average of its answer time and its
+ * error rate. A query stays on its coordinator: only the first request is routed, all
+ * following requests use the nextUri the coordinator returned.
+ *
+ * A coordinator that fails several requests in a row is marked unhealthy and gets no new
+ * queries. A background thread probes unhealthy coordinators through v1/info and takes
+ * them back once they answer. A query whose first request cannot reach its coordinator
+ * is moved to another one before it is retried.
+ *
+ * The coordinators are kept in an ENDPOINTS object that can be shared by many clients,
+ * so all of them see the same load and health. All functions are thread safe.
+ */
+
+#ifndef EASYPTORA_ENDPOINTS_HH
+#define EASYPTORA_ENDPOINTS_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define ENDPOINTS_DEFAULT_PROBEINTERVAL   5000            //!< Default millisec between two probes of an unhealthy coordinator
+#define ENDPOINTS_PROBETIMEOUT            2000            //!< Millisec a probe may take
+#define ENDPOINTS_UNHEALTHY               3               //!< Consecutive failures that mark a coordinator unhealthy
+#define ENDPOINTS_SEPARATOR               ','             //!< Separator of the coordinators in a server list
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create an empty set of coordinators
+ *
+ * \param probeinterval_msec  Millisec between two probes of an unhealthy coordinator, 0 selects ENDPOINTS_DEFAULT_PROBEINTERVAL
+ *
+ * \return A handle to the set
+ */
+extern ENDPOINTS *endpoints_new(long long probeinterval_msec);
+
+/**
+ * \brief Stop the probes and free the set. All attached clients must be closed first.
+ *
+ * \param endpoints  A handle to the set
+ */
+extern void endpoints_delete(ENDPOINTS *endpoints);
+
+/**
+ * \brief Let a client route its queries over the coordinators in its server list
+ *
+ * Entries of the list are "host", "host:port" or "protocol://host:port", protocol and port
+ * default to the ones of the client. The coordinators are added to the set.
+ *
+ * \param endpoints  A handle to the set, NULL gives the client a set of its own
+ * \param client     The client
+ *
+ * \return PRESTO_OK or PRESTO_BAD_REQUEST when the server list has no coordinator
+ */
+extern int endpoints_attach(ENDPOINTS *endpoints, PRESTOCLIENT *client);
+
+/**
+ * \brief Check if a server name is a list of coordinators
+ */
+extern bool endpoints_islist(const char *server);
+
+/**
+ * \brief Pick the coordinator for a new query and count the query on it
+ *
+ * \param client  A client attached to a set
+ * \param avoid   Coordinator that just failed the query, NULL for none
+ *
+ * \return The least loaded healthy coordinator, the least loaded one if none is healthy,
+ *         NULL when the client is not attached
+ */
+extern ENDPOINT *endpoints_choose(PRESTOCLIENT *client, ENDPOINT *avoid);
+
+/**
+ * \brief The query counted by endpoints_choose has ended
+ *
+ * \param endpoint  Coordinator returned by endpoints_choose, may be NULL
+ */
+extern void endpoints_release(ENDPOINT *endpoint);
+
+/**
+ * \brief Report the outcome of a request to a coordinator
+ *
+ * \param endpoint      Coordinator of the request
+ * \param latency_msec  Time the request took, negative when its answer time says nothing about the coordinator
+ * \param success       false for a failed connection or an error answer
+ */
+extern void endpoints_report(ENDPOINT *endpoint, long long latency_msec, bool success);
+
+/**
+ * \brief Base url of a coordinator, for instance "http://coord1:8080/"
+ */
+extern const char *endpoints_baseurl(ENDPOINT *endpoint);
+
+/**
+ * \brief Number of healthy coordinators in the server list of a client
+ */
+extern size_t endpoints_healthy(PRESTOCLIENT *client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_ENDPOINTS_HH
@@ -0,0 +1,174 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lz4block.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LZ4BLOCK_MINMATCH                 4               // Shortest match the format can express
+#define LZ4BLOCK_LASTLITERALS             5               // The last bytes of a block are always literals
+#define LZ4BLOCK_MFLIMIT                  12              // A match starts at least this many bytes before the end
+#define LZ4BLOCK_MAXOFFSET                65535           // Farthest a match may look back
+#define LZ4BLOCK_HASHBITS                 12              // Entries of the hash of 4 byte sequences as a power of two
+
+static uint32_t read32(const unsigned char *p)
+{
+	uint32_t value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t hash32(uint32_t sequence)
+{
+	return (sequence * 2654435761u) >> (32 - LZ4BLOCK_HASHBITS);
+}
+
+// A length beyond the 15 of its nibble continues in bytes of 255 and a last byte below 255
+static unsigned char *write_length(unsigned char *op, size_t length)
+{
+	for (; length >= 255; length -= 255)
+		*op++ = 255;
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+static unsigned char *write_sequence(unsigned char *op, const unsigned char *literals, size_t nliterals,
+									 size_t offset, size_t matchlength)
+{
+	unsigned char *token = op++;
+
+	*token = (unsigned char)((nliterals >= 15 ? 15 : nliterals) << 4);
+	if (nliterals >= 15)
+		op = write_length(op, nliterals - 15);
+	memcpy(op, literals, nliterals);
+	op += nliterals;
+
+	// the last sequence of a block has literals only
+	if (matchlength == 0)
+		return op;
+
+	*op++ = (unsigned char)(offset & 0xff);
+	*op++ = (unsigned char)(offset >> 8);
+	matchlength -= LZ4BLOCK_MINMATCH;
+	*token |= (unsigned char)(matchlength >= 15 ? 15 : matchlength);
+	if (matchlength >= 15)
+		op = write_length(op, matchlength - 15);
+
+	return op;
+}
+
+size_t lz4block_bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t lz4block_compress(const unsigned char *src, size_t size, unsigned char *dst)
+{
+	uint32_t table[1 << LZ4BLOCK_HASHBITS];
+	unsigned char *op = dst;
+	size_t ip = 0, anchor = 0;
+
+	memset(table, 0, sizeof(table));
+
+	while (size > LZ4BLOCK_MFLIMIT && ip < size - LZ4BLOCK_MFLIMIT)
+	{
+		uint32_t sequence = read32(src + ip);
+		uint32_t slot = hash32(sequence);
+		size_t ref = table[slot], length;
+
+		// positions are kept plus one, 0 is an empty entry
+		table[slot] = (uint32_t)(ip + 1);
+		if (ref == 0 || ip - (ref - 1) > LZ4BLOCK_MAXOFFSET || read32(src + ref - 1) != sequence)
+		{
+			ip++;
+			continue;
+		}
+
+		ref--;
+		length = LZ4BLOCK_MINMATCH;
+		while (ip + length < size - LZ4BLOCK_LASTLITERALS && src[ref + length] == src[ip + length])
+			length++;
+
+		op = write_sequence(op, src + anchor, ip - anchor, ip - ref, length);
+		ip += length;
+		anchor = ip;
+	}
+
+	op = write_sequence(op, src + anchor, size - anchor, 0, 0);
+	return (size_t)(op - dst);
+}
+
+// A length continued in bytes, false when the block ends in the middle of it
+static bool read_length(const unsigned char *src, size_t size, size_t *ip, size_t *length)
+{
+	unsigned char byte;
+
+	do
+	{
+		if (*ip >= size)
+			return false;
+		byte = src[(*ip)++];
+		*length += byte;
+	} while (byte == 255);
+
+	return true;
+}
+
+long lz4block_decompress(const unsigned char *src, size_t size, unsigned char *dst, size_t capacity)
+{
+	size_t ip = 0, op = 0;
+
+	while (ip < size)
+	{
+		unsigned char token = src[ip++];
+		size_t nliterals = token >> 4, offset, matchlength;
+
+		if (nliterals == 15 && !read_length(src, size, &ip, &nliterals))
+			return -1;
+		if (nliterals > size - ip || nliterals > capacity - op)
+			return -1;
+		memcpy(dst + op, src + ip, nliterals);
+		ip += nliterals;
+		op += nliterals;
+
+		// the last sequence ends the block after its literals
+		if (ip == size)
+			break;
+
+		if (size - ip < 2)
+			return -1;
+		offset = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op)
+			return -1;
+
+		matchlength = token & 15;
+		if (matchlength == 15 && !read_length(src, size, &ip, &matchlength))
+			return -1;
+		matchlength += LZ4BLOCK_MINMATCH;
+		if (matchlength > capacity - op)
+			return -1;
+
+		// a match may overlap the bytes it writes, which repeats them
+		for (size_t i = 0; i < matchlength; i++, op++)
+			dst[op] = dst[op - offset];
+	}
+
+	return (long)op;
+}
@@ -0,0 +1,58 @@
+/**
+ * \file lz4block.h
+ *
+ * \brief compression of memory blocks in the LZ4 block format
+ *
+ * A small compressor and decompressor of the LZ4 block format, so a block compressed here is
+ * read by any LZ4 implementation and the other way round. The compressor finds matches of 4 bytes
+ * and more through a hash of the last position of every 4 byte sequence, one probe per position,
+ * which trades some ratio for speed the way the fast mode of LZ4 does. The decompressor checks
+ * every length and offset against the input and the output, a damaged block is refused.
+ *
+ * The functions keep no state and are thread safe.
+ */
+
+#ifndef EASYPTORA_LZ4BLOCK_HH
+#define EASYPTORA_LZ4BLOCK_HH
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Room the compressed form of size bytes may need at most
+ */
+extern size_t lz4block_bound(size_t size);
+
+/**
+ * \brief Compress a block
+ *
+ * \param src       The bytes to compress
+ * \param size      Number of bytes
+ * \param dst       Room for the compressed block, lz4block_bound(size) bytes
+ *
+ * \return Bytes of the compressed block
+ */
+extern size_t lz4block_compress(const unsigned char *src, size_t size, unsigned char *dst);
+
+/**
+ * \brief Decompress a block
+ *
+ * \param src       The compressed block
+ * \param size      Bytes of the compressed block
+ * \param dst       Room for the bytes of the block
+ * \param capacity  Bytes of room in dst
+ *
+ * \return Bytes written to dst or -1 for a damaged block or too little room
+ */
+extern long lz4block_decompress(const unsigned char *src, size_t size, unsigned char *dst, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_LZ4BLOCK_HH
@@ -0,0 +1,597 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "multiplexer.h"
+#include <assert.h>
+
+// Headers or a body chunk of a response waiting for the thread of its query
+typedef struct ST_MULTIPLEXCHUNK
+{
+	struct ST_MULTIPLEXCHUNK	 *next;							//!< Next chunk of the same response
+	bool						  header;						//!< A header line instead of body bytes
+	size_t						  size;							//!< Bytes in data
+	char						  data[1];						//!< The bytes
+} MULTIPLEXCHUNK;
+
+// A request running on the multi handle, lives on the stack of multiplexer_perform
+typedef struct ST_MULTIPLEXSTREAM
+{
+	MULTIPLEXER					 *owner;						//!< Multiplexer performing the request
+	CURL						 *hcurl;						//!< The curl handle of the request
+	UTIL_COND					  arrived;						//!< Signals a chunk or the end of the request
+	MULTIPLEXCHUNK				 *first;						//!< Oldest chunk not yet handed to the callbacks
+	MULTIPLEXCHUNK				 *last;							//!< Chunk queued last
+	size_t						  queued;						//!< Body bytes in the chunks
+	size_t						  window;						//!< Body bytes queued before the stream is paused
+	bool						  paused;						//!< The write callback asked curl to pause the stream
+	bool						  resume;						//!< The query caught up, the thread of the multi handle unpauses the stream
+	bool						  abort;						//!< The query does not want the rest of the response
+	bool						  done;							//!< The request ended, code is set
+	CURLcode					  code;							//!< Result of the transfer
+	long						  httpcode;						//!< Response code seen by the last callback
+	char						  contenttype[128];				//!< Content type of the response, empty when unknown
+	bool						  hasbody;						//!< The first body chunk arrived, contenttype is set
+	int							  connection;					//!< Index of the connection in the metrics, -2 before the first callback, -1 without room
+	struct ST_MULTIPLEXSTREAM	 *next;							//!< Next stream waiting to be added or running
+} MULTIPLEXSTREAM;
+
+// Metrics of a connection and when it was seen first
+typedef struct ST_MULTIPLEXCONN
+{
+	MULTIPLEXER_CONNECTION		  metrics;						//!< The public numbers
+	size_t						  sequence;						//!< Order of creation, 0 for an unused entry
+} MULTIPLEXCONN;
+
+struct ST_MULTIPLEXER
+{
+	UTIL_MUTEX					  lock;							//!< Protects everything below but the running list and the multi handle
+	CURLM						 *multi;						//!< The multi handle, only used by the thread
+	UTIL_THREAD					  thread;						//!< Drives the multi handle
+	bool						  started;						//!< thread runs
+	bool						  stop;							//!< thread ends
+	size_t						  performing;					//!< Calls of multiplexer_perform not yet returned
+	UTIL_COND					  left;							//!< Signals a call of multiplexer_perform returning
+	enum E_MULTIPLEXMODE		  mode;							//!< Mode of new requests
+	size_t						  window;						//!< Window of new streams
+	MULTIPLEXSTREAM				 *incoming;						//!< Requests not yet added to the multi handle
+	MULTIPLEXSTREAM				 *running;						//!< Requests on the multi handle, only used by the thread
+	MULTIPLEXCONN				  connections[MULTIPLEXER_MAXCONNECTIONS];	//!< Metrics of the connections
+	size_t						  sequence;						//!< Connections seen so far
+	MULTIPLEXER_STATS			  stats;						//!< Requests and pauses so far
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+static void wakeup(MULTIPLEXER *multiplexer)
+{
+#if LIBCURL_VERSION_NUM >= 0x074400
+	curl_multi_wakeup(multiplexer->multi);
+#else
+	(void)multiplexer; // the thread polls in short slices instead
+#endif
+}
+
+// Find or add the connection a stream runs on, caller holds the lock
+static int find_connection(MULTIPLEXER *multiplexer, const char *address, long localport)
+{
+	int found = -1;
+
+	for (int i = 0; i < MULTIPLEXER_MAXCONNECTIONS; i++)
+	{
+		MULTIPLEXCONN *conn = &multiplexer->connections[i];
+
+		if (conn->sequence > 0 && conn->metrics.localport == localport && strcmp(conn->metrics.address, address) == 0)
+			return i;
+
+		// an unused entry, else the oldest without running requests
+		if (conn->sequence == 0 && (found < 0 || multiplexer->connections[found].sequence > 0))
+			found = i;
+		else if (conn->metrics.active == 0 && (found < 0 || (multiplexer->connections[found].sequence > 0 &&
+				 conn->sequence < multiplexer->connections[found].sequence)))
+			found = i;
+	}
+
+	if (found < 0)
+		return -1;
+
+	memset(&multiplexer->connections[found], 0, sizeof(MULTIPLEXCONN));
+	snprintf(multiplexer->connections[found].metrics.address, sizeof(multiplexer->connections[found].metrics.address),
+			 "%s", address);
+	multiplexer->connections[found].metrics.localport = localport;
+	multiplexer->connections[found].sequence = ++multiplexer->sequence;
+
+	return found;
+}
+
+// The first callback of a stream tells its connection, called on the thread of the multi handle
+static void note_connection(MULTIPLEXSTREAM *stream)
+{
+	MULTIPLEXER *multiplexer = stream->owner;
+	char address[64];
+	char *ip = NULL;
+	long port = 0, localport = 0, version = 0;
+	int index;
+
+	curl_easy_getinfo(stream->hcurl, CURLINFO_PRIMARY_IP, &ip);
+	curl_easy_getinfo(stream->hcurl, CURLINFO_PRIMARY_PORT, &port);
+	curl_easy_getinfo(stream->hcurl, CURLINFO_LOCAL_PORT, &localport);
+	curl_easy_getinfo(stream->hcurl, CURLINFO_HTTP_VERSION, &version);
+	snprintf(address, sizeof(address), "%s:%ld", ip ? ip : "", port);
+
+	util_mutex_lock(&multiplexer->lock);
+	index = find_connection(multiplexer, address, localport);
+	if (index >= 0)
+	{
+		MULTIPLEXER_CONNECTION *conn = &multiplexer->connections[index].metrics;
+
+		conn->version = version;
+		conn->streams++;
+		conn->active++;
+		if (conn->active > conn->maxactive)
+			conn->maxactive = conn->active;
+	}
+	stream->connection = index;
+	util_mutex_unlock(&multiplexer->lock);
+}
+
+// Queue what arrived for the thread of the query, pause the stream while too much is queued
+static size_t queue_chunk(MULTIPLEXSTREAM *stream, bool header, const char *contents, size_t size)
+{
+	MULTIPLEXER *multiplexer = stream->owner;
+	MULTIPLEXCHUNK *chunk;
+
+	if (stream->connection == -2)
+		note_connection(stream);
+
+	util_mutex_lock(&multiplexer->lock);
+
+	if (stream->abort)
+	{
+		util_mutex_unlock(&multiplexer->lock);
+		return 0;
+	}
+
+	// curl hands the same bytes again once the stream is unpaused
+	if (!header && stream->queued >= stream->window)
+	{
+		if (!stream->paused)
+		{
+			stream->paused = true;
+			multiplexer->stats.pauses++;
+		}
+		util_mutex_unlock(&multiplexer->lock);
+		return CURL_WRITEFUNC_PAUSE;
+	}
+
+	curl_easy_getinfo(stream->hcurl, CURLINFO_RESPONSE_CODE, &stream->httpcode);
+	if (!header && !stream->hasbody)
+	{
+		char *contenttype = NULL;
+
+		curl_easy_getinfo(stream->hcurl, CURLINFO_CONTENT_TYPE, &contenttype);
+		snprintf(stream->contenttype, sizeof(stream->contenttype), "%s", contenttype ? contenttype : "");
+		stream->hasbody = true;
+	}
+
+	chunk = (MULTIPLEXCHUNK *)malloc(sizeof(MULTIPLEXCHUNK) + size);
+	if (!chunk)
+		exit(1);
+	chunk->next = NULL;
+	chunk->header = header;
+	chunk->size = size;
+	memcpy(chunk->data, contents, size);
+
+	if (stream->last)
+		stream->last->next = chunk;
+	else
+		stream->first = chunk;
+	stream->last = chunk;
+	if (!header)
+		stream->queued += size;
+
+	util_cond_broadcast(&stream->arrived);
+	util_mutex_unlock(&multiplexer->lock);
+
+	return size;
+}
+
+static size_t write_callback(char *contents, size_t size, size_t nmemb, void *user_data)
+{
+	return queue_chunk((MULTIPLEXSTREAM *)user_data, false, contents, size * nmemb);
+}
+
+static size_t header_callback(char *contents, size_t size, size_t nmemb, void *user_data)
+{
+	return queue_chunk((MULTIPLEXSTREAM *)user_data, true, contents, size * nmemb);
+}
+
+// Take a stream off the multi handle and wake its query, called on the thread of the multi handle
+static void end_stream(MULTIPLEXER *multiplexer, MULTIPLEXSTREAM *stream, CURLcode code)
+{
+	MULTIPLEXSTREAM **link;
+	long connects = 0;
+	size_t bytes;
+
+	curl_easy_getinfo(stream->hcurl, CURLINFO_NUM_CONNECTS, &connects);
+	bytes = util_download_size(stream->hcurl);
+	curl_multi_remove_handle(multiplexer->multi, stream->hcurl);
+
+	for (link = &multiplexer->running; *link && *link != stream; link = &(*link)->next)
+		;
+	if (*link)
+		*link = stream->next;
+
+	// the stream may be gone as soon as the lock is released
+	util_mutex_lock(&multiplexer->lock);
+	multiplexer->stats.connections += connects > 0 ? (size_t)connects : 0;
+	multiplexer->stats.active--;
+	if (stream->connection >= 0)
+	{
+		MULTIPLEXER_CONNECTION *conn = &multiplexer->connections[stream->connection].metrics;
+
+		conn->active--;
+		conn->bytes += bytes;
+	}
+	stream->code = code;
+	stream->done = true;
+	util_cond_broadcast(&stream->arrived);
+	util_mutex_unlock(&multiplexer->lock);
+}
+
+// Thread of the multi handle: add new requests, unpause and abort streams, move the bytes
+static void run_multiplexer(void *arg)
+{
+	MULTIPLEXER *multiplexer = (MULTIPLEXER *)arg;
+	int running;
+
+	util_mutex_lock(&multiplexer->lock);
+
+	while (!multiplexer->stop)
+	{
+		CURLMsg *msg;
+		int left;
+
+		while (multiplexer->incoming)
+		{
+			MULTIPLEXSTREAM *stream = multiplexer->incoming;
+
+			multiplexer->incoming = stream->next;
+			stream->next = multiplexer->running;
+			multiplexer->running = stream;
+			curl_multi_add_handle(multiplexer->multi, stream->hcurl);
+		}
+		util_mutex_unlock(&multiplexer->lock);
+
+		// unpausing hands the held bytes to the write callback at once, which takes the lock
+		for (MULTIPLEXSTREAM *stream = multiplexer->running, *next; stream; stream = next)
+		{
+			bool abort, resume;
+
+			next = stream->next;
+			util_mutex_lock(&multiplexer->lock);
+			abort = stream->abort;
+			resume = stream->resume;
+			stream->resume = false;
+			util_mutex_unlock(&multiplexer->lock);
+
+			if (abort)
+				end_stream(multiplexer, stream, CURLE_WRITE_ERROR);
+			else if (resume)
+				curl_easy_pause(stream->hcurl, CURLPAUSE_CONT);
+		}
+
+		curl_multi_perform(multiplexer->multi, &running);
+
+		while ((msg = curl_multi_info_read(multiplexer->multi, &left)) != NULL)
+		{
+			MULTIPLEXSTREAM *stream = NULL;
+
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&stream);
+			if (stream)
+				end_stream(multiplexer, stream, msg->data.result);
+		}
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+		curl_multi_poll(multiplexer->multi, NULL, 0, MULTIPLEXER_POLLMSEC, NULL);
+#else
+		curl_multi_wait(multiplexer->multi, NULL, 0, PRESTOCLIENT_CANCELCHECKMSEC, NULL);
+#endif
+
+		util_mutex_lock(&multiplexer->lock);
+	}
+
+	// requests still waiting for the thread would wait forever, they end as aborted
+	while (multiplexer->incoming)
+	{
+		MULTIPLEXSTREAM *stream = multiplexer->incoming;
+
+		multiplexer->incoming = stream->next;
+		multiplexer->stats.active--;
+		stream->code = CURLE_ABORTED_BY_CALLBACK;
+		stream->done = true;
+		util_cond_broadcast(&stream->arrived);
+	}
+	util_mutex_unlock(&multiplexer->lock);
+
+	while (multiplexer->running)
+		end_stream(multiplexer, multiplexer->running, CURLE_ABORTED_BY_CALLBACK);
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+MULTIPLEXER *multiplexer_new(enum E_MULTIPLEXMODE mode)
+{
+	MULTIPLEXER *multiplexer = (MULTIPLEXER *)malloc(sizeof(MULTIPLEXER));
+
+	if (!multiplexer)
+		exit(1);
+
+	memset(multiplexer, 0, sizeof(MULTIPLEXER));
+	util_mutex_init(&multiplexer->lock);
+	util_cond_init(&multiplexer->left);
+	multiplexer->multi = curl_multi_init();
+	if (!multiplexer->multi)
+		exit(1);
+	multiplexer->mode = mode;
+	multiplexer->window = MULTIPLEXER_WINDOW;
+
+	// new requests wait for a connection that may carry them as streams
+	curl_multi_setopt(multiplexer->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+	return multiplexer;
+}
+
+void multiplexer_stop(MULTIPLEXER *multiplexer)
+{
+	bool join;
+
+	if (!multiplexer)
+		return;
+
+	// only the first call waits for the thread
+	util_mutex_lock(&multiplexer->lock);
+	join = multiplexer->started && !multiplexer->stop;
+	multiplexer->stop = true;
+	util_mutex_unlock(&multiplexer->lock);
+
+	if (join)
+	{
+		wakeup(multiplexer);
+		util_thread_join(multiplexer->thread);
+	}
+}
+
+void multiplexer_delete(MULTIPLEXER *multiplexer)
+{
+	if (!multiplexer)
+		return;
+
+	multiplexer_stop(multiplexer);
+
+	// the requests the thread ended still hand their last chunks over under the lock
+	util_mutex_lock(&multiplexer->lock);
+	while (multiplexer->performing > 0)
+		util_cond_wait(&multiplexer->left, &multiplexer->lock);
+	util_mutex_unlock(&multiplexer->lock);
+
+	curl_multi_cleanup(multiplexer->multi);
+	util_cond_destroy(&multiplexer->left);
+	util_mutex_destroy(&multiplexer->lock);
+	free(multiplexer);
+}
+
+void multiplexer_configure(MULTIPLEXER *multiplexer, enum E_MULTIPLEXMODE mode, size_t window)
+{
+	util_mutex_lock(&multiplexer->lock);
+	multiplexer->mode = mode;
+	multiplexer->window = window > 0 ? window : MULTIPLEXER_WINDOW;
+	util_mutex_unlock(&multiplexer->lock);
+}
+
+void multiplexer_attach(MULTIPLEXER *multiplexer, PRESTOCLIENT *client)
+{
+	assert(client);
+
+	client->multiplexer = multiplexer;
+}
+
+bool multiplexer_active(const PRESTOCLIENT *client)
+{
+	MULTIPLEXER *multiplexer = client ? client->multiplexer : NULL;
+	bool active;
+
+	if (!multiplexer)
+		return false;
+
+	util_mutex_lock(&multiplexer->lock);
+	active = multiplexer->mode != MULTIPLEXER_OFF && !multiplexer->stop;
+	util_mutex_unlock(&multiplexer->lock);
+
+	return active;
+}
+
+CURLcode multiplexer_perform(MULTIPLEXER *multiplexer, PRESTOCLIENT_RESULT *result, CURL *hcurl,
+							 curl_write_callback write, curl_write_callback header, void *userdata)
+{
+	MULTIPLEXSTREAM stream;
+	CURLcode code;
+
+	memset(&stream, 0, sizeof(stream));
+	stream.owner = multiplexer;
+	stream.hcurl = hcurl;
+	stream.connection = -2;
+	util_cond_init(&stream.arrived);
+
+	util_mutex_lock(&multiplexer->lock);
+	if (!multiplexer->started && !multiplexer->stop &&
+		util_thread_start(&multiplexer->thread, run_multiplexer, multiplexer) == 0)
+		multiplexer->started = true;
+	if (!multiplexer->started || multiplexer->stop)
+	{
+		util_mutex_unlock(&multiplexer->lock);
+		util_cond_destroy(&stream.arrived);
+		return curl_easy_perform(hcurl);
+	}
+	stream.window = multiplexer->window;
+
+	// the multi handle keeps its own connections, a connection of a shared cache can not carry streams of it
+	curl_easy_setopt(hcurl, CURLOPT_SHARE, NULL);
+	curl_easy_setopt(hcurl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+	curl_easy_setopt(hcurl, CURLOPT_PIPEWAIT, 1L);
+	curl_easy_setopt(hcurl, CURLOPT_WRITEFUNCTION, write_callback);
+	curl_easy_setopt(hcurl, CURLOPT_WRITEDATA, (void *)&stream);
+	curl_easy_setopt(hcurl, CURLOPT_HEADERFUNCTION, header_callback);
+	curl_easy_setopt(hcurl, CURLOPT_HEADERDATA, (void *)&stream);
+	curl_easy_setopt(hcurl, CURLOPT_PRIVATE, (char *)&stream);
+
+	result->multiplexstream = &stream;
+	stream.next = multiplexer->incoming;
+	multiplexer->incoming = &stream;
+	multiplexer->performing++;
+	multiplexer->stats.transfers++;
+	multiplexer->stats.active++;
+	if (multiplexer->stats.active > multiplexer->stats.maxactive)
+		multiplexer->stats.maxactive = multiplexer->stats.active;
+	util_mutex_unlock(&multiplexer->lock);
+	wakeup(multiplexer);
+
+	// hand what arrived to the callbacks of the request, on this thread and in order
+	util_mutex_lock(&multiplexer->lock);
+	for (;;)
+	{
+		MULTIPLEXCHUNK *chunk = stream.first;
+		bool resume = false;
+		size_t handled, size;
+
+		if (!chunk)
+		{
+			if (stream.done)
+				break;
+			util_cond_wait(&stream.arrived, &multiplexer->lock);
+			continue;
+		}
+
+		stream.first = chunk->next;
+		if (!stream.first)
+			stream.last = NULL;
+		if (!chunk->header)
+			stream.queued -= chunk->size;
+		if (stream.paused && stream.queued <= stream.window / 2)
+		{
+			stream.paused = false;
+			stream.resume = resume = true;
+		}
+		util_mutex_unlock(&multiplexer->lock);
+
+		if (resume)
+			wakeup(multiplexer);
+		size = chunk->size;
+		if (chunk->header)
+			handled = header ? header(chunk->data, 1, size, userdata) : size;
+		else
+			handled = write(chunk->data, 1, size, userdata);
+		free(chunk);
+
+		util_mutex_lock(&multiplexer->lock);
+		if (handled != size && !stream.abort && !stream.done)
+		{
+			stream.abort = true;
+			util_mutex_unlock(&multiplexer->lock);
+			wakeup(multiplexer);
+			util_mutex_lock(&multiplexer->lock);
+		}
+	}
+	code = stream.code;
+
+	// bytes of an aborted stream nobody wants any more
+	while (stream.first)
+	{
+		MULTIPLEXCHUNK *chunk = stream.first;
+
+		stream.first = chunk->next;
+		free(chunk);
+	}
+	result->multiplexstream = NULL;
+	multiplexer->performing--;
+	util_cond_broadcast(&multiplexer->left);
+	util_mutex_unlock(&multiplexer->lock);
+	util_cond_destroy(&stream.arrived);
+
+	// the handle may run its next request without the multiplexer
+	curl_easy_setopt(hcurl, CURLOPT_SHARE, result->client->share);
+	curl_easy_setopt(hcurl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_NONE);
+	curl_easy_setopt(hcurl, CURLOPT_PIPEWAIT, 0L);
+	curl_easy_setopt(hcurl, CURLOPT_WRITEFUNCTION, write);
+	curl_easy_setopt(hcurl, CURLOPT_WRITEDATA, userdata);
+	curl_easy_setopt(hcurl, CURLOPT_HEADERFUNCTION, header);
+	curl_easy_setopt(hcurl, CURLOPT_HEADERDATA, userdata);
+	curl_easy_setopt(hcurl, CURLOPT_PRIVATE, (char *)NULL);
+
+	return code;
+}
+
+bool multiplexer_response(PRESTOCLIENT_RESULT *result, long *code, const char **contenttype)
+{
+	MULTIPLEXSTREAM *stream = (MULTIPLEXSTREAM *)result->multiplexstream;
+
+	if (!stream)
+		return false;
+
+	util_mutex_lock(&stream->owner->lock);
+	*code = stream->httpcode;
+	*contenttype = stream->hasbody && stream->contenttype[0] ? stream->contenttype : NULL;
+	util_mutex_unlock(&stream->owner->lock);
+
+	return true;
+}
+
+void multiplexer_stats(MULTIPLEXER *multiplexer, MULTIPLEXER_STATS *stats)
+{
+	util_mutex_lock(&multiplexer->lock);
+	*stats = multiplexer->stats;
+	util_mutex_unlock(&multiplexer->lock);
+}
+
+size_t multiplexer_connections(MULTIPLEXER *multiplexer, MULTIPLEXER_CONNECTION *connections, size_t max)
+{
+	size_t count = 0, below = (size_t)-1;
+
+	util_mutex_lock(&multiplexer->lock);
+	while (count < max)
+	{
+		int newest = -1;
+
+		for (int i = 0; i < MULTIPLEXER_MAXCONNECTIONS; i++)
+		{
+			size_t sequence = multiplexer->connections[i].sequence;
+
+			if (sequence > 0 && sequence < below &&
+				(newest < 0 || sequence > multiplexer->connections[newest].sequence))
+				newest = i;
+		}
+		if (newest < 0)
+			break;
+
+		connections[count++] = multiplexer->connections[newest].metrics;
+		below = multiplexer->connections[newest].sequence;
+	}
+	util_mutex_unlock(&multiplexer->lock);
+
+	return count;
+}
@@ -0,0 +1,169 @@
+/**
+ * \file multiplexer.h
+ *
+ * \brief requests of many statements share multiplexed http/2 connections to a coordinator
+ *
+ * Without a multiplexer every result runs its requests with curl_easy_perform on its own curl
+ * handle, so every open statement holds a connection of its own to the coordinator. With a
+ * MULTIPLEXER attached to a client the requests of all its results are handed to one thread
+ * driving a curl multi handle that asks for http/2. Requests to the same coordinator become
+ * streams of one connection, new requests wait for that connection instead of opening another.
+ * MULTIPLEXER_HTTP2 negotiates http/2 during the tls handshake and keeps http/1.1 for plain
+ * http. There is no http/2 with prior knowledge (h2c): libcurl 7.88 breaks the framing of a
+ * reused h2c connection.
+ *
+ * The thread of the multi handle only queues what arrives. The thread running the query takes
+ * the headers and the body chunks of its response from the queue and hands them to the callbacks
+ * of the request, so parsing stays on the thread of the query and one slow statement does not
+ * hold up the streams of the others. A stream with more than the window of bytes queued is
+ * paused, which stops its flow control window on the connection until the query caught up;
+ * the other streams of the connection keep flowing.
+ *
+ * All functions are thread safe.
+ */
+
+#ifndef EASYPTORA_MULTIPLEXER_HH
+#define EASYPTORA_MULTIPLEXER_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define MULTIPLEXER_WINDOW                1048576         //!< Default bytes a stream may have queued before it is paused
+#define MULTIPLEXER_MAXCONNECTIONS        64              //!< Connections the metrics are kept for, the oldest idle one is dropped
+#define MULTIPLEXER_POLLMSEC              1000            //!< Millisec the thread of the multi handle waits for sockets at most
+
+/* --- Enums ---------------------------------------------------------------------------------------------------------- */
+enum E_MULTIPLEXMODE
+{
+	MULTIPLEXER_OFF = 0,											//!< Every result performs its requests itself
+	MULTIPLEXER_HTTP2												//!< http/2 negotiated over tls, http/1.1 for plain http
+};
+
+/* --- Structs -------------------------------------------------------------------------------------------------------- */
+typedef struct ST_MULTIPLEXER_STATS
+{
+	size_t						  transfers;					//!< Requests performed so far
+	size_t						  active;						//!< Requests running now
+	size_t						  maxactive;					//!< Most requests running at the same time
+	size_t						  connections;					//!< Connections opened so far
+	size_t						  pauses;						//!< Times a stream was paused because its query fell behind
+} MULTIPLEXER_STATS;
+
+typedef struct ST_MULTIPLEXER_CONNECTION
+{
+	char						  address[64];					//!< Address and port of the coordinator
+	long						  localport;					//!< Local port of the connection
+	long						  version;						//!< CURL_HTTP_VERSION_1_1, CURL_HTTP_VERSION_2_0, ...
+	size_t						  streams;						//!< Requests the connection carried so far
+	size_t						  active;						//!< Requests running on it now
+	size_t						  maxactive;					//!< Most requests running on it at the same time
+	size_t						  bytes;						//!< Body bytes received on it
+} MULTIPLEXER_CONNECTION;
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create a multiplexer, its thread starts with the first request
+ *
+ * \param mode  MULTIPLEXER_OFF leaves the attached clients performing their requests themselves
+ *
+ * \return A handle to the multiplexer
+ */
+extern MULTIPLEXER *multiplexer_new(enum E_MULTIPLEXMODE mode);
+
+/**
+ * \brief Stop the thread, the multiplexer stays valid for the clients still attached
+ *
+ * Requests still running or waiting for the thread end with CURLE_ABORTED_BY_CALLBACK, later requests of the
+ * attached clients are performed by the clients themselves. May be called from any thread.
+ *
+ * \param multiplexer  A handle to the multiplexer
+ */
+extern void multiplexer_stop(MULTIPLEXER *multiplexer);
+
+/**
+ * \brief Stop the thread and free the multiplexer. All attached clients must be closed or detached first.
+ *
+ * Stops like multiplexer_stop, the call returns once the multiplexer_perform of every ended request returned.
+ *
+ * \param multiplexer  A handle to the multiplexer
+ */
+extern void multiplexer_delete(MULTIPLEXER *multiplexer);
+
+/**
+ * \brief Change the mode and the window of the streams, requests running keep theirs
+ *
+ * \param multiplexer  A handle to the multiplexer
+ * \param mode         The mode of the following requests
+ * \param window       Bytes a stream may have queued before it is paused, 0 for MULTIPLEXER_WINDOW
+ */
+extern void multiplexer_configure(MULTIPLEXER *multiplexer, enum E_MULTIPLEXMODE mode, size_t window);
+
+/**
+ * \brief Let the multiplexer perform all future requests of a client
+ *
+ * \param multiplexer  A handle to the multiplexer, NULL detaches the client
+ * \param client       The client
+ */
+extern void multiplexer_attach(MULTIPLEXER *multiplexer, PRESTOCLIENT *client);
+
+/**
+ * \brief Whether the requests of a client go through its multiplexer now
+ */
+extern bool multiplexer_active(const PRESTOCLIENT *client);
+
+/**
+ * \brief Perform a request on the multi handle and wait for it, replaces curl_easy_perform
+ *
+ * The write and header callbacks set on hcurl are taken over by the multiplexer while the request
+ * runs and are called on the calling thread with what arrived, in the order it arrived.
+ *
+ * \param multiplexer  A handle to the multiplexer
+ * \param result       The result of the request, its response code and content type are kept for curl_callback
+ * \param hcurl        The curl handle with all options of the request
+ * \param write        The write callback of the request
+ * \param header       The header callback of the request or NULL
+ * \param userdata     The data of both callbacks
+ *
+ * \return The CURLcode of the transfer
+ */
+extern CURLcode multiplexer_perform(MULTIPLEXER *multiplexer, PRESTOCLIENT_RESULT *result, CURL *hcurl,
+									curl_write_callback write, curl_write_callback header, void *userdata);
+
+/**
+ * \brief Response code and content type of the response a result receives through the multiplexer
+ *
+ * \param result       The result
+ * \param code         Out: the http code, 0 when unknown
+ * \param contenttype  Out: the content type or NULL, valid until the request ended
+ *
+ * \return false when the request of the result does not run on a multiplexer
+ */
+extern bool multiplexer_response(PRESTOCLIENT_RESULT *result, long *code, const char **contenttype);
+
+/**
+ * \brief Requests, connections and pauses so far
+ */
+extern void multiplexer_stats(MULTIPLEXER *multiplexer, MULTIPLEXER_STATS *stats);
+
+/**
+ * \brief Metrics of the connections the multiplexer opened, the most recent first
+ *
+ * \param multiplexer  A handle to the multiplexer
+ * \param connections  Out: the connections
+ * \param max          Room in connections
+ *
+ * \return Number of connections written
+ */
+extern size_t multiplexer_connections(MULTIPLEXER *multiplexer, MULTIPLEXER_CONNECTION *connections, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_MULTIPLEXER_HH
@@ -0,0 +1,315 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pagebuffer.h"
+#include <assert.h>
+
+#define PAGEBUFFER_FIRSTROWS              256             // Rows allocated for the first row of a page
+#define PAGEBUFFER_FIRSTTEXT              4096            // Bytes of text allocated per column for the first row of a page
+
+typedef struct ST_PAGECOLUMN
+{
+	enum E_FIELDTYPES			  type;							//!< Type of the column
+	unsigned char				 *validity;						//!< Bit per row, 0 for NULL
+	int64_t						 *int64s;						//!< Values of an integer or boolean column or NULL
+	double						 *doubles;						//!< Values of a real, double or decimal column or NULL
+	int64_t						 *offsets;						//!< Start of the text of every row and end of the last one
+	PRESTOCLIENT_STRING_VIEW	 *views;						//!< Views of the text, set by pagebuffer_finish
+	char						 *text;							//!< Text of all values, one after the other
+	size_t						  textsize;						//!< Bytes used in text
+	size_t						  textalloc;					//!< Bytes allocated for text
+} PAGECOLUMN;
+
+struct ST_PRESTOCLIENT_PAGE
+{
+	PAGECOLUMN					 *columns;						//!< Vectors of the columns
+	size_t						  columncount;					//!< Number of columns, 0 until the first row
+	size_t						  rowcount;						//!< Rows in the vectors
+	size_t						  rowalloc;						//!< Rows allocated in the vectors
+};
+
+static bool is_integer(enum E_FIELDTYPES type)
+{
+	return type == PRESTOCLIENT_TYPE_TINYINT || type == PRESTOCLIENT_TYPE_SMALLINT ||
+		   type == PRESTOCLIENT_TYPE_INTEGER || type == PRESTOCLIENT_TYPE_BIGINT ||
+		   type == PRESTOCLIENT_TYPE_BOOLEAN;
+}
+
+static bool is_floating(enum E_FIELDTYPES type)
+{
+	return type == PRESTOCLIENT_TYPE_REAL || type == PRESTOCLIENT_TYPE_DOUBLE || type == PRESTOCLIENT_TYPE_DECIMAL;
+}
+
+static void *grow(void *ptr, size_t size)
+{
+	ptr = realloc(ptr, size);
+	if (!ptr)
+		exit(1);
+	return ptr;
+}
+
+static void grow_rows(PRESTOCLIENT_PAGE *page)
+{
+	size_t rowalloc = page->rowalloc == 0 ? PAGEBUFFER_FIRSTROWS : page->rowalloc * 2;
+
+	for (size_t i = 0; i < page->columncount; i++)
+	{
+		PAGECOLUMN *col = &page->columns[i];
+
+		col->validity = (unsigned char *)grow(col->validity, (rowalloc + 7) / 8);
+		col->offsets = (int64_t *)grow(col->offsets, (rowalloc + 1) * sizeof(int64_t));
+		col->views = (PRESTOCLIENT_STRING_VIEW *)grow(col->views, rowalloc * sizeof(PRESTOCLIENT_STRING_VIEW));
+		if (is_integer(col->type))
+			col->int64s = (int64_t *)grow(col->int64s, rowalloc * sizeof(int64_t));
+		if (is_floating(col->type))
+			col->doubles = (double *)grow(col->doubles, rowalloc * sizeof(double));
+	}
+
+	page->rowalloc = rowalloc;
+}
+
+PRESTOCLIENT_PAGE *pagebuffer_new()
+{
+	PRESTOCLIENT_PAGE *page = (PRESTOCLIENT_PAGE *)malloc(sizeof(PRESTOCLIENT_PAGE));
+
+	if (!page)
+		exit(1);
+
+	page->columns = NULL;
+	page->columncount = 0;
+	page->rowcount = 0;
+	page->rowalloc = 0;
+
+	return page;
+}
+
+void pagebuffer_delete(PRESTOCLIENT_PAGE *page)
+{
+	if (!page)
+		return;
+
+	for (size_t i = 0; i < page->columncount; i++)
+	{
+		PAGECOLUMN *col = &page->columns[i];
+
+		free(col->validity);
+		free(col->int64s);
+		free(col->doubles);
+		free(col->offsets);
+		free(col->views);
+		free(col->text);
+	}
+	free(page->columns);
+	free(page);
+}
+
+void pagebuffer_addrow(PRESTOCLIENT_PAGE *page, PRESTOCLIENT_COLUMN **columns, size_t columncount)
+{
+	size_t row;
+
+	assert(page);
+
+	// The vectors are typed by the columns of the first row
+	if (page->columncount == 0 && columncount > 0)
+	{
+		page->columns = (PAGECOLUMN *)calloc(columncount, sizeof(PAGECOLUMN));
+		if (!page->columns)
+			exit(1);
+		for (size_t i = 0; i < columncount; i++)
+			page->columns[i].type = columns[i]->type;
+		page->columncount = columncount;
+	}
+
+	if (page->rowcount == page->rowalloc)
+		grow_rows(page);
+
+	row = page->rowcount;
+
+	for (size_t i = 0; i < page->columncount; i++)
+	{
+		PAGECOLUMN *col = &page->columns[i];
+		PRESTOCLIENT_COLUMN *field = i < columncount ? columns[i] : NULL;
+		bool isnull = !field || field->dataisnull || !field->data;
+		size_t size = isnull ? 0 : field->dataactualsize;
+
+		if (row == 0)
+			col->offsets[0] = 0;
+
+		if (isnull)
+			col->validity[row / 8] &= (unsigned char)~(1u << (row % 8));
+		else
+			col->validity[row / 8] |= (unsigned char)(1u << (row % 8));
+
+		if (col->int64s)
+			col->int64s[row] = isnull ? 0 :
+				field->type == PRESTOCLIENT_TYPE_BOOLEAN ? (strcmp(field->data, "true") == 0) : strtoll(field->data, NULL, 10);
+		if (col->doubles)
+			col->doubles[row] = isnull ? 0.0 : strtod(field->data, NULL);
+
+		if (!isnull)
+		{
+			if (col->textsize + size > col->textalloc)
+			{
+				size_t textalloc = col->textalloc == 0 ? PAGEBUFFER_FIRSTTEXT : col->textalloc * 2;
+
+				while (textalloc < col->textsize + size)
+					textalloc *= 2;
+				col->text = (char *)grow(col->text, textalloc);
+				col->textalloc = textalloc;
+			}
+			memcpy(col->text + col->textsize, field->data, size);
+			col->textsize += size;
+		}
+		col->offsets[row + 1] = (int64_t)col->textsize;
+	}
+
+	page->rowcount++;
+}
+
+size_t pagebuffer_rows(const PRESTOCLIENT_PAGE *page)
+{
+	return page ? page->rowcount : 0;
+}
+
+void pagebuffer_limit(PRESTOCLIENT_PAGE *page, size_t rows)
+{
+	if (page && page->rowcount > rows)
+		page->rowcount = rows;
+}
+
+void pagebuffer_finish(PRESTOCLIENT_PAGE *page)
+{
+	assert(page);
+
+	for (size_t i = 0; i < page->columncount; i++)
+	{
+		PAGECOLUMN *col = &page->columns[i];
+
+		for (size_t row = 0; row < page->rowcount; row++)
+		{
+			if ((col->validity[row / 8] & (1u << (row % 8))) == 0)
+			{
+				col->views[row].data = NULL;
+				col->views[row].length = 0;
+			}
+			else
+			{
+				col->views[row].data = col->text ? col->text + col->offsets[row] : "";
+				col->views[row].length = (size_t)(col->offsets[row + 1] - col->offsets[row]);
+			}
+		}
+	}
+}
+
+void pagebuffer_clear(PRESTOCLIENT_PAGE *page)
+{
+	if (!page)
+		return;
+
+	for (size_t i = 0; i < page->columncount; i++)
+		page->columns[i].textsize = 0;
+	page->rowcount = 0;
+}
+
+PRESTOCLIENT_PAGE *pagebuffer_take(PRESTOCLIENT_PAGE *page)
+{
+	PRESTOCLIENT_PAGE *taken = pagebuffer_new();
+
+	assert(page);
+
+	*taken = *page;
+	page->columns = NULL;
+	page->columncount = 0;
+	page->rowcount = 0;
+	page->rowalloc = 0;
+
+	return taken;
+}
+
+size_t pagebuffer_columns(const PRESTOCLIENT_PAGE *page)
+{
+	return page ? page->columncount : 0;
+}
+
+enum E_FIELDTYPES pagebuffer_type(const PRESTOCLIENT_PAGE *page, size_t columnindex)
+{
+	if (!page || columnindex >= page->columncount)
+		return PRESTOCLIENT_TYPE_UNDEFINED;
+
+	return page->columns[columnindex].type;
+}
+
+const int64_t *pagebuffer_offsets(const PRESTOCLIENT_PAGE *page, size_t columnindex)
+{
+	if (!page || columnindex >= page->columncount)
+		return NULL;
+
+	return page->columns[columnindex].offsets;
+}
+
+const char *pagebuffer_text(const PRESTOCLIENT_PAGE *page, size_t columnindex)
+{
+	if (!page || columnindex >= page->columncount)
+		return NULL;
+
+	return page->columns[columnindex].text;
+}
+
+size_t prestoclient_getpagerowcount(const PRESTOCLIENT_PAGE *page)
+{
+	return pagebuffer_rows(page);
+}
+
+const unsigned char *prestoclient_getcolumn_validity(const PRESTOCLIENT_PAGE *page, const size_t columnindex)
+{
+	if (!page || columnindex >= page->columncount)
+		return NULL;
+
+	return page->columns[columnindex].validity;
+}
+
+bool prestoclient_getcolumn_isnull(const PRESTOCLIENT_PAGE *page, const size_t columnindex, const size_t row)
+{
+	if (!page || columnindex >= page->columncount || row >= page->rowcount)
+		return true;
+
+	return (page->columns[columnindex].validity[row / 8] & (1u << (row % 8))) == 0;
+}
+
+const int64_t *prestoclient_getcolumn_int64(const PRESTOCLIENT_PAGE *page, const size_t columnindex)
+{
+	if (!page || columnindex >= page->columncount)
+		return NULL;
+
+	return page->columns[columnindex].int64s;
+}
+
+const double *prestoclient_getcolumn_double(const PRESTOCLIENT_PAGE *page, const size_t columnindex)
+{
+	if (!page || columnindex >= page->columncount)
+		return NULL;
+
+	return page->columns[columnindex].doubles;
+}
+
+const PRESTOCLIENT_STRING_VIEW *prestoclient_getcolumn_string_view(const PRESTOCLIENT_PAGE *page, const size_t columnindex)
+{
+	if (!page || columnindex >= page->columncount)
+		return NULL;
+
+	return page->columns[columnindex].views;
+}
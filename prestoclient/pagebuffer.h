@@ -0,0 +1,106 @@
+/**
+ * \file pagebuffer.h
+ *
+ * \brief the rows of a page are collected as typed column vectors for prestoclient_on_page
+ *
+ * A query with a page callback does not keep its rows in a PRESTOCLIENT_TABLEBUFFER. Every row
+ * the json parser completes is added to the PRESTOCLIENT_PAGE of the result instead: a null
+ * bitmap, the text of every value in one arena per column, and for numeric columns the values
+ * converted once to int64_t or double. Bitmap and text are laid out like an Arrow array of large
+ * utf8 strings: bit i of the bitmap is 0 for a NULL in row i, the text of row i starts at offset i
+ * and ends at offset i + 1 without a terminator. When the page is parsed the whole page is handed
+ * to the callback and the page is cleared, its memory is reused for the next page of the query.
+ *
+ * A page callback inside the library may keep the vectors of the page it is handed with
+ * pagebuffer_take instead of copying them, see arrowexport.h.
+ *
+ * A PRESTOCLIENT_PAGE belongs to the thread parsing or delivering it.
+ */
+
+#ifndef EASYPTORA_PAGEBUFFER_HH
+#define EASYPTORA_PAGEBUFFER_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create an empty page, the columns are taken from the first row added
+ */
+extern PRESTOCLIENT_PAGE *pagebuffer_new();
+
+/**
+ * \brief Free a page and its vectors
+ *
+ * \param page  The page, may be NULL
+ */
+extern void pagebuffer_delete(PRESTOCLIENT_PAGE *page);
+
+/**
+ * \brief Append the current values of the columns as a row
+ *
+ * \param page         The page
+ * \param columns      Columns of the result, their data and dataisnull hold the row
+ * \param columncount  Number of columns
+ */
+extern void pagebuffer_addrow(PRESTOCLIENT_PAGE *page, PRESTOCLIENT_COLUMN **columns, size_t columncount);
+
+/**
+ * \brief Number of rows added since the page was cleared
+ */
+extern size_t pagebuffer_rows(const PRESTOCLIENT_PAGE *page);
+
+/**
+ * \brief Keep only the first rows of the page
+ */
+extern void pagebuffer_limit(PRESTOCLIENT_PAGE *page, size_t rows);
+
+/**
+ * \brief Make the string views point into the text of the page, called before the page is handed out
+ */
+extern void pagebuffer_finish(PRESTOCLIENT_PAGE *page);
+
+/**
+ * \brief Drop the rows of the page and keep its memory for the next page
+ */
+extern void pagebuffer_clear(PRESTOCLIENT_PAGE *page);
+
+/**
+ * \brief Move the rows and vectors of a page to a new page, the page is left empty
+ *
+ * \param page  The page
+ *
+ * \return The new page, to be freed with pagebuffer_delete
+ */
+extern PRESTOCLIENT_PAGE *pagebuffer_take(PRESTOCLIENT_PAGE *page);
+
+/**
+ * \brief Number of columns of the page, 0 before the first row
+ */
+extern size_t pagebuffer_columns(const PRESTOCLIENT_PAGE *page);
+
+/**
+ * \brief Type of a column of the page
+ */
+extern enum E_FIELDTYPES pagebuffer_type(const PRESTOCLIENT_PAGE *page, size_t columnindex);
+
+/**
+ * \brief Offsets of the text of a column, one more than rows
+ */
+extern const int64_t *pagebuffer_offsets(const PRESTOCLIENT_PAGE *page, size_t columnindex);
+
+/**
+ * \brief Text of all values of a column, NULL when no value has text
+ */
+extern const char *pagebuffer_text(const PRESTOCLIENT_PAGE *page, size_t columnindex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_PAGEBUFFER_HH
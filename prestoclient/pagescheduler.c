@@ -0,0 +1,165 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pagescheduler.h"
+#include <assert.h>
+
+struct ST_PAGESCHEDULER
+{
+	UTIL_MUTEX					  lock;							//!< Protects everything below
+	UTIL_COND					  changed;						//!< Signals a finished page request or new limits
+	size_t						  maxinflight[PAGECLASS_COUNT];	//!< Page requests in flight per class, 0 for no limit
+	PAGESCHEDULER_STATS			  stats;						//!< Counts, wait times, requests in flight and waiting
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+// A page request of the class may start now, caller holds the lock
+static bool may_start(PAGESCHEDULER *scheduler, enum E_PAGECLASS pageclass)
+{
+	size_t max = scheduler->maxinflight[pageclass];
+
+	if (max > 0 && scheduler->stats.inflight[pageclass] >= max)
+		return false;
+
+	// Bulk pages step back while an interactive page waits for its turn
+	if (pageclass == PAGECLASS_BULK && scheduler->stats.waiting[PAGECLASS_INTERACTIVE] > 0)
+		return false;
+
+	return true;
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+PAGESCHEDULER *pagescheduler_new(size_t maxbulk, size_t maxinteractive)
+{
+	PAGESCHEDULER *scheduler = (PAGESCHEDULER *)malloc(sizeof(PAGESCHEDULER));
+
+	if (!scheduler)
+		exit(1);
+
+	util_mutex_init(&scheduler->lock);
+	util_cond_init(&scheduler->changed);
+	scheduler->maxinflight[PAGECLASS_BULK] = maxbulk;
+	scheduler->maxinflight[PAGECLASS_INTERACTIVE] = maxinteractive;
+	memset(&scheduler->stats, 0, sizeof(scheduler->stats));
+
+	return scheduler;
+}
+
+void pagescheduler_delete(PAGESCHEDULER *scheduler)
+{
+	if (!scheduler)
+		return;
+
+	util_cond_destroy(&scheduler->changed);
+	util_mutex_destroy(&scheduler->lock);
+	free(scheduler);
+}
+
+void pagescheduler_configure(PAGESCHEDULER *scheduler, size_t maxbulk, size_t maxinteractive)
+{
+	assert(scheduler);
+
+	util_mutex_lock(&scheduler->lock);
+	scheduler->maxinflight[PAGECLASS_BULK] = maxbulk;
+	scheduler->maxinflight[PAGECLASS_INTERACTIVE] = maxinteractive;
+	util_cond_broadcast(&scheduler->changed);
+	util_mutex_unlock(&scheduler->lock);
+}
+
+void pagescheduler_attach(PAGESCHEDULER *scheduler, PRESTOCLIENT *client)
+{
+	if (!client)
+		return;
+
+	client->scheduler = scheduler;
+}
+
+enum E_PAGECLASS pagescheduler_class(int priority)
+{
+	return priority > 0 ? PAGECLASS_INTERACTIVE : PAGECLASS_BULK;
+}
+
+int pagescheduler_enter(PAGESCHEDULER *scheduler, enum E_PAGECLASS pageclass, long long deadline,
+						volatile bool *cancel)
+{
+	long long started;
+	int rc = PRESTO_OK;
+
+	if (!scheduler)
+		return PRESTO_OK;
+
+	util_mutex_lock(&scheduler->lock);
+
+	if (!may_start(scheduler, pageclass))
+	{
+		started = util_now_msec();
+		scheduler->stats.waiting[pageclass]++;
+
+		while (!may_start(scheduler, pageclass))
+		{
+			if (cancel && *cancel)
+				rc = PRESTO_CANCELLED;
+			else if (deadline > 0 && util_now_msec() >= deadline)
+				rc = PRESTO_TIMEOUT;
+			if (rc != PRESTO_OK)
+				break;
+
+			util_cond_timedwait(&scheduler->changed, &scheduler->lock, PAGESCHEDULER_CHECKMSEC);
+		}
+
+		scheduler->stats.waiting[pageclass]--;
+		scheduler->stats.waits[pageclass]++;
+		scheduler->stats.waittime[pageclass] += util_now_msec() - started;
+
+		// Bulk pages held back by this one may go now
+		if (pageclass == PAGECLASS_INTERACTIVE)
+			util_cond_broadcast(&scheduler->changed);
+	}
+
+	if (rc == PRESTO_OK)
+	{
+		scheduler->stats.inflight[pageclass]++;
+		scheduler->stats.pages[pageclass]++;
+	}
+
+	util_mutex_unlock(&scheduler->lock);
+
+	return rc;
+}
+
+void pagescheduler_leave(PAGESCHEDULER *scheduler, enum E_PAGECLASS pageclass)
+{
+	if (!scheduler)
+		return;
+
+	util_mutex_lock(&scheduler->lock);
+	if (scheduler->stats.inflight[pageclass] > 0)
+		scheduler->stats.inflight[pageclass]--;
+	util_cond_broadcast(&scheduler->changed);
+	util_mutex_unlock(&scheduler->lock);
+}
+
+void pagescheduler_stats(PAGESCHEDULER *scheduler, PAGESCHEDULER_STATS *stats)
+{
+	assert(scheduler && stats);
+
+	util_mutex_lock(&scheduler->lock);
+	*stats = scheduler->stats;
+	util_mutex_unlock(&scheduler->lock);
+}
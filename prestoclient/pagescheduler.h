@@ -0,0 +1,114 @@
+/**
+ * \file pagescheduler.h
+ *
+ * \brief page requests of interactive queries go before the ones of bulk extracts
+ *
+ * When a process runs short interactive lookups next to large extracts, the page requests of
+ * the extracts take the bandwidth and the parsing time the lookups need. A PAGESCHEDULER
+ * shared by the clients of a process sorts every page request into a class by the priority
+ * of its query: a positive priority is interactive, zero and below is bulk. Each class has a
+ * limit of page requests in flight. A bulk page also waits while an interactive page waits,
+ * so the interactive queries keep a short tail latency however many extracts run.
+ *
+ * All functions are thread safe.
+ */
+
+#ifndef EASYPTORA_PAGESCHEDULER_HH
+#define EASYPTORA_PAGESCHEDULER_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define PAGESCHEDULER_CHECKMSEC           100             //!< Millisec between two checks of a waiting page for cancel and deadline
+
+/* --- Enums ---------------------------------------------------------------------------------------------------------- */
+enum E_PAGECLASS
+{
+	PAGECLASS_BULK = 0,				  //!< Pages of queries with priority 0 or below
+	PAGECLASS_INTERACTIVE,			  //!< Pages of queries with a positive priority
+	PAGECLASS_COUNT
+};
+
+/* --- Structs -------------------------------------------------------------------------------------------------------- */
+typedef struct ST_PAGESCHEDULER_STATS
+{
+	size_t						  pages[PAGECLASS_COUNT];		//!< Page requests started so far
+	size_t						  waits[PAGECLASS_COUNT];		//!< Page requests that had to wait
+	long long					  waittime[PAGECLASS_COUNT];	//!< Millisec the page requests waited together
+	size_t						  inflight[PAGECLASS_COUNT];	//!< Page requests running now
+	size_t						  waiting[PAGECLASS_COUNT];		//!< Page requests waiting now
+} PAGESCHEDULER_STATS;
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create a page scheduler
+ *
+ * \param maxbulk         Bulk page requests in flight, 0 for no limit
+ * \param maxinteractive  Interactive page requests in flight, 0 for no limit
+ *
+ * \return A handle to the scheduler
+ */
+extern PAGESCHEDULER *pagescheduler_new(size_t maxbulk, size_t maxinteractive);
+
+/**
+ * \brief Free the scheduler. All attached clients must be closed first.
+ *
+ * \param scheduler  A handle to the scheduler
+ */
+extern void pagescheduler_delete(PAGESCHEDULER *scheduler);
+
+/**
+ * \brief Change the limits of the page requests in flight, 0 for no limit
+ */
+extern void pagescheduler_configure(PAGESCHEDULER *scheduler, size_t maxbulk, size_t maxinteractive);
+
+/**
+ * \brief Let the page requests of a client pass the scheduler
+ *
+ * \param scheduler  A handle to the scheduler, NULL lets the client request its pages at once
+ * \param client     The client
+ */
+extern void pagescheduler_attach(PAGESCHEDULER *scheduler, PRESTOCLIENT *client);
+
+/**
+ * \brief Class of a query priority
+ */
+extern enum E_PAGECLASS pagescheduler_class(int priority);
+
+/**
+ * \brief Wait until a page request of the class may start
+ *
+ * \param scheduler  A handle to the scheduler
+ * \param pageclass  Class of the query, see pagescheduler_class
+ * \param deadline   util_now_msec() when the query times out, 0 for no limit
+ * \param cancel     Set by another thread to cancel the query, may be NULL
+ *
+ * \return PRESTO_OK when the request may start, PRESTO_CANCELLED or PRESTO_TIMEOUT when it gave up waiting
+ */
+extern int pagescheduler_enter(PAGESCHEDULER *scheduler, enum E_PAGECLASS pageclass, long long deadline,
+							   volatile bool *cancel);
+
+/**
+ * \brief A page request started by pagescheduler_enter is done
+ */
+extern void pagescheduler_leave(PAGESCHEDULER *scheduler, enum E_PAGECLASS pageclass);
+
+/**
+ * \brief Page counts and wait times so far
+ *
+ * \param scheduler  A handle to the scheduler
+ * \param stats      Out: the numbers
+ */
+extern void pagescheduler_stats(PAGESCHEDULER *scheduler, PAGESCHEDULER_STATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_PAGESCHEDULER_HH
@@ -0,0 +1,237 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pagestore.h"
+#include "lz4block.h"
+
+typedef struct ST_PAGESTORE_PAGE
+{
+	unsigned char				 *packed;						//!< Text of the cells compressed
+	size_t						  packedsize;					//!< Bytes of packed
+	size_t						  textsize;						//!< Bytes of the text, every cell flagged and terminated
+	char						 *text;							//!< Text while the page is decompressed or NULL
+	unsigned long long			  used;							//!< Read clock of the last read of the page
+} PAGESTORE_PAGE;
+
+struct ST_PAGESTORE
+{
+	PAGESTORE_PAGE				 *pages;						//!< Pages taken over, from the first row on
+	size_t						  npages;						//!< Pages used
+	size_t						  pagealloc;					//!< Pages allocated
+	size_t						  hotpages;						//!< Pages kept decompressed at most
+	size_t						  thawed;						//!< Pages decompressed now
+	size_t						  thaws;						//!< Times a page was decompressed
+	size_t						  rawbytes;						//!< Bytes of the text of all pages
+	size_t						  packedbytes;					//!< Bytes of all compressed pages
+	size_t						  textbytes;					//!< Bytes of the pages decompressed now
+	unsigned long long			  clock;						//!< Counts the reads of rows of pages
+};
+
+// Compress the text of the cells of the next page and free them, cells of a dictionary stay. A
+// cell is kept as a byte telling a NULL cell from a value followed by its terminated value
+static void freeze(PRESTOCLIENT_TABLEBUFFER *tab, PAGESTORE *store)
+{
+	size_t first = store->npages * PAGESTORE_PAGEROWS * tab->ncol, last = first + PAGESTORE_PAGEROWS * tab->ncol;
+	size_t size = 0, used = 0;
+	PAGESTORE_PAGE *page;
+	char *text;
+
+	for (size_t cell = first; cell < last; cell++)
+	{
+		if (!tablebuffer_interned(tab, cell))
+			size += (tab->rowbuff[cell] ? strlen(tab->rowbuff[cell]) : 0) + 2;
+	}
+
+	text = (char *)malloc(size > 0 ? size : 1);
+	if (!text)
+		exit(1);
+	for (size_t cell = first; cell < last; cell++)
+	{
+		size_t length;
+
+		if (tablebuffer_interned(tab, cell))
+			continue;
+		length = tab->rowbuff[cell] ? strlen(tab->rowbuff[cell]) : 0;
+		text[used++] = tab->rowbuff[cell] ? 1 : 0;
+		memcpy(text + used, tab->rowbuff[cell] ? tab->rowbuff[cell] : "", length + 1);
+		used += length + 1;
+		free(tab->rowbuff[cell]);
+		tab->rowbuff[cell] = NULL;
+	}
+
+	if (store->npages == store->pagealloc)
+	{
+		store->pagealloc = store->pagealloc ? store->pagealloc * 2 : 16;
+		store->pages = (PAGESTORE_PAGE *)realloc(store->pages, store->pagealloc * sizeof(PAGESTORE_PAGE));
+		if (!store->pages)
+			exit(1);
+	}
+
+	page = &store->pages[store->npages++];
+	page->packed = (unsigned char *)malloc(lz4block_bound(size));
+	if (!page->packed)
+		exit(1);
+	page->packedsize = lz4block_compress((unsigned char *)text, size, page->packed);
+	page->packed = (unsigned char *)realloc(page->packed, page->packedsize);
+	if (!page->packed)
+		exit(1);
+	page->textsize = size;
+	page->text = NULL;
+	page->used = 0;
+	free(text);
+
+	store->rawbytes += size;
+	store->packedbytes += page->packedsize;
+}
+
+// Point the cells of a page at its text, or at nothing when text is NULL
+static void point_cells(PRESTOCLIENT_TABLEBUFFER *tab, size_t index, char *text)
+{
+	size_t first = index * PAGESTORE_PAGEROWS * tab->ncol, last = first + PAGESTORE_PAGEROWS * tab->ncol;
+
+	for (size_t cell = first; cell < last; cell++)
+	{
+		if (tablebuffer_interned(tab, cell))
+			continue;
+		if (!text)
+		{
+			tab->rowbuff[cell] = NULL;
+			continue;
+		}
+		tab->rowbuff[cell] = text[0] ? text + 1 : NULL;
+		text += strlen(text + 1) + 2;
+	}
+}
+
+static void drop(PRESTOCLIENT_TABLEBUFFER *tab, PAGESTORE *store, size_t index)
+{
+	PAGESTORE_PAGE *page = &store->pages[index];
+
+	point_cells(tab, index, NULL);
+	free(page->text);
+	page->text = NULL;
+	store->thawed--;
+	store->textbytes -= page->textsize;
+}
+
+// Decompress a page and drop the least recently read one beyond hotpages
+static bool thaw(PRESTOCLIENT_TABLEBUFFER *tab, PAGESTORE *store, size_t index)
+{
+	PAGESTORE_PAGE *page = &store->pages[index];
+
+	page->text = (char *)malloc(page->textsize > 0 ? page->textsize : 1);
+	if (!page->text)
+		exit(1);
+	if (lz4block_decompress(page->packed, page->packedsize, (unsigned char *)page->text, page->textsize) != (long)page->textsize)
+	{
+		free(page->text);
+		page->text = NULL;
+		return false;
+	}
+
+	point_cells(tab, index, page->text);
+	store->thawed++;
+	store->thaws++;
+	store->textbytes += page->textsize;
+
+	while (store->thawed > store->hotpages)
+	{
+		size_t oldest = store->npages;
+
+		for (size_t i = 0; i < store->npages; i++)
+		{
+			if (i != index && store->pages[i].text && (oldest == store->npages || store->pages[i].used < store->pages[oldest].used))
+				oldest = i;
+		}
+		if (oldest == store->npages)
+			break;
+		drop(tab, store, oldest);
+	}
+
+	return true;
+}
+
+PAGESTORE *pagestore_new(size_t hotpages)
+{
+	PAGESTORE *store = (PAGESTORE *)calloc(1, sizeof(PAGESTORE));
+
+	if (!store)
+		exit(1);
+
+	store->hotpages = hotpages > 0 ? hotpages : 1;
+
+	return store;
+}
+
+void pagestore_delete(PAGESTORE *store)
+{
+	if (!store)
+		return;
+
+	for (size_t i = 0; i < store->npages; i++)
+	{
+		free(store->pages[i].packed);
+		free(store->pages[i].text);
+	}
+	free(store->pages);
+	free(store);
+}
+
+char **pagestore_row(PRESTOCLIENT_TABLEBUFFER *tab, size_t row)
+{
+	PAGESTORE *store = tab->store;
+	size_t index = row / PAGESTORE_PAGEROWS;
+
+	// pages more than hotpages before the cursor are taken over
+	while (store->npages + store->hotpages < index && (store->npages + 1) * PAGESTORE_PAGEROWS <= tab->nrow)
+		freeze(tab, store);
+
+	if (index < store->npages)
+	{
+		store->pages[index].used = ++store->clock;
+		if (!store->pages[index].text && !thaw(tab, store, index))
+			return NULL;
+	}
+
+	return &tab->rowbuff[row * tab->ncol];
+}
+
+size_t pagestore_rows(const PAGESTORE *store)
+{
+	return store ? store->npages * PAGESTORE_PAGEROWS : 0;
+}
+
+size_t pagestore_bytes(const PAGESTORE *store)
+{
+	if (!store)
+		return 0;
+
+	return sizeof(PAGESTORE) + store->pagealloc * sizeof(PAGESTORE_PAGE) + store->packedbytes + store->textbytes;
+}
+
+void pagestore_stats(const PAGESTORE *store, PAGESTORE_STATS *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	if (!store)
+		return;
+
+	stats->pages = store->npages;
+	stats->thawed = store->thawed;
+	stats->thaws = store->thaws;
+	stats->rawbytes = store->rawbytes;
+	stats->packedbytes = store->packedbytes;
+}
@@ -0,0 +1,96 @@
+/**
+ * \file pagestore.h
+ *
+ * \brief rows a cursor left behind are kept compressed in memory
+ *
+ * A static cursor keeps every row of its result in the PRESTOCLIENT_TABLEBUFFER although an
+ * application mostly reads it once from the start and seldom goes back. A PAGESTORE takes over the
+ * rows of a tablebuffer in pages of PAGESTORE_PAGEROWS rows once the cursor is more than hotpages
+ * pages past them. The text of the cells of such a page is compressed in the LZ4 block format
+ * (see lz4block.h) and the cells are freed, cells pointing into a dictionary (see dictionary.h)
+ * keep pointing there. When the cursor goes back to a page, the page is decompressed in one piece
+ * and its cells point into it. At most hotpages pages are decompressed at a time, the least
+ * recently read one is dropped again; its compressed copy stays, so a page is compressed only once.
+ *
+ * Rows are read through prestoclient_getrow. The store sits between keeping every row as it
+ * came and spilling the result to disk (see diskcache.h), pages of text compress 3 to 5 times.
+ *
+ * A tablebuffer shared by several results, e.g. by the result cache, is never given a store. The
+ * store belongs to the thread reading its result.
+ */
+
+#ifndef EASYPTORA_PAGESTORE_HH
+#define EASYPTORA_PAGESTORE_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define PAGESTORE_PAGEROWS                1024            //!< Rows of a page of the store
+#define PAGESTORE_HOTPAGES                4               //!< Default pages kept decompressed behind and around the cursor
+
+/* --- Structs -------------------------------------------------------------------------------------------------------- */
+typedef struct ST_PAGESTORE_STATS
+{
+	size_t						  pages;						//!< Pages taken over from the tablebuffer
+	size_t						  thawed;						//!< Pages decompressed now
+	size_t						  thaws;						//!< Times a page was decompressed
+	size_t						  rawbytes;						//!< Bytes of the text of the pages taken over
+	size_t						  packedbytes;					//!< Bytes of the compressed pages
+} PAGESTORE_STATS;
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create a store for the rows of a tablebuffer
+ *
+ * \param hotpages  Pages kept decompressed, at least 1
+ *
+ * \return A handle to the store
+ */
+extern PAGESTORE *pagestore_new(size_t hotpages);
+
+/**
+ * \brief Free the compressed and decompressed pages of a store, the cells of the tablebuffer are left alone
+ *
+ * \param store  The store, may be NULL
+ */
+extern void pagestore_delete(PAGESTORE *store);
+
+/**
+ * \brief The cells of a row of a tablebuffer with a store
+ *
+ * Pages more than hotpages pages before the row are compressed, the page of the row is
+ * decompressed if needed.
+ *
+ * \param tab  The tablebuffer, tab->store is set
+ * \param row  The row, below tab->nrow
+ *
+ * \return The cells of the row, valid until the next call for the tablebuffer or NULL when a page is damaged
+ */
+extern char **pagestore_row(PRESTOCLIENT_TABLEBUFFER *tab, size_t row);
+
+/**
+ * \brief Rows at the start of the tablebuffer the store took over, their cells belong to the store
+ */
+extern size_t pagestore_rows(const PAGESTORE *store);
+
+/**
+ * \brief Heap bytes of the store, compressed and decompressed pages included
+ */
+extern size_t pagestore_bytes(const PAGESTORE *store);
+
+/**
+ * \brief Pages and bytes of a store
+ */
+extern void pagestore_stats(const PAGESTORE *store, PAGESTORE_STATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_PAGESTORE_HH
@@ -0,0 +1,514 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "parsepool.h"
+#include <assert.h>
+
+#define PARSEPOOL_FIRSTALLOC              65536           // Bytes allocated for the first chunk of a page
+
+typedef struct ST_PARSEPAGE
+{
+	PARSEQUEUE					 *queue;						//!< Query of the page, NULL once its queue was closed
+	char						 *json;							//!< The downloaded page, freed once parsed
+	size_t						  size;							//!< Bytes in json
+	PRESTOCLIENT_COLUMN			**columns;						//!< Copies of the columns known when the page was submitted
+	size_t						  columncount;					//!< Number of columns
+	bool						  paged;						//!< The rows go to a PRESTOCLIENT_PAGE instead of a tablebuffer
+	PRESTOCLIENT_RESULT			 *parsed;						//!< Rows and state of the parsed page
+	bool						  started;						//!< A worker took the page
+	bool						  done;							//!< The worker is done with the page
+	struct ST_PARSEPAGE			 *nextwork;						//!< Next page waiting for a worker
+	struct ST_PARSEPAGE			 *nextpage;						//!< Next page of the same query
+} PARSEPAGE;
+
+struct ST_PARSEQUEUE
+{
+	PARSEPOOL					 *pool;							//!< Pool parsing the pages
+	char						 *raw;							//!< The page downloading now
+	size_t						  rawsize;						//!< Bytes received of it
+	size_t						  rawalloc;						//!< Bytes allocated for it
+	PARSEPAGE					 *first;						//!< Oldest page not yet handed back
+	PARSEPAGE					 *last;							//!< Page submitted last
+	size_t						  pending;						//!< Pages submitted and not yet handed back
+};
+
+struct ST_PARSEPOOL
+{
+	UTIL_MUTEX					  lock;							//!< Protects everything below and the started, done and parsed fields of the pages
+	UTIL_COND					  work;							//!< Signals a page waiting for a worker or the stop of the pool
+	UTIL_COND					  parsed;						//!< Signals a parsed page
+	UTIL_THREAD					  threads[PARSEPOOL_MAXWORKERS];	//!< The workers
+	size_t						  started;						//!< Workers started
+	size_t						  workers;						//!< Workers asked for
+	PARSEPAGE					 *head;							//!< First page waiting for a worker
+	PARSEPAGE					 *tail;							//!< Last page waiting for a worker
+	bool						  stop;							//!< The workers end
+	PARSEPOOL_STATS				  stats;						//!< Pages, bytes and times so far
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+static void free_page(PARSEPAGE *page)
+{
+	free(page->json);
+
+	if (page->columns)
+	{
+		for (size_t i = 0; i < page->columncount; i++)
+			delete_prestocolumn(page->columns[i]);
+		free(page->columns);
+	}
+
+	delete_prestopage(page->parsed);
+	free(page);
+}
+
+// Worker thread: parse the waiting pages until the pool stops
+static void run_worker(void *arg)
+{
+	PARSEPOOL *pool = (PARSEPOOL *)arg;
+	PARSEPAGE *page;
+	PRESTOCLIENT_RESULT *parsed;
+	long long started;
+
+	util_mutex_lock(&pool->lock);
+
+	while (!pool->stop)
+	{
+		page = pool->head;
+		if (!page)
+		{
+			util_cond_wait(&pool->work, &pool->lock);
+			continue;
+		}
+
+		pool->head = page->nextwork;
+		if (!pool->head)
+			pool->tail = NULL;
+		pool->stats.queued--;
+		page->started = true;
+		util_mutex_unlock(&pool->lock);
+
+		// The parsed page takes the columns
+		started = util_now_msec();
+		parsed = parse_prestopage(page->json, page->size, page->columns, page->columncount, page->paged);
+		page->columns = NULL;
+		free(page->json);
+		page->json = NULL;
+
+		util_mutex_lock(&pool->lock);
+		pool->stats.pages++;
+		pool->stats.bytes += page->size;
+		pool->stats.parsetime += util_now_msec() - started;
+		page->parsed = parsed;
+		page->done = true;
+
+		// Nobody waits for the page of a closed queue
+		if (!page->queue)
+			free_page(page);
+		util_cond_broadcast(&pool->parsed);
+	}
+
+	util_mutex_unlock(&pool->lock);
+}
+
+// Skip a json string starting at the quote at pos, return the position of its closing quote or size
+static size_t skip_string(const char *json, size_t size, size_t pos)
+{
+	for (pos++; pos < size && json[pos] != '"'; pos++)
+	{
+		if (json[pos] == '\\')
+			pos++;
+	}
+
+	return pos;
+}
+
+static size_t skip_space(const char *json, size_t size, size_t pos)
+{
+	while (pos < size && (json[pos] == ' ' || json[pos] == '\t' || json[pos] == '\r' || json[pos] == '\n'))
+		pos++;
+
+	return pos;
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+PARSEPOOL *parsepool_new(size_t workers)
+{
+	PARSEPOOL *pool = (PARSEPOOL *)malloc(sizeof(PARSEPOOL));
+
+	if (!pool)
+		exit(1);
+
+	util_mutex_init(&pool->lock);
+	util_cond_init(&pool->work);
+	util_cond_init(&pool->parsed);
+	pool->started = 0;
+	pool->workers = workers > PARSEPOOL_MAXWORKERS ? PARSEPOOL_MAXWORKERS : workers;
+	pool->head = NULL;
+	pool->tail = NULL;
+	pool->stop = false;
+	memset(&pool->stats, 0, sizeof(pool->stats));
+
+	return pool;
+}
+
+void parsepool_delete(PARSEPOOL *pool)
+{
+	if (!pool)
+		return;
+
+	util_mutex_lock(&pool->lock);
+	pool->stop = true;
+	util_cond_broadcast(&pool->work);
+	util_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->started; i++)
+		util_thread_join(pool->threads[i]);
+
+	util_cond_destroy(&pool->parsed);
+	util_cond_destroy(&pool->work);
+	util_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+void parsepool_configure(PARSEPOOL *pool, size_t workers)
+{
+	assert(pool);
+
+	util_mutex_lock(&pool->lock);
+	pool->workers = workers > PARSEPOOL_MAXWORKERS ? PARSEPOOL_MAXWORKERS : workers;
+	util_mutex_unlock(&pool->lock);
+}
+
+void parsepool_attach(PARSEPOOL *pool, PRESTOCLIENT *client)
+{
+	if (!client)
+		return;
+
+	client->parsepool = NULL;
+	if (!pool)
+		return;
+
+	util_mutex_lock(&pool->lock);
+
+	while (pool->started < pool->workers)
+	{
+		if (util_thread_start(&pool->threads[pool->started], run_worker, pool) != 0)
+			break;
+		pool->started++;
+	}
+	pool->stats.workers = pool->started;
+
+	if (pool->started > 0)
+		client->parsepool = pool;
+
+	util_mutex_unlock(&pool->lock);
+}
+
+void parsepool_stats(PARSEPOOL *pool, PARSEPOOL_STATS *stats)
+{
+	assert(pool && stats);
+
+	util_mutex_lock(&pool->lock);
+	*stats = pool->stats;
+	util_mutex_unlock(&pool->lock);
+}
+
+PARSEQUEUE *parsepool_open(PARSEPOOL *pool)
+{
+	PARSEQUEUE *queue = (PARSEQUEUE *)malloc(sizeof(PARSEQUEUE));
+
+	assert(pool);
+	if (!queue)
+		exit(1);
+
+	queue->pool = pool;
+	queue->raw = NULL;
+	queue->rawsize = 0;
+	queue->rawalloc = 0;
+	queue->first = NULL;
+	queue->last = NULL;
+	queue->pending = 0;
+
+	return queue;
+}
+
+void parsepool_close(PARSEQUEUE *queue)
+{
+	PARSEPOOL *pool;
+	PARSEPAGE *page, *next, *prev;
+
+	if (!queue)
+		return;
+
+	pool = queue->pool;
+	util_mutex_lock(&pool->lock);
+
+	for (page = queue->first; page; page = next)
+	{
+		next = page->nextpage;
+
+		if (page->started && !page->done)
+		{
+			// The worker frees it
+			page->queue = NULL;
+			continue;
+		}
+
+		// Still waiting for a worker
+		if (!page->started)
+		{
+			prev = NULL;
+			for (PARSEPAGE *p = pool->head; p != page; p = p->nextwork)
+				prev = p;
+			if (prev)
+				prev->nextwork = page->nextwork;
+			else
+				pool->head = page->nextwork;
+			if (pool->tail == page)
+				pool->tail = prev;
+			pool->stats.queued--;
+		}
+
+		free_page(page);
+	}
+
+	util_mutex_unlock(&pool->lock);
+
+	free(queue->raw);
+	free(queue);
+}
+
+void parsepool_write(PARSEQUEUE *queue, const char *data, size_t size)
+{
+	assert(queue);
+
+	if (queue->rawsize + size > queue->rawalloc)
+	{
+		size_t newalloc = queue->rawalloc > 0 ? queue->rawalloc : PARSEPOOL_FIRSTALLOC;
+
+		while (newalloc < queue->rawsize + size)
+			newalloc *= 2;
+
+		queue->raw = (char *)realloc(queue->raw, newalloc);
+		if (!queue->raw)
+			exit(1);
+		queue->rawalloc = newalloc;
+	}
+
+	memcpy(queue->raw + queue->rawsize, data, size);
+	queue->rawsize += size;
+}
+
+void parsepool_rewind(PARSEQUEUE *queue)
+{
+	assert(queue);
+
+	queue->rawsize = 0;
+}
+
+// The string value after the key ending at end, the value is copied to *value
+static bool copy_value(const char *json, size_t size, size_t end, char **value)
+{
+	size_t start = skip_space(json, size, end + 1);
+
+	if (start >= size || json[start] != ':')
+		return false;
+
+	start = skip_space(json, size, start + 1);
+	if (start >= size || json[start] != '"')
+		return false;
+
+	end = skip_string(json, size, start);
+	if (end >= size)
+		return false;
+
+	*value = (char *)realloc(*value, end - start);
+	if (!*value)
+		exit(1);
+	memcpy(*value, json + start + 1, end - start - 1);
+	(*value)[end - start - 1] = '\0';
+	return true;
+}
+
+size_t parsepool_topvalues(PARSEQUEUE *queue, const char *const *keys, char **const *values, size_t count)
+{
+	const char *json;
+	size_t size, pos, end, length, found = 0;
+	bool done[PARSEPOOL_MAXKEYS] = { false };
+	int depth = 0;
+
+	assert(queue && keys && values && count <= PARSEPOOL_MAXKEYS);
+
+	json = queue->raw;
+	size = queue->rawsize;
+
+	// Only strings and brackets matter, the rows are skipped without being looked at
+	for (pos = 0; pos < size && found < count; pos++)
+	{
+		switch (json[pos])
+		{
+		case '{':
+		case '[':
+			depth++;
+			break;
+		case '}':
+		case ']':
+			depth--;
+			break;
+		case '"':
+			end = skip_string(json, size, pos);
+			if (end >= size)
+				return found;
+
+			length = end - pos - 1;
+			for (size_t k = 0; depth == 1 && k < count; k++)
+			{
+				if (!done[k] && strlen(keys[k]) == length && memcmp(json + pos + 1, keys[k], length) == 0)
+				{
+					if (copy_value(json, size, end, values[k]))
+					{
+						done[k] = true;
+						found++;
+					}
+					break;
+				}
+			}
+			pos = end;
+			break;
+		}
+	}
+
+	return found;
+}
+
+void parsepool_submit(PARSEQUEUE *queue, PRESTOCLIENT_COLUMN **columns, size_t columncount, bool paged)
+{
+	PARSEPOOL *pool;
+	PARSEPAGE *page;
+
+	assert(queue);
+	pool = queue->pool;
+
+	page = (PARSEPAGE *)malloc(sizeof(PARSEPAGE));
+	if (!page)
+		exit(1);
+
+	// The page takes the buffer, the next page gets a new one
+	page->queue = queue;
+	page->json = queue->raw;
+	page->size = queue->rawsize;
+	queue->raw = NULL;
+	queue->rawsize = 0;
+	queue->rawalloc = 0;
+
+	page->columns = NULL;
+	page->columncount = 0;
+	if (columns && columncount > 0)
+	{
+		page->columns = (PRESTOCLIENT_COLUMN **)malloc(columncount * sizeof(PRESTOCLIENT_COLUMN *));
+		if (!page->columns)
+			exit(1);
+		for (size_t i = 0; i < columncount; i++)
+			page->columns[i] = clone_prestocolumn(columns[i]);
+		page->columncount = columncount;
+	}
+
+	page->paged = paged;
+	page->parsed = NULL;
+	page->started = false;
+	page->done = false;
+	page->nextwork = NULL;
+	page->nextpage = NULL;
+
+	if (queue->last)
+		queue->last->nextpage = page;
+	else
+		queue->first = page;
+	queue->last = page;
+	queue->pending++;
+
+	util_mutex_lock(&pool->lock);
+	if (pool->tail)
+		pool->tail->nextwork = page;
+	else
+		pool->head = page;
+	pool->tail = page;
+	pool->stats.queued++;
+	util_cond_broadcast(&pool->work);
+	util_mutex_unlock(&pool->lock);
+}
+
+size_t parsepool_pending(PARSEQUEUE *queue)
+{
+	return queue ? queue->pending : 0;
+}
+
+int parsepool_next(PARSEQUEUE *queue, bool wait, long long deadline, volatile bool *cancel,
+				   PRESTOCLIENT_RESULT **page)
+{
+	PARSEPOOL *pool;
+	PARSEPAGE *first;
+	long long started;
+	int rc = PRESTO_OK;
+
+	assert(queue && page);
+	*page = NULL;
+
+	first = queue->first;
+	if (!first)
+		return PRESTO_OK;
+
+	pool = queue->pool;
+	util_mutex_lock(&pool->lock);
+
+	if (!first->done && wait)
+	{
+		started = util_now_msec();
+
+		while (!first->done)
+		{
+			if (cancel && *cancel)
+				rc = PRESTO_CANCELLED;
+			else if (deadline > 0 && util_now_msec() >= deadline)
+				rc = PRESTO_TIMEOUT;
+			if (rc != PRESTO_OK)
+				break;
+
+			util_cond_timedwait(&pool->parsed, &pool->lock, PARSEPOOL_CHECKMSEC);
+		}
+
+		pool->stats.waits++;
+		pool->stats.waittime += util_now_msec() - started;
+	}
+
+	if (first->done)
+	{
+		*page = first->parsed;
+		queue->first = first->nextpage;
+		if (!queue->first)
+			queue->last = NULL;
+		queue->pending--;
+		free(first);
+	}
+
+	util_mutex_unlock(&pool->lock);
+
+	return rc;
+}
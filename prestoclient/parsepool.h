@@ -0,0 +1,159 @@
+/**
+ * \file parsepool.h
+ *
+ * \brief pages are parsed on a pool of worker threads while the next page downloads
+ *
+ * Without a pool the json of a page is parsed in the curl write callback, on the thread that
+ * downloads it. The next page is only requested once the last one is parsed, and one query
+ * never parses on more than one core. With a PARSEPOOL attached to a client, a page of a
+ * buffered query is kept as raw json while it downloads. The downloading thread only scans the
+ * top level of the page once for its uris, hands the page to a worker and requests the next one.
+ * Each worker parses a whole page with json_parse and presto_json_parser into rows of its own. The
+ * parsed pages are handed back in page order, so the rows keep the order of the server, and at
+ * most PARSEPOOL_MAXPAGES pages of a query are ahead of the one handed back next.
+ *
+ * The rows of a query with a page callback (see prestoclient_on_page) are collected in the
+ * PRESTOCLIENT_PAGE of the parsed page, the page is handed to the callback in page order.
+ * Queries with a write callback of their own still parse on the downloading thread, the
+ * callback sees its rows in the order and on the thread it always did.
+ *
+ * All functions are thread safe, a PARSEQUEUE belongs to the thread running its query.
+ */
+
+#ifndef EASYPTORA_PARSEPOOL_HH
+#define EASYPTORA_PARSEPOOL_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define PARSEPOOL_MAXWORKERS              32              //!< Most worker threads of a pool
+#define PARSEPOOL_MAXPAGES                8               //!< Pages of a query downloaded ahead of the one handed back next
+#define PARSEPOOL_CHECKMSEC               100             //!< Millisec between two checks for cancel and deadline while waiting for a page
+#define PARSEPOOL_MAXKEYS                 8               //!< Most keys looked up in one call of parsepool_topvalues
+
+/* --- Structs -------------------------------------------------------------------------------------------------------- */
+typedef struct ST_PARSEPOOL_STATS
+{
+	size_t						  workers;						//!< Worker threads running
+	size_t						  pages;						//!< Pages parsed so far
+	size_t						  bytes;						//!< Json bytes parsed so far
+	long long					  parsetime;					//!< Millisec the workers spent parsing
+	size_t						  waits;						//!< Times a query waited for its next page to be parsed
+	long long					  waittime;						//!< Millisec the queries waited together
+	size_t						  queued;						//!< Pages waiting for a worker now
+} PARSEPOOL_STATS;
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create a parse pool, the workers start with the first client attached
+ *
+ * \param workers  Number of worker threads, at most PARSEPOOL_MAXWORKERS, 0 keeps parsing on the downloading thread
+ *
+ * \return A handle to the pool
+ */
+extern PARSEPOOL *parsepool_new(size_t workers);
+
+/**
+ * \brief Stop the workers and free the pool. All attached clients must be closed first.
+ *
+ * \param pool  A handle to the pool
+ */
+extern void parsepool_delete(PARSEPOOL *pool);
+
+/**
+ * \brief Change the number of worker threads. Workers already running keep running until the pool is deleted.
+ */
+extern void parsepool_configure(PARSEPOOL *pool, size_t workers);
+
+/**
+ * \brief Let the workers of the pool parse the pages of a client
+ *
+ * \param pool    A handle to the pool, NULL or a pool without workers parses on the downloading thread
+ * \param client  The client
+ */
+extern void parsepool_attach(PARSEPOOL *pool, PRESTOCLIENT *client);
+
+/**
+ * \brief Worker count, pages parsed and wait times so far
+ *
+ * \param pool   A handle to the pool
+ * \param stats  Out: the numbers
+ */
+extern void parsepool_stats(PARSEPOOL *pool, PARSEPOOL_STATS *stats);
+
+/**
+ * \brief Open the page queue of a query
+ */
+extern PARSEQUEUE *parsepool_open(PARSEPOOL *pool);
+
+/**
+ * \brief Drop the pages of a query not yet handed back. Pages a worker is parsing are freed by it.
+ *
+ * \param queue  The page queue, may be NULL
+ */
+extern void parsepool_close(PARSEQUEUE *queue);
+
+/**
+ * \brief Add a chunk of the page that is downloading
+ */
+extern void parsepool_write(PARSEQUEUE *queue, const char *data, size_t size);
+
+/**
+ * \brief Drop what was received of the page that is downloading, it is requested again
+ */
+extern void parsepool_rewind(PARSEQUEUE *queue);
+
+/**
+ * \brief Find the string values of keys of the top level object of the page that is downloading
+ *
+ * The page is scanned once for all keys, the scan ends when every key was found.
+ *
+ * \param queue   The page queue
+ * \param keys    Names of the keys
+ * \param values  In/Out: per key a malloc'ed copy of its value, reallocated when set, left as it is when the key is missing
+ * \param count   Number of keys, at most PARSEPOOL_MAXKEYS
+ *
+ * \return Number of keys found
+ */
+extern size_t parsepool_topvalues(PARSEQUEUE *queue, const char *const *keys, char **const *values, size_t count);
+
+/**
+ * \brief Hand the downloaded page to a worker
+ *
+ * \param queue        The page queue
+ * \param columns      Columns known so far, the page is parsed with copies of them, may be NULL
+ * \param columncount  Number of columns
+ * \param paged        Collect the rows in the PRESTOCLIENT_PAGE of the parsed page, see pagebuffer.h
+ */
+extern void parsepool_submit(PARSEQUEUE *queue, PRESTOCLIENT_COLUMN **columns, size_t columncount, bool paged);
+
+/**
+ * \brief Number of pages submitted and not yet handed back
+ */
+extern size_t parsepool_pending(PARSEQUEUE *queue);
+
+/**
+ * \brief Hand back the oldest page when it is parsed
+ *
+ * \param queue     The page queue
+ * \param wait      Wait until the oldest page is parsed
+ * \param deadline  util_now_msec() when the query times out, 0 for no limit
+ * \param cancel    Set by another thread to cancel the query, may be NULL
+ * \param page      Out: the parsed page, to be freed with delete_prestopage, NULL when no page is ready
+ *
+ * \return PRESTO_OK, PRESTO_CANCELLED or PRESTO_TIMEOUT when it gave up waiting
+ */
+extern int parsepool_next(PARSEQUEUE *queue, bool wait, long long deadline, volatile bool *cancel,
+						  PRESTOCLIENT_RESULT **page);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_PARSEPOOL_HH
@@ -0,0 +1,426 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "partitions.h"
+#include <assert.h>
+#include <ctype.h>
+
+typedef struct ST_PARTITION
+{
+	PARTITIONS					 *owner;						//!< All range queries of the merged result
+	char						 *sql;							//!< The range query
+	UTIL_THREAD					  thread;						//!< Runs the range query
+	bool						  started;						//!< thread was started and not yet joined
+} PARTITION;
+
+struct ST_PARTITIONS
+{
+	UTIL_MUTEX					  lock;							//!< Protects everything below
+	UTIL_COND					  changed;						//!< Signals new rows or an ended range query
+	PRESTOCLIENT				 *client;						//!< Client running the range queries
+	PARTITION					  parts[PARTITIONS_MAX];		//!< The range queries
+	size_t						  count;						//!< Number of range queries
+	size_t						  running;						//!< Range queries not yet ended
+	PRESTOCLIENT_TABLEBUFFER	 *pending;						//!< Rows received but not yet handed to the merged result
+	PRESTOCLIENT_COLUMN			**columns;						//!< Columns of the first range query that knew them
+	size_t						  columncount;					//!< Number of columns
+	int							  rc;							//!< Code of the first range query that failed
+	size_t						  wirebytes;					//!< Bytes received by the range queries that ended
+	size_t						  bodybytes;					//!< The same bytes after decompression
+	volatile bool				  stop;							//!< The merged result needs no more rows
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+// Keep the columns of the first range query that knows them, caller holds the lock
+static void publish_columns(PARTITIONS *partitions, PRESTOCLIENT_RESULT *result)
+{
+	if (partitions->columns || !result || result->columncount == 0)
+		return;
+
+	partitions->columns = (PRESTOCLIENT_COLUMN **)malloc(result->columncount * sizeof(PRESTOCLIENT_COLUMN *));
+	if (!partitions->columns)
+		exit(1);
+
+	for (size_t i = 0; i < result->columncount; i++)
+		partitions->columns[i] = clone_prestocolumn(result->columns[i]);
+	partitions->columncount = result->columncount;
+}
+
+// Write callback of the range queries, called on their threads for every row
+static void receive_row(void *in_userdata, void *in_result)
+{
+	PARTITION *part = (PARTITION *)in_userdata;
+	PARTITIONS *partitions = part->owner;
+	PRESTOCLIENT_RESULT *result = (PRESTOCLIENT_RESULT *)in_result;
+
+	util_mutex_lock(&partitions->lock);
+	publish_columns(partitions, result);
+	tablebuffer_addrow(&partitions->pending, result->columns, result->columncount);
+	util_cond_broadcast(&partitions->changed);
+	util_mutex_unlock(&partitions->lock);
+}
+
+// Thread of a range query: stream it until it ended or the merged result is stopped
+static void run_partition(void *arg)
+{
+	PARTITION *part = (PARTITION *)arg;
+	PARTITIONS *partitions = part->owner;
+	PRESTOCLIENT_RESULT *result = NULL;
+	int rc = PRESTO_OK;
+
+	if (!partitions->stop)
+		rc = prestoclient_querystart(partitions->client, &result, part->sql, receive_row, part);
+
+	// A range without rows still tells the columns
+	util_mutex_lock(&partitions->lock);
+	if (rc == PRESTO_OK)
+		publish_columns(partitions, result);
+	util_mutex_unlock(&partitions->lock);
+
+	while (rc == PRESTO_OK && !partitions->stop && prestoclient_getstatus(result) == PRESTOCLIENT_STATUS_RUNNING)
+		rc = prestoclient_fetchmore(result);
+
+	util_mutex_lock(&partitions->lock);
+	if (result)
+	{
+		partitions->wirebytes += result->wirebytes;
+		partitions->bodybytes += result->bodybytes;
+	}
+	util_mutex_unlock(&partitions->lock);
+
+	if (result)
+		prestoclient_deleteresult(partitions->client, result);
+
+	util_mutex_lock(&partitions->lock);
+	if (rc != PRESTO_OK && !partitions->stop && partitions->rc == PRESTO_OK)
+		partitions->rc = rc;
+	partitions->running--;
+	util_cond_broadcast(&partitions->changed);
+	util_mutex_unlock(&partitions->lock);
+}
+
+// Length of the query without a trailing semicolon and white space
+static size_t query_length(const char *sql)
+{
+	size_t length = strlen(sql);
+
+	while (length > 0 && (isspace((unsigned char)sql[length - 1]) || sql[length - 1] == ';'))
+		length--;
+
+	return length;
+}
+
+// Row callback of find_range, takes both values of the one row when neither is NULL
+static void receive_range(void *in_range, void *in_result)
+{
+	PRESTOCLIENT_RESULT *result = (PRESTOCLIENT_RESULT *)in_result;
+	long long *range = (long long *)in_range;
+
+	if (result->columncount == 2 && !result->columns[0]->dataisnull && !result->columns[1]->dataisnull)
+	{
+		range[0] = strtoll(result->columns[0]->data, NULL, 10);
+		range[1] = strtoll(result->columns[1]->data, NULL, 10);
+	}
+}
+
+// Ask the server for the smallest and largest value of the column, low > high when the query has no rows.
+// The row goes to a callback of its own, so a client delivering pages (see prestoclient_on_page) finds it too
+static int find_range(PRESTOCLIENT *client, const char *sql, const char *column, long long *low, long long *high)
+{
+	PRESTOCLIENT_RESULT *result = NULL;
+	size_t length = query_length(sql);
+	char *query = (char *)malloc(length + 2 * strlen(column) + 64);
+	long long range[2] = { 1, 0 };
+	int rc;
+
+	if (!query)
+		exit(1);
+
+	sprintf(query, "SELECT min(%s), max(%s) FROM (%.*s) partitioned", column, column, (int)length, sql);
+	rc = prestoclient_query(client, &result, query, &receive_range, range);
+	free(query);
+
+	*low = range[0];
+	*high = range[1];
+	if (rc != PRESTO_OK)
+		return rc;
+
+	prestoclient_deleteresult(client, result);
+
+	return PRESTO_OK;
+}
+
+// Range query number n of count over [low, high]
+static char *range_query(const char *sql, const char *column, long long low, long long high, size_t n, size_t count)
+{
+	size_t length = query_length(sql);
+	// a range of hashed keys may span more than LLONG_MAX, so it is measured unsigned
+	unsigned long long width = ((unsigned long long)high - (unsigned long long)low) / count + 1;
+	long long from = (long long)((unsigned long long)low + width * n);
+	long long to = (long long)((unsigned long long)low + width * (n + 1));
+	char *query = (char *)malloc(length + 3 * strlen(column) + 128);
+
+	if (!query)
+		exit(1);
+
+	// The first range also takes the NULLs and everything below, the last one everything above
+	if (n == 0)
+		sprintf(query, "SELECT * FROM (%.*s) partitioned WHERE %s < %lld OR %s IS NULL", (int)length, sql, column, to, column);
+	else if (n + 1 == count)
+		sprintf(query, "SELECT * FROM (%.*s) partitioned WHERE %s >= %lld", (int)length, sql, column, from);
+	else
+		sprintf(query, "SELECT * FROM (%.*s) partitioned WHERE %s >= %lld AND %s < %lld", (int)length, sql,
+				column, from, column, to);
+
+	return query;
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+int partitions_query(PRESTOCLIENT *client, PRESTOCLIENT_RESULT **result, const char *sql, const char *column,
+					 long long low, long long high, size_t parallel, void *in_client_object)
+{
+	PRESTOCLIENT_RESULT *merged;
+	PARTITIONS *partitions;
+	int rc;
+
+	if (!client || !result || !sql || !column || strlen(column) == 0)
+		return PRESTO_BAD_REQUEST;
+
+	*result = NULL;
+
+	if (parallel > PARTITIONS_MAX)
+		parallel = PARTITIONS_MAX;
+
+	if (high < low && parallel > 1)
+	{
+		rc = find_range(client, sql, column, &low, &high);
+		if (rc != PRESTO_OK)
+			return rc;
+	}
+
+	// An empty query or fewer values than ranges
+	if (high < low || parallel == 0)
+		parallel = 1;
+	else if ((unsigned long long)high - (unsigned long long)low < parallel - 1)
+		parallel = (size_t)((unsigned long long)high - (unsigned long long)low) + 1;
+
+	merged = new_prestoresult_shared(client, NULL, 0, NULL);
+	if (!merged)
+		return PRESTO_NO_MEMORY;
+
+	merged->user_data = in_client_object;
+	merged->clientstatus = PRESTOCLIENT_STATUS_RUNNING;
+	alloc_copy(&merged->laststate, "RUNNING");
+	if (client->querytimeout > 0)
+		merged->deadline = util_now_msec() + client->querytimeout;
+
+	partitions = (PARTITIONS *)malloc(sizeof(PARTITIONS));
+	if (!partitions)
+		exit(1);
+
+	util_mutex_init(&partitions->lock);
+	util_cond_init(&partitions->changed);
+	partitions->client = client;
+	partitions->count = parallel;
+	partitions->running = parallel;
+	partitions->pending = NULL;
+	partitions->columns = NULL;
+	partitions->columncount = 0;
+	partitions->rc = PRESTO_OK;
+	partitions->wirebytes = 0;
+	partitions->bodybytes = 0;
+	partitions->stop = false;
+	merged->partitions = partitions;
+
+	for (size_t n = 0; n < parallel; n++)
+	{
+		PARTITION *part = &partitions->parts[n];
+
+		part->owner = partitions;
+		part->sql = NULL;
+		if (parallel == 1)
+			alloc_copy(&part->sql, sql);
+		else
+			part->sql = range_query(sql, column, low, high, n, parallel);
+
+		part->started = util_thread_start(&part->thread, run_partition, part) == 0;
+		if (!part->started)
+		{
+			util_mutex_lock(&partitions->lock);
+			partitions->running--;
+			partitions->rc = PRESTO_NO_MEMORY;
+			util_mutex_unlock(&partitions->lock);
+		}
+	}
+
+	// Like prestoclient_querystart return with the first rows
+	rc = partitions_fetchmore(merged);
+	if (rc != PRESTO_OK)
+	{
+		prestoclient_deleteresult(client, merged);
+		return rc;
+	}
+
+	*result = merged;
+
+	return PRESTO_OK;
+}
+
+int partitions_fetchmore(PRESTOCLIENT_RESULT *result)
+{
+	PARTITIONS *partitions;
+	PRESTOCLIENT_TABLEBUFFER *pending, *tab;
+	int rc = PRESTO_OK;
+	bool done;
+
+	assert(result && result->partitions);
+	partitions = result->partitions;
+
+	if (result->clientstatus != PRESTOCLIENT_STATUS_RUNNING)
+		return PRESTO_OK;
+
+	util_mutex_lock(&partitions->lock);
+
+	while ((!partitions->pending || partitions->pending->nrow == 0) && partitions->running > 0 &&
+		   partitions->rc == PRESTO_OK)
+	{
+		if (result->deadline > 0 && !result->cancelquery && util_now_msec() >= result->deadline)
+		{
+			result->timedout = true;
+			result->cancelquery = true;
+		}
+		if (result->cancelquery)
+			break;
+
+		util_cond_timedwait(&partitions->changed, &partitions->lock, PARTITIONS_CHECKMSEC);
+	}
+
+	if (!result->columns && partitions->columns)
+	{
+		result->columns = partitions->columns;
+		result->columncount = partitions->columncount;
+		partitions->columns = NULL;
+	}
+
+	// Hand over the pointers to the cells, the first batch hands over the whole buffer
+	pending = partitions->pending;
+	if (pending && pending->nrow > 0)
+	{
+		tab = result->tablebuff;
+		if (!tab)
+		{
+			result->tablebuff = pending;
+			partitions->pending = NULL;
+		}
+		else
+			tablebuffer_append(tab, pending);
+		result->rowsreceived = result->tablebuff->nrow;
+	}
+
+	done = partitions->running == 0;
+	if (partitions->rc != PRESTO_OK)
+		rc = partitions->rc;
+
+	util_mutex_unlock(&partitions->lock);
+
+	if (result->cancelquery)
+	{
+		partitions_stop(partitions);
+		result->clientstatus = PRESTOCLIENT_STATUS_FAILED;
+		result->errorcode = result->timedout ? PRESTOCLIENT_RESULT_TIMEOUT : PRESTOCLIENT_RESULT_CANCELLED;
+		return result->timedout ? PRESTO_TIMEOUT : PRESTO_CANCELLED;
+	}
+
+	if (rc != PRESTO_OK)
+	{
+		partitions_stop(partitions);
+		result->clientstatus = PRESTOCLIENT_STATUS_FAILED;
+		return rc;
+	}
+
+	// Enough rows, the range queries still running are not needed
+	if (!done && result->maxrows > 0 && result->rowsreceived >= result->maxrows)
+	{
+		partitions_stop(partitions);
+		done = true;
+	}
+
+	if (done)
+	{
+		result->clientstatus = PRESTOCLIENT_STATUS_SUCCEEDED;
+		alloc_copy(&result->laststate, "FINISHED");
+	}
+
+	return PRESTO_OK;
+}
+
+void partitions_bytes(PARTITIONS *partitions, size_t *wirebytes, size_t *bodybytes)
+{
+	util_mutex_lock(&partitions->lock);
+	*wirebytes += partitions->wirebytes;
+	*bodybytes += partitions->bodybytes;
+	util_mutex_unlock(&partitions->lock);
+}
+
+void partitions_stop(PARTITIONS *partitions)
+{
+	if (!partitions)
+		return;
+
+	util_mutex_lock(&partitions->lock);
+	partitions->stop = true;
+	util_mutex_unlock(&partitions->lock);
+
+	// A range query waiting for its server ends at once
+	for (size_t n = 0; n < partitions->count; n++)
+		prestoclient_cancelqueries(partitions->client, &partitions->parts[n]);
+
+	for (size_t n = 0; n < partitions->count; n++)
+	{
+		if (partitions->parts[n].started)
+		{
+			util_thread_join(partitions->parts[n].thread);
+			partitions->parts[n].started = false;
+		}
+	}
+}
+
+void partitions_delete(PARTITIONS *partitions)
+{
+	if (!partitions)
+		return;
+
+	partitions_stop(partitions);
+
+	for (size_t n = 0; n < partitions->count; n++)
+		free(partitions->parts[n].sql);
+
+	tablebuffer_release(partitions->pending);
+
+	if (partitions->columns)
+	{
+		for (size_t i = 0; i < partitions->columncount; i++)
+			delete_prestocolumn(partitions->columns[i]);
+		free(partitions->columns);
+	}
+
+	util_cond_destroy(&partitions->changed);
+	util_mutex_destroy(&partitions->lock);
+	free(partitions);
+}
@@ -0,0 +1,92 @@
+/**
+ * \file partitions.h
+ *
+ * \brief parallel extraction of one SELECT split into range queries on a partition column
+ *
+ * A single query streams its result through one coordinator connection and one parsing
+ * thread. For a large extract on an otherwise idle cluster partitions_query splits the query
+ * into range restricted copies on an integer column,
+ *
+ *     SELECT * FROM (query) WHERE column >= low_i AND column < high_i
+ *
+ * runs them at the same time on threads of their own and hands their rows to one result. The
+ * first range also takes the rows where the column is NULL, the last range is open ended, so
+ * no row is lost when the table changed since the range was determined.
+ *
+ * The result is streamed like one of prestoclient_querystart: prestoclient_fetchmore hands
+ * over the rows the range queries received so far, in no particular order.
+ * prestoclient_closequery, prestoclient_cancelquery and prestoclient_deleteresult stop all
+ * range queries.
+ */
+
+#ifndef EASYPTORA_PARTITIONS_HH
+#define EASYPTORA_PARTITIONS_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define PARTITIONS_MAX                    64              //!< Most range queries one query is split into
+#define PARTITIONS_CHECKMSEC              100             //!< Millisec between two checks for cancel and deadline while waiting for rows
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Run a SELECT as parallel range queries and stream their rows into one result
+ *
+ * \param client    A handle to a PRESTOCLIENT object
+ * \param result    Out: the merged result, to be freed with prestoclient_deleteresult
+ * \param sql       The SELECT
+ * \param column    Integer column or expression of the SELECT to split on
+ * \param low       Smallest value of the column
+ * \param high      Largest value of the column, less than low lets the client ask the server with min() and max()
+ * \param parallel  Number of range queries, at most PARTITIONS_MAX, 1 runs the query as it is
+ * \param in_client_object  Passed to prestoclient_cancelqueries to cancel the merged result
+ *
+ * \return PRESTO_OK, or the code of the first range query that failed
+ */
+extern int partitions_query(PRESTOCLIENT *client, PRESTOCLIENT_RESULT **result, const char *sql, const char *column,
+							long long low, long long high, size_t parallel, void *in_client_object);
+
+/**
+ * \brief Hand the rows received so far to the merged result, wait for rows when there are none yet.
+ *        Called by prestoclient_fetchmore.
+ *
+ * \param result  The merged result
+ *
+ * \return PRESTO_OK, PRESTO_CANCELLED, PRESTO_TIMEOUT or the code of the first range query that failed
+ */
+extern int partitions_fetchmore(PRESTOCLIENT_RESULT *result);
+
+/**
+ * \brief Add the bytes received by the range queries that ended, see prestoclient_getbytes
+ *
+ * \param partitions  The range queries of a merged result
+ * \param wirebytes   In/Out: body bytes as received
+ * \param bodybytes   In/Out: body bytes after decompression
+ */
+extern void partitions_bytes(PARTITIONS *partitions, size_t *wirebytes, size_t *bodybytes);
+
+/**
+ * \brief Cancel the range queries still running and wait for their threads to end
+ *
+ * \param partitions  The range queries of a merged result, may be NULL
+ */
+extern void partitions_stop(PARTITIONS *partitions);
+
+/**
+ * \brief Stop the range queries and free them. Called when the merged result is deleted.
+ *
+ * \param partitions  The range queries of a merged result, may be NULL
+ */
+extern void partitions_delete(PARTITIONS *partitions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_PARTITIONS_HH
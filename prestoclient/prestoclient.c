@@ -22,12 +22,25 @@
 #include "prestoclient.h"
 #include "prestoclienttypes.h"
 #include "prestojson.h"
+#include "retrypolicy.h"
+#include "endpoints.h"
+#include "admission.h"
+#include "pagescheduler.h"
+#include "partitions.h"
+#include "parsepool.h"
+#include "pagebuffer.h"
+#include "decoder.h"
+#include "segments.h"
+#include "multiplexer.h"
+#include "dictionary.h"
+#include "pagestore.h"
 #include <curl/curl.h>
 #include <assert.h>
 
 // forward declarations
 static void remove_result(PRESTOCLIENT_RESULT *result);
 static void write_callback_buffer(void *in_userdata, void *in_result);
+static void write_callback_page(void *in_userdata, void *in_result);
 
 /* --- Private functions ---------------------------------------------------------------------------------------------- */
 
@@ -107,6 +120,10 @@ PRESTOCLIENT_COLUMN *new_prestocolumn()
 	field->schema = NULL;
 	field->table = NULL;
 	field->type = PRESTOCLIENT_TYPE_UNDEFINED;
+	field->bytesize = 0;
+	field->precision = 0;
+	field->scale = 0;
+	field->alias = false;
 	field->databuffersize = 1024 * sizeof(char);	
 	field->dataactualsize = 0;
 	field->data = (char *)malloc(sizeof(char) * (field->databuffersize + 1) );
@@ -118,7 +135,7 @@ PRESTOCLIENT_COLUMN *new_prestocolumn()
 	return field;
 }
 
-static void delete_prestocolumn(PRESTOCLIENT_COLUMN *field)
+void delete_prestocolumn(PRESTOCLIENT_COLUMN *field)
 {
 	if (!field)
 		return;
@@ -141,15 +158,48 @@ static void delete_prestocolumn(PRESTOCLIENT_COLUMN *field)
 	free(field);
 }
 
+// Deep copy of a column description, the data buffer is allocated but not copied
+PRESTOCLIENT_COLUMN *clone_prestocolumn(PRESTOCLIENT_COLUMN *field)
+{
+	PRESTOCLIENT_COLUMN *copy = new_prestocolumn();
+
+	if (field->name)
+		alloc_copy(&copy->name, field->name);
+	if (field->catalog)
+		alloc_copy(&copy->catalog, field->catalog);
+	if (field->schema)
+		alloc_copy(&copy->schema, field->schema);
+	if (field->table)
+		alloc_copy(&copy->table, field->table);
+
+	copy->type = field->type;
+	copy->bytesize = field->bytesize;
+	copy->precision = field->precision;
+	copy->scale = field->scale;
+	copy->alias = field->alias;
+
+	return copy;
+}
+
 PRESTOCLIENT_TABLEBUFFER *new_tablebuffer(size_t initialsize)
 {
 	PRESTOCLIENT_TABLEBUFFER *tab = (PRESTOCLIENT_TABLEBUFFER *)malloc(sizeof(PRESTOCLIENT_TABLEBUFFER));
+
+	if (!tab)
+		exit(1);
+
 	tab->nalloc = initialsize;
 	tab->rowbuff = (char **)malloc(tab->nalloc * sizeof(char*));
 	tab->nrow = 0;
 	tab->ncol = 0;
 	tab->ndata = 0;
-	tab->rowidx = -1;
+	tab->refcount = 1;
+	tab->mapping = NULL;
+	tab->mappingsize = 0;
+	tab->dictionaries = NULL;
+	tab->ndictionaries = 0;
+	tab->interned = NULL;
+	tab->store = NULL;
 	return tab;
 }
 
@@ -159,9 +209,48 @@ void grow_tablebuffer(PRESTOCLIENT_TABLEBUFFER *tab, size_t addsize)
 	// printf("%li reallocate old %li\n", newsz, tab->nalloc);
 	tab->rowbuff = (char **)realloc(tab->rowbuff,newsz* sizeof(char*));
 	// printf("success reallocate %li\n", newsz);
+	if (tab->interned)
+	{
+		tab->interned = (unsigned char *)realloc(tab->interned, (newsz + 7) / 8);
+		if (!tab->interned)
+			exit(1);
+		memset(tab->interned + (tab->nalloc + 7) / 8, 0, (newsz + 7) / 8 - (tab->nalloc + 7) / 8);
+	}
 	tab->nalloc = newsz;
 }
 
+// Whether a cell points into a dictionary of the buffer instead of being malloc'ed (see dictionary.h)
+bool tablebuffer_interned(const PRESTOCLIENT_TABLEBUFFER *tab, size_t cell)
+{
+	return tab->interned && (tab->interned[cell / 8] & (1 << (cell % 8)));
+}
+
+static void mark_interned(PRESTOCLIENT_TABLEBUFFER *tab, size_t cell)
+{
+	if (!tab->interned)
+	{
+		tab->interned = (unsigned char *)calloc((tab->nalloc + 7) / 8, 1);
+		if (!tab->interned)
+			exit(1);
+	}
+	tab->interned[cell / 8] |= (unsigned char)(1 << (cell % 8));
+}
+
+// Free the cells from cell on, those of a dictionary stay with it and those of the page store with the store
+static void free_cells(PRESTOCLIENT_TABLEBUFFER *tab, size_t cell)
+{
+	size_t stored = pagestore_rows(tab->store) * tab->ncol;
+
+	for (; cell < (size_t)tab->ndata; cell++)
+	{
+		if (tablebuffer_interned(tab, cell))
+			tab->interned[cell / 8] &= (unsigned char)~(1 << (cell % 8));
+		else if (tab->rowbuff[cell] && cell >= stored)
+			free(tab->rowbuff[cell]);
+		tab->rowbuff[cell] = NULL;
+	}
+}
+
 static void delete_tablebuffer(PRESTOCLIENT_TABLEBUFFER *tab)
 {
 	if (!tab)
@@ -169,19 +258,65 @@ static void delete_tablebuffer(PRESTOCLIENT_TABLEBUFFER *tab)
 
 	if (tab->rowbuff)
 	{
-		for (size_t zz = 0; zz < (size_t)tab->ndata; zz++)
-		{
-			if (tab->rowbuff[zz])
-			{
-				free(tab->rowbuff[zz]);
-			}
-		}
+		// cells of a mapped buffer live in the mapping
+		if (!tab->mapping)
+			free_cells(tab, 0);
 		free(tab->rowbuff);
 	}
 
+	for (size_t i = 0; i < tab->ndictionaries; i++)
+		dictionary_delete(tab->dictionaries[i]);
+	free(tab->dictionaries);
+	free(tab->interned);
+	pagestore_delete(tab->store);
+
+	if (tab->mapping)
+		util_unmap_file(tab->mapping, tab->mappingsize);
+
 	free(tab);
 }
 
+// A tablebuffer can be shared read-only between several results (e.g. by the result cache)
+PRESTOCLIENT_TABLEBUFFER *tablebuffer_retain(PRESTOCLIENT_TABLEBUFFER *tab)
+{
+	if (tab)
+		util_atomic_add(&tab->refcount, 1);
+
+	return tab;
+}
+
+// Drop one reference, the last one frees the buffer
+void tablebuffer_release(PRESTOCLIENT_TABLEBUFFER *tab)
+{
+	if (!tab)
+		return;
+
+	if (util_atomic_add(&tab->refcount, -1) == 0)
+		delete_tablebuffer(tab);
+}
+
+// Approximate heap usage of the buffer, used for cache accounting
+size_t tablebuffer_bytes(PRESTOCLIENT_TABLEBUFFER *tab)
+{
+	size_t bytes;
+
+	if (!tab)
+		return 0;
+
+	bytes = sizeof(PRESTOCLIENT_TABLEBUFFER) + tab->nalloc * sizeof(char *) + pagestore_bytes(tab->store);
+	for (size_t zz = pagestore_rows(tab->store) * tab->ncol; !tab->mapping && zz < (size_t)tab->ndata; zz++)
+	{
+		if (tab->rowbuff[zz] && !tablebuffer_interned(tab, zz))
+			bytes += strlen(tab->rowbuff[zz]) + 1;
+	}
+	for (size_t i = 0; i < tab->ndictionaries; i++)
+		bytes += dictionary_bytes(tab->dictionaries[i]);
+	if (tab->interned)
+		bytes += (tab->nalloc + 7) / 8 + tab->ndictionaries * sizeof(DICTIONARY *);
+
+	return bytes;
+}
+
 static void tablebuffer_print(PRESTOCLIENT_TABLEBUFFER *tab)
 {
 	if (!tab)
@@ -233,6 +368,31 @@ static PRESTOCLIENT_RESULT *new_prestoresult()
 	result->clientstatus = PRESTOCLIENT_STATUS_NONE;
 	result->errorcode = PRESTOCLIENT_RESULT_OK;
 	result->cancelquery = false;	
+	result->timedout = false;
+	result->deadline = 0;
+	result->rowsreceived = 0;
+	result->responsebytes = 0;
+	result->wirebytes = 0;
+	result->bodybytes = 0;
+	result->resumes = 0;
+	result->maxrows = 0;
+	result->pagesize = 0;
+	result->maxpagesize = 0;
+	result->pageended = 0;
+	result->hotpages = 0;
+	result->endpoint = NULL;
+	result->gate = NULL;
+	result->priority = 0;
+	result->partitions = NULL;
+	result->abandoned = false;
+	result->parsequeue = NULL;
+	result->pipelined = false;
+	result->page_callback_function = NULL;
+	result->page = NULL;
+	result->decoder = NULL;
+	result->decoderstate = NULL;
+	result->segments = NULL;
+	result->multiplexstream = NULL;
 
 	result->query = NULL;
 	result->prepared_stmt_hdr = NULL;
@@ -241,7 +401,8 @@ static PRESTOCLIENT_RESULT *new_prestoresult()
 	result->columncount = 0;
 	result->parameters = NULL;
 	result->parametercount = 0;
-	result->tablebuff = NULL;		
+	result->tablebuff = NULL;
+	result->rowidx = -1;
 	result->jsonparser = NULL;
 	result->parserstate = NULL;
 	
@@ -251,18 +412,71 @@ static PRESTOCLIENT_RESULT *new_prestoresult()
 	return result;
 }
 
+// Get a curl handle for a new request, reusing one of a finished result when possible.
+// A reused handle keeps its open connections, dns cache and tls sessions
+static CURL *acquire_curl(PRESTOCLIENT *client)
+{
+	CURL *hcurl = NULL;
+
+	if (client)
+	{
+		util_mutex_lock(&client->lock);
+		if (client->nidlecurl > 0)
+			hcurl = client->idlecurl[--client->nidlecurl];
+		util_mutex_unlock(&client->lock);
+	}
+
+	if (hcurl)
+		curl_easy_reset(hcurl);
+	else
+		hcurl = curl_easy_init();
+
+	if (hcurl && client && client->share)
+		curl_easy_setopt(hcurl, CURLOPT_SHARE, client->share);
+	if (hcurl && client && client->cafile)
+		curl_easy_setopt(hcurl, CURLOPT_CAINFO, client->cafile);
+
+	return hcurl;
+}
+
+// Hand a curl handle back to the client or clean it up when enough are idle
+static void release_curl(PRESTOCLIENT *client, CURL *hcurl)
+{
+	if (client)
+	{
+		util_mutex_lock(&client->lock);
+		if (client->nidlecurl < PRESTOCLIENT_MAXIDLEHANDLES)
+		{
+			client->idlecurl[client->nidlecurl++] = hcurl;
+			hcurl = NULL;
+		}
+		util_mutex_unlock(&client->lock);
+	}
+
+	if (hcurl)
+		curl_easy_cleanup(hcurl);
+}
+
 // Delete this result set from memory and remove from PRESTOCLIENT
 static void delete_prestoresult(PRESTOCLIENT_RESULT *result)
 {
 	if (!result)
 		return;
 
+	// the range queries of a merged result end before it goes
+	partitions_delete(result->partitions);
+	parsepool_close(result->parsequeue);
+	segments_delete(result);
+
 	// disassociate result from PRESTOCLIENT buffer
 	remove_result(result);
 
+	admission_leave(result->gate);
+	endpoints_release(result->endpoint);
+
 	if (result->hcurl)
 	{
-		curl_easy_cleanup(result->hcurl);
+		release_curl(result->client, result->hcurl);
 		if (result->curl_error_buffer)
 			free(result->curl_error_buffer);
 	}
@@ -315,14 +529,48 @@ static void delete_prestoresult(PRESTOCLIENT_RESULT *result)
 
 	if (result->tablebuff)
 	{
-		delete_tablebuffer(result->tablebuff);
+		tablebuffer_release(result->tablebuff);
 		result->tablebuff = NULL;
 	}
 
+	pagebuffer_delete(result->page);
+
 	free(result);
 }
 
 
+// Parse the json of a whole page into a result of its own on a worker of the parse pool, see parsepool.h.
+// The page takes the columns, a page without them parses the columns it contains. The rows of a paged
+// page are collected in its PRESTOCLIENT_PAGE, see pagebuffer.h
+PRESTOCLIENT_RESULT *parse_prestopage(const char *json, size_t size, PRESTOCLIENT_COLUMN **columns, size_t columncount, bool paged)
+{
+	static const JSON_CALLBACKS callbacks = {
+		presto_json_parser
+	};
+	PRESTOCLIENT_RESULT *page = new_prestoresult();
+	PARSINGSTATE pstate = {0};
+
+	if (!page)
+		exit(1);
+
+	page->write_callback_function = paged ? &write_callback_page : &write_callback_buffer;
+	page->columns = columns;
+	page->columncount = columns ? columncount : 0;
+	page->parserstate = &pstate;
+
+	if (json_parse(json, size, &callbacks, NULL, page, NULL) != 0)
+		page->errorcode = PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+
+	page->parserstate = NULL;
+
+	return page;
+}
+
+void delete_prestopage(PRESTOCLIENT_RESULT *page)
+{
+	delete_prestoresult(page);
+}
+
 static PRESTOCLIENT_RESULT *new_prestoresult_readied(PRESTOCLIENT *prestoclient, 													
 													void (*in_write_callback_function)(void *, void *),													
 													void *in_client_object) {
@@ -343,7 +591,11 @@ static PRESTOCLIENT_RESULT *new_prestoresult_readied(PRESTOCLIENT *prestoclient,
 	}
 
 	res->user_data = in_client_object;
-	res->hcurl = curl_easy_init();
+	res->priority = prestoclient->priority;
+	res->pagesize = prestoclient->firstpagesize;
+	res->maxpagesize = prestoclient->maxpagesize;
+	res->hotpages = prestoclient->hotpages;
+	res->hcurl = acquire_curl(prestoclient);
 	if (!res->hcurl)
 	{		
 		rc = PRESTO_NO_MEMORY;
@@ -380,10 +632,14 @@ static void reset_prestoresult(PRESTOCLIENT_RESULT *result)
 
 	if (result->tablebuff)
 	{
-		delete_tablebuffer(result->tablebuff);
+		tablebuffer_release(result->tablebuff);
 		result->tablebuff = NULL;
 	}
-	
+	result->rowidx = -1;
+	result->rowsreceived = 0;
+	result->cancelquery = false;
+	result->timedout = false;
+	result->deadline = 0;
 }
 
 static PRESTOCLIENT *new_prestoclient(bool trace_http)
@@ -406,6 +662,29 @@ static PRESTOCLIENT *new_prestoclient(bool trace_http)
 	client->results = NULL;
 	client->active_results = 0;
 	client->trace_http = trace_http;
+	client->nidlecurl = 0;
+	util_mutex_init(&client->lock);
+	client->share = NULL;
+	client->querytimeout = 0;
+	client->retry = retrypolicy_new();
+	client->ownretry = true;
+	client->endpoints = NULL;
+	client->ownendpoints = false;
+	client->candidates = NULL;
+	client->ncandidates = 0;
+	client->admission = NULL;
+	client->priority = 0;
+	client->scheduler = NULL;
+	client->parsepool = NULL;
+	client->page_callback_function = NULL;
+	client->accept = NULL;
+	client->spooling = 0;
+	client->compression = NULL;
+	client->cafile = NULL;
+	client->multiplexer = NULL;
+	client->firstpagesize = 0;
+	client->maxpagesize = 0;
+	client->hotpages = 0;
 
 	return client;
 }
@@ -421,24 +700,84 @@ static void write_callback_buffer(void *in_userdata, void *in_result)
 	PRESTOCLIENT_RESULT *result = (PRESTOCLIENT_RESULT *)in_result;
 	size_t columncount = prestoclient_getcolumncount(result);
 
+	// Rows beyond prestoclient_setmaxrows are not kept
+	if (result->maxrows > 0 && result->tablebuff && result->tablebuff->nrow >= result->maxrows)
+		return;
+
+	tablebuffer_addrow(&result->tablebuff, result->columns, columncount);
+}
+
+/*
+ * The write callback function of queries with a page callback. The row is added
+ * to the page parsed now, the page is handed to the callback once it is complete
+ */
+static void write_callback_page(void *in_userdata, void *in_result)
+{
+	(void)in_userdata;
+	PRESTOCLIENT_RESULT *result = (PRESTOCLIENT_RESULT *)in_result;
+
+	// Rows beyond prestoclient_setmaxrows are not delivered
+	if (result->maxrows > 0 && result->rowsreceived > result->maxrows)
+		return;
+
+	if (!result->page)
+		result->page = pagebuffer_new();
+
+	pagebuffer_addrow(result->page, result->columns, prestoclient_getcolumncount(result));
+}
+
+// Hand the rows of a page to the page callback of the caller and start the next page
+static void flush_page(PRESTOCLIENT_RESULT *result, PRESTOCLIENT_PAGE *page)
+{
+	if (pagebuffer_rows(page) > 0 && result->page_callback_function)
+	{
+		pagebuffer_finish(page);
+		result->page_callback_function(result, page, result->user_data);
+	}
+
+	pagebuffer_clear(page);
+}
+
+// Every varchar and char column gets a dictionary for its repeating values (see dictionary.h)
+static void open_dictionaries(PRESTOCLIENT_TABLEBUFFER *tab, PRESTOCLIENT_COLUMN **columns, size_t columncount)
+{
+	tab->dictionaries = (DICTIONARY **)calloc(columncount, sizeof(DICTIONARY *));
+	if (!tab->dictionaries)
+		exit(1);
+	tab->ndictionaries = columncount;
+
+	for (size_t idx = 0; idx < columncount; idx++)
+	{
+		if (columns[idx]->type == PRESTOCLIENT_TYPE_VARCHAR || columns[idx]->type == PRESTOCLIENT_TYPE_CHAR)
+			tab->dictionaries[idx] = dictionary_new();
+	}
+}
+
+// Append the current values of the columns as a row, the buffer is created with the first row
+void tablebuffer_addrow(PRESTOCLIENT_TABLEBUFFER **tab, PRESTOCLIENT_COLUMN **columns, size_t columncount)
+{
 	size_t growby = 10;
+	const char *text;
 
-	if (!result->tablebuff)
+	if (!*tab)
 	{
-		result->tablebuff = new_tablebuffer(columncount * growby);
-		result->tablebuff->ncol = columncount;
+		*tab = new_tablebuffer(columncount * growby);
+		(*tab)->ncol = columncount;
 	}
 
-	if (result->tablebuff->nalloc <= (columncount + result->tablebuff->ndata))
+	if ((*tab)->ndictionaries == 0 && columncount > 0)
+		open_dictionaries(*tab, columns, columncount);
+
+	if ((*tab)->nalloc <= (columncount + (*tab)->ndata))
 	{
-		grow_tablebuffer(result->tablebuff, columncount * growby);
+		grow_tablebuffer(*tab, columncount * growby);
 	}
 
-	result->tablebuff->nrow++;
+	(*tab)->nrow++;
 
 	for (size_t idx = 0; idx < columncount; idx++)
 	{			
-		PRESTOCLIENT_COLUMN * col = result->columns[idx];
+		PRESTOCLIENT_COLUMN * col = columns[idx];
 		if (!col->data) {
 			printf("%li len %li flddata is not initialized: %s\n", idx, col->dataactualsize, col->data);
 			exit(1);			
@@ -446,13 +785,66 @@ static void write_callback_buffer(void *in_userdata, void *in_result)
 			printf("Datasize idx: %li len: %li is not initialized", idx, col->dataactualsize);
 			exit(1);
 		}
+		else if (idx < (*tab)->ndictionaries &&
+				 (text = dictionary_intern((*tab)->dictionaries[idx], col->data, col->dataactualsize)) != NULL) {
+			(*tab)->rowbuff[(*tab)->ndata] = (char *)text;
+			mark_interned(*tab, (size_t)(*tab)->ndata);
+			(*tab)->ndata++;
+		}
 		else {
-			result->tablebuff->rowbuff[result->tablebuff->ndata] = (char *)malloc(sizeof(char)* (col->dataactualsize + 1) );
-			strncpy((char *)result->tablebuff->rowbuff[result->tablebuff->ndata], col->data, col->dataactualsize);
-			result->tablebuff->rowbuff[result->tablebuff->ndata][col->dataactualsize] = 0;
-			result->tablebuff->ndata++;
+			(*tab)->rowbuff[(*tab)->ndata] = (char *)malloc(sizeof(char)* (col->dataactualsize + 1) );
+			strncpy((char *)(*tab)->rowbuff[(*tab)->ndata], col->data, col->dataactualsize);
+			(*tab)->rowbuff[(*tab)->ndata][col->dataactualsize] = 0;
+			(*tab)->ndata++;
+		}
+	}
+}
+
+// Move the rows of a buffer behind the rows of another one, rows is left empty for more rows.
+// The dictionaries of rows go along with the cells pointing into them.
+void tablebuffer_append(PRESTOCLIENT_TABLEBUFFER *tab, PRESTOCLIENT_TABLEBUFFER *rows)
+{
+	size_t first = (size_t)tab->ndata, count = 0;
+
+	if (tab->nalloc < (size_t)(tab->ndata + rows->ndata))
+		grow_tablebuffer(tab, (size_t)rows->ndata);
+	memcpy(&tab->rowbuff[tab->ndata], rows->rowbuff, (size_t)rows->ndata * sizeof(char *));
+	for (size_t i = 0; rows->interned && i < (size_t)rows->ndata; i++)
+	{
+		if (tablebuffer_interned(rows, i))
+			mark_interned(tab, first + i);
+	}
+	tab->ndata += rows->ndata;
+	tab->nrow += rows->nrow;
+
+	for (size_t i = 0; i < rows->ndictionaries; i++)
+		count += rows->dictionaries[i] != NULL;
+	if (count > 0)
+	{
+		size_t used = tab->ndictionaries > tab->ncol ? tab->ndictionaries : tab->ncol;
+
+		tab->dictionaries = (DICTIONARY **)realloc(tab->dictionaries, (used + count) * sizeof(DICTIONARY *));
+		if (!tab->dictionaries)
+			exit(1);
+		for (size_t i = tab->ndictionaries; i < used; i++)
+			tab->dictionaries[i] = NULL;
+		for (size_t i = 0; i < rows->ndictionaries; i++)
+		{
+			if (!rows->dictionaries[i])
+				continue;
+			dictionary_seal(rows->dictionaries[i]);
+			tab->dictionaries[used++] = rows->dictionaries[i];
 		}
+		tab->ndictionaries = used;
 	}
+
+	free(rows->dictionaries);
+	free(rows->interned);
+	rows->dictionaries = NULL;
+	rows->ndictionaries = 0;
+	rows->interned = NULL;
+	rows->ndata = 0;
+	rows->nrow = 0;
 }
 
 // Add this result set to the PRESTOCLIENT
@@ -468,6 +860,8 @@ static void add_result(PRESTOCLIENT_RESULT *result)
 
 	client = result->client;
 
+	util_mutex_lock(&client->lock);
+
 	client->active_results++;
 
 	if (client->active_results == 1)
@@ -479,6 +873,43 @@ static void add_result(PRESTOCLIENT_RESULT *result)
 		exit(1);
 
 	client->results[client->active_results - 1] = result;
+
+	util_mutex_unlock(&client->lock);
+}
+
+// Create a finished result that reads rows from an existing tablebuffer, no request is sent.
+// The columns are deep copied and the tablebuffer is retained, so the result owns its own cursor.
+PRESTOCLIENT_RESULT *new_prestoresult_shared(PRESTOCLIENT *client, PRESTOCLIENT_COLUMN **columns, size_t columncount, PRESTOCLIENT_TABLEBUFFER *tab)
+{
+	PRESTOCLIENT_RESULT *result;
+
+	if (!client)
+		return NULL;
+
+	result = new_prestoresult();
+	if (!result)
+		return NULL;
+
+	result->client = client;
+	result->write_callback_function = &write_callback_buffer;
+	result->clientstatus = PRESTOCLIENT_STATUS_SUCCEEDED;
+	alloc_copy(&result->laststate, "FINISHED");
+
+	if (columncount > 0)
+	{
+		result->columns = (PRESTOCLIENT_COLUMN **)malloc(columncount * sizeof(PRESTOCLIENT_COLUMN *));
+		if (!result->columns)
+			exit(1);
+
+		for (size_t i = 0; i < columncount; i++)
+			result->columns[i] = clone_prestocolumn(columns[i]);
+	}
+	result->columncount = columncount;
+	result->tablebuff = tablebuffer_retain(tab);
+
+	add_result(result);
+
+	return result;
 }
 
 static void remove_result(PRESTOCLIENT_RESULT *result)
@@ -493,8 +924,7 @@ static void remove_result(PRESTOCLIENT_RESULT *result)
 
 	client = result->client;
 
-	if (client->active_results == 0)
-		return;
+	util_mutex_lock(&client->lock);
 
 	bool found = false;
 	for (size_t idx = 0; idx < client->active_results; idx++)
@@ -508,17 +938,24 @@ static void remove_result(PRESTOCLIENT_RESULT *result)
 			client->results[idx] = client->results[idx + 1];
 		}
 	}
-	client->active_results--;
 
-	if (client->active_results == 0)
-	{
-		free(client->results);
-		client->results = NULL;
-	}
-	else
+	// Already removed, e.g. by prestoclient_query before deleting a failed result
+	if (found)
 	{
-		client->results = (PRESTOCLIENT_RESULT **)realloc((PRESTOCLIENT_RESULT **)client->results, client->active_results * sizeof(PRESTOCLIENT_RESULT *));
+		client->active_results--;
+
+		if (client->active_results == 0)
+		{
+			free(client->results);
+			client->results = NULL;
+		}
+		else
+		{
+			client->results = (PRESTOCLIENT_RESULT **)realloc((PRESTOCLIENT_RESULT **)client->results, client->active_results * sizeof(PRESTOCLIENT_RESULT *));
+		}
 	}
+
+	util_mutex_unlock(&client->lock);
 }
 
 // Add a key/value to curl header list
@@ -540,6 +977,44 @@ static void add_headerline(struct curl_slist **header, char *name, char *value)
 	free(line);
 }
 
+// Turn a passed deadline into a cancel, returns true when the query is to be cancelled
+static bool check_deadline(PRESTOCLIENT_RESULT *result)
+{
+	if (result->deadline > 0 && !result->cancelquery && util_now_msec() >= result->deadline)
+	{
+		result->timedout = true;
+		result->cancelquery = true;
+	}
+
+	return result->cancelquery;
+}
+
+// Sleep between two requests, return early when the query gets cancelled or times out
+static void wait_unless_cancelled(PRESTOCLIENT_RESULT *result, int msec)
+{
+	// a wait of the client is not time the consumer of the rows spent, see adapt_pagesize
+	if (msec > 0 && result->pageended > 0)
+		result->pageended += msec;
+	for (; msec > 0 && !check_deadline(result); msec -= PRESTOCLIENT_CANCELCHECKMSEC)
+		util_sleep(msec < PRESTOCLIENT_CANCELCHECKMSEC ? msec : PRESTOCLIENT_CANCELCHECKMSEC);
+}
+
+static void close_decoder(PRESTOCLIENT_RESULT *result)
+{
+	if (result->decoder)
+		result->decoder->close(result->decoderstate);
+	result->decoder = NULL;
+	result->decoderstate = NULL;
+}
+
+// A decoder state per response, the previous one is closed
+static void open_decoder(PRESTOCLIENT_RESULT *result, const DECODER *decoder)
+{
+	close_decoder(result);
+	result->decoder = decoder;
+	result->decoderstate = decoder->open(result);
+}
+
 // Callback function for CURL data. Data is added to the resultset databuffer
 // json parser should handle that data is transferred in chunks and keep state between the calls
 // so we do not want to grow the buffer
@@ -549,6 +1024,28 @@ static size_t curl_callback(char *contents, size_t size, size_t nmemb, void *use
 	int ret;
 	PRESTOCLIENT_RESULT *result = (PRESTOCLIENT_RESULT *)user_data;
 
+	// Returning less than contentsize makes curl abort the transfer
+	if (result->cancelquery)
+		return 0;
+
+	// contents is already inflated when the response was compressed
+	result->bodybytes += contentsize;
+
+	// The body of a busy answer is no json, the request is retried
+	if (result->hcurl)
+	{
+		long http_code = 0;
+		const char *contenttype;
+
+		// the handle of a multiplexed request belongs to the thread of the multi handle
+		if (!multiplexer_response(result, &http_code, &contenttype))
+			curl_easy_getinfo(result->hcurl, CURLINFO_RESPONSE_CODE, &http_code);
+		if (http_code == PRESTOCLIENT_CURL_EXPECT_HTTP_BUSY)
+			return contentsize;
+	}
+
+	result->responsebytes += contentsize;
+
 	// Do we need a bigger buffer ? Should really not happen as we keep buffersize equal
 	/*
 	if (size > result->lastresponsebuffersize)
@@ -574,19 +1071,158 @@ static size_t curl_callback(char *contents, size_t size, size_t nmemb, void *use
 		printf("Request returned: >%.*s< \n", (int)contentsize, contents);		
 	}
 
-	// this should in fact return false at all as errors propagate to json_fini
-    ret = json_feed(result->jsonparser, contents, contentsize);
+	// A worker of the parse pool parses the page once it is complete
+	if (result->pipelined)
+	{
+		parsepool_write(result->parsequeue, contents, contentsize);
+		return contentsize;
+	}
+
+	// The first chunk tells which decoder the response needs (see decoder.h)
+	if (result->responsebytes == contentsize && result->hcurl)
+	{
+		char *contenttype = NULL;
+		const char *streamtype;
+		long http_code;
+		const DECODER *decoder;
+
+		if (multiplexer_response(result, &http_code, &streamtype))
+			contenttype = (char *)streamtype;
+		else
+			curl_easy_getinfo(result->hcurl, CURLINFO_CONTENT_TYPE, &contenttype);
+		decoder = decoder_find(contenttype);
+		if (decoder != result->decoder)
+			open_decoder(result, decoder);
+	}
+
+	// this should in fact return false at all as errors propagate to finish
+	ret = result->decoder->feed(result->decoderstate, contents, contentsize);
 	if (ret != 0) {
 		printf("Unable to feed parser, retcode %i\n", ret);
 		exit(1);
 		return false;
 	}
 	
-	// Return number of bytes processed or zero if the query should be cancelled
-	// return (result->cancelquery ? 0 : contentsize);
 	return contentsize;
 }
 
+// Callback function for CURL data of requests whose response is not needed
+static size_t discard_callback(char *contents, size_t size, size_t nmemb, void *user_data)
+{
+	(void)contents;
+	(void)user_data;
+
+	return size * nmemb;
+}
+
+// What the result looked like before a page was requested, see rewind_page
+typedef struct ST_PAGEMARK
+{
+	size_t						  rowsreceived;					//!< rowsreceived before the page
+	size_t						  columncount;					//!< columncount before the page
+	size_t						  nrow;							//!< Rows in tablebuff before the page
+	bool						  hadbuffer;					//!< tablebuff existed before the page
+} PAGEMARK;
+
+static void mark_page(PRESTOCLIENT_RESULT *result, PAGEMARK *mark)
+{
+	mark->rowsreceived = result->rowsreceived;
+	mark->columncount = result->columncount;
+	mark->hadbuffer = result->tablebuff != NULL;
+	mark->nrow = result->tablebuff ? result->tablebuff->nrow : 0;
+}
+
+// A partly received page can be requested again if the rows it delivered can be taken back
+static bool can_rewind_page(PRESTOCLIENT_RESULT *result, const PAGEMARK *mark)
+{
+	PRESTOCLIENT_TABLEBUFFER *tab = result->tablebuff;
+
+	if (result->rowsreceived == mark->rowsreceived)
+		return true;
+
+	// Rows handed to a callback of the caller are gone, a page is only handed over when it is complete
+	if (result->write_callback_function != &write_callback_buffer && result->write_callback_function != &write_callback_page)
+		return false;
+
+	return !tab || (tab->refcount == 1 && !tab->mapping);
+}
+
+// Drop what the parser took from a partly received page so the page can be parsed again
+static void rewind_page(PRESTOCLIENT_RESULT *result, const PAGEMARK *mark)
+{
+	PRESTOCLIENT_TABLEBUFFER *tab = result->tablebuff;
+
+	if (tab && !mark->hadbuffer)
+	{
+		tablebuffer_release(tab);
+		result->tablebuff = NULL;
+	}
+	else if (tab && tab->nrow > mark->nrow)
+	{
+		free_cells(tab, mark->nrow * tab->ncol);
+		tab->ndata = mark->nrow * tab->ncol;
+		tab->nrow = mark->nrow;
+	}
+
+	// Column information is parsed only once, a page cut off in the middle of it starts over
+	if (result->columncount > mark->columncount && mark->columncount == 0 && result->columns)
+	{
+		for (size_t i = 0; i < result->columncount; i++)
+		{
+			if (result->columns[i])
+				delete_prestocolumn(result->columns[i]);
+		}
+		free(result->columns);
+		result->columns = NULL;
+		result->columncount = 0;
+	}
+
+	// The rows of a page are all parsed again
+	pagebuffer_clear(result->page);
+
+	result->rowsreceived = mark->rowsreceived;
+}
+
+// Failures of the connection, as opposed to answers of the server or aborts by a callback
+static bool transient_failure(CURLcode curlstatus)
+{
+	switch (curlstatus)
+	{
+	case CURLE_COULDNT_RESOLVE_HOST:
+	case CURLE_COULDNT_CONNECT:
+	case CURLE_OPERATION_TIMEDOUT:
+	case CURLE_SEND_ERROR:
+	case CURLE_RECV_ERROR:
+	case CURLE_GOT_NOTHING:
+	case CURLE_PARTIAL_FILE:
+	case CURLE_SSL_CONNECT_ERROR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Callback function for CURL transfer progress, a non zero return aborts a transfer that is waiting for the server
+static int progress_callback(void *user_data, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+	PRESTOCLIENT_RESULT *result = (PRESTOCLIENT_RESULT *)user_data;
+
+	(void)dltotal;
+	(void)dlnow;
+	(void)ultotal;
+	(void)ulnow;
+
+	return check_deadline(result) ? 1 : 0;
+}
+
+#if LIBCURL_VERSION_NUM < 0x072000
+// libcurl before 7.32.0 only knows the double based progress callback
+static int progress_callback_old(void *user_data, double dltotal, double dlnow, double ultotal, double ulnow)
+{
+	return progress_callback(user_data, (curl_off_t)dltotal, (curl_off_t)dlnow, (curl_off_t)ultotal, (curl_off_t)ulnow);
+}
+#endif
+
 
 typedef void (*split_fn)(const char *, size_t, void *);
 
@@ -676,6 +1312,91 @@ static size_t header_callback(char *buffer, size_t size,
 	return length;
 }
 
+// Base url of the coordinator running the query
+static const char *coordinator(PRESTOCLIENT_RESULT *result)
+{
+	return result->endpoint ? endpoints_baseurl(result->endpoint) : result->client->baseurl;
+}
+
+// Point a POST at the statement url of the coordinator running the query
+static void set_query_url(CURL *hcurl, PRESTOCLIENT_RESULT *result)
+{
+	const char *baseurl = coordinator(result);
+	char *full_url = (char *)malloc(strlen(baseurl) + strlen(PRESTOCLIENT_QUERY_URL) + 1);
+
+	if (!full_url)
+		exit(1);
+
+	strcpy(full_url, baseurl);
+	strcat(full_url, PRESTOCLIENT_QUERY_URL);
+	curl_easy_setopt(hcurl, CURLOPT_URL, full_url);
+	free(full_url);
+}
+
+// true when a wait for admission or a page slot ended with PRESTO_OK, otherwise the query is cancelled
+static bool passed(PRESTOCLIENT_RESULT *result, int rc)
+{
+	if (rc == PRESTO_OK)
+		return true;
+
+	result->timedout = rc == PRESTO_TIMEOUT;
+	result->cancelquery = true;
+	result->errorcode = result->timedout ? PRESTOCLIENT_RESULT_TIMEOUT : PRESTOCLIENT_RESULT_CANCELLED;
+
+	return false;
+}
+
+// Wait until the query may run on its coordinator (see admission.h), false when it gave up waiting
+static bool admit(PRESTOCLIENT_RESULT *result)
+{
+	PRESTOCLIENT *client = result->client;
+	int rc;
+
+	if (!client->admission)
+		return true;
+
+	rc = admission_enter(client->admission, coordinator(result), result->priority, result->deadline,
+						 &result->cancelquery, &result->gate);
+
+	return passed(result, rc);
+}
+
+// The query no longer runs on its coordinator
+static void release_coordinator(PRESTOCLIENT_RESULT *result)
+{
+	admission_leave(result->gate);
+	result->gate = NULL;
+	endpoints_release(result->endpoint);
+	result->endpoint = NULL;
+}
+
+// Move a query that could not be posted to another coordinator of the server list
+static void fail_over(CURL *hcurl, PRESTOCLIENT_RESULT *result)
+{
+	ENDPOINT *failed = result->endpoint;
+
+	admission_leave(result->gate);
+	result->gate = NULL;
+	result->endpoint = endpoints_choose(result->client, failed);
+	endpoints_release(failed);
+	set_query_url(hcurl, result);
+	admit(result);
+}
+
+// Next page target of a query after a page of bytes, fetched and parsed in fetchmsec after the consumer of the rows
+// took consumemsec for the page before. A page well short of its target was all the coordinator had ready, a larger
+// target would not change that. A consumer slower than the client is not helped by larger pages, they would only
+// hold more rows in memory.
+static void adapt_pagesize(PRESTOCLIENT_RESULT *result, size_t bytes, long long fetchmsec, long long consumemsec)
+{
+	if (result->pagesize == 0 || result->pagesize >= result->maxpagesize)
+		return;
+	if (bytes < result->pagesize / 4 * 3 || consumemsec > fetchmsec)
+		return;
+
+	result->pagesize = result->pagesize <= result->maxpagesize / 2 ? result->pagesize * 2 : result->maxpagesize;
+}
+
 // Send a http request to the Presto server
 static unsigned int do_http_request(enum E_HTTP_REQUEST_TYPES in_request_type,
 									CURL *hcurl,							
@@ -685,13 +1406,19 @@ static unsigned int do_http_request(enum E_HTTP_REQUEST_TYPES in_request_type,
 {
 	CURLcode curlstatus;
 	PRESTOCLIENT* client = NULL;
-	char *query_url, *full_url, port[32];
+	char port[32];
 	struct curl_slist *headers;
-	bool retry;
-	unsigned int retrycount, length;
+	bool retry, reached;
+	unsigned int retrycount;
+	size_t failovers = 0;
+	bool scheduled = false, pipelined = false;
+	enum E_PAGECLASS pageclass = PAGECLASS_BULK;
 	long http_code, expected_http_code, expected_http_code_busy;
+	long long delay = 0, started, ended, requested = util_now_msec();
+	size_t received = result ? result->bodybytes : 0;
+	char pagesize[32];
+	PAGEMARK mark;
 
-	query_url = PRESTOCLIENT_QUERY_URL;
 	headers = NULL;
 	expected_http_code_busy = PRESTOCLIENT_CURL_EXPECT_HTTP_BUSY;
 
@@ -729,25 +1456,49 @@ static unsigned int do_http_request(enum E_HTTP_REQUEST_TYPES in_request_type,
 	// URL
 	if (in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_POST)
 	{
-		// Url
-		length = (strlen(query_url) + strlen(client->baseurl)) * sizeof(char);
-		full_url = (char *)malloc(length + 1);
-		if (!full_url)
-			exit(1);
+		// A new query goes to the least loaded coordinator of a server list (see endpoints.h)
+		release_coordinator(result);
+		if (client->endpoints)
+			result->endpoint = endpoints_choose(client, NULL);
+		set_query_url(hcurl, result);
 
-		strcpy(full_url, client->baseurl);
-		strcat(full_url, query_url);
-		curl_easy_setopt(hcurl, CURLOPT_URL, full_url);
-		free(full_url);
+		// Queries over the limit of the coordinator wait here instead of making it answer 503
+		if (!admit(result))
+			return result->errorcode;
 	}
 	else
 	{
 		curl_easy_setopt(hcurl, CURLOPT_URL, get_uri);		
 	}
 
+	// Interactive queries get their pages before bulk extracts (see pagescheduler.h)
+	if (in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_GET && client->scheduler)
+	{
+		pageclass = pagescheduler_class(result->priority);
+		if (!passed(result, pagescheduler_enter(client->scheduler, pageclass, result->deadline, &result->cancelquery)))
+			return result->errorcode;
+		scheduled = true;
+	}
+
+	// The pages of a buffered query are parsed by the workers of the parse pool (see parsepool.h)
+	if (in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_GET && client->parsepool && !client->accept && !client->spooling &&
+		(result->write_callback_function == &write_callback_buffer || result->write_callback_function == &write_callback_page))
+	{
+		if (!result->parsequeue)
+			result->parsequeue = parsepool_open(client->parsepool);
+		parsepool_rewind(result->parsequeue);
+		pipelined = true;
+	}
+	result->pipelined = pipelined;
+
 	// CURL options
 	curl_easy_setopt(hcurl, CURLOPT_CONNECTTIMEOUT_MS, (long)PRESTOCLIENT_URLTIMEOUT);
 
+	// libcurl inflates a compressed response before it reaches curl_callback, a handle taken over
+	// from another client must not keep its compressions
+	curl_easy_setopt(hcurl, CURLOPT_ACCEPT_ENCODING, client->compression);
+
+
 	switch (in_request_type)
 	{
 	case PRESTOCLIENT_HTTP_REQUEST_TYPE_POST:
@@ -788,8 +1539,17 @@ static unsigned int do_http_request(enum E_HTTP_REQUEST_TYPES in_request_type,
 		add_headerline(&headers, "X-Presto-Time-Zone", client->timezone);
 	if (client->language)
 		add_headerline(&headers, "X-Presto-Language", client->language);
+	if (client->accept)
+		add_headerline(&headers, "Accept", client->accept);
+	if (client->spooling > 0 && in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_POST)
+		add_headerline(&headers, "X-Presto-Query-Data-Encoding", "json");
 	if (client->useragent)
 		add_headerline(&headers, "User-Agent", client->useragent);
+	if (result->pagesize > 0 && in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE)
+	{
+		sprintf(pagesize, "%zuB", result->pagesize);
+		add_headerline(&headers, "X-Presto-Max-Size", pagesize);
+	}
 
 	if (result->prepared_stmt_hdr && strlen(result->prepared_stmt_hdr) > 0)
 	{
@@ -830,6 +1590,22 @@ static unsigned int do_http_request(enum E_HTTP_REQUEST_TYPES in_request_type,
 	{
 		curl_easy_setopt(hcurl, CURLOPT_WRITEFUNCTION, curl_callback);
 		curl_easy_setopt(hcurl, CURLOPT_WRITEDATA, (void *)result);
+
+		// Lets prestoclient_cancelquery abort a request while the server is still working on it
+#if LIBCURL_VERSION_NUM >= 0x072000
+		curl_easy_setopt(hcurl, CURLOPT_XFERINFOFUNCTION, progress_callback);
+		curl_easy_setopt(hcurl, CURLOPT_XFERINFODATA, (void *)result);
+#else
+		curl_easy_setopt(hcurl, CURLOPT_PROGRESSFUNCTION, progress_callback_old);
+		curl_easy_setopt(hcurl, CURLOPT_PROGRESSDATA, (void *)result);
+#endif
+		curl_easy_setopt(hcurl, CURLOPT_NOPROGRESS, 0L);
+	}
+	else
+	{
+		// The cancel request itself must not be aborted
+		curl_easy_setopt(hcurl, CURLOPT_WRITEFUNCTION, discard_callback);
+		curl_easy_setopt(hcurl, CURLOPT_NOPROGRESS, 1L);
 	}
 
 	// Set request body
@@ -860,109 +1636,369 @@ static unsigned int do_http_request(enum E_HTTP_REQUEST_TYPES in_request_type,
 		result->lastnexturi[0] = '\0';
 	}
 	
-	// parser callback
-	static const JSON_CALLBACKS callbacks = {
-    	presto_json_parser
-	};
+	// a decoder state needs to be reset per request but not between curl chunk downloads,
+	// json until the first chunk tells otherwise
+	open_decoder(result, &decoder_json);
+	segments_clear(result);
 
-	// a parser instance needs to be reset per request but not between curl chunk downloads
-	JSON_PARSER parser;
-	result->jsonparser = &parser;
-	json_init(&parser, &callbacks, NULL, result);
+	mark_page(result, &mark);
 
-	PARSINGSTATE pstate = {0};
-	result->parserstate = &pstate;
-
-	// Execute CURL request, retry when server is busy
-	result->errorcode = PRESTOCLIENT_RESULT_OK;
+	// Execute CURL request, retry what is safe to retry (see retrypolicy.h)
 	retry = true;
 	retrycount = 0;
 
 	while (retry)
 	{
 		retrycount++;
+		result->errorcode = PRESTOCLIENT_RESULT_OK;
+		result->responsebytes = 0;
+
+		// Fail fast while the coordinator is unhealthy, the cancel request is always sent
+		if (in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE &&
+			!retrypolicy_allow(client->retry, coordinator(result)))
+		{
+			// Another coordinator of the server list may still take a new query
+			if (in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_POST && result->endpoint &&
+				failovers + 1 < client->ncandidates)
+			{
+				failovers++;
+				retrycount--;
+				fail_over(hcurl, result);
+				continue;
+			}
+			result->errorcode = PRESTOCLIENT_RESULT_UNAVAILABLE;
+			break;
+		}
+
+		// A request must not outlive the deadline of its query, the cancel request gets the connect timeout
+		if (result->deadline > 0 && in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE)
+		{
+			long long remaining = result->deadline - util_now_msec();
+			curl_easy_setopt(hcurl, CURLOPT_TIMEOUT_MS, (long)(remaining > 0 ? remaining : 1));
+		}
+		else if (result->deadline > 0)
+			curl_easy_setopt(hcurl, CURLOPT_TIMEOUT_MS, (long)PRESTOCLIENT_URLTIMEOUT);
+		else
+			curl_easy_setopt(hcurl, CURLOPT_TIMEOUT_MS, 0L);
 
 		// Execute request
-		curlstatus = curl_easy_perform(hcurl);
+		started = util_now_msec();
+		reached = true;
+		if (multiplexer_active(client))
+			curlstatus = multiplexer_perform(client->multiplexer, result, hcurl,
+											 in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE ? discard_callback : curl_callback,
+											 header_callback, result);
+		else
+			curlstatus = curl_easy_perform(hcurl);
+		if (in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE)
+			result->wirebytes += util_download_size(hcurl);
 		if (curlstatus == CURLE_OK)
 		{
-			// Get return code
-			http_code = 0;
-			curl_easy_getinfo(hcurl, CURLINFO_RESPONSE_CODE, &http_code);
+			// Get return code
+			http_code = 0;
+			curl_easy_getinfo(hcurl, CURLINFO_RESPONSE_CODE, &http_code);
+
+			if (http_code == expected_http_code)
+			{
+				retry = false;
+			}
+			else if (http_code == expected_http_code_busy)
+			{
+				// Server is busy
+				result->errorcode = PRESTOCLIENT_RESULT_MAX_RETRIES_REACHED;
+			}
+			else
+			{
+				result->errorcode = PRESTOCLIENT_RESULT_SERVER_ERROR;
+				// Re-using port buffer
+				sprintf(port, "Http-code: %d", (unsigned int)http_code);
+				alloc_copy(&result->curl_error_buffer, port);
+				retry = false;
+			}
+
+			if (in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE)
+				retrypolicy_report(client->retry, coordinator(result), http_code < 500);
+			reached = http_code < 500;
+		}
+		else
+		{
+			if (curlstatus == CURLE_OPERATION_TIMEDOUT && result->deadline > 0 &&
+				in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE)
+			{
+				result->timedout = true;
+				result->cancelquery = true;
+			}
+			result->errorcode = PRESTOCLIENT_RESULT_CURL_ERROR;
+
+			// Asking for the same page again is idempotent, a page cut off in the middle is parsed
+			// again from the start. A query is only posted again when it never reached the server.
+			if (result->cancelquery || !transient_failure(curlstatus))
+				retry = false;
+			else if (in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_GET)
+				retry = result->responsebytes == 0 || can_rewind_page(result, &mark);
+			else if (in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_POST)
+				retry = curlstatus == CURLE_COULDNT_RESOLVE_HOST || curlstatus == CURLE_COULDNT_CONNECT;
+			else
+				retry = false;
+
+			if (in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE && !result->cancelquery)
+				retrypolicy_report(client->retry, coordinator(result), !transient_failure(curlstatus));
+			reached = result->cancelquery || !transient_failure(curlstatus);
+		}
+
+		// Only the answer time of a POST measures the coordinator, a GET waits for the query
+		if (in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE)
+			endpoints_report(result->endpoint,
+							 in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_POST ? util_now_msec() - started : -1,
+							 reached);
+
+		if (retry && !retrypolicy_retry(client->retry, retrycount, &delay))
+			retry = false;
+
+		// A query that did not reach its coordinator is posted to another one
+		if (retry && in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_POST && result->endpoint)
+			fail_over(hcurl, result);
+
+		if (retry)
+		{
+			wait_unless_cancelled(result, (int)delay);
+			if (result->cancelquery)
+				retry = false;
+		}
+
+		// Resume with the same nextUri and a fresh parser
+		if (retry && result->responsebytes > 0)
+		{
+			rewind_page(result, &mark);
+			if (pipelined)
+				parsepool_rewind(result->parsequeue);
+			open_decoder(result, &decoder_json);
+			segments_clear(result);
+			if (result->lastnexturi)
+				result->lastnexturi[0] = '\0';
+			result->resumes++;
+		}
+	}
+
+	// Cleanup
+	// decoding was done in the write callback
+	int ret = result->decoder->finish(result->decoderstate);
+	// a cancel request has no body and a cancelled transfer stops in the middle of the page
+	if (ret != 0 && in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE && !result->cancelquery && !pipelined)
+		result->errorcode = PRESTOCLIENT_RESULT_SERVER_ERROR;
+
+	// the decoder state is transient in the result, it only lives as long as the response
+	close_decoder(result);
+
+	// The rows of a spooled page are in its segments (see segments.h)
+	if (segments_pending(result) > 0)
+	{
+		if (result->errorcode == PRESTOCLIENT_RESULT_OK && !result->cancelquery && in_request_type != PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE)
+			result->errorcode = segments_fetch(result);
+		else
+			segments_clear(result);
+	}
+
+	// The next page is requested while a worker parses this one, only its uris are looked up now
+	if (pipelined)
+	{
+		result->pipelined = false;
+		if (result->errorcode == PRESTOCLIENT_RESULT_OK && !result->cancelquery)
+		{
+			const char *const urikeys[] = { "infoUri", "partialCancelUri", "nextUri" };
+			char **const urivalues[] = { &result->lastinfouri, &result->lastcanceluri, &result->lastnexturi };
+
+			parsepool_topvalues(result->parsequeue, urikeys, urivalues, 3);
+			parsepool_submit(result->parsequeue, result->columns, result->columncount,
+							 result->write_callback_function == &write_callback_page);
+		}
+		else
+			parsepool_rewind(result->parsequeue);
+	}
+	else if (result->page)
+		flush_page(result, result->page);
+
+	if (scheduled)
+		pagescheduler_leave(client->scheduler, pageclass);
+
+	// The consumer had the rows from the end of the last page until this request, see adapt_pagesize
+	if (result->errorcode == PRESTOCLIENT_RESULT_OK && !result->cancelquery && in_request_type == PRESTOCLIENT_HTTP_REQUEST_TYPE_GET)
+	{
+		ended = util_now_msec();
+		if (result->pageended > 0)
+			adapt_pagesize(result, result->bodybytes - received, ended - requested, requested - result->pageended);
+		result->pageended = ended;
+	}
+
+	curl_slist_free_all(headers);
+	return result->errorcode;
+}
+
+// Send a cancel request to the Prestoserver, no more pages will be requested
+static void stop_query(PRESTOCLIENT_RESULT *result)
+{
+	char *uri = NULL;
+
+	if (!result || !result->client)
+		return;
+
+	// A DELETE on the next uri cancels the whole query, the partial cancel uri only a stage
+	if (result->lastnexturi && strlen(result->lastnexturi) > 0)
+		uri = result->lastnexturi;
+	else if (result->lastcanceluri && strlen(result->lastcanceluri) > 0)
+		uri = result->lastcanceluri;
+
+	if (uri && result->hcurl)
+	{
+		// Not checking returncode since we're cancelling the request and don't care if it succeeded or not
+		do_http_request(PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE,
+				result->hcurl,				
+				uri,
+				NULL,				
+				result);
+	}
+
+	if (result->lastnexturi)
+		result->lastnexturi[0] = '\0';
+
+	// Pages not yet parsed are not needed anymore
+	parsepool_close(result->parsequeue);
+	result->parsequeue = NULL;
+
+	release_coordinator(result);
+}
+
+// Stop the query and drop the rows received so far
+static void release_query(PRESTOCLIENT_RESULT *result)
+{
+	if (!result || !result->client)
+		return;
+
+	stop_query(result);
+
+	if (result->tablebuff)
+	{
+		tablebuffer_release(result->tablebuff);
+		result->tablebuff = NULL;
+	}
+	result->rowidx = -1;
+}
+
+// Drop buffered rows beyond maxrows and stop the query once maxrows rows were received
+static void apply_maxrows(PRESTOCLIENT_RESULT *result)
+{
+	PRESTOCLIENT_TABLEBUFFER *tab = result->tablebuff;
+
+	if (result->maxrows == 0)
+		return;
+
+	if (tab && tab->nrow > result->maxrows && tab->refcount == 1 && !tab->mapping)
+	{
+		free_cells(tab, result->maxrows * tab->ncol);
+		tab->ndata = result->maxrows * tab->ncol;
+		tab->nrow = result->maxrows;
+	}
+
+	if (result->rowsreceived >= result->maxrows && result->clientstatus == PRESTOCLIENT_STATUS_RUNNING)
+	{
+		stop_query(result);
+		result->clientstatus = PRESTOCLIENT_STATUS_SUCCEEDED;
+	}
+}
+
+// Stop the query on behalf of prestoclient_cancelquery
+static void cancel(PRESTOCLIENT_RESULT *result)
+{
+	if (!result || !result->client)
+		return;
+
+	release_query(result);
+
+	result->clientstatus = PRESTOCLIENT_STATUS_FAILED;
+	result->errorcode = result->timedout ? PRESTOCLIENT_RESULT_TIMEOUT : PRESTOCLIENT_RESULT_CANCELLED;
+}
+
+// Hand the pages parsed by the parse pool to the result in page order. Waits for the oldest page while
+// more than ahead pages are outstanding, a page with an error ends the delivery
+static int deliver_pages(PRESTOCLIENT_RESULT *result, size_t ahead)
+{
+	PRESTOCLIENT_RESULT *page;
+	PRESTOCLIENT_TABLEBUFFER *tab, *rows;
+	int rc = PRESTO_OK;
+
+	while (rc == PRESTO_OK && parsepool_pending(result->parsequeue) > 0)
+	{
+		rc = parsepool_next(result->parsequeue, parsepool_pending(result->parsequeue) > ahead, result->deadline,
+							&result->cancelquery, &page);
+		if (!page)
+			break;
+
+		if (page->laststate)
+			alloc_copy(&result->laststate, page->laststate);
+		if (page->lasterrormessage)
+			alloc_copy(&result->lasterrormessage, page->lasterrormessage);
+
+		if (!result->columns && page->columns)
+		{
+			result->columns = page->columns;
+			result->columncount = page->columncount;
+			page->columns = NULL;
+			page->columncount = 0;
+		}
 
-			if (http_code == expected_http_code)
-			{
-				retry = false;
-			}
-			else if (http_code == expected_http_code_busy)
+		// The cells move to the result, the first page hands over its whole buffer
+		rows = page->tablebuff;
+		if (rows && rows->nrow > 0)
+		{
+			tab = result->tablebuff;
+			if (!tab)
 			{
-				// Server is busy
-				util_sleep(PRESTOCLIENT_RETRYWAITTIMEMSEC * retrycount);
+				result->tablebuff = rows;
+				page->tablebuff = NULL;
 			}
 			else
-			{
-				result->errorcode = PRESTOCLIENT_RESULT_SERVER_ERROR;
-				// Re-using port buffer
-				sprintf(port, "Http-code: %d", (unsigned int)http_code);
-				alloc_copy(&result->curl_error_buffer, port);
-				retry = false;
-			}
-
-			if (retry && retrycount > PRESTOCLIENT_MAXIMUMRETRIES)
-			{
-				result->errorcode = PRESTOCLIENT_RESULT_MAX_RETRIES_REACHED;
-				retry = false;
-			}
+				tablebuffer_append(tab, rows);
 		}
-		else
+
+		// The rows of a paged query go to the page callback, without those beyond maxrows
+		if (page->page)
 		{
-			result->errorcode = PRESTOCLIENT_RESULT_CURL_ERROR;
-			retry = false;
+			if (result->maxrows > 0)
+				pagebuffer_limit(page->page, result->maxrows > result->rowsreceived ? result->maxrows - result->rowsreceived : 0);
+			flush_page(result, page->page);
 		}
-	}
-
-	// Cleanup
-	// parsing was done int he write callback
-	JSON_INPUT_POS pdbg = {0};
-	int ret = json_fini(&parser, &pdbg ); // 
-	if (ret != 0) {
-		//printf("Unable to finish parser, retcode %i \n", ret);
-		printf("Unable to finish parser, retcode %i (offset: %li, column %i, line %i)\n", ret, pdbg.offset, pdbg.column_number, pdbg.line_number);
-		result->errorcode = PRESTOCLIENT_RESULT_SERVER_ERROR;
-	}	
+		result->rowsreceived += page->rowsreceived;
 
-	// the parser is transientin the result and allocated on the stack of do_http_request
-	// if we would reuse in other contexts bad things would happen	
-	result->jsonparser = NULL;
-	result->parserstate = NULL;
+		if (page->errorcode != PRESTOCLIENT_RESULT_OK)
+		{
+			result->errorcode = page->errorcode;
+			rc = PRESTO_BACKEND_ERROR;
+		}
 
-	curl_slist_free_all(headers);
-	return result->errorcode;
-}
+		delete_prestopage(page);
+	}
 
-// Send a cancel request to the Prestoserver
-static void cancel(PRESTOCLIENT_RESULT *result)
-{
-	if (result && result->client && result->lastcanceluri && strlen(result->lastcanceluri) > 0 )
+	if (rc == PRESTO_TIMEOUT)
 	{
-		// Not checking returncode since we're cancelling the request and don't care if it succeeded or not
-		do_http_request(PRESTOCLIENT_HTTP_REQUEST_TYPE_DELETE,
-				result->hcurl,				
-				result->lastcanceluri,
-				NULL,				
-				result);
+		result->timedout = true;
+		result->cancelquery = true;
 	}
+
+	return rc;
 }
 
 // Fetch the next uri from the prestoserver, handle the response and determine if we're done or not
 static bool prestoclient_queryisrunning(PRESTOCLIENT_RESULT *result)
 {
 	PRESTOCLIENT *prestoclient;
+	char *requesturi = NULL;
+	bool running = true;
+	int delivered = PRESTO_OK;
 
 	if (!result)
 		return false;
 
-	if (result->cancelquery)
+	if (check_deadline(result))
 	{
 		cancel(result);
 		return false;
@@ -976,6 +2012,9 @@ static bool prestoclient_queryisrunning(PRESTOCLIENT_RESULT *result)
 	if (!prestoclient)
 		return false;
 
+	// The request clears lastnexturi, keep it to cancel an aborted request
+	alloc_copy(&requesturi, result->lastnexturi);
+
 	// Start request. This will execute callbackfunction when data is recieved
 	if (do_http_request(PRESTOCLIENT_HTTP_REQUEST_TYPE_GET,
 				result->hcurl,
@@ -983,8 +2022,23 @@ static bool prestoclient_queryisrunning(PRESTOCLIENT_RESULT *result)
 				NULL,				
 				result) == PRESTOCLIENT_RESULT_OK)
 	{
+		// Pages parsed meanwhile, all of them once the last page arrived
+		if (result->parsequeue)
+			delivered = deliver_pages(result, result->lastnexturi && strlen(result->lastnexturi) > 0 ? PARSEPOOL_MAXPAGES - 1 : 0);
+
 		// Determine client state
-		if (result->lastnexturi && strlen(result->lastnexturi) > 0)
+		if (delivered == PRESTO_CANCELLED || delivered == PRESTO_TIMEOUT)
+		{
+			cancel(result);
+			running = false;
+		}
+		else if (delivered != PRESTO_OK)
+		{
+			stop_query(result);
+			result->clientstatus = PRESTOCLIENT_STATUS_FAILED;
+			running = false;
+		}
+		else if (result->lastnexturi && strlen(result->lastnexturi) > 0)
 			result->clientstatus = PRESTOCLIENT_STATUS_RUNNING;
 		else
 		{
@@ -993,16 +2047,47 @@ static bool prestoclient_queryisrunning(PRESTOCLIENT_RESULT *result)
 			else
 				result->clientstatus = PRESTOCLIENT_STATUS_SUCCEEDED;
 		}
+
+		// Enough rows, the rest of the result is not needed
+		apply_maxrows(result);
 	}
 	else
 	{
-		return false;
+		// Transfer aborted by a cancel from another thread
+		if (result->cancelquery)
+		{
+			alloc_copy(&result->lastnexturi, requesturi);
+			cancel(result);
+		}
+
+		running = false;
 	}
 
+	free(requesturi);
+
 	if (!result->lastnexturi || strlen(result->lastnexturi) == 0)
+	{
+		release_coordinator(result);
 		return false;
+	}
 
-	return true;
+	return running;
+}
+
+// Fetch packets until more than rows rows were received or the query is done
+static void prestoclient_waitforrows(PRESTOCLIENT_RESULT *result, size_t rows)
+{
+	while (prestoclient_queryisrunning(result) && result->rowsreceived <= rows)
+	{
+		if (rows > 0)
+		{
+			wait_unless_cancelled(result, PRESTOCLIENT_RETRIEVEWAITTIMEMSEC);
+		}
+		else
+		{
+			wait_unless_cancelled(result, PRESTOCLIENT_UPDATEWAITTIMEMSEC);
+		}
+	}
 }
 
 // Start fetching packets until we're done. Wait for a specified interval between requests
@@ -1013,11 +2098,11 @@ static void prestoclient_waituntilfinished(PRESTOCLIENT_RESULT *result)
 		// Once there is data use the short wait interval
 		if (result->tablebuff && result->tablebuff->nrow > 0)
 		{
-			util_sleep(PRESTOCLIENT_RETRIEVEWAITTIMEMSEC);
+			wait_unless_cancelled(result, PRESTOCLIENT_RETRIEVEWAITTIMEMSEC);
 		}
 		else
 		{
-			util_sleep(PRESTOCLIENT_UPDATEWAITTIMEMSEC);
+			wait_unless_cancelled(result, PRESTOCLIENT_UPDATEWAITTIMEMSEC);
 		}
 	}
 }
@@ -1062,32 +2147,45 @@ PRESTOCLIENT *prestoclient_init(const char *in_protocol, const char *in_server,
 		}
 		else
 		{
-			client->protocol = "http";
+			alloc_copy(&client->protocol, "http");
 		}
 
 		if (in_port && *in_port > 0 && *in_port <= 65535)
 			client->port = *in_port;
 
-		// assemble base url...
-		char *port = (char *)malloc(32);
-		sprintf(port, "%i", client->port);
-
-		size_t length = (strlen(in_server) + strlen(in_protocol) + strlen(port) + 5) * sizeof(char);
-		char *base_url = (char *)malloc(length + 1);
-
-		if (!base_url)
-			exit(1);
-
-		strcpy(base_url, client->protocol);
-		strcat(base_url, "://");
-		strcat(base_url, client->server);
-		strcat(base_url, ":");
-		strcat(base_url, port);
-		strcat(base_url, "/");
-		base_url[length] = '\0';
-
-		client->baseurl = base_url;
-		free(port);
+		// A server list spreads the queries over its coordinators, the first one answers server info
+		if (endpoints_islist(in_server))
+		{
+			if (endpoints_attach(NULL, client) != PRESTO_OK)
+			{
+				prestoclient_close(client);
+				return NULL;
+			}
+			alloc_copy(&client->baseurl, endpoints_baseurl(client->candidates[0]));
+		}
+		else
+		{
+			// assemble base url...
+			char *port = (char *)malloc(32);
+			sprintf(port, "%i", client->port);
+
+			size_t length = (strlen(in_server) + strlen(client->protocol) + strlen(port) + 5) * sizeof(char);
+			char *base_url = (char *)malloc(length + 1);
+
+			if (!base_url)
+				exit(1);
+
+			strcpy(base_url, client->protocol);
+			strcat(base_url, "://");
+			strcat(base_url, client->server);
+			strcat(base_url, ":");
+			strcat(base_url, port);
+			strcat(base_url, "/");
+			base_url[length] = '\0';
+
+			client->baseurl = base_url;
+			free(port);
+		}
 
 		if (in_catalog)
 			alloc_copy(&client->catalog, in_catalog);
@@ -1146,15 +2244,31 @@ void prestoclient_close(PRESTOCLIENT *prestoclient)
 	if (prestoclient->language)
 		free(prestoclient->language);
 
-	if (prestoclient->results)
-	{
-		for (size_t i = 0; i < prestoclient->active_results; i++)
-			if (prestoclient->results[i])
-				delete_prestoresult(prestoclient->results[i]);
+	if (prestoclient->accept)
+		free(prestoclient->accept);
 
-		free(prestoclient->results);
-	}
+	if (prestoclient->compression)
+		free(prestoclient->compression);
+
+	if (prestoclient->cafile)
+		free(prestoclient->cafile);
+
+	// deleting a result removes it from the array, deleting a merged result also its range queries
+	while (prestoclient->active_results > 0)
+		delete_prestoresult(prestoclient->results[0]);
+	free(prestoclient->results);
+
+	for (size_t i = 0; i < prestoclient->nidlecurl; i++)
+		curl_easy_cleanup(prestoclient->idlecurl[i]);
+
+	if (prestoclient->ownretry)
+		retrypolicy_delete(prestoclient->retry);
 
+	free(prestoclient->candidates);
+	if (prestoclient->ownendpoints)
+		endpoints_delete(prestoclient->endpoints);
+
+	util_mutex_destroy(&prestoclient->lock);
 	free(prestoclient);
 	prestoclient = NULL;
 }
@@ -1209,9 +2323,10 @@ char *prestoclient_serverinfo(PRESTOCLIENT *prestoclient)
 	ret.memory[0] = '\0';
 	ret.size = 0;
 
-	CURL *curl = curl_easy_init();
+	CURL *curl = acquire_curl(prestoclient);
 	if (!curl)
 	{
+		free(ret.memory);
 		return NULL;
 	}
 
@@ -1231,16 +2346,61 @@ char *prestoclient_serverinfo(PRESTOCLIENT *prestoclient)
 		ret.memory = NULL;
 	}
 
-	curl_easy_cleanup(curl);
+	release_curl(prestoclient, curl);
 	return ret.memory;
 }
 
-int prestoclient_query(PRESTOCLIENT *prestoclient, 
+// Turn the state of a result into a return code. A streamed result may still be running.
+static int check_result(PRESTOCLIENT_RESULT *ret, bool streaming)
+{
+	if (ret->cancelquery)
+	{
+		// Cancelled while the last request was already done
+		if (ret->errorcode != PRESTOCLIENT_RESULT_CANCELLED && ret->errorcode != PRESTOCLIENT_RESULT_TIMEOUT)
+			cancel(ret);
+		return ret->timedout ? PRESTO_TIMEOUT : PRESTO_CANCELLED;
+	}
+
+	// nevertheless we have to check for presto errors in the body of the result (not header code only)
+	// Query succeeded ?
+	if (prestoclient_getstatus(ret) != PRESTOCLIENT_STATUS_SUCCEEDED &&
+		!(streaming && prestoclient_getstatus(ret) == PRESTOCLIENT_STATUS_RUNNING))
+		return PRESTO_BACKEND_ERROR;
+
+	// Messages from presto server
+	if (prestoclient_getlastservererror(ret))
+	{
+		printf("%s\n", prestoclient_getlastservererror(ret));
+		printf("Serverstate = %s\n", prestoclient_getlastserverstate(ret));
+		return PRESTO_BACKEND_ERROR;
+	}
+
+	// Messages from prestoclient
+	if (prestoclient_getlastclienterror(ret))
+	{
+		printf("%s\n", prestoclient_getlastclienterror(ret));
+		return PRESTO_BACKEND_ERROR;
+	}
+
+	// Messages from curl
+	if (prestoclient_getlastcurlerror(ret))
+	{
+		printf("%s\n", prestoclient_getlastcurlerror(ret));
+		return PRESTO_BACKEND_ERROR;
+	}
+
+	return PRESTO_OK;
+}
+
+// Post a query and wait until it is finished or, when streaming, until the first rows arrived
+static int start_query(PRESTOCLIENT *prestoclient, 
 						PRESTOCLIENT_RESULT **result,
 						const char *sql_qry,
 						void (*in_write_callback_function)(void *, void *),						
-						void *in_client_object)
-	{
+						void (*in_page_callback_function)(PRESTOCLIENT_RESULT*, const PRESTOCLIENT_PAGE*, void*),
+						void *in_client_object,
+						bool streaming)
+{
 	int rc = PRESTOCLIENT_RESULT_OK;
 	PRESTOCLIENT_RESULT *ret = NULL;	
 
@@ -1260,9 +2420,21 @@ int prestoclient_query(PRESTOCLIENT *prestoclient,
 			goto exit;
 		}
 
+		// The rows go page by page to the page callback of the query or of the client (see prestoclient_on_page)
+		if (!in_page_callback_function && !in_write_callback_function)
+			in_page_callback_function = prestoclient->page_callback_function;
+		if (in_page_callback_function)
+		{
+			ret->page_callback_function = in_page_callback_function;
+			ret->write_callback_function = &write_callback_page;
+		}
+
 		// Add resultset to the client
 		add_result(ret);
 
+		if (prestoclient->querytimeout > 0)
+			ret->deadline = util_now_msec() + prestoclient->querytimeout;
+
 		// Create request
 		if (do_http_request(PRESTOCLIENT_HTTP_REQUEST_TYPE_POST,
 					ret->hcurl,
@@ -1270,42 +2442,26 @@ int prestoclient_query(PRESTOCLIENT *prestoclient,
 					sql_qry, 
 					ret) == PRESTOCLIENT_RESULT_OK)
 		{
-			// Start polling server for data
-			prestoclient_waituntilfinished(ret);
-			columns_print(ret->columns, ret->columncount);
-			tablebuffer_print(ret->tablebuff);
-			
-			// nevertheless we have to check for presto errors in the body of the result (not header code only)
-			// Query succeeded ?
-			if (prestoclient_getstatus(ret) != PRESTOCLIENT_STATUS_SUCCEEDED) {
-				rc = PRESTO_BACKEND_ERROR;
-				goto exit;
-			}
+			// The response to the post has no status yet
+			if (ret->lastnexturi && strlen(ret->lastnexturi) > 0)
+				ret->clientstatus = PRESTOCLIENT_STATUS_RUNNING;
 
-			// Messages from presto server
-			if (prestoclient_getlastservererror(ret))
+			// Start polling server for data
+			if (streaming)
 			{
-				printf("%s\n", prestoclient_getlastservererror(ret));
-				printf("Serverstate = %s\n", prestoclient_getlastserverstate(ret));
-				rc = PRESTO_BACKEND_ERROR;
-				goto exit;
+				prestoclient_waitforrows(ret, 0);
 			}
-
-			// Messages from prestoclient
-			if (prestoclient_getlastclienterror(ret))
+			else
 			{
-				printf("%s\n", prestoclient_getlastclienterror(ret));
-				rc = PRESTO_BACKEND_ERROR;
-				goto exit;
+				prestoclient_waituntilfinished(ret);
+				columns_print(ret->columns, ret->columncount);
+				tablebuffer_print(ret->tablebuff);
 			}
 
-			// Messages from curl
-			if (prestoclient_getlastcurlerror(ret))
-			{
-				printf("%s\n", prestoclient_getlastcurlerror(ret));
-				rc = PRESTO_BACKEND_ERROR;
-				goto exit;
-			}
+			rc = check_result(ret, streaming);
+		} else if (ret->cancelquery) {
+			cancel(ret);
+			rc = ret->timedout ? PRESTO_TIMEOUT : PRESTO_CANCELLED;
 		} else {
 			rc = PRESTO_BAD_REQUEST;
 		}
@@ -1324,6 +2480,81 @@ exit:
 	return rc;
 }
 
+int prestoclient_query(PRESTOCLIENT *prestoclient, 
+						PRESTOCLIENT_RESULT **result,
+						const char *sql_qry,
+						void (*in_write_callback_function)(void *, void *),						
+						void *in_client_object)
+{
+	return start_query(prestoclient, result, sql_qry, in_write_callback_function, NULL, in_client_object, false);
+}
+
+int prestoclient_querystart(PRESTOCLIENT *prestoclient, 
+						PRESTOCLIENT_RESULT **result,
+						const char *sql_qry,
+						void (*in_write_callback_function)(void *, void *),						
+						void *in_client_object)
+{
+	return start_query(prestoclient, result, sql_qry, in_write_callback_function, NULL, in_client_object, true);
+}
+
+// Like prestoclient_querystart with a page callback of the query itself, see arrowexport.h
+int start_paged_query(PRESTOCLIENT *prestoclient,
+					  PRESTOCLIENT_RESULT **result,
+					  const char *sql_qry,
+					  void (*in_page_callback_function)(PRESTOCLIENT_RESULT*, const PRESTOCLIENT_PAGE*, void*),
+					  void *in_client_object)
+{
+	return start_query(prestoclient, result, sql_qry, NULL, in_page_callback_function, in_client_object, true);
+}
+
+int prestoclient_fetchmore(PRESTOCLIENT_RESULT *result)
+{
+	if (!result || result->abandoned)
+		return PRESTO_BAD_REQUEST;
+
+	// Finished, failed or a result of prestoclient_query
+	if (result->clientstatus != PRESTOCLIENT_STATUS_RUNNING)
+		return PRESTO_OK;
+
+	// Rows of the range queries of partitions_query
+	if (result->partitions)
+		return partitions_fetchmore(result);
+
+	prestoclient_waitforrows(result, result->rowsreceived);
+
+	return check_result(result, true);
+}
+
+void prestoclient_setmaxrows(PRESTOCLIENT_RESULT *result, size_t maxrows)
+{
+	if (!result)
+		return;
+
+	result->maxrows = maxrows;
+	apply_maxrows(result);
+}
+
+void prestoclient_closequery(PRESTOCLIENT_RESULT *result)
+{
+	if (!result)
+		return;
+
+	if (result->clientstatus == PRESTOCLIENT_STATUS_RUNNING && result->partitions)
+	{
+		partitions_stop(result->partitions);
+		result->abandoned = true;
+		result->clientstatus = PRESTOCLIENT_STATUS_SUCCEEDED;
+	}
+
+	if (result->clientstatus == PRESTOCLIENT_STATUS_RUNNING && result->lastnexturi && strlen(result->lastnexturi) > 0)
+	{
+		release_query(result);
+		result->abandoned = true;
+		result->clientstatus = PRESTOCLIENT_STATUS_SUCCEEDED;
+	}
+}
+
 int prestoclient_prepare(PRESTOCLIENT *prestoclient, 
 						PRESTOCLIENT_RESULT **result,
 						const char *in_sql_statement)
@@ -1600,6 +2831,9 @@ int prestoclient_execute(PRESTOCLIENT *prestoclient
 
 		prepared_result->user_data = in_client_object;
 
+		if (prestoclient->querytimeout > 0)
+			prepared_result->deadline = util_now_msec() + prestoclient->querytimeout;
+
 		exec_sql = (char *)malloc(strlen(prepared_result->prepared_stmt_name) + 15);
 		sprintf(exec_sql, "EXECUTE %s ", prepared_result->prepared_stmt_name);
 
@@ -1613,6 +2847,13 @@ int prestoclient_execute(PRESTOCLIENT *prestoclient
 			// Start polling server for data
 			prestoclient_waituntilfinished(prepared_result);
 
+			// The prepared statement stays usable, only this execution was stopped
+			if (prepared_result->cancelquery)
+			{
+				free(exec_sql);
+				return check_result(prepared_result, false);
+			}
+
 			columns_print(prepared_result->columns, prepared_result->columncount);
 			tablebuffer_print(prepared_result->tablebuff);
 		}
@@ -1704,7 +2945,7 @@ void prestoclient_deleteresult(PRESTOCLIENT *prestoclient, PRESTOCLIENT_RESULT *
 	{		
 		prestoclient_unprepare(prestoclient, result);
 		if (result)
-			prestoclient_cancelquery(result);
+			prestoclient_closequery(result);
 		if (result)
 			delete_prestoresult(result);
 		result = NULL;
@@ -1847,12 +3088,195 @@ int prestoclient_getnullcolumnvalue(PRESTOCLIENT_RESULT *result, const size_t co
 	return result->columns[columnindex]->dataisnull ? true : false;
 }
 
+void prestoclient_setquerytimeout(PRESTOCLIENT *prestoclient, long long msec)
+{
+	if (prestoclient)
+		prestoclient->querytimeout = msec > 0 ? msec : 0;
+}
+
+void prestoclient_setpriority(PRESTOCLIENT *prestoclient, int priority)
+{
+	if (prestoclient)
+		prestoclient->priority = priority;
+}
+
+// Names of Accept-Encoding and whether the linked libcurl can decode them
+static bool can_decompress(const char *codec, size_t length, bool *known)
+{
+	curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+
+	*known = true;
+	if ((length == 4 && strncmp(codec, "gzip", 4) == 0) || (length == 7 && strncmp(codec, "deflate", 7) == 0))
+		return (info->features & CURL_VERSION_LIBZ) != 0;
+	if (length == 4 && strncmp(codec, "zstd", 4) == 0)
+#ifdef CURL_VERSION_ZSTD
+		return (info->features & CURL_VERSION_ZSTD) != 0;
+#else
+		return false;
+#endif
+	if (length == 2 && strncmp(codec, "br", 2) == 0)
+#ifdef CURL_VERSION_BROTLI
+		return (info->features & CURL_VERSION_BROTLI) != 0;
+#else
+		return false;
+#endif
+
+	*known = false;
+	return false;
+}
+
+int prestoclient_setcompression(PRESTOCLIENT *prestoclient, const char *codecs)
+{
+	char *encoding = NULL;
+	const char *codec = codecs;
+
+	if (!prestoclient)
+		return PRESTO_BAD_REQUEST;
+
+	while (codec && *codec)
+	{
+		size_t length;
+		bool known;
+
+		while (*codec == ' ' || *codec == ',')
+			codec++;
+		length = strcspn(codec, " ,");
+		if (length == 0)
+			break;
+
+		if (can_decompress(codec, length, &known))
+		{
+			size_t used = encoding ? strlen(encoding) : 0;
+
+			encoding = (char *)realloc(encoding, used + length + 3);
+			if (!encoding)
+				exit(1);
+			sprintf(encoding + used, "%s%.*s", used ? ", " : "", (int)length, codec);
+		}
+		else if (!known)
+		{
+			if (encoding)
+				free(encoding);
+			return PRESTO_BAD_REQUEST;
+		}
+		codec += length;
+	}
+
+	if (prestoclient->compression)
+		free(prestoclient->compression);
+	prestoclient->compression = encoding;
+
+	return PRESTO_OK;
+}
+
+int prestoclient_setcafile(PRESTOCLIENT *prestoclient, const char *path)
+{
+	if (!prestoclient)
+		return PRESTO_BAD_REQUEST;
+
+	if (prestoclient->cafile)
+		free(prestoclient->cafile);
+	prestoclient->cafile = NULL;
+	if (path && strlen(path) > 0)
+		alloc_copy(&prestoclient->cafile, path);
+
+	return PRESTO_OK;
+}
+
+int prestoclient_setpagesize(PRESTOCLIENT *prestoclient, size_t first, size_t max)
+{
+	if (!prestoclient)
+		return PRESTO_BAD_REQUEST;
+
+	if (first > 0 || max > 0)
+	{
+		first = first > 0 ? first : PRESTOCLIENT_PAGESIZE_FIRST;
+		max = max > 0 ? max : PRESTOCLIENT_PAGESIZE_MAX;
+		if (first > max)
+			return PRESTO_BAD_REQUEST;
+	}
+
+	prestoclient->firstpagesize = first;
+	prestoclient->maxpagesize = max;
+
+	return PRESTO_OK;
+}
+
+size_t prestoclient_getpagesize(const PRESTOCLIENT_RESULT *result)
+{
+	return result ? result->pagesize : 0;
+}
+
+void prestoclient_sethotpages(PRESTOCLIENT *prestoclient, size_t hotpages)
+{
+	if (prestoclient)
+		prestoclient->hotpages = hotpages;
+}
+
+char **prestoclient_getrow(PRESTOCLIENT_RESULT *result, size_t row)
+{
+	PRESTOCLIENT_TABLEBUFFER *tab;
+
+	if (!result || !(tab = result->tablebuff) || !tab->rowbuff || row >= tab->nrow)
+		return NULL;
+
+	// Only rows of this result alone are compressed, see pagestore.h
+	if (!tab->store && result->hotpages > 0 && tab->refcount == 1 && !tab->mapping)
+		tab->store = pagestore_new(result->hotpages);
+	if (!tab->store)
+		return &tab->rowbuff[row * tab->ncol];
+
+	return pagestore_row(tab, row);
+}
+
+void prestoclient_getbytes(const PRESTOCLIENT_RESULT *result, size_t *wirebytes, size_t *bodybytes)
+{
+	size_t wire = 0, body = 0;
+
+	if (result)
+	{
+		wire = result->wirebytes;
+		body = result->bodybytes;
+		if (result->partitions)
+			partitions_bytes(result->partitions, &wire, &body);
+	}
+
+	if (wirebytes)
+		*wirebytes = wire;
+	if (bodybytes)
+		*bodybytes = body;
+}
+
+void prestoclient_on_page(PRESTOCLIENT *prestoclient,
+						  void (*in_page_callback_function)(PRESTOCLIENT_RESULT*, const PRESTOCLIENT_PAGE*, void*))
+{
+	if (prestoclient)
+		prestoclient->page_callback_function = in_page_callback_function;
+}
+
 void prestoclient_cancelquery(PRESTOCLIENT_RESULT *result)
 {
 	if (result)
 		result->cancelquery = true;
 }
 
+void prestoclient_cancelqueries(PRESTOCLIENT *prestoclient, void *in_client_object)
+{
+	if (!prestoclient)
+		return;
+
+	// Results are only freed after remove_result, so holding the lock keeps them alive
+	util_mutex_lock(&prestoclient->lock);
+	for (size_t i = 0; i < prestoclient->active_results; i++)
+	{
+		PRESTOCLIENT_RESULT *result = prestoclient->results[i];
+
+		if (!in_client_object || result->user_data == in_client_object)
+			result->cancelquery = true;
+	}
+	util_mutex_unlock(&prestoclient->lock);
+}
+
 char *prestoclient_getlastclienterror(PRESTOCLIENT_RESULT *result)
 {
 	if (!result)
@@ -1872,6 +3296,12 @@ char *prestoclient_getlastclienterror(PRESTOCLIENT_RESULT *result)
 		return "CURL error occurred";
 	case PRESTOCLIENT_RESULT_PARSE_JSON_ERROR:
 		return "Error parsing returned json object";
+	case PRESTOCLIENT_RESULT_CANCELLED:
+		return "Query was cancelled";
+	case PRESTOCLIENT_RESULT_TIMEOUT:
+		return "Query timed out";
+	case PRESTOCLIENT_RESULT_UNAVAILABLE:
+		return "Coordinator is unavailable, requests fail until it recovers";
 	default:
 		return "Invalid errorcode";
 	}
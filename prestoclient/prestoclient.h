@@ -33,6 +33,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -44,8 +45,8 @@ extern "C" {
 #define PRESTOCLIENT_URLTIMEOUT           5000            //!< Timeout in millisec to wait for Presto server to respond
 #define PRESTOCLIENT_UPDATEWAITTIMEMSEC   20              //!< Wait time in millisec to wait between requests to Presto server
 #define PRESTOCLIENT_RETRIEVEWAITTIMEMSEC 20              //!< Wait time in millisec to wait before getting next data packet
-#define PRESTOCLIENT_RETRYWAITTIMEMSEC    100             //!< Wait time in millisec to wait before retrying a request
-#define PRESTOCLIENT_MAXIMUMRETRIES       5               //!< Maximum number of retries for request in case of 503 errors
+#define PRESTOCLIENT_PAGESIZE_FIRST       65536           //!< Default target size in bytes of the first page of a query, see prestoclient_setpagesize
+#define PRESTOCLIENT_PAGESIZE_MAX         16777216        //!< Default size in bytes the pages of a query may grow to
 #define PRESTOCLIENT_DEFAULT_PORT         8080            //!< Default tcp port of presto server
 #define PRESTOCLIENT_DEFAULT_CATALOG      "system"        //!< Default presto catalog name
 #define PRESTOCLIENT_DEFAULT_SCHEMA       "runtime"       //!< Default presto schema name
@@ -55,7 +56,9 @@ enum PRESTO_RESULTCODES
 	PRESTO_OK = 0,		          //!< all went well
 	PRESTO_BAD_REQUEST,			  //!< caller did not provide sufficient parameters
 	PRESTO_NO_MEMORY,			  //!< memory allocation error 
-	PRESTO_BACKEND_ERROR		  //!< presto backend issued an error
+	PRESTO_BACKEND_ERROR,		  //!< presto backend issued an error
+	PRESTO_CANCELLED,			  //!< query was cancelled by prestoclient_cancelquery or prestoclient_cancelqueries
+	PRESTO_TIMEOUT				  //!< query was cancelled because it ran longer than prestoclient_setquerytimeout allows
 };
 
 /* --- Enums ---------------------------------------------------------------------------------------------------------- */
@@ -144,6 +147,20 @@ typedef struct ST_PRESTOCLIENT_RESULT PRESTOCLIENT_RESULT;
  */
 typedef struct ST_PRESTOCLIENT        PRESTOCLIENT;
 
+/**
+ * \brief  The rows of one page of a result as column vectors, see prestoclient_on_page. All members are private.
+ */
+typedef struct ST_PRESTOCLIENT_PAGE   PRESTOCLIENT_PAGE;
+
+/**
+ * \brief  Text of a value inside a PRESTOCLIENT_PAGE, valid during the page callback. data is NULL for NULL.
+ */
+typedef struct ST_PRESTOCLIENT_STRING_VIEW
+{
+	const char                   *data;                         //!< Text of the value, not null terminated
+	size_t                        length;                       //!< Length of the text
+} PRESTOCLIENT_STRING_VIEW;
+
 /* --- Functions ------------------------------------------------------------------------------------------------------ */
 /**
  * \brief               Get the version string of prestoclient
@@ -215,6 +232,50 @@ int    					prestoclient_query                      (PRESTOCLIENT *prestoclient
                                                                 , void *in_client_object
                                                                 );
 
+/**
+ * \brief               Start a query and return as soon as the first rows arrived or the query finished
+ *                      The parameters are the same as for prestoclient_query. While prestoclient_getstatus returns
+ *                      PRESTOCLIENT_STATUS_RUNNING more rows are pulled with prestoclient_fetchmore.
+ *
+ * \return              PRESTO_OK or an error code, result is NULL on error
+ */
+int    					prestoclient_querystart                 (PRESTOCLIENT *prestoclient
+																, PRESTOCLIENT_RESULT** result
+                                                                , const char *in_sql_statement
+                                                                , void (*in_write_callback_function)(void*, void*)                                                                
+                                                                , void *in_client_object
+                                                                );
+
+/**
+ * \brief               Pull pages of a result started with prestoclient_querystart until new rows arrived or the query finished
+ *
+ * \param result        A handle to a PRESTOCLIENT_RESULT object
+ *
+ * \return              PRESTO_OK, also when there are no more rows, or an error code
+ */
+int                     prestoclient_fetchmore                  (PRESTOCLIENT_RESULT *result);
+
+/**
+ * \brief               Limit the number of rows of a result
+ *                      Rows beyond the limit are dropped and once the limit is reached no more pages are requested
+ *                      and the query is cancelled on the server. Use on a result of prestoclient_querystart before
+ *                      prestoclient_fetchmore.
+ *
+ * \param result        A handle to a PRESTOCLIENT_RESULT object
+ * \param maxrows       Maximum number of rows, 0 for all rows
+ */
+void                    prestoclient_setmaxrows                 (PRESTOCLIENT_RESULT *result, size_t maxrows);
+
+/**
+ * \brief               Stop reading a result before its end
+ *                      A query that is still running is cancelled on the server right away and the buffered rows
+ *                      are dropped. The result is marked abandoned and delivers no more rows.
+ *                      prestoclient_deleteresult closes the query too.
+ *
+ * \param result        A handle to a PRESTOCLIENT_RESULT object
+ */
+void                    prestoclient_closequery                 (PRESTOCLIENT_RESULT *result);
+
 /**
  * \brief 				prepare query preparation to mimic odbc api
  */
@@ -313,16 +374,212 @@ char*                   prestoclient_getcolumndata              (PRESTOCLIENT_RE
  */
 int                     prestoclient_getnullcolumnvalue         (PRESTOCLIENT_RESULT *result, const size_t columnindex);
 
+/**
+ * \brief               Deliver the rows of queries started afterwards page by page instead of row by row
+ *                      Queries started with prestoclient_query or prestoclient_querystart without a write callback
+ *                      of their own hand every page to the page callback as typed column vectors and keep no rows
+ *                      in the result. The callback gets the result, the page and the in_client_object of the query.
+ *                      The page and its vectors are only valid during the call. Rows beyond a limit of
+ *                      prestoclient_setmaxrows are not delivered.
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT object
+ * \param in_page_callback_function  Function called for every page, NULL delivers row by row again
+ */
+void                    prestoclient_on_page                    (PRESTOCLIENT *prestoclient
+                                                                , void (*in_page_callback_function)(PRESTOCLIENT_RESULT*, const PRESTOCLIENT_PAGE*, void*));
+
+/**
+ * \brief               Number of rows of a page
+ */
+size_t                  prestoclient_getpagerowcount            (const PRESTOCLIENT_PAGE *page);
+
+/**
+ * \brief               Null bitmap of a column of a page
+ *                      Bit i, counted from the least significant bit of the first byte, is 0 when the value of row i
+ *                      is NULL. This is the layout of an Arrow validity bitmap.
+ *
+ * \param page          A page handed to the page callback
+ * \param columnindex   Zero based index of column. Should be smaller than number returned by prestoclient_getcolumncount
+ *
+ * \return              (rows + 7) / 8 bytes
+ */
+const unsigned char*    prestoclient_getcolumn_validity         (const PRESTOCLIENT_PAGE *page, const size_t columnindex);
+
+/**
+ * \brief               Returns true if the value of a row of a column of a page is NULL
+ */
+bool                    prestoclient_getcolumn_isnull           (const PRESTOCLIENT_PAGE *page, const size_t columnindex, const size_t row);
+
+/**
+ * \brief               Values of a tinyint, smallint, integer, bigint or boolean column of a page, NULLs are 0
+ *
+ * \return              One value per row or NULL for a column of another type
+ */
+const int64_t*          prestoclient_getcolumn_int64            (const PRESTOCLIENT_PAGE *page, const size_t columnindex);
+
+/**
+ * \brief               Values of a real, double or decimal column of a page, NULLs are 0.0
+ *
+ * \return              One value per row or NULL for a column of another type
+ */
+const double*           prestoclient_getcolumn_double           (const PRESTOCLIENT_PAGE *page, const size_t columnindex);
+
+/**
+ * \brief               Text of the values of a column of any type of a page, without copying them
+ *
+ * \return              One view per row
+ */
+const PRESTOCLIENT_STRING_VIEW* prestoclient_getcolumn_string_view(const PRESTOCLIENT_PAGE *page, const size_t columnindex);
+
+/**
+ * \brief               Limit the time a query may take
+ *                      Applies to queries started afterwards and covers the query request, the polling for the
+ *                      result and the pages fetched with prestoclient_fetchmore. When the time is up the query is
+ *                      cancelled like with prestoclient_cancelquery and PRESTO_TIMEOUT is returned.
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT object
+ * \param msec          Milliseconds from the start of the query, 0 for no limit
+ */
+void                    prestoclient_setquerytimeout            (PRESTOCLIENT *prestoclient, long long msec);
+
+/**
+ * \brief               Set the priority of queries started afterwards
+ *                      A client attached to an admission control with ADMISSION_PRIORITY order (see admission.h)
+ *                      lets its queries wait for a coordinator in front of the queries with a lower priority.
+ *                      A client attached to a page scheduler (see pagescheduler.h) fetches the pages of queries
+ *                      with a positive priority before the pages of bulk queries.
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT object
+ * \param priority      Higher values are served first, 0 is the default
+ */
+void                    prestoclient_setpriority                (PRESTOCLIENT *prestoclient, int priority);
+
+/**
+ * \brief               Set the encodings of the pages of queries started afterwards
+ *                      The client asks the coordinator for the encodings in the order given and decodes every response
+ *                      by its Content-Type, json is always accepted as the fallback (see decoder.h).
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT object
+ * \param encodings     Comma separated list of "json" and "arrow", most preferred first, NULL for json only
+ *
+ * \return              PRESTO_OK or PRESTO_BAD_REQUEST for an unknown encoding
+ */
+int                     prestoclient_setencoding                (PRESTOCLIENT *prestoclient, const char *encodings);
+
+/**
+ * \brief               Let queries started afterwards receive their rows as spooled segments
+ *                      A coordinator speaking the spooling protocol hands out large results as segments the client
+ *                      downloads next to the coordinator, several at a time (see segments.h). Coordinators not
+ *                      spooling keep sending the rows in their pages.
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT object
+ * \param parallel      Segments downloaded at a time, at most SEGMENTS_MAXPARALLEL, 0 for rows in the pages
+ *
+ * \return              PRESTO_OK or PRESTO_BAD_REQUEST
+ */
+int                     prestoclient_setspooling                (PRESTOCLIENT *prestoclient, size_t parallel);
+
+/**
+ * \brief               Set the compressions the responses of queries started afterwards may use
+ *                      The client sends them as Accept-Encoding and libcurl inflates a compressed response chunk by
+ *                      chunk on its way to the parser, a page is never held compressed as a whole. Compressions the
+ *                      linked libcurl cannot decode are left out, a server not compressing answers as before.
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT object
+ * \param codecs        Comma separated list of "gzip", "deflate", "zstd" and "br", most preferred first, NULL for none
+ *
+ * \return              PRESTO_OK or PRESTO_BAD_REQUEST for an unknown compression
+ */
+int                     prestoclient_setcompression             (PRESTOCLIENT *prestoclient, const char *codecs);
+
+/**
+ * \brief               Verify the coordinators of requests started afterwards against the certificates of a file
+ *                      Instead of the certificate store of the system, for coordinators with a certificate of a private
+ *                      authority. Spooled segments are still verified against the system store.
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT object
+ * \param path          PEM file of the certificates, NULL for the certificate store of the system
+ *
+ * \return              PRESTO_OK
+ */
+int                     prestoclient_setcafile                  (PRESTOCLIENT *prestoclient, const char *path);
+
+/**
+ * \brief               Let the pages of queries started afterwards grow from a small first page
+ *                      The client asks the coordinator for pages of a target size (X-Presto-Max-Size). The first page
+ *                      is small so the first rows arrive early. The target doubles with every page that came back
+ *                      full while the consumer of the rows keeps up with fetching and parsing them, up to max. A
+ *                      consumer slower than the client keeps the pages at their size, larger ones would only hold
+ *                      more rows in memory. Coordinators not knowing the header send pages of their default size.
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT object
+ * \param first         Target size in bytes of the first page, 0 for PRESTOCLIENT_PAGESIZE_FIRST
+ * \param max           Size in bytes the pages may grow to, 0 for PRESTOCLIENT_PAGESIZE_MAX. Both 0 leave the size
+ *                      of the pages to the coordinator
+ *
+ * \return              PRESTO_OK or PRESTO_BAD_REQUEST when first is larger than max
+ */
+int                     prestoclient_setpagesize                (PRESTOCLIENT *prestoclient, size_t first, size_t max);
+
+/**
+ * \brief               Target size in bytes of the next page of a query, 0 when the coordinator decides
+ *
+ * \param result        A handle to a PRESTOCLIENT_RESULT object
+ */
+size_t                  prestoclient_getpagesize                (const PRESTOCLIENT_RESULT *result);
+
+/**
+ * \brief               Keep the rows queries started afterwards left behind compressed in memory
+ *                      Rows read with prestoclient_getrow more than hotpages pages of PAGESTORE_PAGEROWS rows behind
+ *                      the row read are compressed, reading them again decompresses their page (see pagestore.h).
+ *                      Results shared through the result cache are never compressed.
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT object
+ * \param hotpages      Pages kept decompressed, 0 keeps every row as it came
+ */
+void                    prestoclient_sethotpages                (PRESTOCLIENT *prestoclient, size_t hotpages);
+
+/**
+ * \brief               The cells of a buffered row, decompressed when needed
+ *
+ * \param result        A handle to a PRESTOCLIENT_RESULT object
+ * \param row           Index of the row in the buffered rows
+ *
+ * \return              The cells of the row, valid until the next call for the result, or NULL for a row out of range
+ */
+char                  **prestoclient_getrow                     (PRESTOCLIENT_RESULT *result, size_t row);
+
+/**
+ * \brief               Bytes a query received so far
+ *                      Both counts cover the pages, spooled segments and the range queries of a partitioned query
+ *                      that ended. Without compression they are the same.
+ *
+ * \param result        A handle to a PRESTOCLIENT_RESULT object
+ * \param wirebytes     Out: body bytes as they came over the network, NULL if not needed
+ * \param bodybytes     Out: body bytes after decompression, NULL if not needed
+ */
+void                    prestoclient_getbytes                   (const PRESTOCLIENT_RESULT *result, size_t *wirebytes, size_t *bodybytes);
+
 /**
  * \brief               Inform prestoclient to cancel the running query
- *                      Prestoclient should cancel the running query. As soon as prestoclient detects this signal and is not
- *                      in the middle of handling a curl response, it will send a cancel query request to the Presto server
- *                      and return from the prestoclient_query function.
+ *                      Prestoclient should cancel the running query. A transfer in progress is aborted, a cancel query
+ *                      request is sent to the Presto server, buffered rows are dropped and prestoclient_query returns
+ *                      PRESTO_CANCELLED.
  *
  * \param result        A handle to a PRESTOCLIENT_RESULT object
  */
 void                    prestoclient_cancelquery                (PRESTOCLIENT_RESULT *result);
 
+/**
+ * \brief               Cancel the running queries of a client that were started with in_client_object.
+ *                      Unlike prestoclient_cancelquery this needs no result handle, so it can be called from another
+ *                      thread while prestoclient_query is still running.
+ *
+ * \param prestoclient  A handle to a PRESTOCLIENT
+ * \param in_client_object  The object passed to prestoclient_query, NULL cancels all queries of the client
+ */
+void                    prestoclient_cancelqueries              (PRESTOCLIENT *prestoclient, void *in_client_object);
+
 /**
  * \brief               Return error message of last executed request generated by the prestoserver
  *
@@ -36,6 +36,18 @@
 #include "json.h"
 #include "prestojson.h"
 
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION UTIL_MUTEX;
+typedef CONDITION_VARIABLE UTIL_COND;
+typedef HANDLE UTIL_THREAD;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t UTIL_MUTEX;
+typedef pthread_cond_t UTIL_COND;
+typedef pthread_t UTIL_THREAD;
+#endif
+
 /* --- Defines -------------------------------------------------------------------------------------------------------- */
 #define PRESTOCLIENT_QUERY_URL "v1/statement" 				// URL added to servername to start a query
 #define PRESTOCLIENT_INFO_URL "v1/info"					    // URL added to get info from server
@@ -43,6 +55,8 @@
 #define PRESTOCLIENT_CURL_EXPECT_HTTP_GET_POST 200			// Expected http response code for get and post requests
 #define PRESTOCLIENT_CURL_EXPECT_HTTP_DELETE   204			// Expected http response code for delete requests
 #define PRESTOCLIENT_CURL_EXPECT_HTTP_BUSY     503			// Expected http response code when presto server is busy
+#define PRESTOCLIENT_MAXIDLEHANDLES            4			// Finished curl handles kept per client for reuse by the next request
+#define PRESTOCLIENT_CANCELCHECKMSEC           10			// Waits between requests are cut into slices of this length to notice a cancel
 
 /* --- Enums ---------------------------------------------------------------------------------------------------------- */
 enum E_RESULTCODES
@@ -52,7 +66,10 @@ enum E_RESULTCODES
 	PRESTOCLIENT_RESULT_SERVER_ERROR,
 	PRESTOCLIENT_RESULT_MAX_RETRIES_REACHED,
 	PRESTOCLIENT_RESULT_CURL_ERROR,
-	PRESTOCLIENT_RESULT_PARSE_JSON_ERROR
+	PRESTOCLIENT_RESULT_PARSE_JSON_ERROR,
+	PRESTOCLIENT_RESULT_CANCELLED,
+	PRESTOCLIENT_RESULT_TIMEOUT,
+	PRESTOCLIENT_RESULT_UNAVAILABLE
 };
 
 enum E_HTTP_REQUEST_TYPES
@@ -79,6 +96,9 @@ typedef struct ST_PRESTOCLIENT_COLUMN
 	bool                          alias;						//!< Set to true if is an alias
 } PRESTOCLIENT_COLUMN;
 
+typedef struct ST_DICTIONARY DICTIONARY;
+typedef struct ST_PAGESTORE PAGESTORE;
+
 typedef struct ST_PRESTOCLIENT_TABLEBUFFER
 {
 	char              		    **rowbuff;		//!< result array	
@@ -86,10 +106,28 @@ typedef struct ST_PRESTOCLIENT_TABLEBUFFER
 	size_t 						  nrow;			//!< number of rows in result array
 	size_t 						  ncol;			//!< number of columns in result array
 	ptrdiff_t 					  ndata;		//!< index into result array
-	int                           rowidx;       //!< row index pointer can be negative -1 for not started to iterate
+	volatile long                 refcount;     //!< number of results sharing this buffer (see resultcache.c)
+	void                         *mapping;      //!< file mapping the cells point into or NULL when cells are malloc'ed (see diskcache.c)
+	size_t                        mappingsize;  //!< size of the file mapping
+	DICTIONARY                  **dictionaries; //!< dictionaries of the varchar columns, then those of appended buffers, or NULL (see dictionary.h)
+	size_t                        ndictionaries;//!< number of entries in dictionaries, the first ncol belong to the columns
+	unsigned char                *interned;     //!< bit per cell of rowbuff, set when the cell points into a dictionary, or NULL
+	PAGESTORE                    *store;        //!< keeps the rows behind the cursor compressed or NULL (see pagestore.h)
 } PRESTOCLIENT_TABLEBUFFER;
 
 typedef struct ST_PRESTOCLIENT PRESTOCLIENT;
+typedef struct ST_RETRYPOLICY RETRYPOLICY;
+typedef struct ST_ENDPOINTS ENDPOINTS;
+typedef struct ST_ENDPOINT ENDPOINT;
+typedef struct ST_ADMISSION ADMISSION;
+typedef struct ST_ADMISSION_GATE ADMISSION_GATE;
+typedef struct ST_PAGESCHEDULER PAGESCHEDULER;
+typedef struct ST_PARTITIONS PARTITIONS;
+typedef struct ST_PARSEPOOL PARSEPOOL;
+typedef struct ST_PARSEQUEUE PARSEQUEUE;
+typedef struct ST_DECODER DECODER;
+typedef struct ST_SEGMENTS SEGMENTS;
+typedef struct ST_MULTIPLEXER MULTIPLEXER;
 
 // way too many error fields ...
 typedef struct ST_PRESTOCLIENT_RESULT
@@ -111,8 +149,34 @@ typedef struct ST_PRESTOCLIENT_RESULT
 	char                         *prepared_stmt_name;           //!< prepared statement name
 	char                         *prepared_stmt_hdr;            //!< prepared statement header 
 
-	bool						  cancelquery;					//!< Boolean, when set to true signals that query should be cancelled	
+	volatile bool				  cancelquery;					//!< Boolean, when set to true signals that query should be cancelled, may be set from another thread
+	bool                          timedout;                     //!< The query was cancelled because its deadline passed
+	long long                     deadline;                     //!< util_now_msec() when the query times out, 0 for no limit
 	PRESTOCLIENT_TABLEBUFFER     *tablebuff;                    //!< Buffer for result rows of the http fetch (should not be more than 16 MB of json in one go)
+	int                           rowidx;                       //!< row index pointer into tablebuff can be negative -1 for not started to iterate
+	size_t                        rowsreceived;                 //!< Rows handed to write_callback_function so far
+	size_t                        responsebytes;                //!< Body bytes of the current response handed to the json parser
+	size_t                        wirebytes;                    //!< Body bytes of all responses of the query as received, see prestoclient_getbytes
+	size_t                        bodybytes;                    //!< Body bytes of all responses of the query after decompression
+	size_t                        resumes;                      //!< Pages requested again after the connection broke in the middle
+	size_t                        maxrows;                      //!< Stop the query after this many rows, 0 for all rows
+	ENDPOINT                     *endpoint;                     //!< Coordinator running the query when the client has a server list, see endpoints.h
+	ADMISSION_GATE               *gate;                         //!< Admission of the running query, see admission.h
+	int                           priority;                     //!< Priority of the client when the query started, see prestoclient_setpriority
+	PARTITIONS                   *partitions;                   //!< Range queries feeding the result of partitions_query or NULL, see partitions.h
+	bool                          abandoned;                    //!< Closed by prestoclient_closequery before the query finished
+	PARSEQUEUE                   *parsequeue;                   //!< Pages downloaded and not yet handed to the result or NULL, see parsepool.h
+	bool                          pipelined;                    //!< The page downloading now goes to parsequeue instead of the json parser
+	void (*page_callback_function)(PRESTOCLIENT_RESULT*, const PRESTOCLIENT_PAGE*, void*); //!< Gets the rows page by page or NULL, see prestoclient_on_page
+	PRESTOCLIENT_PAGE            *page;                         //!< Rows of the page parsed now when page_callback_function is set, see pagebuffer.h
+	const DECODER                *decoder;                      //!< Decoder of the response downloading now, see decoder.h
+	void                         *decoderstate;                 //!< State of decoder for the response downloading now
+	SEGMENTS                     *segments;                     //!< Segments of the page downloading now and their counters or NULL, see segments.h
+	void                         *multiplexstream;              //!< Stream of the request running on a multiplexer or NULL, see multiplexer.h
+	size_t                        pagesize;                     //!< Target size in bytes of the next page, 0 when the coordinator decides, see prestoclient_setpagesize
+	size_t                        maxpagesize;                  //!< Size in bytes pagesize may grow to
+	long long                     pageended;                    //!< util_now_msec() when the last response was in, waits of the client left out
+	size_t                        hotpages;                     //!< Pages of rows prestoclient_getrow keeps decompressed, 0 for no compression
 	PRESTOCLIENT_COLUMN			**columns;						//!< Buffer for the column information returned by the query	
 	size_t      				  columncount;					//!< Number of columns in output or 0 if unknown	
 	PRESTOCLIENT_COLUMN         **parameters;					//!< Buffer for the parameters returned by the query	
@@ -137,6 +201,30 @@ typedef struct ST_PRESTOCLIENT
 	PRESTOCLIENT_RESULT			**results;						//!< Array containing query status and data
 	size_t				         active_results;				//!< Number of queries issued
 	bool                         trace_http;					//!< trace http / verbose curl stuff
+	CURL                        *idlecurl[PRESTOCLIENT_MAXIDLEHANDLES]; //!< curl handles of deleted results, they keep their connections alive
+	size_t                        nidlecurl;					//!< Number of handles in idlecurl
+	UTIL_MUTEX                    lock;							//!< Protects idlecurl
+	CURLSH                       *share;						//!< dns, tls session and connection cache shared with other clients or NULL, see curlshare.h
+	long long                     querytimeout;					//!< Milliseconds a query may take, 0 for no limit, see prestoclient_setquerytimeout
+	RETRYPOLICY                  *retry;						//!< Retry policy and circuit breakers, see retrypolicy.h
+	bool                          ownretry;						//!< retry was created for this client and is freed with it
+	ENDPOINTS                    *endpoints;					//!< Coordinators of a server list or NULL for a single server, see endpoints.h
+	bool                          ownendpoints;					//!< endpoints was created for this client and is freed with it
+	ENDPOINT                    **candidates;					//!< Coordinators of the server list of this client
+	size_t                        ncandidates;					//!< Number of entries in candidates
+	ADMISSION                    *admission;					//!< Limits the queries running per coordinator or NULL, see admission.h
+	int                           priority;						//!< Priority of new queries, see prestoclient_setpriority
+	PAGESCHEDULER                *scheduler;					//!< Orders the page requests by priority or NULL, see pagescheduler.h
+	PARSEPOOL                    *parsepool;					//!< Parses the pages of buffered queries on worker threads or NULL, see parsepool.h
+	void (*page_callback_function)(PRESTOCLIENT_RESULT*, const PRESTOCLIENT_PAGE*, void*); //!< Page callback of new queries or NULL, see prestoclient_on_page
+	char                         *accept;						//!< Accept header of the encodings of new requests or NULL for json, see prestoclient_setencoding
+	size_t                        spooling;						//!< Spooled segments downloaded at a time, 0 for rows inline in the pages, see prestoclient_setspooling
+	char                         *compression;					//!< Accept-Encoding of new requests or NULL for none, see prestoclient_setcompression
+	char                         *cafile;						//!< Certificates the coordinators are verified against or NULL for the system ones, see prestoclient_setcafile
+	MULTIPLEXER                  *multiplexer;					//!< Performs the requests on shared http/2 connections or NULL, see multiplexer.h
+	size_t                        firstpagesize;				//!< Target size in bytes of the first page of new queries, 0 when the coordinator decides, see prestoclient_setpagesize
+	size_t                        maxpagesize;					//!< Size in bytes the pages of new queries may grow to
+	size_t                        hotpages;						//!< Pages of rows new queries keep decompressed, 0 for no compression, see prestoclient_sethotpages
 } PRESTOCLIENT;
 
 /* --- Functions ------------------------------------------------------------------------------------------------------ */
@@ -144,6 +232,23 @@ typedef struct ST_PRESTOCLIENT
 // Utility functions
 extern char* get_username();
 extern void util_sleep(const int sleeptime_msec);
+extern long long util_now_msec();
+extern void util_mutex_init(UTIL_MUTEX *mutex);
+extern void util_mutex_destroy(UTIL_MUTEX *mutex);
+extern void util_mutex_lock(UTIL_MUTEX *mutex);
+extern void util_mutex_unlock(UTIL_MUTEX *mutex);
+extern void util_cond_init(UTIL_COND *cond);
+extern void util_cond_destroy(UTIL_COND *cond);
+extern void util_cond_wait(UTIL_COND *cond, UTIL_MUTEX *mutex);
+extern void util_cond_broadcast(UTIL_COND *cond);
+extern void util_cond_timedwait(UTIL_COND *cond, UTIL_MUTEX *mutex, int msec);
+extern int util_thread_start(UTIL_THREAD *thread, void (*function)(void *), void *arg);
+extern void util_thread_join(UTIL_THREAD thread);
+extern long util_atomic_add(volatile long *value, long delta);
+extern unsigned long long util_hash(const char *str);
+extern void *util_map_file(const char *path, size_t *size);
+extern void util_unmap_file(void *addr, size_t size);
+extern size_t util_download_size(CURL *hcurl);
 
 // Memory handling functions
 extern void alloc_copy(char **var, const char *newvalue);
@@ -152,6 +257,20 @@ extern void alloc_add(char **var, const char *addedvalue);
 // this is ugly and should not be part of the external contract
 extern PRESTOCLIENT_COLUMN* new_prestocolumn();
 extern PRESTOCLIENT_TABLEBUFFER* new_tablebuffer();
+extern PRESTOCLIENT_TABLEBUFFER* tablebuffer_retain(PRESTOCLIENT_TABLEBUFFER *tab);
+extern void grow_tablebuffer(PRESTOCLIENT_TABLEBUFFER *tab, size_t addsize);
+extern void tablebuffer_addrow(PRESTOCLIENT_TABLEBUFFER **tab, PRESTOCLIENT_COLUMN **columns, size_t columncount);
+extern void tablebuffer_release(PRESTOCLIENT_TABLEBUFFER *tab);
+extern void tablebuffer_append(PRESTOCLIENT_TABLEBUFFER *tab, PRESTOCLIENT_TABLEBUFFER *rows);
+extern bool tablebuffer_interned(const PRESTOCLIENT_TABLEBUFFER *tab, size_t cell);
+extern size_t tablebuffer_bytes(PRESTOCLIENT_TABLEBUFFER *tab);
+extern PRESTOCLIENT_COLUMN* clone_prestocolumn(PRESTOCLIENT_COLUMN *field);
+extern void delete_prestocolumn(PRESTOCLIENT_COLUMN *field);
+extern PRESTOCLIENT_RESULT* new_prestoresult_shared(PRESTOCLIENT *client, PRESTOCLIENT_COLUMN **columns, size_t columncount, PRESTOCLIENT_TABLEBUFFER *tab);
+extern PRESTOCLIENT_RESULT* parse_prestopage(const char *json, size_t size, PRESTOCLIENT_COLUMN **columns, size_t columncount, bool paged);
+extern void delete_prestopage(PRESTOCLIENT_RESULT *page);
+extern int start_paged_query(PRESTOCLIENT *prestoclient, PRESTOCLIENT_RESULT **result, const char *sql_qry,
+							 void (*in_page_callback_function)(PRESTOCLIENT_RESULT*, const PRESTOCLIENT_PAGE*, void*), void *in_client_object);
 
 // JSON Functions
 extern bool json_reader(PRESTOCLIENT_RESULT* result, char * contents, size_t size);
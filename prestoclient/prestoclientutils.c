@@ -22,6 +22,7 @@
 #ifdef _WIN32
 #include <windows.h>
 #include <lmcons.h>
+#include "prestoclienttypes.h"
 
 // returnvalue must be freed by caller
 char* get_username()
@@ -41,11 +42,147 @@ void util_sleep(const int sleeptime_msec)
 {
 	Sleep(sleeptime_msec);
 }
+
+// Monotonic clock in milliseconds, only useful for measuring intervals
+long long util_now_msec()
+{
+	return (long long)GetTickCount64();
+}
+
+void util_mutex_init(UTIL_MUTEX *mutex)
+{
+	InitializeCriticalSection(mutex);
+}
+
+void util_mutex_destroy(UTIL_MUTEX *mutex)
+{
+	DeleteCriticalSection(mutex);
+}
+
+void util_mutex_lock(UTIL_MUTEX *mutex)
+{
+	EnterCriticalSection(mutex);
+}
+
+void util_mutex_unlock(UTIL_MUTEX *mutex)
+{
+	LeaveCriticalSection(mutex);
+}
+
+void util_cond_init(UTIL_COND *cond)
+{
+	InitializeConditionVariable(cond);
+}
+
+void util_cond_destroy(UTIL_COND *cond)
+{
+	(void)cond; // Windows condition variables need no cleanup
+}
+
+void util_cond_wait(UTIL_COND *cond, UTIL_MUTEX *mutex)
+{
+	SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+void util_cond_broadcast(UTIL_COND *cond)
+{
+	WakeAllConditionVariable(cond);
+}
+
+// Wait for a broadcast or until msec milliseconds passed
+void util_cond_timedwait(UTIL_COND *cond, UTIL_MUTEX *mutex, int msec)
+{
+	SleepConditionVariableCS(cond, mutex, (DWORD)msec);
+}
+
+typedef struct ST_UTIL_THREADSTART
+{
+	void (*function)(void *);
+	void *arg;
+} UTIL_THREADSTART;
+
+static DWORD WINAPI util_thread_main(LPVOID param)
+{
+	UTIL_THREADSTART start = *(UTIL_THREADSTART *)param;
+
+	free(param);
+	start.function(start.arg);
+	return 0;
+}
+
+// Run function(arg) in a new thread, returns 0 on success
+int util_thread_start(UTIL_THREAD *thread, void (*function)(void *), void *arg)
+{
+	UTIL_THREADSTART *start = (UTIL_THREADSTART *)malloc(sizeof(UTIL_THREADSTART));
+
+	if (!start)
+		exit(1);
+
+	start->function = function;
+	start->arg = arg;
+	*thread = CreateThread(NULL, 0, util_thread_main, start, 0, NULL);
+	if (!*thread)
+	{
+		free(start);
+		return -1;
+	}
+
+	return 0;
+}
+
+void util_thread_join(UTIL_THREAD thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+// Atomically add delta to *value and return the new value
+long util_atomic_add(volatile long *value, long delta)
+{
+	return InterlockedExchangeAdd(value, delta) + delta;
+}
+
+// Map a whole file read-only, returns NULL if the file can't be opened or is empty
+void *util_map_file(const char *path, size_t *size)
+{
+	HANDLE file, mapping;
+	LARGE_INTEGER filesize;
+	void *addr = NULL;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	if (GetFileSizeEx(file, &filesize) && filesize.QuadPart > 0)
+	{
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping)
+		{
+			addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			*size = (size_t)filesize.QuadPart;
+			// The view keeps the mapping alive
+			CloseHandle(mapping);
+		}
+	}
+
+	CloseHandle(file);
+	return addr;
+}
+
+void util_unmap_file(void *addr, size_t size)
+{
+	(void)size;
+	UnmapViewOfFile(addr);
+}
 #else
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "prestoclienttypes.h"
 
 // returnvalue must be freed by caller
 char* get_username()
@@ -68,4 +205,174 @@ void util_sleep(const int sleeptime_msec)
     nanosleep(&ts, NULL);
 	// sleep(sleeptime_msec / 1000);
 }
+
+// Monotonic clock in milliseconds, only useful for measuring intervals
+long long util_now_msec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void util_mutex_init(UTIL_MUTEX *mutex)
+{
+	pthread_mutex_init(mutex, NULL);
+}
+
+void util_mutex_destroy(UTIL_MUTEX *mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+void util_mutex_lock(UTIL_MUTEX *mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void util_mutex_unlock(UTIL_MUTEX *mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+void util_cond_init(UTIL_COND *cond)
+{
+	pthread_cond_init(cond, NULL);
+}
+
+void util_cond_destroy(UTIL_COND *cond)
+{
+	pthread_cond_destroy(cond);
+}
+
+void util_cond_wait(UTIL_COND *cond, UTIL_MUTEX *mutex)
+{
+	pthread_cond_wait(cond, mutex);
+}
+
+void util_cond_broadcast(UTIL_COND *cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
+// Wait for a broadcast or until msec milliseconds passed
+void util_cond_timedwait(UTIL_COND *cond, UTIL_MUTEX *mutex, int msec)
+{
+	struct timespec ts;
+
+	// Condition variables wait on the realtime clock by default
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += msec / 1000;
+	ts.tv_nsec += (long)(msec % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+typedef struct ST_UTIL_THREADSTART
+{
+	void (*function)(void *);
+	void *arg;
+} UTIL_THREADSTART;
+
+static void *util_thread_main(void *param)
+{
+	UTIL_THREADSTART start = *(UTIL_THREADSTART *)param;
+
+	free(param);
+	start.function(start.arg);
+	return NULL;
+}
+
+// Run function(arg) in a new thread, returns 0 on success
+int util_thread_start(UTIL_THREAD *thread, void (*function)(void *), void *arg)
+{
+	UTIL_THREADSTART *start = (UTIL_THREADSTART *)malloc(sizeof(UTIL_THREADSTART));
+
+	if (!start)
+		exit(1);
+
+	start->function = function;
+	start->arg = arg;
+	if (pthread_create(thread, NULL, util_thread_main, start) != 0)
+	{
+		free(start);
+		return -1;
+	}
+
+	return 0;
+}
+
+void util_thread_join(UTIL_THREAD thread)
+{
+	pthread_join(thread, NULL);
+}
+
+// Atomically add delta to *value and return the new value
+long util_atomic_add(volatile long *value, long delta)
+{
+	return __sync_add_and_fetch(value, delta);
+}
+
+// Map a whole file read-only, returns NULL if the file can't be opened or is empty
+void *util_map_file(const char *path, size_t *size)
+{
+	struct stat st;
+	void *addr = NULL;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (addr == MAP_FAILED)
+			addr = NULL;
+		else
+			*size = (size_t)st.st_size;
+	}
+
+	// The mapping stays valid after close
+	close(fd);
+	return addr;
+}
+
+void util_unmap_file(void *addr, size_t size)
+{
+	munmap(addr, size);
+}
+#endif
+
+// FNV-1a hash of a string
+unsigned long long util_hash(const char *str)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+
+	while (*str)
+	{
+		hash ^= (unsigned char)*str++;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+// Body bytes of the last transfer of a curl handle as they came over the network, before any decompression
+size_t util_download_size(CURL *hcurl)
+{
+#if LIBCURL_VERSION_NUM >= 0x073700
+	curl_off_t size = 0;
+
+	curl_easy_getinfo(hcurl, CURLINFO_SIZE_DOWNLOAD_T, &size);
+	return size > 0 ? (size_t)size : 0;
+#else
+	double size = 0;
+
+	curl_easy_getinfo(hcurl, CURLINFO_SIZE_DOWNLOAD, &size);
+	return size > 0 ? (size_t)size : 0;
 #endif
+}
@@ -1,4 +1,5 @@
 #include "prestojson.h"
+#include "segments.h"
 #include <assert.h>
 
 #define min(a, b) \
@@ -335,6 +336,7 @@ int presto_json_parser(JSON_TYPE typ, const char *data, size_t size, void *user_
             if (pstate->level == 2)
             {
                 // this is where the write callback function is invoked end of array (meaning end of row in result set)
+                result->rowsreceived++;
                 result->write_callback_function(result->user_data, result);
             }
             else if (pstate->level >= 3)
@@ -346,7 +348,17 @@ int presto_json_parser(JSON_TYPE typ, const char *data, size_t size, void *user_
     case JSON_OBJECT_BEG:
         pstate->level++;
         pstate->oopen++;
-        if (pstate->section == DATA)
+        // a spooling coordinator sends an object of segments instead of the rows
+        if (pstate->section == DATA && pstate->level == 2)
+        {
+            pstate->section = SEGMENTS_SECTION;
+            pstate->segmentkey = SEGMENTKEY_NONE;
+        }
+        else if (pstate->section == SEGMENTS_SECTION && pstate->level == 4)
+        {
+            segments_begin(result);
+        }
+        else if (pstate->section == DATA)
         {
             if (pstate->level > 3)
             {                
@@ -431,6 +443,10 @@ int presto_json_parser(JSON_TYPE typ, const char *data, size_t size, void *user_
                 append_column_value(data, size, pstate->currentdatacolumn, result, ':');                
             }
         }
+        else if (pstate->section == SEGMENTS_SECTION)
+        {
+            segments_key(result, &pstate->segmentkey, data, size, pstate->level);
+        }
         else if (pstate->section == ERROR_SECTION)
         {
             if (pstate->level == 2)
@@ -522,6 +538,10 @@ int presto_json_parser(JSON_TYPE typ, const char *data, size_t size, void *user_
                 append_column_value(data, size, pstate->currentdatacolumn, result, ',');                
             }
         }
+        else if (pstate->section == SEGMENTS_SECTION)
+        {
+            segments_value(result, pstate->segmentkey, data, size);
+        }
         else if (pstate->section == STATS)
         {
             if (pstate->state)
@@ -583,6 +603,9 @@ int presto_json_parser(JSON_TYPE typ, const char *data, size_t size, void *user_
                 free(tmp);
             }
             break;
+        case SEGMENTS_SECTION:
+            segments_value(result, pstate->segmentkey, data, size);
+            break;
         case ROOT:
         case ERROR_SECTION:
         case WARNINGS:
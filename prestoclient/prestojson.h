@@ -14,7 +14,8 @@ enum JSON_RESULT_SECTION {
     DATA ,
     STATS ,
     ERROR_SECTION , 
-    WARNINGS 
+    WARNINGS ,
+    SEGMENTS_SECTION                    //!< data is an object of segments, see segments.h
 };
 
 enum JSON_RESULT_HEADER {
@@ -39,6 +40,7 @@ typedef struct IT_PARSINGSTATE {
     int state;    
     int inErrorType;
     int inErrorMessage;
+    int segmentkey;                     //!< what the value of the current key of a segment is, see segments.h
 } PARSINGSTATE;
 
 int presto_json_parser(JSON_TYPE typ, const char* data, size_t size, void* userdata);
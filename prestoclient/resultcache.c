@@ -0,0 +1,477 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "resultcache.h"
+#include <assert.h>
+
+typedef struct ST_RESULTCACHE_ENTRY
+{
+	char						 *key;							//!< Session + normalized sql
+	unsigned long long			  hash;							//!< Hash of key
+	PRESTOCLIENT_COLUMN			**columns;						//!< Private copy of the column descriptions
+	size_t						  columncount;					//!< Number of columns
+	PRESTOCLIENT_TABLEBUFFER	 *tablebuff;					//!< Retained rows, shared with readers
+	size_t						  bytes;						//!< Accounted size of this entry
+	long long					  expires;						//!< util_now_msec() after which the entry is stale
+	struct ST_RESULTCACHE_ENTRY	 *hnext;						//!< Next entry in hash bucket
+	struct ST_RESULTCACHE_ENTRY	 *prev;							//!< LRU list, towards most recently used
+	struct ST_RESULTCACHE_ENTRY	 *next;							//!< LRU list, towards least recently used
+} RESULTCACHE_ENTRY;
+
+struct ST_RESULTCACHE_FLIGHT
+{
+	char						 *key;							//!< Key of the running query
+	unsigned long long			  hash;							//!< Hash of key
+	int							  refs;							//!< Leader plus waiting followers
+	bool						  done;							//!< Set by the leader when finished
+	PRESTOCLIENT_COLUMN			**columns;						//!< Columns of the leader's result, NULL on failure
+	size_t						  columncount;					//!< Number of columns
+	PRESTOCLIENT_TABLEBUFFER	 *tablebuff;					//!< Retained rows of the leader's result
+	bool						  succeeded;					//!< Leader's query succeeded
+	UTIL_COND					  finished;						//!< Signalled when done is set
+	struct ST_RESULTCACHE_FLIGHT *next;							//!< Next running query
+};
+
+struct ST_RESULTCACHE
+{
+	UTIL_MUTEX					  lock;							//!< Protects everything below
+	RESULTCACHE_ENTRY			 *buckets[RESULTCACHE_BUCKETS];	//!< Hash table
+	RESULTCACHE_ENTRY			 *head;							//!< Most recently used entry
+	RESULTCACHE_ENTRY			 *tail;							//!< Least recently used entry
+	size_t						  bytes;						//!< Sum of entry sizes
+	size_t						  maxbytes;						//!< Byte budget
+	RESULTCACHE_FLIGHT			 *flights;						//!< Queries currently running
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+static void delete_entry(RESULTCACHE_ENTRY *entry)
+{
+	if (entry->columns)
+	{
+		for (size_t i = 0; i < entry->columncount; i++)
+			delete_prestocolumn(entry->columns[i]);
+		free(entry->columns);
+	}
+
+	tablebuffer_release(entry->tablebuff);
+	free(entry->key);
+	free(entry);
+}
+
+static void lru_unlink(RESULTCACHE *cache, RESULTCACHE_ENTRY *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache->head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+static void lru_pushfront(RESULTCACHE *cache, RESULTCACHE_ENTRY *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+
+	if (cache->head)
+		cache->head->prev = entry;
+	else
+		cache->tail = entry;
+
+	cache->head = entry;
+}
+
+// Unlink entry from hash table and LRU list and free it. Cache must be locked
+static void remove_entry(RESULTCACHE *cache, RESULTCACHE_ENTRY *entry)
+{
+	RESULTCACHE_ENTRY **link = &cache->buckets[entry->hash % RESULTCACHE_BUCKETS];
+
+	while (*link && *link != entry)
+		link = &(*link)->hnext;
+
+	if (*link)
+		*link = entry->hnext;
+
+	lru_unlink(cache, entry);
+	cache->bytes -= entry->bytes;
+	delete_entry(entry);
+}
+
+// Cache must be locked
+static RESULTCACHE_ENTRY *find_entry(RESULTCACHE *cache, const char *key, unsigned long long hash)
+{
+	RESULTCACHE_ENTRY *entry = cache->buckets[hash % RESULTCACHE_BUCKETS];
+
+	while (entry)
+	{
+		if (entry->hash == hash && strcmp(entry->key, key) == 0)
+			return entry;
+
+		entry = entry->hnext;
+	}
+
+	return NULL;
+}
+
+// Evict least recently used entries until 'needed' more bytes fit. Cache must be locked
+static void evict(RESULTCACHE *cache, size_t needed)
+{
+	while (cache->tail && cache->bytes + needed > cache->maxbytes)
+		remove_entry(cache, cache->tail);
+}
+
+// Drop one reference to a flight. Cache must be locked
+static void release_flight(RESULTCACHE_FLIGHT *flight)
+{
+	if (--flight->refs > 0)
+		return;
+
+	if (flight->columns)
+	{
+		for (size_t i = 0; i < flight->columncount; i++)
+			delete_prestocolumn(flight->columns[i]);
+		free(flight->columns);
+	}
+
+	tablebuffer_release(flight->tablebuff);
+	util_cond_destroy(&flight->finished);
+	free(flight->key);
+	free(flight);
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+RESULTCACHE *resultcache_new(size_t maxbytes)
+{
+	RESULTCACHE *cache = (RESULTCACHE *)calloc(1, sizeof(RESULTCACHE));
+
+	if (!cache)
+		exit(1);
+
+	util_mutex_init(&cache->lock);
+	cache->maxbytes = maxbytes > 0 ? maxbytes : RESULTCACHE_DEFAULT_MAXBYTES;
+
+	return cache;
+}
+
+void resultcache_delete(RESULTCACHE *cache)
+{
+	if (!cache)
+		return;
+
+	while (cache->head)
+		remove_entry(cache, cache->head);
+
+	// Running queries still reference their flight, they are freed by the last resultcache_leave/wait
+	assert(cache->flights == NULL);
+
+	util_mutex_destroy(&cache->lock);
+	free(cache);
+}
+
+void resultcache_setmaxbytes(RESULTCACHE *cache, size_t maxbytes)
+{
+	if (!cache || maxbytes == 0)
+		return;
+
+	util_mutex_lock(&cache->lock);
+	cache->maxbytes = maxbytes;
+	evict(cache, 0);
+	util_mutex_unlock(&cache->lock);
+}
+
+char *resultcache_makekey(PRESTOCLIENT *client, const char *sql)
+{
+	const char *session[6];
+	const char *q;
+	char *key, *p, inq = 0;
+	size_t length = strlen(sql) + 1;
+
+	assert(client);
+
+	session[0] = client->baseurl;
+	session[1] = client->user;
+	session[2] = client->catalog;
+	session[3] = client->schema;
+	session[4] = client->timezone;
+	session[5] = client->language;
+
+	for (int i = 0; i < 6; i++)
+		length += (session[i] ? strlen(session[i]) : 0) + 1;
+
+	key = (char *)malloc(length);
+	if (!key)
+		exit(1);
+
+	// Session part, fields are separated by a unit separator so they cannot run into each other
+	p = key;
+	for (int i = 0; i < 6; i++)
+	{
+		if (session[i])
+		{
+			strcpy(p, session[i]);
+			p += strlen(session[i]);
+		}
+		*p++ = '\x1f';
+	}
+
+	// Sql part, collapse whitespace outside of quotes and drop a trailing ';'
+	for (q = sql; *q && (*q == ' ' || *q == '\t' || *q == '\r' || *q == '\n'); q++)
+		;
+
+	for (; *q; q++)
+	{
+		if (inq)
+		{
+			if (*q == inq)
+				inq = 0;
+			*p++ = *q;
+		}
+		else if (*q == ' ' || *q == '\t' || *q == '\r' || *q == '\n')
+		{
+			if (p[-1] != ' ')
+				*p++ = ' ';
+		}
+		else
+		{
+			if (*q == '\'' || *q == '"')
+				inq = *q;
+			*p++ = *q;
+		}
+	}
+
+	while (p[-1] == ' ' || p[-1] == ';')
+		p--;
+	*p = '\0';
+
+	return key;
+}
+
+PRESTOCLIENT_RESULT *resultcache_get(RESULTCACHE *cache, PRESTOCLIENT *client, const char *key)
+{
+	RESULTCACHE_ENTRY *entry;
+	PRESTOCLIENT_RESULT *result = NULL;
+	unsigned long long hash;
+
+	if (!cache || !client || !key)
+		return NULL;
+
+	hash = util_hash(key);
+
+	util_mutex_lock(&cache->lock);
+
+	entry = find_entry(cache, key, hash);
+	if (entry && entry->expires <= util_now_msec())
+	{
+		remove_entry(cache, entry);
+		entry = NULL;
+	}
+
+	if (entry)
+	{
+		lru_unlink(cache, entry);
+		lru_pushfront(cache, entry);
+		result = new_prestoresult_shared(client, entry->columns, entry->columncount, entry->tablebuff);
+	}
+
+	util_mutex_unlock(&cache->lock);
+
+	return result;
+}
+
+void resultcache_put(RESULTCACHE *cache, const char *key, PRESTOCLIENT_RESULT *result, long long ttl_msec)
+{
+	RESULTCACHE_ENTRY *entry, *old;
+
+	if (!cache || !key || !result || ttl_msec <= 0)
+		return;
+
+	// Only finished, error free results are worth sharing
+	if (result->clientstatus != PRESTOCLIENT_STATUS_SUCCEEDED ||
+		result->errorcode != PRESTOCLIENT_RESULT_OK ||
+		(result->lasterrormessage && strlen(result->lasterrormessage) > 0))
+		return;
+
+	entry = (RESULTCACHE_ENTRY *)calloc(1, sizeof(RESULTCACHE_ENTRY));
+	if (!entry)
+		exit(1);
+
+	alloc_copy(&entry->key, key);
+	entry->hash = util_hash(key);
+	entry->columncount = result->columncount;
+	if (entry->columncount > 0)
+	{
+		entry->columns = (PRESTOCLIENT_COLUMN **)malloc(entry->columncount * sizeof(PRESTOCLIENT_COLUMN *));
+		if (!entry->columns)
+			exit(1);
+
+		for (size_t i = 0; i < entry->columncount; i++)
+			entry->columns[i] = clone_prestocolumn(result->columns[i]);
+	}
+	entry->tablebuff = tablebuffer_retain(result->tablebuff);
+	entry->bytes = sizeof(RESULTCACHE_ENTRY) + strlen(key) + tablebuffer_bytes(entry->tablebuff);
+	entry->expires = util_now_msec() + ttl_msec;
+
+	util_mutex_lock(&cache->lock);
+
+	if (entry->bytes > cache->maxbytes)
+	{
+		// Would evict everything else and still not fit
+		util_mutex_unlock(&cache->lock);
+		delete_entry(entry);
+		return;
+	}
+
+	old = find_entry(cache, key, entry->hash);
+	if (old)
+		remove_entry(cache, old);
+
+	evict(cache, entry->bytes);
+
+	entry->hnext = cache->buckets[entry->hash % RESULTCACHE_BUCKETS];
+	cache->buckets[entry->hash % RESULTCACHE_BUCKETS] = entry;
+	lru_pushfront(cache, entry);
+	cache->bytes += entry->bytes;
+
+	util_mutex_unlock(&cache->lock);
+}
+
+RESULTCACHE_FLIGHT *resultcache_join(RESULTCACHE *cache, const char *key, bool *leader)
+{
+	RESULTCACHE_FLIGHT *flight;
+	unsigned long long hash;
+
+	if (!cache || !key || !leader)
+		return NULL;
+
+	hash = util_hash(key);
+
+	util_mutex_lock(&cache->lock);
+
+	for (flight = cache->flights; flight; flight = flight->next)
+	{
+		if (flight->hash == hash && strcmp(flight->key, key) == 0)
+			break;
+	}
+
+	if (flight)
+	{
+		flight->refs++;
+		*leader = false;
+	}
+	else
+	{
+		flight = (RESULTCACHE_FLIGHT *)calloc(1, sizeof(RESULTCACHE_FLIGHT));
+		if (!flight)
+			exit(1);
+
+		alloc_copy(&flight->key, key);
+		flight->hash = hash;
+		flight->refs = 1;
+		util_cond_init(&flight->finished);
+		flight->next = cache->flights;
+		cache->flights = flight;
+		*leader = true;
+	}
+
+	util_mutex_unlock(&cache->lock);
+
+	return flight;
+}
+
+void resultcache_leave(RESULTCACHE *cache, RESULTCACHE_FLIGHT *flight, PRESTOCLIENT_RESULT *result)
+{
+	RESULTCACHE_FLIGHT **link;
+
+	if (!cache || !flight)
+		return;
+
+	util_mutex_lock(&cache->lock);
+
+	// New callers with this key start a new query (or hit the cache) from now on
+	for (link = &cache->flights; *link && *link != flight; link = &(*link)->next)
+		;
+	if (*link)
+		*link = flight->next;
+
+	if (result && result->clientstatus == PRESTOCLIENT_STATUS_SUCCEEDED &&
+		result->errorcode == PRESTOCLIENT_RESULT_OK &&
+		!(result->lasterrormessage && strlen(result->lasterrormessage) > 0))
+	{
+		if (result->columncount > 0)
+		{
+			flight->columns = (PRESTOCLIENT_COLUMN **)malloc(result->columncount * sizeof(PRESTOCLIENT_COLUMN *));
+			if (!flight->columns)
+				exit(1);
+
+			for (size_t i = 0; i < result->columncount; i++)
+				flight->columns[i] = clone_prestocolumn(result->columns[i]);
+		}
+		flight->columncount = result->columncount;
+		flight->tablebuff = tablebuffer_retain(result->tablebuff);
+		flight->succeeded = true;
+	}
+
+	flight->done = true;
+	util_cond_broadcast(&flight->finished);
+	release_flight(flight);
+
+	util_mutex_unlock(&cache->lock);
+}
+
+int resultcache_wait(RESULTCACHE *cache, RESULTCACHE_FLIGHT *flight, PRESTOCLIENT *client, long long deadline,
+					 volatile bool *cancel, PRESTOCLIENT_RESULT **result)
+{
+	int rc = PRESTO_OK;
+
+	assert(result);
+	*result = NULL;
+
+	if (!cache || !flight)
+		return PRESTO_OK;
+
+	util_mutex_lock(&cache->lock);
+
+	while (!flight->done)
+	{
+		if (cancel && *cancel)
+			rc = PRESTO_CANCELLED;
+		else if (deadline > 0 && util_now_msec() >= deadline)
+			rc = PRESTO_TIMEOUT;
+		if (rc != PRESTO_OK)
+			break;
+
+		util_cond_timedwait(&flight->finished, &cache->lock, RESULTCACHE_CHECKMSEC);
+	}
+
+	if (rc == PRESTO_OK && flight->succeeded && client)
+		*result = new_prestoresult_shared(client, flight->columns, flight->columncount, flight->tablebuff);
+
+	// The leader still holds the flight when the wait was given up
+	release_flight(flight);
+
+	util_mutex_unlock(&cache->lock);
+
+	return rc;
+}
@@ -0,0 +1,136 @@
+/**
+ * \file resultcache.h
+ *
+ * \brief in-memory cache of finished query results
+ *
+ * Results are keyed by the normalized sql text and the session (server, user,
+ * catalog, schema, timezone, language) of the client that produced them.
+ * Entries expire after a time to live and the least recently used entries are
+ * evicted when the cache grows beyond its byte budget. A hit does not copy the
+ * rows: every reader gets its own result with its own cursor that shares the
+ * reference counted tablebuffer of the cached entry.
+ *
+ * The cache also coalesces identical queries that are running at the same time
+ * (single-flight): the first caller becomes the leader and runs the query, later
+ * callers with the same key wait for it and read the leader's rows.
+ *
+ * All functions are thread safe, one cache can be shared by many clients.
+ */
+
+#ifndef EASYPTORA_RESULTCACHE_HH
+#define EASYPTORA_RESULTCACHE_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define RESULTCACHE_BUCKETS               256                  //!< Number of hash buckets
+#define RESULTCACHE_DEFAULT_MAXBYTES      (64 * 1024 * 1024)   //!< Default byte budget of a cache
+#define RESULTCACHE_CHECKMSEC             100                  //!< Millisec between two checks of a follower for cancel and deadline
+
+/* --- Typedefs ------------------------------------------------------------------------------------------------------- */
+typedef struct ST_RESULTCACHE RESULTCACHE;
+typedef struct ST_RESULTCACHE_FLIGHT RESULTCACHE_FLIGHT;
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create an empty cache
+ *
+ * \param maxbytes   Byte budget, 0 selects RESULTCACHE_DEFAULT_MAXBYTES
+ *
+ * \return A handle to the cache
+ */
+extern RESULTCACHE *resultcache_new(size_t maxbytes);
+
+/**
+ * \brief Drop all entries and free the cache. Results handed out by resultcache_get stay valid.
+ *
+ * \param cache  A handle to the cache
+ */
+extern void resultcache_delete(RESULTCACHE *cache);
+
+/**
+ * \brief Change the byte budget, evicting entries if needed
+ *
+ * \param cache     A handle to the cache
+ * \param maxbytes  New byte budget
+ */
+extern void resultcache_setmaxbytes(RESULTCACHE *cache, size_t maxbytes);
+
+/**
+ * \brief Build the cache key for a query issued by a client
+ *
+ * \param client  Client that will run the query, supplies the session part of the key
+ * \param sql     Query text, whitespace and a trailing ';' are normalized
+ *
+ * \return Newly allocated key, must be freed by caller
+ */
+extern char *resultcache_makekey(PRESTOCLIENT *client, const char *sql);
+
+/**
+ * \brief Look up a key
+ *
+ * \param cache   A handle to the cache
+ * \param client  Client the returned result is attached to
+ * \param key     Key returned by resultcache_makekey
+ *
+ * \return A finished result sharing the cached rows or NULL on a miss. Free with prestoclient_deleteresult
+ */
+extern PRESTOCLIENT_RESULT *resultcache_get(RESULTCACHE *cache, PRESTOCLIENT *client, const char *key);
+
+/**
+ * \brief Store a finished result. Failed or unfinished results are ignored.
+ *
+ * \param cache     A handle to the cache
+ * \param key       Key returned by resultcache_makekey
+ * \param result    Result to share, its rows are retained not copied
+ * \param ttl_msec  Time to live of the entry in milliseconds
+ */
+extern void resultcache_put(RESULTCACHE *cache, const char *key, PRESTOCLIENT_RESULT *result, long long ttl_msec);
+
+/**
+ * \brief Join the running query for a key or register as its leader
+ *
+ * \param cache   A handle to the cache
+ * \param key     Key returned by resultcache_makekey
+ * \param leader  Set to true when the caller must run the query and call resultcache_leave
+ *
+ * \return Handle to the in-flight query. A follower must pass it to resultcache_wait
+ */
+extern RESULTCACHE_FLIGHT *resultcache_join(RESULTCACHE *cache, const char *key, bool *leader);
+
+/**
+ * \brief Leader publishes the outcome of its query and wakes all followers
+ *
+ * \param cache   A handle to the cache
+ * \param flight  Handle returned by resultcache_join
+ * \param result  Finished result or NULL when the query failed
+ */
+extern void resultcache_leave(RESULTCACHE *cache, RESULTCACHE_FLIGHT *flight, PRESTOCLIENT_RESULT *result);
+
+/**
+ * \brief Follower blocks until the leader is done, its deadline passes or it is cancelled
+ *
+ * \param cache     A handle to the cache
+ * \param flight    Handle returned by resultcache_join, invalid after this call
+ * \param client    Client the returned result is attached to
+ * \param deadline  util_now_msec() when the follower times out, 0 for no limit
+ * \param cancel    Checked while waiting, may be set from another thread, may be NULL
+ * \param result    Set to a result sharing the leader's rows or NULL when the leader failed and the caller should
+ *                  run the query itself
+ *
+ * \return PRESTO_OK, PRESTO_TIMEOUT or PRESTO_CANCELLED, the leader's query runs on in the last two cases
+ */
+extern int resultcache_wait(RESULTCACHE *cache, RESULTCACHE_FLIGHT *flight, PRESTOCLIENT *client, long long deadline,
+							volatile bool *cancel, PRESTOCLIENT_RESULT **result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_RESULTCACHE_HH
@@ -0,0 +1,274 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "retrypolicy.h"
+#include <assert.h>
+#include <stdint.h>
+
+typedef struct ST_RETRYPOLICY_BREAKER
+{
+	char						 *coordinator;					//!< Base url of the coordinator
+	int							  failures;						//!< Consecutive failed requests
+	long long					  openuntil;					//!< util_now_msec() until requests fail fast
+	long long					  probesince;					//!< util_now_msec() of the request let through an open breaker, 0 for none
+	struct ST_RETRYPOLICY_BREAKER *next;						//!< Next breaker
+} RETRYPOLICY_BREAKER;
+
+struct ST_RETRYPOLICY
+{
+	UTIL_MUTEX					  lock;							//!< Protects everything below
+	int							  maxretries;					//!< Retries of one request
+	long long					  basedelay;					//!< Minimum wait in millisec before a retry
+	long long					  maxdelay;						//!< Maximum wait in millisec before a retry
+	int							  budgetpercent;				//!< Hundredths of a retry added to the budget per request
+	long long					  budget;						//!< Retries available, in hundredths of a retry
+	int							  threshold;					//!< Consecutive failures that open a breaker
+	long long					  opentime;						//!< Millisec a breaker stays open
+	uint64_t					  random;						//!< State of the xorshift generator for the jitter
+	size_t						  retries;						//!< Retries granted
+	size_t						  rejected;						//!< Requests failed by an open breaker
+	RETRYPOLICY_BREAKER			 *breakers;						//!< One breaker per coordinator
+};
+
+/* --- Private functions ---------------------------------------------------------------------------------------------- */
+
+// Breaker of the coordinator, created on first use, caller holds the lock
+static RETRYPOLICY_BREAKER *find_breaker(RETRYPOLICY *policy, const char *coordinator)
+{
+	RETRYPOLICY_BREAKER *breaker;
+
+	for (breaker = policy->breakers; breaker; breaker = breaker->next)
+		if (strcmp(breaker->coordinator, coordinator) == 0)
+			return breaker;
+
+	breaker = (RETRYPOLICY_BREAKER *)malloc(sizeof(RETRYPOLICY_BREAKER));
+	if (!breaker)
+		exit(1);
+
+	breaker->coordinator = NULL;
+	alloc_copy(&breaker->coordinator, coordinator);
+	breaker->failures = 0;
+	breaker->openuntil = 0;
+	breaker->probesince = 0;
+	breaker->next = policy->breakers;
+	policy->breakers = breaker;
+
+	return breaker;
+}
+
+// Uniform random number in [low, high], caller holds the lock
+static long long random_between(RETRYPOLICY *policy, long long low, long long high)
+{
+	uint64_t x = policy->random;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	policy->random = x;
+
+	if (high <= low)
+		return low;
+
+	return low + (long long)(x % (uint64_t)(high - low + 1));
+}
+
+/* --- Public functions ----------------------------------------------------------------------------------------------- */
+
+RETRYPOLICY *retrypolicy_new(void)
+{
+	RETRYPOLICY *policy = (RETRYPOLICY *)malloc(sizeof(RETRYPOLICY));
+
+	if (!policy)
+		exit(1);
+
+	util_mutex_init(&policy->lock);
+	policy->maxretries = RETRYPOLICY_DEFAULT_MAXRETRIES;
+	policy->basedelay = RETRYPOLICY_DEFAULT_BASEDELAY;
+	policy->maxdelay = RETRYPOLICY_DEFAULT_MAXDELAY;
+	policy->budgetpercent = RETRYPOLICY_DEFAULT_BUDGET;
+	policy->budget = RETRYPOLICY_BUDGET_BURST * 100;
+	policy->threshold = RETRYPOLICY_DEFAULT_THRESHOLD;
+	policy->opentime = RETRYPOLICY_DEFAULT_OPENTIME;
+	// Seed differs between processes and policies, the generator must not start at zero
+	policy->random = ((uint64_t)util_now_msec() << 20) ^ (uint64_t)(uintptr_t)policy ^ 0x9e3779b97f4a7c15ULL;
+	policy->retries = 0;
+	policy->rejected = 0;
+	policy->breakers = NULL;
+
+	return policy;
+}
+
+void retrypolicy_delete(RETRYPOLICY *policy)
+{
+	if (!policy)
+		return;
+
+	while (policy->breakers)
+	{
+		RETRYPOLICY_BREAKER *next = policy->breakers->next;
+
+		free(policy->breakers->coordinator);
+		free(policy->breakers);
+		policy->breakers = next;
+	}
+
+	util_mutex_destroy(&policy->lock);
+	free(policy);
+}
+
+void retrypolicy_configure(RETRYPOLICY *policy, int maxretries, long long basedelay_msec, long long maxdelay_msec,
+						   int budgetpercent, int threshold, long long opentime_msec)
+{
+	assert(policy);
+
+	util_mutex_lock(&policy->lock);
+	if (maxretries >= 0)
+		policy->maxretries = maxretries;
+	if (basedelay_msec >= 0)
+		policy->basedelay = basedelay_msec;
+	if (maxdelay_msec >= 0)
+		policy->maxdelay = maxdelay_msec;
+	if (budgetpercent >= 0)
+		policy->budgetpercent = budgetpercent;
+	if (threshold >= 0)
+		policy->threshold = threshold;
+	if (opentime_msec >= 0)
+		policy->opentime = opentime_msec;
+	util_mutex_unlock(&policy->lock);
+}
+
+void retrypolicy_attach(RETRYPOLICY *policy, PRESTOCLIENT *client)
+{
+	if (!client)
+		return;
+
+	if (client->ownretry)
+		retrypolicy_delete(client->retry);
+
+	client->ownretry = policy == NULL;
+	client->retry = policy ? policy : retrypolicy_new();
+}
+
+bool retrypolicy_allow(RETRYPOLICY *policy, const char *coordinator)
+{
+	RETRYPOLICY_BREAKER *breaker;
+	long long now;
+	bool allow = true;
+
+	if (!policy || !coordinator)
+		return true;
+
+	now = util_now_msec();
+
+	util_mutex_lock(&policy->lock);
+
+	if (policy->budget < RETRYPOLICY_BUDGET_BURST * 100)
+		policy->budget += policy->budgetpercent;
+
+	if (policy->threshold > 0)
+	{
+		breaker = find_breaker(policy, coordinator);
+		if (breaker->failures >= policy->threshold)
+		{
+			if (now < breaker->openuntil)
+				allow = false;
+			else if (breaker->probesince > 0 && now - breaker->probesince < policy->opentime)
+				allow = false;		// Another request is already probing
+			else
+				breaker->probesince = now;
+		}
+		if (!allow)
+			policy->rejected++;
+	}
+
+	util_mutex_unlock(&policy->lock);
+
+	return allow;
+}
+
+void retrypolicy_report(RETRYPOLICY *policy, const char *coordinator, bool success)
+{
+	RETRYPOLICY_BREAKER *breaker;
+
+	if (!policy || !coordinator)
+		return;
+
+	util_mutex_lock(&policy->lock);
+
+	if (policy->threshold > 0)
+	{
+		breaker = find_breaker(policy, coordinator);
+		if (success)
+		{
+			breaker->failures = 0;
+			breaker->probesince = 0;
+		}
+		else
+		{
+			breaker->failures++;
+			if (breaker->failures >= policy->threshold)
+			{
+				breaker->openuntil = util_now_msec() + policy->opentime;
+				breaker->probesince = 0;
+			}
+		}
+	}
+
+	util_mutex_unlock(&policy->lock);
+}
+
+bool retrypolicy_retry(RETRYPOLICY *policy, int attempt, long long *delay)
+{
+	bool retry = false;
+
+	assert(delay);
+
+	if (!policy)
+		return false;
+
+	util_mutex_lock(&policy->lock);
+
+	if (attempt <= policy->maxretries && policy->budget >= 100)
+	{
+		long long previous = *delay > policy->basedelay ? *delay : policy->basedelay;
+
+		// Decorrelated jitter: somewhere between the base delay and three times the previous wait
+		*delay = random_between(policy, policy->basedelay, previous * 3);
+		if (*delay > policy->maxdelay)
+			*delay = policy->maxdelay;
+
+		policy->budget -= 100;
+		policy->retries++;
+		retry = true;
+	}
+
+	util_mutex_unlock(&policy->lock);
+
+	return retry;
+}
+
+void retrypolicy_stats(RETRYPOLICY *policy, size_t *retries, size_t *rejected)
+{
+	assert(policy);
+
+	util_mutex_lock(&policy->lock);
+	if (retries)
+		*retries = policy->retries;
+	if (rejected)
+		*rejected = policy->rejected;
+	util_mutex_unlock(&policy->lock);
+}
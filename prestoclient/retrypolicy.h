@@ -0,0 +1,127 @@
+/**
+ * \file retrypolicy.h
+ *
+ * \brief retry policy and circuit breaker for the requests to the coordinators
+ *
+ * A failed request is retried when it is safe: a busy (503) answer or a connection that
+ * could not be made is always retried, a GET of a nextUri also when the connection broke
+ * or timed out, as asking for the same page again is idempotent. A page cut off in the
+ * middle is rewound first: the rows it delivered are taken back and it is parsed again
+ * from the start. That is not possible once the rows went to a write callback of the
+ * caller, such a GET is only retried when no byte of the answer arrived. The wait between two attempts is drawn with decorrelated jitter,
+ * uniformly between the base delay and three times the previous wait, capped at a maximum
+ * delay, so clients hitting an overloaded coordinator at the same time spread out.
+ *
+ * Retries draw from a budget shared by all clients attached to the policy. Every request
+ * adds a fraction of a retry to the budget and every retry takes a whole one, so under a
+ * lasting outage only that fraction of the traffic is retried.
+ *
+ * Each coordinator has a circuit breaker. After a number of consecutive failed requests
+ * the breaker opens and requests to the coordinator fail at once. Once the open time has
+ * passed a single request is let through, its success closes the breaker again.
+ *
+ * All functions are thread safe.
+ */
+
+#ifndef EASYPTORA_RETRYPOLICY_HH
+#define EASYPTORA_RETRYPOLICY_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define RETRYPOLICY_DEFAULT_MAXRETRIES    5               //!< Default retries of one request
+#define RETRYPOLICY_DEFAULT_BASEDELAY     100             //!< Default minimum wait in millisec before a retry
+#define RETRYPOLICY_DEFAULT_MAXDELAY      5000            //!< Default maximum wait in millisec before a retry
+#define RETRYPOLICY_DEFAULT_BUDGET        10              //!< Default percentage of requests that may be retried
+#define RETRYPOLICY_BUDGET_BURST          10              //!< Retries available before the budget needs refilling
+#define RETRYPOLICY_DEFAULT_THRESHOLD     5               //!< Default consecutive failures that open a circuit breaker
+#define RETRYPOLICY_DEFAULT_OPENTIME      10000           //!< Default millisec a circuit breaker stays open
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Create a policy with the default settings
+ *
+ * \return A handle to the policy
+ */
+extern RETRYPOLICY *retrypolicy_new(void);
+
+/**
+ * \brief Free the policy. All attached clients must be closed first.
+ *
+ * \param policy  A handle to the policy
+ */
+extern void retrypolicy_delete(RETRYPOLICY *policy);
+
+/**
+ * \brief Change the settings, a negative value keeps the current setting
+ *
+ * \param policy          A handle to the policy
+ * \param maxretries      Retries of one request, 0 disables retries
+ * \param basedelay_msec  Minimum wait before a retry
+ * \param maxdelay_msec   Maximum wait before a retry
+ * \param budgetpercent   Percentage of requests that may be retried
+ * \param threshold       Consecutive failures that open a circuit breaker, 0 disables the breakers
+ * \param opentime_msec   Time a circuit breaker stays open
+ */
+extern void retrypolicy_configure(RETRYPOLICY *policy, int maxretries, long long basedelay_msec, long long maxdelay_msec,
+								  int budgetpercent, int threshold, long long opentime_msec);
+
+/**
+ * \brief Let all future requests of a client use the policy. A client has a policy of its own
+ *        until it is attached to a shared one.
+ *
+ * \param policy  A handle to the policy, NULL gives the client a policy of its own again
+ * \param client  The client
+ */
+extern void retrypolicy_attach(RETRYPOLICY *policy, PRESTOCLIENT *client);
+
+/**
+ * \brief Check the circuit breaker before a request and add to the retry budget
+ *
+ * \param policy       A handle to the policy
+ * \param coordinator  Base url of the coordinator
+ *
+ * \return false when the breaker of the coordinator is open and the request must fail
+ */
+extern bool retrypolicy_allow(RETRYPOLICY *policy, const char *coordinator);
+
+/**
+ * \brief Report the outcome of a request to the circuit breaker of its coordinator
+ *
+ * \param policy       A handle to the policy
+ * \param coordinator  Base url of the coordinator
+ * \param success      true when the coordinator answered, false for a failed connection or a busy answer
+ */
+extern void retrypolicy_report(RETRYPOLICY *policy, const char *coordinator, bool success);
+
+/**
+ * \brief Decide if a failed request is retried and how long to wait before
+ *
+ * \param policy    A handle to the policy
+ * \param attempt   Number of the failed attempt, starting with 1
+ * \param delay     In: wait before the failed attempt, 0 for the first. Out: wait before the next attempt in millisec
+ *
+ * \return true when the request is to be retried, false when retries or the budget are used up
+ */
+extern bool retrypolicy_retry(RETRYPOLICY *policy, int attempt, long long *delay);
+
+/**
+ * \brief Number of retries and failed fast requests so far
+ *
+ * \param policy    A handle to the policy
+ * \param retries   Out: retries granted, may be NULL
+ * \param rejected  Out: requests failed by an open circuit breaker, may be NULL
+ */
+extern void retrypolicy_stats(RETRYPOLICY *policy, size_t *retries, size_t *rejected);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_RETRYPOLICY_HH
@@ -0,0 +1,683 @@
+/*
+* This file is part of cPrestoClient
+*
+* cPrestoClient is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "segments.h"
+#include "prestojson.h"
+#include "retrypolicy.h"
+
+#define SEGMENTS_FIRSTALLOC               65536           // Bytes allocated for the first chunk of a segment
+#define SEGMENTS_URLTIMEOUT               300000          // Millisec a segment download may take without a query deadline
+
+enum E_SEGMENTSTATE
+{
+	SEGMENT_WAITING = 0,										// Not started or waiting for a retry
+	SEGMENT_RUNNING,											// Downloading
+	SEGMENT_DONE,												// Downloaded or inline, waiting to be decoded
+	SEGMENT_FAILED												// Download failed for good
+};
+
+typedef struct ST_SEGMENT
+{
+	bool						  spooled;						//!< Rows are at uri, otherwise in data
+	char						 *data;							//!< Base64 of the rows of an inline segment
+	char						 *uri;							//!< Where a spooled segment is downloaded from
+	char						 *ackuri;						//!< Uri acknowledging the segment or NULL
+	long long					  rowoffset;					//!< Row of the result the segment starts with
+	long long					  rowscount;					//!< Rows in the segment, -1 when not given
+	long long					  size;							//!< Bytes of the segment, -1 when not given
+	struct curl_slist			 *headers;						//!< Headers to download the segment with
+	enum E_SEGMENTSTATE			  state;						//!< Download state
+	CURL						 *hcurl;						//!< Transfer of a running download
+	char						 *body;							//!< The downloaded rows
+	size_t						  bodysize;						//!< Bytes in body
+	size_t						  bodyalloc;					//!< Bytes allocated for body
+	int							  attempts;						//!< Downloads started
+	long long					  delay;						//!< Wait before the last retry
+	long long					  notbefore;					//!< util_now_msec() before which a retry does not start
+	PRESTOCLIENT_RESULT			 *result;						//!< Result the segment belongs to, checked for a cancel while downloading
+} SEGMENT;
+
+struct ST_SEGMENTS
+{
+	SEGMENT						 *list;							//!< Segments of the page in page order
+	size_t						  count;						//!< Segments in list
+	size_t						  alloc;						//!< Segments allocated in list
+	char						 *encoding;						//!< Encoding of the segments of the page
+	char						 *headername;					//!< Name of the header whose values are parsed now
+	SEGMENTS_STATS				  stats;						//!< Counters of the query
+};
+
+/* --- Parsing -------------------------------------------------------------------------------------------------------- */
+
+static SEGMENTS *segments_of(PRESTOCLIENT_RESULT *result)
+{
+	if (!result->segments)
+	{
+		result->segments = (SEGMENTS *)calloc(1, sizeof(SEGMENTS));
+		if (!result->segments)
+			exit(1);
+	}
+
+	return result->segments;
+}
+
+static bool key_is(const char *data, size_t size, const char *name)
+{
+	return strlen(name) == size && strncmp(data, name, size) == 0;
+}
+
+static void copy_value(char **var, const char *data, size_t size)
+{
+	*var = (char *)realloc(*var, size + 1);
+	if (!*var)
+		exit(1);
+	memcpy(*var, data, size);
+	(*var)[size] = 0;
+}
+
+void segments_key(PRESTOCLIENT_RESULT *result, int *key, const char *data, size_t size, size_t level)
+{
+	SEGMENTS *segments = segments_of(result);
+
+	if (level == 2)
+		*key = key_is(data, size, "encoding") ? SEGMENTKEY_ENCODING : SEGMENTKEY_NONE;
+	else if (level == 4)
+	{
+		if (key_is(data, size, "type"))
+			*key = SEGMENTKEY_TYPE;
+		else if (key_is(data, size, "data"))
+			*key = SEGMENTKEY_DATA;
+		else if (key_is(data, size, "uri"))
+			*key = SEGMENTKEY_URI;
+		else if (key_is(data, size, "ackUri"))
+			*key = SEGMENTKEY_ACKURI;
+		else if (key_is(data, size, "metadata"))
+			*key = SEGMENTKEY_METADATA;
+		else if (key_is(data, size, "headers"))
+			*key = SEGMENTKEY_HEADERS;
+		else
+			*key = SEGMENTKEY_NONE;
+	}
+	else if (level == 5 && (*key == SEGMENTKEY_METADATA || *key == SEGMENTKEY_ROWOFFSET ||
+							*key == SEGMENTKEY_ROWSCOUNT || *key == SEGMENTKEY_SEGMENTSIZE))
+	{
+		if (key_is(data, size, "rowOffset"))
+			*key = SEGMENTKEY_ROWOFFSET;
+		else if (key_is(data, size, "rowsCount"))
+			*key = SEGMENTKEY_ROWSCOUNT;
+		else if (key_is(data, size, "segmentSize"))
+			*key = SEGMENTKEY_SEGMENTSIZE;
+		else
+			*key = SEGMENTKEY_METADATA;
+	}
+	else if (level == 5 && (*key == SEGMENTKEY_HEADERS || *key == SEGMENTKEY_HEADERVALUE))
+	{
+		copy_value(&segments->headername, data, size);
+		*key = SEGMENTKEY_HEADERVALUE;
+	}
+}
+
+void segments_begin(PRESTOCLIENT_RESULT *result)
+{
+	SEGMENTS *segments = segments_of(result);
+	SEGMENT *segment;
+
+	if (segments->count == segments->alloc)
+	{
+		segments->alloc = segments->alloc ? 2 * segments->alloc : 8;
+		segments->list = (SEGMENT *)realloc(segments->list, segments->alloc * sizeof(SEGMENT));
+		if (!segments->list)
+			exit(1);
+	}
+
+	segment = &segments->list[segments->count++];
+	memset(segment, 0, sizeof(SEGMENT));
+	segment->rowscount = -1;
+	segment->size = -1;
+	segment->result = result;
+}
+
+void segments_value(PRESTOCLIENT_RESULT *result, int key, const char *data, size_t size)
+{
+	SEGMENTS *segments = segments_of(result);
+	SEGMENT *segment = segments->count > 0 ? &segments->list[segments->count - 1] : NULL;
+	char number[32];
+
+	if (key == SEGMENTKEY_ENCODING)
+	{
+		copy_value(&segments->encoding, data, size);
+		return;
+	}
+
+	if (!segment)
+		return;
+
+	switch (key)
+	{
+	case SEGMENTKEY_TYPE:
+		segment->spooled = key_is(data, size, "spooled");
+		break;
+	case SEGMENTKEY_DATA:
+		copy_value(&segment->data, data, size);
+		break;
+	case SEGMENTKEY_URI:
+		copy_value(&segment->uri, data, size);
+		break;
+	case SEGMENTKEY_ACKURI:
+		copy_value(&segment->ackuri, data, size);
+		break;
+	case SEGMENTKEY_ROWOFFSET:
+	case SEGMENTKEY_ROWSCOUNT:
+	case SEGMENTKEY_SEGMENTSIZE:
+		snprintf(number, sizeof(number), "%.*s", (int)(size < sizeof(number) ? size : sizeof(number) - 1), data);
+		if (key == SEGMENTKEY_ROWOFFSET)
+			segment->rowoffset = strtoll(number, NULL, 10);
+		else if (key == SEGMENTKEY_ROWSCOUNT)
+			segment->rowscount = strtoll(number, NULL, 10);
+		else
+			segment->size = strtoll(number, NULL, 10);
+		break;
+	case SEGMENTKEY_HEADERVALUE:
+	{
+		char *line = NULL;
+		size_t namelen = segments->headername ? strlen(segments->headername) : 0;
+
+		line = (char *)malloc(namelen + size + 3);
+		if (!line)
+			exit(1);
+		memcpy(line, segments->headername ? segments->headername : "", namelen);
+		memcpy(line + namelen, ": ", 2);
+		memcpy(line + namelen + 2, data, size);
+		line[namelen + 2 + size] = 0;
+		segment->headers = curl_slist_append(segment->headers, line);
+		free(line);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+/* --- Decoding ------------------------------------------------------------------------------------------------------- */
+
+static int base64_value(unsigned char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	if (c >= '0' && c <= '9')
+		return c - '0' + 52;
+	if (c == '+' || c == '-')
+		return 62;
+	if (c == '/' || c == '_')
+		return 63;
+	return -1;
+}
+
+// Decode base64 in place, padding and line breaks are skipped
+static size_t base64_decode(char *text)
+{
+	size_t out = 0;
+	unsigned int bits = 0;
+	int nbits = 0;
+
+	for (const char *in = text; *in; in++)
+	{
+		int value = base64_value((unsigned char)*in);
+
+		if (value < 0)
+			continue;
+
+		bits = (bits << 6) | (unsigned int)value;
+		nbits += 6;
+		if (nbits >= 8)
+		{
+			nbits -= 8;
+			text[out++] = (char)((bits >> nbits) & 0xFF);
+		}
+	}
+
+	return out;
+}
+
+// The rows of a segment are a json array of rows, parsed like the data of a page
+static enum E_RESULTCODES decode_rows(PRESTOCLIENT_RESULT *result, SEGMENT *segment, const char *rows, size_t size)
+{
+	static const JSON_CALLBACKS callbacks = {
+		presto_json_parser
+	};
+	JSON_CONFIG config;
+	JSON_PARSER parser;
+	JSON_INPUT_POS pos = {0};
+	PARSINGSTATE pstate = {0};
+	size_t before = result->rowsreceived;
+	int ret;
+
+	if (result->columncount == 0)
+		return PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+
+	// a segment can be larger than a page, it is not limited like one
+	json_default_config(&config);
+	config.max_total_len = 0;
+	config.max_string_len = 0;
+
+	pstate.level = 1;
+	pstate.section = DATA;
+	result->parserstate = &pstate;
+	json_init(&parser, &callbacks, &config, result);
+	result->jsonparser = &parser;
+
+	ret = json_feed(&parser, rows, size);
+	if (ret == 0)
+		ret = json_fini(&parser, &pos);
+	else
+		json_fini(&parser, NULL);
+
+	result->jsonparser = NULL;
+	result->parserstate = NULL;
+
+	if (ret != 0)
+	{
+		printf("Unable to parse segment, retcode %i (offset: %li)\n", ret, pos.offset);
+		return PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+	}
+
+	// a segment with less rows than announced was cut off, a limit of the query stops the rows early
+	if (segment->rowscount >= 0 && result->rowsreceived - before != (size_t)segment->rowscount && !result->cancelquery &&
+		!(result->maxrows > 0 && result->rowsreceived >= result->maxrows))
+		return PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+
+	return PRESTOCLIENT_RESULT_OK;
+}
+
+/* --- Downloading ---------------------------------------------------------------------------------------------------- */
+
+static size_t segment_callback(char *contents, size_t size, size_t nmemb, void *user_data)
+{
+	SEGMENT *segment = (SEGMENT *)user_data;
+	size_t contentsize = size * nmemb;
+
+	// Returning less than contentsize makes curl abort the transfer
+	if (segment->result->cancelquery)
+		return 0;
+
+	if (segment->bodysize + contentsize + 1 > segment->bodyalloc)
+	{
+		size_t alloc = segment->bodyalloc ? segment->bodyalloc : SEGMENTS_FIRSTALLOC;
+
+		if (segment->size > 0 && (size_t)segment->size + 1 > alloc)
+			alloc = (size_t)segment->size + 1;
+		while (alloc < segment->bodysize + contentsize + 1)
+			alloc *= 2;
+		segment->body = (char *)realloc(segment->body, alloc);
+		if (!segment->body)
+			exit(1);
+		segment->bodyalloc = alloc;
+	}
+
+	memcpy(segment->body + segment->bodysize, contents, contentsize);
+	segment->bodysize += contentsize;
+	segment->result->bodybytes += contentsize;
+
+	return contentsize;
+}
+
+static size_t ack_callback(char *contents, size_t size, size_t nmemb, void *user_data)
+{
+	(void)contents;
+	(void)user_data;
+
+	return size * nmemb;
+}
+
+static CURL *new_transfer(PRESTOCLIENT_RESULT *result, const char *uri)
+{
+	CURL *hcurl = curl_easy_init();
+	long long timeout = SEGMENTS_URLTIMEOUT;
+
+	if (!hcurl)
+		exit(1);
+
+	if (result->client->share)
+		curl_easy_setopt(hcurl, CURLOPT_SHARE, result->client->share);
+	if (result->client->trace_http)
+		curl_easy_setopt(hcurl, CURLOPT_VERBOSE, 1L);
+	if (result->deadline > 0)
+	{
+		timeout = result->deadline - util_now_msec();
+		if (timeout < 1)
+			timeout = 1;
+	}
+
+	curl_easy_setopt(hcurl, CURLOPT_URL, uri);
+	curl_easy_setopt(hcurl, CURLOPT_HTTPGET, 1L);
+	curl_easy_setopt(hcurl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(hcurl, CURLOPT_CONNECTTIMEOUT_MS, (long)PRESTOCLIENT_URLTIMEOUT);
+	curl_easy_setopt(hcurl, CURLOPT_TIMEOUT_MS, (long)timeout);
+	curl_easy_setopt(hcurl, CURLOPT_NOSIGNAL, 1L);
+
+	return hcurl;
+}
+
+static void start_download(CURLM *multi, PRESTOCLIENT_RESULT *result, SEGMENT *segment)
+{
+	segment->hcurl = new_transfer(result, segment->uri);
+	curl_easy_setopt(segment->hcurl, CURLOPT_HTTPHEADER, segment->headers);
+	curl_easy_setopt(segment->hcurl, CURLOPT_ACCEPT_ENCODING, result->client->compression);
+	curl_easy_setopt(segment->hcurl, CURLOPT_WRITEFUNCTION, segment_callback);
+	curl_easy_setopt(segment->hcurl, CURLOPT_WRITEDATA, (void *)segment);
+	curl_easy_setopt(segment->hcurl, CURLOPT_PRIVATE, (char *)segment);
+
+	segment->bodysize = 0;
+	segment->attempts++;
+	segment->state = SEGMENT_RUNNING;
+	curl_multi_add_handle(multi, segment->hcurl);
+}
+
+static void start_ack(CURLM *multi, PRESTOCLIENT_RESULT *result, SEGMENT *segment)
+{
+	CURL *hcurl = new_transfer(result, segment->ackuri);
+
+	curl_easy_setopt(hcurl, CURLOPT_WRITEFUNCTION, ack_callback);
+	curl_easy_setopt(hcurl, CURLOPT_PRIVATE, (char *)NULL);
+	curl_multi_add_handle(multi, hcurl);
+}
+
+// A segment download ended, it is done, retried later or failed
+static void end_download(PRESTOCLIENT_RESULT *result, SEGMENT *segment, CURLcode curlstatus)
+{
+	long http_code = 0;
+
+	curl_easy_getinfo(segment->hcurl, CURLINFO_RESPONSE_CODE, &http_code);
+	result->wirebytes += util_download_size(segment->hcurl);
+	curl_easy_cleanup(segment->hcurl);
+	segment->hcurl = NULL;
+
+	if (curlstatus == CURLE_OPERATION_TIMEDOUT && result->deadline > 0)
+	{
+		result->timedout = true;
+		result->cancelquery = true;
+	}
+
+	if (curlstatus == CURLE_OK && http_code == PRESTOCLIENT_CURL_EXPECT_HTTP_GET_POST)
+	{
+		segment->state = SEGMENT_DONE;
+		result->segments->stats.bytes += segment->bodysize;
+		return;
+	}
+
+	// storage answering busy or failing, or a connection that broke, is asked again
+	if (!result->cancelquery && (curlstatus != CURLE_OK || http_code >= 500 || http_code == 429) &&
+		curlstatus != CURLE_OPERATION_TIMEDOUT &&
+		retrypolicy_retry(result->client->retry, segment->attempts, &segment->delay))
+	{
+		segment->state = SEGMENT_WAITING;
+		segment->notbefore = util_now_msec() + segment->delay;
+		result->segments->stats.retries++;
+		return;
+	}
+
+	segment->state = SEGMENT_FAILED;
+	if (!result->cancelquery)
+	{
+		char message[128];
+
+		if (curlstatus != CURLE_OK)
+			snprintf(message, sizeof(message), "Segment download failed: %s", curl_easy_strerror(curlstatus));
+		else
+			snprintf(message, sizeof(message), "Segment download failed: Http-code: %ld", http_code);
+		alloc_copy(&result->lasterrormessage, message);
+	}
+}
+
+enum E_RESULTCODES segments_fetch(PRESTOCLIENT_RESULT *result)
+{
+	SEGMENTS *segments = result->segments;
+	enum E_RESULTCODES rc = PRESTOCLIENT_RESULT_OK;
+	size_t parallel, decoded = 0, running = 0, acks = 0;
+	CURLM *multi = NULL;
+
+	if (!segments || segments->count == 0)
+		return PRESTOCLIENT_RESULT_OK;
+
+	// only the json encoding is asked for
+	if (segments->encoding && strcmp(segments->encoding, "json") != 0)
+	{
+		alloc_copy(&result->lasterrormessage, "Unsupported segment encoding");
+		segments_clear(result);
+		return PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+	}
+
+	parallel = result->client->spooling;
+	if (parallel < 1)
+		parallel = 1;
+	if (parallel > SEGMENTS_MAXPARALLEL)
+		parallel = SEGMENTS_MAXPARALLEL;
+
+	for (size_t i = 0; i < segments->count; i++)
+	{
+		if (!segments->list[i].spooled)
+			segments->list[i].state = SEGMENT_DONE;
+		else if (!segments->list[i].uri)
+			segments->list[i].state = SEGMENT_FAILED;
+	}
+
+	while (decoded < segments->count || acks > 0)
+	{
+		CURLMsg *msg;
+		int left, still = 0;
+		long long now = util_now_msec();
+
+		// Start downloads within the window of segments not yet decoded
+		for (size_t i = decoded; i < segments->count && i < decoded + parallel && rc == PRESTOCLIENT_RESULT_OK; i++)
+		{
+			SEGMENT *segment = &segments->list[i];
+
+			if (segment->state == SEGMENT_WAITING && segment->notbefore <= now && running < parallel)
+			{
+				if (!multi)
+					multi = curl_multi_init();
+				start_download(multi, result, segment);
+				running++;
+				if (running > segments->stats.maxactive)
+					segments->stats.maxactive = running;
+			}
+		}
+
+		// Decode in page order what arrived, the rows keep the order of the server
+		while (decoded < segments->count && rc == PRESTOCLIENT_RESULT_OK && !result->cancelquery)
+		{
+			SEGMENT *segment = &segments->list[decoded];
+
+			if (segment->state == SEGMENT_FAILED)
+				rc = segment->attempts > 0 ? PRESTOCLIENT_RESULT_CURL_ERROR : PRESTOCLIENT_RESULT_PARSE_JSON_ERROR;
+			if (segment->state != SEGMENT_DONE)
+				break;
+
+			if (segment->spooled)
+			{
+				rc = decode_rows(result, segment, segment->body ? segment->body : "", segment->bodysize);
+				segments->stats.spooled++;
+			}
+			else
+			{
+				size_t size = segment->data ? base64_decode(segment->data) : 0;
+
+				rc = decode_rows(result, segment, segment->data ? segment->data : "", size);
+				segments->stats.inlined++;
+			}
+
+			free(segment->body);
+			segment->body = NULL;
+			segment->bodysize = segment->bodyalloc = 0;
+			decoded++;
+
+			// The coordinator may drop a segment once it is read
+			if (rc == PRESTOCLIENT_RESULT_OK && segment->ackuri)
+			{
+				if (!multi)
+					multi = curl_multi_init();
+				start_ack(multi, result, segment);
+				acks++;
+			}
+		}
+
+		if (rc != PRESTOCLIENT_RESULT_OK || result->cancelquery)
+			break;
+		if (result->deadline > 0 && util_now_msec() >= result->deadline)
+		{
+			result->timedout = true;
+			result->cancelquery = true;
+			break;
+		}
+		if (!multi || (running == 0 && acks == 0))
+		{
+			// only retries waiting for their time
+			if (decoded < segments->count)
+				util_sleep(PRESTOCLIENT_CANCELCHECKMSEC);
+			continue;
+		}
+
+		curl_multi_perform(multi, &still);
+		curl_multi_wait(multi, NULL, 0, SEGMENTS_CHECKMSEC, NULL);
+		curl_multi_perform(multi, &still);
+
+		while ((msg = curl_multi_info_read(multi, &left)) != NULL)
+		{
+			SEGMENT *segment = NULL;
+
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&segment);
+			curl_multi_remove_handle(multi, msg->easy_handle);
+			if (segment)
+			{
+				end_download(result, segment, msg->data.result);
+				running--;
+			}
+			else
+			{
+				long http_code = 0;
+
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &http_code);
+				if (msg->data.result == CURLE_OK && http_code >= 200 && http_code < 300)
+					segments->stats.acknowledged++;
+				curl_easy_cleanup(msg->easy_handle);
+				acks--;
+			}
+		}
+	}
+
+	// Transfers of a failed or cancelled page end here
+	if (multi)
+	{
+		for (size_t i = 0; i < segments->count; i++)
+		{
+			if (segments->list[i].hcurl)
+			{
+				curl_multi_remove_handle(multi, segments->list[i].hcurl);
+				curl_easy_cleanup(segments->list[i].hcurl);
+				segments->list[i].hcurl = NULL;
+			}
+		}
+		while (acks > 0)
+		{
+			CURLMsg *msg;
+			int left, still = 0;
+
+			curl_multi_perform(multi, &still);
+			if (still == 0)
+				break;
+			curl_multi_wait(multi, NULL, 0, SEGMENTS_CHECKMSEC, NULL);
+			while ((msg = curl_multi_info_read(multi, &left)) != NULL)
+			{
+				if (msg->msg == CURLMSG_DONE)
+					acks--;
+			}
+		}
+		curl_multi_cleanup(multi);
+	}
+
+	if (result->cancelquery && rc == PRESTOCLIENT_RESULT_OK)
+		rc = result->timedout ? PRESTOCLIENT_RESULT_TIMEOUT : PRESTOCLIENT_RESULT_CANCELLED;
+
+	segments_clear(result);
+	return rc;
+}
+
+/* --- State ---------------------------------------------------------------------------------------------------------- */
+
+size_t segments_pending(const PRESTOCLIENT_RESULT *result)
+{
+	return result->segments ? result->segments->count : 0;
+}
+
+void segments_clear(PRESTOCLIENT_RESULT *result)
+{
+	SEGMENTS *segments = result->segments;
+
+	if (!segments)
+		return;
+
+	for (size_t i = 0; i < segments->count; i++)
+	{
+		SEGMENT *segment = &segments->list[i];
+
+		if (segment->hcurl)
+			curl_easy_cleanup(segment->hcurl);
+		free(segment->data);
+		free(segment->uri);
+		free(segment->ackuri);
+		free(segment->body);
+		curl_slist_free_all(segment->headers);
+	}
+	segments->count = 0;
+
+	free(segments->encoding);
+	segments->encoding = NULL;
+}
+
+void segments_delete(PRESTOCLIENT_RESULT *result)
+{
+	if (!result->segments)
+		return;
+
+	segments_clear(result);
+	free(result->segments->list);
+	free(result->segments->headername);
+	free(result->segments);
+	result->segments = NULL;
+}
+
+void segments_stats(const PRESTOCLIENT_RESULT *result, SEGMENTS_STATS *stats)
+{
+	if (result->segments)
+		*stats = result->segments->stats;
+	else
+		memset(stats, 0, sizeof(SEGMENTS_STATS));
+}
+
+int prestoclient_setspooling(PRESTOCLIENT *prestoclient, size_t parallel)
+{
+	if (!prestoclient || parallel > SEGMENTS_MAXPARALLEL)
+		return PRESTO_BAD_REQUEST;
+
+	prestoclient->spooling = parallel;
+	return PRESTO_OK;
+}
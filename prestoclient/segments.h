@@ -0,0 +1,132 @@
+/**
+ * \file segments.h
+ *
+ * \brief rows of spooled results are downloaded as segments next to the coordinator
+ *
+ * A coordinator speaking the spooling protocol does not inline the rows of a large result in
+ * the data of every page. The data of a page is an object listing segments instead:
+ *
+ *   "data": { "encoding": "json", "segments": [
+ *       { "type": "inline", "data": "<base64 of the rows>", "metadata": { "rowOffset": 0, "rowsCount": 10 } },
+ *       { "type": "spooled", "uri": "...", "ackUri": "...", "headers": { "name": ["value"] },
+ *         "metadata": { "rowOffset": 10, "rowsCount": 5000, "segmentSize": 180000 } } ] }
+ *
+ * The client asks for it with the X-Presto-Query-Data-Encoding header once prestoclient_setspooling
+ * is set; a coordinator not spooling keeps sending rows in data. The body of a segment is the json
+ * array of its rows. Spooled segments are fetched from their uri, usually object storage, with
+ * the headers of their descriptor, several at a time on one curl multi handle. They complete in
+ * any order and are decoded in the order of the page, so the rows keep the order of the server;
+ * at most the parallel number of segments are downloading or waiting to be decoded at a time.
+ * A decoded segment is acknowledged with a GET of its ackUri, the coordinator may drop it then.
+ *
+ * A failed segment download is retried under the retry policy of the client (see retrypolicy.h),
+ * the circuit breakers of the coordinators are not touched by it.
+ */
+
+#ifndef EASYPTORA_SEGMENTS_HH
+#define EASYPTORA_SEGMENTS_HH
+
+#include "prestoclient.h"
+#include "prestoclienttypes.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* --- Defines -------------------------------------------------------------------------------------------------------- */
+#define SEGMENTS_MAXPARALLEL              16              //!< Most segments of a query downloading at a time
+#define SEGMENTS_CHECKMSEC                100             //!< Millisec between two checks for cancel and deadline while downloading
+
+/* --- Enums ---------------------------------------------------------------------------------------------------------- */
+
+// What the value of the json key being parsed goes to, kept in PARSINGSTATE
+enum E_SEGMENTKEY
+{
+	SEGMENTKEY_NONE = 0,
+	SEGMENTKEY_ENCODING,
+	SEGMENTKEY_TYPE,
+	SEGMENTKEY_DATA,
+	SEGMENTKEY_URI,
+	SEGMENTKEY_ACKURI,
+	SEGMENTKEY_METADATA,
+	SEGMENTKEY_ROWOFFSET,
+	SEGMENTKEY_ROWSCOUNT,
+	SEGMENTKEY_SEGMENTSIZE,
+	SEGMENTKEY_HEADERS,
+	SEGMENTKEY_HEADERVALUE
+};
+
+/* --- Structs -------------------------------------------------------------------------------------------------------- */
+typedef struct ST_SEGMENTS_STATS
+{
+	size_t						  inlined;						//!< Inline segments decoded
+	size_t						  spooled;						//!< Spooled segments downloaded and decoded
+	size_t						  bytes;						//!< Bytes of the spooled segments
+	size_t						  acknowledged;					//!< Segments the coordinator confirmed as acknowledged
+	size_t						  retries;						//!< Segment downloads started again
+	size_t						  maxactive;					//!< Most segment downloads running at the same time
+} SEGMENTS_STATS;
+
+/* --- Functions ------------------------------------------------------------------------------------------------------ */
+
+/**
+ * \brief Follow a key of the data object of a page, called by presto_json_parser
+ *
+ * \param result  The result being parsed
+ * \param key     In: key of the enclosing value, Out: what the value of this key is
+ * \param data    The key
+ * \param size    Length of the key
+ * \param level   Nesting level of the key, the data object is level 2
+ */
+extern void segments_key(PRESTOCLIENT_RESULT *result, int *key, const char *data, size_t size, size_t level);
+
+/**
+ * \brief Start the descriptor of the next segment of the page, called by presto_json_parser
+ */
+extern void segments_begin(PRESTOCLIENT_RESULT *result);
+
+/**
+ * \brief Set a string or number of the descriptor, called by presto_json_parser
+ */
+extern void segments_value(PRESTOCLIENT_RESULT *result, int key, const char *data, size_t size);
+
+/**
+ * \brief Number of segments of the page not yet decoded
+ */
+extern size_t segments_pending(const PRESTOCLIENT_RESULT *result);
+
+/**
+ * \brief Decode the inline segments and download and decode the spooled segments of the page
+ *
+ * The rows go to the write callback of the result like those of an inline page. The segments
+ * are dropped afterwards, also when one failed.
+ *
+ * \param result  The result of the page
+ *
+ * \return PRESTOCLIENT_RESULT_OK, or the code of the first segment that failed
+ */
+extern enum E_RESULTCODES segments_fetch(PRESTOCLIENT_RESULT *result);
+
+/**
+ * \brief Drop the segments of a page, its request is sent again
+ */
+extern void segments_clear(PRESTOCLIENT_RESULT *result);
+
+/**
+ * \brief Free the segment state of a result
+ */
+extern void segments_delete(PRESTOCLIENT_RESULT *result);
+
+/**
+ * \brief Segments decoded, bytes downloaded and acknowledgements of a result so far
+ *
+ * \param result  The result
+ * \param stats   Out: the numbers, all 0 for a query without segments
+ */
+extern void segments_stats(const PRESTOCLIENT_RESULT *result, SEGMENTS_STATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EASYPTORA_SEGMENTS_HH
@@ -376,4 +376,110 @@ char *fixupsql(char *sql, int sqlLen, int cte, size_t *nparam, int *sqltype, cha
         }
     }
     return out;
-}
\ No newline at end of file
+}
+/**
+ * Check if query contains one of the given words as identifier
+ * token outside of string literals.
+ * @param sql query string
+ * @param words NULL terminated list of lower case words
+ * @result true or false
+ */
+
+static int
+hasword(const char *sql, const char **words)
+{
+    const char *q = sql, *inq = NULL;
+
+    if (!sql)
+    {
+        return 0;
+    }
+    while (*q)
+    {
+        if (inq)
+        {
+            if (*q == *inq)
+            {
+                inq = NULL;
+            }
+            ++q;
+        }
+        else if (*q == '\'')
+        {
+            inq = q++;
+        }
+        else if (*q == '_' || (*q >= 'a' && *q <= 'z') || (*q >= 'A' && *q <= 'Z'))
+        {
+            const char *start = q;
+            int i, len;
+
+            while (*q == '_' || (*q >= 'a' && *q <= 'z') ||
+                   (*q >= 'A' && *q <= 'Z') || (*q >= '0' && *q <= '9'))
+            {
+                ++q;
+            }
+            len = q - start;
+            for (i = 0; words[i]; i++)
+            {
+                if ((int)strlen(words[i]) == len &&
+                    strncasecmp(start, words[i], len) == 0)
+                {
+                    return 1;
+                }
+            }
+        }
+        else
+        {
+            ++q;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Check if query references functions or tables whose result
+ * changes between executions, e.g. now() or system.runtime.
+ * Such queries must not be served from a result cache.
+ * @param sql query string
+ * @result true or false
+ */
+
+int checkvolatile(const char *sql)
+{
+    static const char *volstr[] = {
+        "now",
+        "rand",
+        "random",
+        "uuid",
+        "shuffle",
+        "current_date",
+        "current_time",
+        "current_timestamp",
+        "current_timezone",
+        "current_user",
+        "localtime",
+        "localtimestamp",
+        "runtime",
+        NULL
+    };
+
+    return hasword(sql, volstr);
+}
+
+/**
+ * Check if query already restricts its row count with
+ * LIMIT or FETCH FIRST, anywhere in the statement.
+ * @param sql query string
+ * @result true or false
+ */
+
+int checklimit(const char *sql)
+{
+    static const char *limstr[] = {
+        "limit",
+        "fetch",
+        NULL
+    };
+
+    return hasword(sql, limstr);
+}
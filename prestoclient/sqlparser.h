@@ -13,5 +13,7 @@ enum STATMENT_TYPE {
 };
 
 char* fixupsql(char *sql, int sqlLen, int cte, size_t *nparam, int *isselect, char **errmsg);
+int checkvolatile(const char *sql);
+int checklimit(const char *sql);
 
 #endif
\ No newline at end of file
@@ -308,6 +308,7 @@ drvgpps(DBC *d, char *sect, char *ent, char *def, char *buf,
 // forward
 static void unbindcols(STMT *s);
 static SQLRETURN mkbindcols(STMT *s, size_t ncols);
+static SQLRETURN drvrunquery(STMT *s);
 
 
 
@@ -621,7 +622,8 @@ freeresult(STMT *s, int clrcols)
     {
         freedyncols(s);
         if (s->presto_stmt)
-            prestoclient_deleteresult(s->presto_stmt->client, s->presto_stmt);        
+            prestoclient_deleteresult(s->presto_stmt->client, s->presto_stmt);
+        s->presto_stmt = NULL;
         s->nowchar[1] = 0;
         s->one_tbl = -1;
         s->has_pk = -1;
@@ -649,6 +651,7 @@ freestmt(SQLHSTMT stmt)
     presto_stmt_drop(s);
     freeresult(s, 1);
     freep(&s->query);
+    freep(&s->partcolumn);
     d = (DBC *)s->dbc;
     if (d && d->magic == DBC_MAGIC)
     {
@@ -721,6 +724,15 @@ drvallocenv(SQLHENV *env)
 #endif
 #endif
     e->dbcs = NULL;
+    e->resultcache = resultcache_new(0);
+    e->clientpool = clientpool_new(0, 0);
+    e->curlshare = curlshare_new();
+    e->retrypolicy = retrypolicy_new();
+    e->endpoints = endpoints_new(0);
+    e->admission = admission_new(0, ADMISSION_FIFO);
+    e->scheduler = pagescheduler_new(0, 0);
+    e->parsepool = parsepool_new(0);
+    e->multiplexer = multiplexer_new(MULTIPLEXER_OFF);
     *env = (SQLHENV)e;
     return SQL_SUCCESS;
 }
@@ -770,6 +782,8 @@ drvallocstmt(SQLHDBC dbc, SQLHSTMT *stmt)
     s->longnames = d->longnames;
     s->retr_data = SQL_RD_ON;
     s->max_rows = 0;
+    s->query_timeout = d->querytimeout;
+    s->priority = d->priority;
     s->bind_type = SQL_BIND_BY_COLUMN;
     s->bind_offs = NULL;
     s->paramset_size = 1;
@@ -847,6 +861,15 @@ drvfreeenv(SQLHENV env)
     LeaveCriticalSection(&e->cs);
     DeleteCriticalSection(&e->cs);
 #endif
+    resultcache_delete(e->resultcache);
+    clientpool_delete(e->clientpool);
+    curlshare_delete(e->curlshare);
+    retrypolicy_delete(e->retrypolicy);
+    endpoints_delete(e->endpoints);
+    admission_delete(e->admission);
+    pagescheduler_delete(e->scheduler);
+    parsepool_delete(e->parsepool);
+    multiplexer_delete(e->multiplexer);
     free(e);
     return SQL_SUCCESS;
 }
@@ -863,6 +886,162 @@ SQLFreeEnv(SQLHENV env)
     return drvfreeenv(env);
 }
 
+/**
+ * Get environment attribute.
+ * @param env environment handle
+ * @param attr attribute to be retrieved
+ * @param val output buffer
+ * @param len length of output buffer
+ * @param lenp output length
+ * @result ODBC error code
+ */
+
+SQLRETURN SQL_API
+SQLGetEnvAttr(SQLHENV env, SQLINTEGER attr, SQLPOINTER val,
+              SQLINTEGER len, SQLINTEGER *lenp)
+{
+    ENV *e;
+    SQLRETURN ret = SQL_ERROR;
+
+    (void)len;
+    if (env == SQL_NULL_HENV)
+    {
+        return SQL_INVALID_HANDLE;
+    }
+    e = (ENV *)env;
+    if (e->magic != ENV_MAGIC)
+    {
+        return SQL_INVALID_HANDLE;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    EnterCriticalSection(&e->cs);
+#endif
+    switch (attr)
+    {
+    case SQL_ATTR_CONNECTION_POOLING:
+        if (val)
+        {
+            *((SQLINTEGER *)val) = e->pool ? SQL_CP_ONE_PER_DRIVER : SQL_CP_OFF;
+        }
+        if (lenp)
+        {
+            *lenp = sizeof(SQLINTEGER);
+        }
+        ret = SQL_SUCCESS;
+        break;
+    case SQL_ATTR_CP_MATCH:
+        if (val)
+        {
+            *((SQLINTEGER *)val) = SQL_CP_STRICT_MATCH;
+        }
+        if (lenp)
+        {
+            *lenp = sizeof(SQLINTEGER);
+        }
+        ret = SQL_SUCCESS;
+        break;
+    case SQL_ATTR_OUTPUT_NTS:
+        if (val)
+        {
+            *((SQLINTEGER *)val) = SQL_TRUE;
+        }
+        if (lenp)
+        {
+            *lenp = sizeof(SQLINTEGER);
+        }
+        ret = SQL_SUCCESS;
+        break;
+    case SQL_ATTR_ODBC_VERSION:
+        if (val)
+        {
+            *((SQLINTEGER *)val) = e->ov3 ? SQL_OV_ODBC3 : SQL_OV_ODBC2;
+        }
+        if (lenp)
+        {
+            *lenp = sizeof(SQLINTEGER);
+        }
+        ret = SQL_SUCCESS;
+        break;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    LeaveCriticalSection(&e->cs);
+#endif
+    return ret;
+}
+
+/**
+ * Set environment attribute.
+ * SQL_ATTR_CONNECTION_POOLING set to SQL_CP_ONE_PER_DRIVER makes
+ * connections of this environment reuse presto clients of
+ * disconnected connections, see clientpool.h.
+ * @param env environment handle
+ * @param attr attribute to be set
+ * @param val value of attribute
+ * @param len length of value
+ * @result ODBC error code
+ */
+
+SQLRETURN SQL_API
+SQLSetEnvAttr(SQLHENV env, SQLINTEGER attr, SQLPOINTER val, SQLINTEGER len)
+{
+    ENV *e;
+    SQLRETURN ret = SQL_ERROR;
+
+    (void)len;
+    if (env == SQL_NULL_HENV)
+    {
+        return SQL_INVALID_HANDLE;
+    }
+    e = (ENV *)env;
+    if (e->magic != ENV_MAGIC)
+    {
+        return SQL_INVALID_HANDLE;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    EnterCriticalSection(&e->cs);
+#endif
+    switch (attr)
+    {
+    case SQL_ATTR_CONNECTION_POOLING:
+        if (val == (SQLPOINTER)SQL_CP_ONE_PER_DRIVER)
+        {
+            e->pool = 1;
+            ret = SQL_SUCCESS;
+        }
+        else if (val == (SQLPOINTER)SQL_CP_OFF)
+        {
+            e->pool = 0;
+            ret = SQL_SUCCESS;
+        }
+        break;
+    case SQL_ATTR_CP_MATCH:
+        ret = SQL_SUCCESS;
+        break;
+    case SQL_ATTR_OUTPUT_NTS:
+        if (val == (SQLPOINTER)SQL_TRUE)
+        {
+            ret = SQL_SUCCESS;
+        }
+        break;
+    case SQL_ATTR_ODBC_VERSION:
+        if (val == (SQLPOINTER)SQL_OV_ODBC2)
+        {
+            e->ov3 = 0;
+            ret = SQL_SUCCESS;
+        }
+        else if (val == (SQLPOINTER)SQL_OV_ODBC3)
+        {
+            e->ov3 = 1;
+            ret = SQL_SUCCESS;
+        }
+        break;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    LeaveCriticalSection(&e->cs);
+#endif
+    return ret;
+}
+
 /**
  * Internal allocate HDBC.
  * @param env environment handle
@@ -1059,18 +1238,55 @@ SQLFreeConnect(SQLHDBC dbc)
 }
 
 /**
- * Open SQLite database file given file name and flags.
+ * Release presto client of DBC, pooled clients go back to the ENV pool.
+ * @param d DBC pointer
+ */
+
+static void
+dbclose(DBC *d)
+{
+    if (!d->presto_client)
+    {
+        return;
+    }
+    if (d->pooled && d->env)
+    {
+        dbtraceapi(d, "clientpool_checkin", d->dsn);
+        clientpool_checkin(d->env->clientpool, d->presto_client);
+    }
+    else
+    {
+        prestoclient_close(d->presto_client);
+    }
+    d->presto_client = NULL;
+    d->pooled = 0;
+}
+
+/**
+ * Open connection to Presto coordinator given DSN attributes.
  * @param d DBC pointer
+ * @param name database name
  * @param dsn data source name
+ * @param sflag STEPAPI flag
+ * @param ntflag NOTXN flag
  * @param busy busy/lock timeout
+ * @param server coordinator host name
+ * @param port coordinator port
+ * @param protocol http or https
+ * @param catalog default catalog or empty
+ * @param schema default schema or empty
+ * @param user user name or empty for the login name
  * @result ODBC error code
  */
 
 static SQLRETURN
-dbopen(DBC *d, char *name, char *dsn, char *sflag, char *ntflag, char *busy)
+dbopen(DBC *d, char *name, char *dsn, char *sflag, char *ntflag, char *busy,
+       char *server, char *port, char *protocol, char *catalog, char *schema,
+       char *user)
 {
     char *endp = NULL;
     int rc, tmp, busyto = 100000;
+    unsigned int prt = 8080;
 
     if (d->presto_client)
     {
@@ -1080,11 +1296,49 @@ dbopen(DBC *d, char *name, char *dsn, char *sflag, char *ntflag, char *busy)
                     d->dbname);
             fflush(d->trace);
         }
-        prestoclient_close(d->presto_client);
-        d->presto_client = NULL;
+        dbclose(d);
+    }
+    tmp = strtol(port, &endp, 10);
+    if (endp && *endp == '\0' && endp != port && tmp > 0 && tmp <= 65535)
+    {
+        prt = tmp;
+    }
+    if (server[0] == '\0')
+    {
+        server = "localhost";
+    }
+    if (protocol[0] == '\0')
+    {
+        protocol = "http";
+    }
+    if (d->pooling && d->env)
+    {
+        d->presto_client = clientpool_checkout(d->env->clientpool, protocol, server, &prt,
+                                               catalog[0] ? catalog : NULL,
+                                               schema[0] ? schema : NULL,
+                                               user[0] ? user : NULL, NULL, NULL, NULL, true);
+        d->pooled = d->presto_client != NULL;
+    }
+    else
+    {
+        d->presto_client = prestoclient_init(protocol, server, &prt,
+                                             catalog[0] ? catalog : NULL,
+                                             schema[0] ? schema : NULL,
+                                             user[0] ? user : NULL, NULL, NULL, NULL, true);
+    }
+    if (d->presto_client && d->env)
+    {
+        curlshare_attach(d->env->curlshare, d->presto_client);
+        retrypolicy_attach(d->env->retrypolicy, d->presto_client);
+        admission_attach(d->env->admission, d->presto_client);
+        pagescheduler_attach(d->env->scheduler, d->presto_client);
+        parsepool_attach(d->env->parsepool, d->presto_client);
+        multiplexer_attach(d->env->multiplexer, d->presto_client);
+        if (endpoints_islist(server))
+        {
+            endpoints_attach(d->env->endpoints, d->presto_client);
+        }
     }
-    unsigned int prt = 8080;
-    d->presto_client = prestoclient_init("http", "localhost", &prt, NULL, NULL, NULL, NULL, NULL, NULL, true);
     if (!d->presto_client)
     {
         rc = PRESTO_ERROR;
@@ -1098,11 +1352,7 @@ dbopen(DBC *d, char *name, char *dsn, char *sflag, char *ntflag, char *busy)
     {
     connfail:
         setstatd(d, rc, "connect failed", (*d->ov3) ? (char *)"HY000" : (char *)"S1000");
-        if (d->presto_client)
-        {
-            prestoclient_close(d->presto_client);
-            d->presto_client = NULL;
-        }
+        dbclose(d);
         return SQL_ERROR;
     }
     d->pwd = NULL;
@@ -1190,10 +1440,17 @@ drvconnect(SQLHDBC dbc, SQLCHAR *dsn, SQLSMALLINT dsnLen, char *pwd,
     SQLRETURN ret;
     char buf[SQL_MAX_MESSAGE_LENGTH * 6], dbname[SQL_MAX_MESSAGE_LENGTH];
     char busy[SQL_MAX_MESSAGE_LENGTH / 4], tracef[SQL_MAX_MESSAGE_LENGTH];
-    char loadext[SQL_MAX_MESSAGE_LENGTH];
+    char loadext[SQL_MAX_MESSAGE_LENGTH], cdir[SQL_MAX_MESSAGE_LENGTH];
+    char server[SQL_MAX_MESSAGE_LENGTH], catalog[SQL_MAX_MESSAGE_LENGTH];
+    char schema[SQL_MAX_MESSAGE_LENGTH], user[SQL_MAX_MESSAGE_LENGTH];
     char sflag[32], spflag[32], ntflag[32], nwflag[32], biflag[32];
     char snflag[32], lnflag[32], ncflag[32], fkflag[32], jmode[32];
-    char jdflag[32];
+    char jdflag[32], cttl[32], csize[32], coflag[32];
+    char port[32], protocol[32], poflag[32], psize[32], pidle[32];
+    char qtmo[32], rmax[32], rdelay[32], rbudget[32], bthres[32], btime[32];
+    char maxq[32], qorder[32], prio[32], bpages[32], pthreads[32], spool[32];
+    char h2[32], fpage[32], mpage[32], hpages[32];
+    char enc[64], comp[64];
 #if defined(_WIN32) || defined(_WIN64)
     char oemcp[32];
 #endif
@@ -1287,6 +1544,68 @@ drvconnect(SQLHDBC dbc, SQLCHAR *dsn, SQLSMALLINT dsnLen, char *pwd,
 #endif
     biflag[0] = '\0';
     getdsnattr(buf, "bigint", biflag, sizeof(biflag));
+    cttl[0] = '\0';
+    getdsnattr(buf, "resultcachettl", cttl, sizeof(cttl));
+    csize[0] = '\0';
+    getdsnattr(buf, "resultcachesize", csize, sizeof(csize));
+    coflag[0] = '\0';
+    getdsnattr(buf, "coalesce", coflag, sizeof(coflag));
+    cdir[0] = '\0';
+    getdsnattr(buf, "cachedir", cdir, sizeof(cdir));
+    qtmo[0] = '\0';
+    getdsnattr(buf, "querytimeout", qtmo, sizeof(qtmo));
+    rmax[0] = '\0';
+    getdsnattr(buf, "maxretries", rmax, sizeof(rmax));
+    rdelay[0] = '\0';
+    getdsnattr(buf, "retrydelay", rdelay, sizeof(rdelay));
+    rbudget[0] = '\0';
+    getdsnattr(buf, "retrybudget", rbudget, sizeof(rbudget));
+    bthres[0] = '\0';
+    getdsnattr(buf, "breakerthreshold", bthres, sizeof(bthres));
+    btime[0] = '\0';
+    getdsnattr(buf, "breakertime", btime, sizeof(btime));
+    maxq[0] = '\0';
+    getdsnattr(buf, "maxqueries", maxq, sizeof(maxq));
+    qorder[0] = '\0';
+    getdsnattr(buf, "queueorder", qorder, sizeof(qorder));
+    prio[0] = '\0';
+    getdsnattr(buf, "priority", prio, sizeof(prio));
+    bpages[0] = '\0';
+    getdsnattr(buf, "bulkpages", bpages, sizeof(bpages));
+    pthreads[0] = '\0';
+    getdsnattr(buf, "parsethreads", pthreads, sizeof(pthreads));
+    h2[0] = '\0';
+    getdsnattr(buf, "http2", h2, sizeof(h2));
+    enc[0] = '\0';
+    getdsnattr(buf, "encoding", enc, sizeof(enc));
+    spool[0] = '\0';
+    getdsnattr(buf, "spooling", spool, sizeof(spool));
+    comp[0] = '\0';
+    getdsnattr(buf, "compression", comp, sizeof(comp));
+    fpage[0] = '\0';
+    getdsnattr(buf, "firstpagesize", fpage, sizeof(fpage));
+    mpage[0] = '\0';
+    getdsnattr(buf, "maxpagesize", mpage, sizeof(mpage));
+    hpages[0] = '\0';
+    getdsnattr(buf, "hotpages", hpages, sizeof(hpages));
+    server[0] = '\0';
+    getdsnattr(buf, "server", server, sizeof(server));
+    port[0] = '\0';
+    getdsnattr(buf, "port", port, sizeof(port));
+    protocol[0] = '\0';
+    getdsnattr(buf, "protocol", protocol, sizeof(protocol));
+    catalog[0] = '\0';
+    getdsnattr(buf, "catalog", catalog, sizeof(catalog));
+    schema[0] = '\0';
+    getdsnattr(buf, "schema", schema, sizeof(schema));
+    user[0] = '\0';
+    getdsnattr(buf, "user", user, sizeof(user));
+    poflag[0] = '\0';
+    getdsnattr(buf, "pooling", poflag, sizeof(poflag));
+    psize[0] = '\0';
+    getdsnattr(buf, "poolsize", psize, sizeof(psize));
+    pidle[0] = '\0';
+    getdsnattr(buf, "poolidletime", pidle, sizeof(pidle));
 #else
     SQLGetPrivateProfileString(buf, "timeout", "100000",
                                busy, sizeof(busy), ODBC_INI);
@@ -1324,6 +1643,68 @@ drvconnect(SQLHDBC dbc, SQLCHAR *dsn, SQLSMALLINT dsnLen, char *pwd,
 #endif
     SQLGetPrivateProfileString(buf, "bigint", "",
                                biflag, sizeof(biflag), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "resultcachettl", "0",
+                               cttl, sizeof(cttl), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "resultcachesize", "",
+                               csize, sizeof(csize), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "coalesce", "",
+                               coflag, sizeof(coflag), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "cachedir", "",
+                               cdir, sizeof(cdir), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "querytimeout", "0",
+                               qtmo, sizeof(qtmo), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "maxretries", "",
+                               rmax, sizeof(rmax), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "retrydelay", "",
+                               rdelay, sizeof(rdelay), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "retrybudget", "",
+                               rbudget, sizeof(rbudget), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "breakerthreshold", "",
+                               bthres, sizeof(bthres), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "breakertime", "",
+                               btime, sizeof(btime), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "maxqueries", "",
+                               maxq, sizeof(maxq), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "queueorder", "",
+                               qorder, sizeof(qorder), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "priority", "0",
+                               prio, sizeof(prio), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "bulkpages", "",
+                               bpages, sizeof(bpages), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "parsethreads", "",
+                               pthreads, sizeof(pthreads), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "http2", "",
+                               h2, sizeof(h2), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "encoding", "",
+                               enc, sizeof(enc), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "spooling", "0",
+                               spool, sizeof(spool), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "compression", "",
+                               comp, sizeof(comp), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "firstpagesize", "",
+                               fpage, sizeof(fpage), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "maxpagesize", "",
+                               mpage, sizeof(mpage), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "hotpages", "0",
+                               hpages, sizeof(hpages), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "server", "localhost",
+                               server, sizeof(server), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "port", "8080",
+                               port, sizeof(port), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "protocol", "http",
+                               protocol, sizeof(protocol), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "catalog", "",
+                               catalog, sizeof(catalog), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "schema", "",
+                               schema, sizeof(schema), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "user", "",
+                               user, sizeof(user), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "pooling", "",
+                               poflag, sizeof(poflag), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "poolsize", "",
+                               psize, sizeof(psize), ODBC_INI);
+    SQLGetPrivateProfileString(buf, "poolidletime", "",
+                               pidle, sizeof(pidle), ODBC_INI);
 #endif
     tracef[0] = '\0';
 #ifdef WITHOUT_DRIVERMGR
@@ -1347,13 +1728,101 @@ drvconnect(SQLHDBC dbc, SQLCHAR *dsn, SQLSMALLINT dsnLen, char *pwd,
     d->oemcp = 0;
 #endif
     d->dobigint = getbool(biflag);
+    /* result cache TTL is given in seconds, size in megabytes */
+    d->cachettl = strtol(cttl, NULL, 10) * 1000;
+    if (d->cachettl < 0 || !d->env)
+    {
+        d->cachettl = 0;
+    }
+    if (d->cachettl > 0 && strtol(csize, NULL, 10) > 0)
+    {
+        resultcache_setmaxbytes(d->env->resultcache,
+                                (size_t)strtol(csize, NULL, 10) * 1024 * 1024);
+    }
+    d->coalesce = d->env ? getbool(coflag) : 0;
+    /* query timeout is given in seconds like SQL_ATTR_QUERY_TIMEOUT */
+    d->querytimeout = (SQLULEN)max(strtol(qtmo, NULL, 10), 0);
+    /* unset retry settings keep the ENV wide value, breaker time is in seconds */
+    if (d->env)
+    {
+        retrypolicy_configure(d->env->retrypolicy,
+                              rmax[0] ? (int)strtol(rmax, NULL, 10) : -1,
+                              rdelay[0] ? strtol(rdelay, NULL, 10) : -1,
+                              -1,
+                              rbudget[0] ? (int)strtol(rbudget, NULL, 10) : -1,
+                              bthres[0] ? (int)strtol(bthres, NULL, 10) : -1,
+                              btime[0] ? strtol(btime, NULL, 10) * 1000 : -1);
+    }
+    /* the query limit per coordinator is ENV wide as well, unset keeps it */
+    if (d->env && maxq[0])
+    {
+        admission_configure(d->env->admission,
+                            (size_t)max(strtol(maxq, NULL, 10), 0),
+                            strcasecmp(qorder, "priority") == 0 ?
+                            ADMISSION_PRIORITY : ADMISSION_FIFO);
+    }
+    d->priority = strtol(prio, NULL, 10);
+    /* bulk page requests in flight are limited ENV wide, interactive ones never */
+    if (d->env && bpages[0])
+    {
+        pagescheduler_configure(d->env->scheduler,
+                                (size_t)max(strtol(bpages, NULL, 10), 0), 0);
+    }
+    /* the parse workers are ENV wide as well, unset keeps them */
+    if (d->env && pthreads[0])
+    {
+        parsepool_configure(d->env->parsepool,
+                            (size_t)max(strtol(pthreads, NULL, 10), 0));
+    }
+    /* so are the multiplexed connections, h2c is negotiated over tls like 1 */
+    if (d->env && h2[0])
+    {
+        if (strcasecmp(h2, "h2c") == 0)
+        {
+            dbtraceapi(d, "http2=h2c not supported, negotiated over tls", h2);
+        }
+        multiplexer_configure(d->env->multiplexer,
+                              strcasecmp(h2, "h2c") == 0 || getbool(h2) ?
+                              MULTIPLEXER_HTTP2 : MULTIPLEXER_OFF, 0);
+    }
+    freep(&d->cachedir);
+    if (cdir[0] != '\0')
+    {
+        d->cachedir = xstrdup(cdir);
+    }
+    freep(&d->encoding);
+    if (enc[0] != '\0')
+    {
+        d->encoding = xstrdup(enc);
+    }
+    d->spooling = max(strtol(spool, NULL, 10), 0);
+    freep(&d->compression);
+    if (comp[0] != '\0')
+    {
+        d->compression = xstrdup(comp);
+    }
+    /* page sizes are given in kB, both 0 leave them to the server */
+    d->firstpagesize = fpage[0] != '\0' ? max(strtol(fpage, NULL, 10), 0) :
+                       PRESTOCLIENT_PAGESIZE_FIRST / 1024;
+    d->maxpagesize = mpage[0] != '\0' ? max(strtol(mpage, NULL, 10), 0) :
+                     PRESTOCLIENT_PAGESIZE_MAX / 1024;
+    d->hotpages = max(strtol(hpages, NULL, 10), 0);
+    /* pool idle time is given in seconds */
+    d->pooling = d->env && (d->env->pool || getbool(poflag));
+    if (d->pooling)
+    {
+        clientpool_configure(d->env->clientpool,
+                             (size_t)max(strtol(psize, NULL, 10), 0),
+                             (long long)strtol(pidle, NULL, 10) * 1000);
+    }
     d->pwd = pwd;
     d->pwdLen = 0;
     if (d->pwd)
     {
         d->pwdLen = (pwdLen == SQL_NTS) ? strlen(d->pwd) : (size_t)pwdLen;
     }
-    ret = dbopen(d, dbname, (char *)dsn, sflag, ntflag, busy);    
+    ret = dbopen(d, dbname, (char *)dsn, sflag, ntflag, busy,
+                 server, port, protocol, catalog, schema, user);
     return ret;
 }
 
@@ -1440,6 +1909,52 @@ done:
 }
 #endif
 
+/**
+ * Hand the statement's SQL_ATTR_QUERY_TIMEOUT and SQL_ATTR_PRESTO_PRIORITY
+ * to the presto client before a query is started. The timeout covers the
+ * query request, waiting for the result and the pages pulled by SQLFetch(),
+ * when it expires the query is cancelled on the server and HYT00 is reported.
+ * The priority orders the query's wait for admission and its page requests.
+ * The page encodings of the DSN are set again as a pooled client forgets them,
+ * an unknown encoding is traced and the pages stay json. So is the number
+ * of spooled segments downloaded at a time, a value out of range is traced,
+ * and the compressions of the responses, an unknown one is traced, and
+ * the page sizes, a first page size above the maximum is traced. Rows a
+ * static cursor left behind are compressed beyond the hot pages of the DSN.
+ * @param s statement pointer
+ */
+
+static void
+setqueryattrs(STMT *s)
+{
+    DBC *d = (DBC *)s->dbc;
+
+    prestoclient_setquerytimeout(d->presto_client,
+                                 (long long)s->query_timeout * 1000);
+    prestoclient_setpriority(d->presto_client, (int)s->priority);
+    if (prestoclient_setencoding(d->presto_client, d->encoding) != PRESTO_OK)
+    {
+        dbtraceapi(d, "prestoclient_setencoding", d->encoding);
+    }
+    if (prestoclient_setspooling(d->presto_client, (size_t)d->spooling) != PRESTO_OK)
+    {
+        dbtraceapi(d, "prestoclient_setspooling", NULL);
+    }
+    if (prestoclient_setcompression(d->presto_client, d->compression) != PRESTO_OK)
+    {
+        dbtraceapi(d, "prestoclient_setcompression", d->compression);
+    }
+    if (prestoclient_setpagesize(d->presto_client,
+                                 (size_t)d->firstpagesize * 1024,
+                                 (size_t)d->maxpagesize * 1024) != PRESTO_OK)
+    {
+        dbtraceapi(d, "prestoclient_setpagesize", NULL);
+    }
+    prestoclient_sethotpages(d->presto_client,
+                             s->curtype == SQL_CURSOR_STATIC ?
+                             (size_t)d->hotpages : 0);
+}
+
 static void
 s3stmt_end(STMT *s)
 {
@@ -1522,6 +2037,7 @@ drvprepare(SQLHSTMT stmt, SQLCHAR *query, SQLINTEGER queryLen)
     }
     errp = NULL;
     freeresult(s, -1);
+    setqueryattrs(s);
 
     if (s->isselect == 1)
     {
@@ -1543,7 +2059,9 @@ drvprepare(SQLHSTMT stmt, SQLCHAR *query, SQLINTEGER queryLen)
     } else {
         // there are statements presto cannot prepare so we execute direct (dms, special keywords)
         dbtraceapi(d, "prestoclient_prepare execute direct...", (char *)s->query);
-        rc = prestoclient_query(d->presto_client, &presto_stmt, (char *)s->query, NULL, NULL);
+        s->executing = 1;
+        rc = prestoclient_query(d->presto_client, &presto_stmt, (char *)s->query, NULL, (void *)s);
+        s->executing = 0;
         if (rc != PRESTO_OK)
         {            
             if (presto_stmt)
@@ -1551,7 +2069,18 @@ drvprepare(SQLHSTMT stmt, SQLCHAR *query, SQLINTEGER queryLen)
                 dbtraceapi(d, "prestoclient_deleteresult", 0);
                 prestoclient_deleteresult(d->presto_client, presto_stmt);
             }
-            setstat(s, rc, "%s (%s)", (*s->ov3) ? (char *)"HY000" : (char *)"S1000", "ERROR executing non preparable query", s->query);
+            if (rc == PRESTO_CANCELLED)
+            {
+                setstat(s, rc, "operation canceled", (*s->ov3) ? (char *)"HY008" : (char *)"S1008");
+            }
+            else if (rc == PRESTO_TIMEOUT)
+            {
+                setstat(s, rc, "timeout expired", (*s->ov3) ? (char *)"HYT00" : (char *)"S1T00");
+            }
+            else
+            {
+                setstat(s, rc, "%s (%s)", (*s->ov3) ? (char *)"HY000" : (char *)"S1000", "ERROR executing non preparable query", s->query);
+            }
             sret = SQL_ERROR;            
         } else {
             s->presto_stmt = presto_stmt;
@@ -1872,7 +2401,9 @@ mkbindcols(STMT *s, size_t ncols)
 }
 
 /**
- * Internal query execution used by SQLExecute().
+ * Internal query execution used by SQLExecute(). A SELECT without
+ * parameters is streamed by drvrunquery(), so closing its cursor early
+ * stops the query on the server.
  * @param stmt statement handle
  * @param initial false when called from SQLPutData()
  * @result ODBC error code
@@ -1911,8 +2442,33 @@ drvexecute(SQLHSTMT stmt, int initial)
         return SQL_ERROR;
     }
 
+    /*
+     * A SELECT without parameters runs like SQLExecDirect(): with the
+     * LIMIT of SQL_ATTR_MAX_ROWS, streamed and served by the result
+     * cache. Its prepared statement only described the columns.
+     */
+    if (s->isselect == SELECT && s->nparams == 0)
+    {
+        s3stmt_end(s);
+        freeresult(s, -1);
+        return drvrunquery(s);
+    }
+
+    setqueryattrs(s);
+    s->executing = 1;
     ret = prestoclient_execute(d->presto_client, s->presto_stmt, NULL, NULL);
-    if (ret != PRESTO_OK)
+    s->executing = 0;
+    if (ret == PRESTO_CANCELLED)
+    {
+        setstat(s, -1, "operation canceled", (*s->ov3) ? (char *)"HY008" : (char *)"S1008");
+        ret = SQL_ERROR;
+    }
+    else if (ret == PRESTO_TIMEOUT)
+    {
+        setstat(s, -1, "timeout expired", (*s->ov3) ? (char *)"HYT00" : (char *)"S1T00");
+        ret = SQL_ERROR;
+    }
+    else if (ret != PRESTO_OK)
     {
         printf("Execute error %i", ret);
         setstat(s, -1, "unable to execute query", (*s->ov3) ? (char *)"HY000" : (char *)"S1000");
@@ -1931,68 +2487,188 @@ drvexecute(SQLHSTMT stmt, int initial)
 }
 
 /**
- * Internal query execution used by SQLExecDirect().
- * @param stmt statement handle
- * @param initial false when called from SQLPutData()
- * @result ODBC error code
+ * Copy of a query with LIMIT max_rows appended, so the server stops
+ * producing rows early, too. A trailing semicolon is dropped, the
+ * newline ends a trailing line comment.
+ * @param query query string
+ * @param max_rows the statement's SQL_ATTR_MAX_ROWS
+ * @result malloc'ed query or NULL when out of memory
  */
 
-static SQLRETURN
-drvexecutedirect(SQLHSTMT stmt, SQLCHAR *query, SQLINTEGER queryLen)
+static char *
+addlimit(const char *query, SQLULEN max_rows)
 {
-    SQLRETURN ret;
-    STMT *s;
-    DBC *d;
-    char *errp = NULL;
-    int rc, busy_count;
-    size_t i, ncols = 0, nrows = 0;
+    size_t len = strlen(query);
+    char *nq;
 
-    if (stmt == SQL_NULL_HSTMT)
-    {
-        printf("Invalid handle");
-        return SQL_INVALID_HANDLE;
-    }
-    s = (STMT *)stmt;
-    if (s->dbc == SQL_NULL_HDBC)
+    while (len > 0 && (ISSPACE(query[len - 1]) || query[len - 1] == ';'))
     {
-    noconn:
-        printf("No connection");
-        return noconn(s);
+        --len;
     }
-    d = (DBC *)s->dbc;
-    if (!d->presto_client)
+    nq = xmalloc(len + 32);
+    if (!nq)
     {
-        goto noconn;
+        return NULL;
     }
+    sprintf(nq, "%.*s\nLIMIT %lu", (int)len, query, (unsigned long)max_rows);
+    return nq;
+}
 
-    s3stmt_end(s);
-    presto_stmt_drop(s);
-    freep(&s->query);
+/**
+ * Run the query of a statement, shared by SQLExecDirect(), SQLExecDirectW()
+ * and SQLExecute() of a SELECT without parameters. The query is s->query,
+ * fixed up and with an empty result.
+ * @param s statement pointer
+ * @result ODBC error code
+ */
 
-    s->query = (SQLCHAR *)fixupsql((char *)query, queryLen,
-                                   (d->version >= 0x030805),
-                                   &s->nparams, &s->isselect, &errp);
-    if (!s->query)
+static SQLRETURN
+drvrunquery(STMT *s)
+{
+    SQLRETURN ret;
+    DBC *d = (DBC *)s->dbc;
+    char *sql = (char *)s->query, *limited = NULL, *cachekey = NULL;
+    RESULTCACHE_FLIGHT *flight = NULL;
+    bool leader = false;
+    bool extract = s->isselect == SELECT && s->partcolumn && s->parallelism > 1;
+
+    s->cancelwait = false;
+    if (s->isselect == SELECT && s->max_rows && !checklimit(sql))
     {
-        if (errp)
+        limited = addlimit(sql, s->max_rows);
+        if (!limited)
         {
-            setstat(s, -1, "%s", (*s->ov3) ? (char *)"HY000" : (char *)"S1000", errp);
-            return SQL_ERROR;
+            return nomem(s);
         }
-        return nomem(s);
+        sql = limited;
     }
-    errp = NULL;
-    freeresult(s, -1);
+    /* from here on SQLCancel() must not close the statement under us */
+    s->executing = 1;
 
-    ret = prestoclient_query(d->presto_client, &(s->presto_stmt), (char*)s->query, NULL, NULL);
-    if (ret != PRESTO_OK)
+    /*
+     * Deterministic SELECTs may be answered from the ENV wide result
+     * cache or share the rows of an identical query that is already
+     * running on another DBC. DDL and queries using now(), rand() etc.
+     * always go to the server. Waiting for the other DBC is bounded by
+     * the query timeout and ended by SQLCancel(). A statement with the
+     * partition attributes set is an extract and skips both.
+     */
+    if ((d->cachettl > 0 || d->coalesce) && extract)
     {
-        printf("Execute error %i", ret);
-        setstat(s, -1, "unable to execute query direct", (*s->ov3) ? (char *)"HY000" : (char *)"S1000");
-        ret = SQL_ERROR;
-    } else {
+        dbtraceapi(d, "partitioned extract, resultcache skipped", sql);
+    }
+    else if ((d->cachettl > 0 || d->coalesce) && s->isselect == SELECT &&
+             !checkvolatile(sql))
+    {
+        cachekey = resultcache_makekey(d->presto_client, sql);
+        if (d->cachettl > 0)
+        {
+            s->presto_stmt = resultcache_get(d->env->resultcache,
+                                             d->presto_client, cachekey);
+            if (s->presto_stmt)
+            {
+                dbtraceapi(d, "resultcache hit", sql);
+                goto hit;
+            }
+        }
+        if (d->cachettl > 0 && d->cachedir)
+        {
+            s->presto_stmt = diskcache_load(d->cachedir, cachekey,
+                                            d->presto_client);
+            if (s->presto_stmt)
+            {
+                dbtraceapi(d, "diskcache hit", sql);
+                goto hit;
+            }
+        }
+        if (d->coalesce)
+        {
+            flight = resultcache_join(d->env->resultcache, cachekey, &leader);
+            if (!leader)
+            {
+                ret = resultcache_wait(d->env->resultcache, flight,
+                                       d->presto_client,
+                                       s->query_timeout > 0 ?
+                                       util_now_msec() +
+                                       (long long)s->query_timeout * 1000 : 0,
+                                       &s->cancelwait, &s->presto_stmt);
+                flight = NULL;
+                if (ret != PRESTO_OK)
+                {
+                    goto waited;
+                }
+                if (s->presto_stmt)
+                {
+                    dbtraceapi(d, "coalesced", sql);
+                    goto hit;
+                }
+                /* leader failed, run the query ourselves */
+            }
+        }
+    }
+
+    setqueryattrs(s);
+    if (extract)
+    {
+        /* extract: range queries on the partition column stream into one result */
+        ret = partitions_query(d->presto_client, &(s->presto_stmt), sql, s->partcolumn,
+                               1, 0, s->parallelism, (void *)s);
+        if (ret == PRESTO_OK)
+        {
+            prestoclient_setmaxrows(s->presto_stmt, s->max_rows);
+        }
+    }
+    else if (s->isselect == SELECT && !cachekey)
+    {
+        /* stream: rows after the first page are pulled by SQLFetch() */
+        ret = prestoclient_querystart(d->presto_client, &(s->presto_stmt), sql, NULL, (void *)s);
+        if (ret == PRESTO_OK)
+        {
+            prestoclient_setmaxrows(s->presto_stmt, s->max_rows);
+        }
+    }
+    else
+    {
+        ret = prestoclient_query(d->presto_client, &(s->presto_stmt), sql, NULL, (void *)s);
+    }
+waited:
+    s->executing = 0;
+    if (ret == PRESTO_CANCELLED)
+    {
+        setstat(s, -1, "operation canceled", (*s->ov3) ? (char *)"HY008" : (char *)"S1008");
+        ret = SQL_ERROR;
+    }
+    else if (ret == PRESTO_TIMEOUT)
+    {
+        setstat(s, -1, "timeout expired", (*s->ov3) ? (char *)"HYT00" : (char *)"S1T00");
+        ret = SQL_ERROR;
+    }
+    else if (ret != PRESTO_OK)
+    {
+        printf("Execute error %i", ret);
+        setstat(s, -1, "unable to execute query direct", (*s->ov3) ? (char *)"HY000" : (char *)"S1000");
+        ret = SQL_ERROR;
+    } else {
+        if (cachekey && d->cachettl > 0)
+        {
+            resultcache_put(d->env->resultcache, cachekey, s->presto_stmt,
+                            d->cachettl);
+            if (d->cachedir &&
+                diskcache_store(d->cachedir, cachekey, s->presto_stmt,
+                                d->cachettl) != PRESTO_OK)
+            {
+                dbtraceapi(d, "diskcache store failed", d->cachedir);
+            }
+        }
         ret = mkbindcols(s, s->presto_stmt->columncount);        
     }
+    if (flight)
+    {
+        resultcache_leave(d->env->resultcache, flight,
+                          ret == SQL_SUCCESS ? s->presto_stmt : NULL);
+    }
+    freep(&cachekey);
+    freep(&limited);
 
     // For INSERT/UPDATE/DELETE statements change the return code
     // to SQL_NO_DATA if the number of rows affected was 0.
@@ -2001,6 +2677,66 @@ drvexecutedirect(SQLHSTMT stmt, SQLCHAR *query, SQLINTEGER queryLen)
     //    ret = SQL_NO_DATA;
     //}    
     return ret;
+
+hit:
+    s->executing = 0;
+    freep(&cachekey);
+    freep(&limited);
+    return mkbindcols(s, s->presto_stmt->columncount);
+}
+
+/**
+ * Internal query execution used by SQLExecDirect() and SQLExecDirectW().
+ * @param stmt statement handle
+ * @param query query string
+ * @param queryLen length of query string or SQL_NTS
+ * @result ODBC error code
+ */
+
+static SQLRETURN
+drvexecutedirect(SQLHSTMT stmt, SQLCHAR *query, SQLINTEGER queryLen)
+{
+    STMT *s;
+    DBC *d;
+    char *errp = NULL;
+
+    if (stmt == SQL_NULL_HSTMT)
+    {
+        printf("Invalid handle");
+        return SQL_INVALID_HANDLE;
+    }
+    s = (STMT *)stmt;
+    if (s->dbc == SQL_NULL_HDBC)
+    {
+    noconn:
+        printf("No connection");
+        return noconn(s);
+    }
+    d = (DBC *)s->dbc;
+    if (!d->presto_client)
+    {
+        goto noconn;
+    }
+
+    s3stmt_end(s);
+    presto_stmt_drop(s);
+    freep(&s->query);
+
+    s->query = (SQLCHAR *)fixupsql((char *)query, queryLen,
+                                   (d->version >= 0x030805),
+                                   &s->nparams, &s->isselect, &errp);
+    if (!s->query)
+    {
+        if (errp)
+        {
+            setstat(s, -1, "%s", (*s->ov3) ? (char *)"HY000" : (char *)"S1000", errp);
+            return SQL_ERROR;
+        }
+        return nomem(s);
+    }
+    errp = NULL;
+    freeresult(s, -1);
+    return drvrunquery(s);
 }
 
 
@@ -2063,12 +2799,8 @@ SQLExecDirectW(SQLHSTMT stmt, SQLWCHAR *query, SQLINTEGER queryLen)
         ret = nomem((STMT *)stmt);
         goto done;
     }
-    ret = drvprepare(stmt, (SQLCHAR *)q, SQL_NTS);
+    ret = drvexecutedirect(stmt, (SQLCHAR *)q, SQL_NTS);
     uc_free(q);
-    if (ret == SQL_SUCCESS)
-    {
-        ret = drvexecute(stmt, 1);
-    }
 done:
     HSTMT_UNLOCK(stmt);
     return ret;
@@ -2184,6 +2916,12 @@ drvfreestmt(SQLHSTMT stmt, SQLUSMALLINT opt)
         break;
     case SQL_CLOSE:
         s3stmt_end_if(s);
+        if (s->presto_stmt)
+        {
+            /* rows not read yet are not pulled from the server any more */
+            dbtraceapi((DBC *)dbc, "prestoclient_closequery", 0);
+            prestoclient_closequery(s->presto_stmt);
+        }
         freeresult(s, 0);
         break;
     case SQL_DROP:
@@ -2199,6 +2937,44 @@ drvfreestmt(SQLHSTMT stmt, SQLUSMALLINT opt)
     return ret;
 }
 
+/**
+ * Cancel HSTMT processing.
+ * May be called from another thread while a function runs on the
+ * statement: the running transfer is aborted, the query is cancelled
+ * on the server and the function fails with HY008. The cursor is
+ * only closed for ODBC 2 applications; in ODBC 3 SQLCancel on an idle
+ * statement has no effect, and the owning thread may still be using
+ * its result in SQLFetch() or SQLGetData().
+ * @param stmt statement handle
+ * @result ODBC error code
+ */
+
+SQLRETURN SQL_API
+SQLCancel(SQLHSTMT stmt)
+{
+    STMT *s = (STMT *)stmt;
+    DBC *d;
+
+    if (stmt == SQL_NULL_HSTMT)
+    {
+        return SQL_INVALID_HANDLE;
+    }
+    d = (DBC *)s->dbc;
+    if (d && d->magic == DBC_MAGIC && d->presto_client)
+    {
+        d->busyint = 1;
+        dbtraceapi(d, "prestoclient_cancelqueries", 0);
+        /* no HSTMT_LOCK here, the executing thread holds it */
+        prestoclient_cancelqueries(d->presto_client, s);
+    }
+    s->cancelwait = true;
+    if (s->executing || *s->ov3)
+    {
+        return SQL_SUCCESS;
+    }
+    return drvfreestmt(stmt, SQL_CLOSE);
+}
+
 /**
  * Free a HENV, HDBC, or HSTMT handle.
  * @param type handle type
@@ -2875,7 +3651,48 @@ SQLColAttributeW(SQLHSTMT stmt, SQLUSMALLINT col, SQLUSMALLINT id,
 #endif
 
 /**
- * Internal fetch function for SQLFetchScroll() and SQLExtendedFetch().
+ * Pull pages of a streamed result until its row want is buffered or
+ * the query ended.
+ * @param s statement pointer
+ * @param want index of the row, negative for all rows of the result
+ * @result ODBC error code
+ */
+
+static SQLRETURN
+pullrows(STMT *s, long long want)
+{
+    while (prestoclient_getstatus(s->presto_stmt) == PRESTOCLIENT_STATUS_RUNNING &&
+           (want < 0 || !s->presto_stmt->tablebuff ||
+            (size_t)want >= s->presto_stmt->tablebuff->nrow))
+    {
+        int rc;
+
+        s->executing = 1;
+        rc = prestoclient_fetchmore(s->presto_stmt);
+        s->executing = 0;
+        if (rc == PRESTO_CANCELLED)
+        {
+            setstat(s, -1, "operation canceled", (*s->ov3) ? (char *)"HY008" : (char *)"S1008");
+            return SQL_ERROR;
+        }
+        if (rc == PRESTO_TIMEOUT)
+        {
+            setstat(s, -1, "timeout expired", (*s->ov3) ? (char *)"HYT00" : (char *)"S1T00");
+            return SQL_ERROR;
+        }
+        if (rc != PRESTO_OK)
+        {
+            setstat(s, -1, "fetching next page failed", (*s->ov3) ? (char *)"HY000" : (char *)"S1000");
+            return SQL_ERROR;
+        }
+    }
+    return SQL_SUCCESS;
+}
+
+/**
+ * Internal fetch function for SQLFetch(), SQLFetchScroll() and SQLExtendedFetch().
+ * The rowset is a single row, a static cursor may move to any row of
+ * its result.
  * @param stmt statement handle
  * @param orient fetch direction
  * @param offset offset for fetch direction
@@ -2886,7 +3703,8 @@ static SQLRETURN
 drvfetchscroll(SQLHSTMT stmt, SQLSMALLINT orient, SQLINTEGER offset)
 {
     STMT *s;
-    int i, withinfo = 0;
+    int i, withinfo = 0, fromend = 0;
+    long long cur, want = 0, pull, rows = 0;
     SQLRETURN ret;
 
     if (stmt == SQL_NULL_HSTMT)
@@ -2970,199 +3788,152 @@ drvfetchscroll(SQLHSTMT stmt, SQLSMALLINT orient, SQLINTEGER offset)
     //     }
     // }
     
+    // the row to fetch, rowidx -1 is before the first row and the row count after the last
+    cur = s->presto_stmt->rowidx;
+    switch (orient)
+    {
+    case SQL_FETCH_NEXT:
+        want = cur + 1;
+        break;
+    case SQL_FETCH_PRIOR:
+        want = cur - 1;
+        break;
+    case SQL_FETCH_FIRST:
+        want = 0;
+        break;
+    case SQL_FETCH_LAST:
+        fromend = 1;
+        break;
+    case SQL_FETCH_ABSOLUTE:
+        fromend = offset < 0;
+        want = (long long)offset - 1;
+        break;
+    case SQL_FETCH_RELATIVE:
+        want = cur + offset;
+        break;
+    // 		case SQL_FETCH_BOOKMARK:
+    // 			if (s->bkmrk == SQL_UB_ON && !s->bkmrkptr)
+    // 			{
+    // 				if (offset < 0 || offset >= s->nrows)
+    // 				{
+    // 					return SQL_NO_DATA;
+    // 				}
+    // 				s->rowp = offset - 1;
+    // 				break;
+    // 			}
+    // 			if (s->bkmrk != SQL_UB_OFF && s->bkmrkptr)
+    // 			{
+    // 				int rowp;
+
+    // 				if (s->bkmrk == SQL_UB_VARIABLE)
+    // 				{
+    // 					if (s->has_rowid >= 0)
+    // 					{
+    // 						sqlite_int64 bkmrk, rowid;
+
+    // 						bkmrk = *(sqlite_int64 *)s->bkmrkptr;
+    // 						for (rowp = 0; rowp < s->nrows; rowp++)
+    // 						{
+    // 							char **data, *endp = 0;
+
+    // 							data = s->rows + s->ncols + (rowp * s->ncols) + s->has_rowid;
+    // #ifdef __osf__
+    // 							rowid = strtol(*data, &endp, 0);
+    // #else
+    // 							rowid = strtoll(*data, &endp, 0);
+    // #endif
+    // 							if (rowid == bkmrk)
+    // 							{
+    // 								break;
+    // 							}
+    // 						}
+    // 					}
+    // 					else
+    // 					{
+    // 						rowp = *(sqlite_int64 *)s->bkmrkptr;
+    // 					}
+    // 				}
+    // 				else
+    // 				{
+    // 					rowp = *(int *)s->bkmrkptr;
+    // 				}
+    // 				if (rowp + offset < 0 || rowp + offset >= s->nrows)
+    // 				{
+    // 					return SQL_NO_DATA;
+    // 				}
+    // 				s->rowp = rowp + offset - 1;
+    // 				break;
+    // 			}
+    default:
+        printf("Unsupported fetch orient %i\n", orient);
+        s->row_status0[0] = SQL_ROW_ERROR;
+        ret = SQL_ERROR;
+        goto done;
+    }
+
+    // streamed result, pull pages until the row is buffered, counting from the end needs them all
+    pull = fromend ? -1 : want;
+    if (s->max_rows && (pull < 0 || pull >= (long long)s->max_rows))
+    {
+        pull = (long long)s->max_rows - 1;
+    }
+    ret = pullrows(s, pull);
+    if (ret != SQL_SUCCESS)
+    {
+        goto done2;
+    }
+
     // guard, if query with no results, tablebuff is NULL
     if (s->presto_stmt->tablebuff && s->presto_stmt->tablebuff->rowbuff)
-    {        
-        switch (orient)
+    {
+        rows = (long long)s->presto_stmt->tablebuff->nrow;
+        if (s->max_rows && rows > (long long)s->max_rows)
         {
-        case SQL_FETCH_NEXT:
-            if ((s->presto_stmt->tablebuff->rowidx + 1) < s->presto_stmt->tablebuff->nrow ) {
-                s->presto_stmt->tablebuff->rowidx += 1;                
-            } else {
-                ret = SQL_NO_DATA;
-            }
-            break;
-            // if (s->nrows < 1)
-            // {
-            //     printf("Error: %s\n", "SQL_FETCH_NEXT no data");
-            //     return SQL_NO_DATA;
-            // }
-            // if (s->rowp < 0)
-            // {
-            //     s->rowp = -1;
-            // }
-            // if (s->rowp >= s->nrows)
-            // {
-            //     s->rowp = s->rowprs = s->nrows;
-            //     return SQL_NO_DATA;
-            // }
-            // break;
-        case SQL_FETCH_PRIOR:            
-            // if (s->nrows < 1 || s->rowp <= 0)
-            // {
-            //     printf("Error: %s\n", "SQL_FETCH_PRIOR no data");
-            //     s->rowp = s->rowprs = -1;
-            //     return SQL_NO_DATA;
-            // }
-            // s->rowp -= s->rowset_size + 1;
-            // if (s->rowp < -1)
-            // {
-            //     printf("Error: %s\n", "SQL_FETCH_PRIOR no data");
-            //     s->rowp = s->rowprs = -1;
-            //     return SQL_NO_DATA;
-            // }
-            // break;
-        case SQL_FETCH_FIRST:
-            // if (s->nrows < 1)
-            // {
-            //     printf("Error: %s\n", "SQL_FETCH_FIRST no data");
-            //     return SQL_NO_DATA;
-            // }
-            // s->rowp = -1;
-            // break;
-        case SQL_FETCH_LAST:
-            // if (s->nrows < 1)
-            // {
-            //     printf("Error: %s\n", "SQL_FETCH_LAST no data");
-            //     return SQL_NO_DATA;
-            // }
-            // s->rowp = s->nrows - s->rowset_size;
-            // if (--s->rowp < -1)
-            // {
-            //     s->rowp = -1;
-            // }
-            // break;
-        case SQL_FETCH_ABSOLUTE:
-            // if (offset == 0)
-            // {
-            //     printf("Error: %s\n", "SQL_FETCH_ABSOLUTE no data");
-            //     s->rowp = s->rowprs = -1;
-            //     return SQL_NO_DATA;
-            // }
-            // else if (offset < 0)
-            // {
-            //     if (0 - offset <= s->nrows)
-            //     {
-            //         s->rowp = s->nrows + offset - 1;
-            //         break;
-            //     }
-            //     printf("Error: %s\n", "SQL_FETCH_ABSOLUTE no data");
-            //     s->rowp = s->rowprs = -1;
-            //     return SQL_NO_DATA;
-            // }
-            // else if (offset > s->nrows)
-            // {
-            //     printf("Error: %s\n", "SQL_FETCH_ABSOLUTE no data");
-            //     s->rowp = s->rowprs = s->nrows;
-            //     return SQL_NO_DATA;
-            // }
-            // s->rowp = offset - 1 - 1;
-            // break;
-        case SQL_FETCH_RELATIVE:
-            // if (offset >= 0)
-            // {
-            //     s->rowp += offset * s->rowset_size - 1;
-            //     if (s->rowp >= s->nrows)
-            //     {
-            //         printf("Error: %s\n", "SQL_FETCH_RELATIVE no data");
-            //         s->rowp = s->rowprs = s->nrows;
-            //         return SQL_NO_DATA;
-            //     }
-            // }
-            // else
-            // {
-            //     s->rowp += offset * s->rowset_size - 1;
-            //     if (s->rowp < -1)
-            //     {
-            //         printf("Error: %s\n", "SQL_FETCH_RELATIVE no data");
-            //         s->rowp = s->rowprs = -1;
-            //         return SQL_NO_DATA;
-            //     }
-            // }
-            // break;
-
-            // 		case SQL_FETCH_BOOKMARK:
-            // 			if (s->bkmrk == SQL_UB_ON && !s->bkmrkptr)
-            // 			{
-            // 				if (offset < 0 || offset >= s->nrows)
-            // 				{
-            // 					return SQL_NO_DATA;
-            // 				}
-            // 				s->rowp = offset - 1;
-            // 				break;
-            // 			}
-            // 			if (s->bkmrk != SQL_UB_OFF && s->bkmrkptr)
-            // 			{
-            // 				int rowp;
-
-            // 				if (s->bkmrk == SQL_UB_VARIABLE)
-            // 				{
-            // 					if (s->has_rowid >= 0)
-            // 					{
-            // 						sqlite_int64 bkmrk, rowid;
-
-            // 						bkmrk = *(sqlite_int64 *)s->bkmrkptr;
-            // 						for (rowp = 0; rowp < s->nrows; rowp++)
-            // 						{
-            // 							char **data, *endp = 0;
-
-            // 							data = s->rows + s->ncols + (rowp * s->ncols) + s->has_rowid;
-            // #ifdef __osf__
-            // 							rowid = strtol(*data, &endp, 0);
-            // #else
-            // 							rowid = strtoll(*data, &endp, 0);
-            // #endif
-            // 							if (rowid == bkmrk)
-            // 							{
-            // 								break;
-            // 							}
-            // 						}
-            // 					}
-            // 					else
-            // 					{
-            // 						rowp = *(sqlite_int64 *)s->bkmrkptr;
-            // 					}
-            // 				}
-            // 				else
-            // 				{
-            // 					rowp = *(int *)s->bkmrkptr;
-            // 				}
-            // 				if (rowp + offset < 0 || rowp + offset >= s->nrows)
-            // 				{
-            // 					return SQL_NO_DATA;
-            // 				}
-            // 				s->rowp = rowp + offset - 1;
-            // 				break;
-            // 			}
-            /* fall through */
-        default:
-            printf("Unsupported fetch orient %i\n", orient);
-            s->row_status0[0] = SQL_ROW_ERROR;
-            ret = SQL_ERROR;
-            goto done;
-        }        
-        // s->rowprs = s->rowp + 1;
-        // for (; i < s->rowset_size; i++)
-        // {
-        //     ++s->rowp;
-        //     if (s->rowp < 0 || s->rowp >= s->nrows)
-        //     {
-        //         break;
-        //     }
-        //     ret = dofetchbind(s, i);
-        //     if (!SQL_SUCCEEDED(ret))
-        //     {
-        //         break;
-        //     }
-        //     else if (ret == SQL_SUCCESS_WITH_INFO)
-        //     {
-        //         withinfo = 1;
-        //     }
-        // }        
-    } else {
-        printf("Error: %s\n", "unable to fetch from non existent buffer");
+            rows = (long long)s->max_rows;
+        }
+    }
+    if (fromend)
+    {
+        want = rows + (orient == SQL_FETCH_LAST ? -1 : offset);
+    }
+
+    // rows left behind are decompressed again by SQLGetData(), see prestoclient_getrow()
+    if (want < 0)
+    {
+        s->presto_stmt->rowidx = -1;
         ret = SQL_NO_DATA;
     }
+    else if (want >= rows)
+    {
+        if (s->max_rows && want >= (long long)s->max_rows)
+        {
+            prestoclient_closequery(s->presto_stmt);
+        }
+        s->presto_stmt->rowidx = (int)rows;
+        ret = SQL_NO_DATA;
+    }
+    else
+    {
+        s->presto_stmt->rowidx = (int)want;
+    }
+    // s->rowprs = s->rowp + 1;
+    // for (; i < s->rowset_size; i++)
+    // {
+    //     ++s->rowp;
+    //     if (s->rowp < 0 || s->rowp >= s->nrows)
+    //     {
+    //         break;
+    //     }
+    //     ret = dofetchbind(s, i);
+    //     if (!SQL_SUCCEEDED(ret))
+    //     {
+    //         break;
+    //     }
+    //     else if (ret == SQL_SUCCESS_WITH_INFO)
+    //     {
+    //         withinfo = 1;
+    //     }
+    // }        
 done:    
     // if (!could_fetch)
     // {
@@ -3208,6 +3979,55 @@ SQLFetch(SQLHSTMT stmt)
     return ret;
 }
 
+/**
+ * Fetch result row with scrolling.
+ * @param stmt statement handle
+ * @param orient fetch direction
+ * @param offset offset for fetch direction
+ * @result ODBC error code
+ */
+
+SQLRETURN SQL_API
+SQLFetchScroll(SQLHSTMT stmt, SQLSMALLINT orient, SQLLEN offset)
+{
+    SQLRETURN ret;
+
+    HSTMT_LOCK(stmt);
+    ret = drvfetchscroll(stmt, orient, (SQLINTEGER)offset);
+    HSTMT_UNLOCK(stmt);
+    return ret;
+}
+
+/**
+ * Fetch result row with scrolling (ODBC 2).
+ * @param stmt statement handle
+ * @param orient fetch direction
+ * @param offset offset for fetch direction
+ * @param rowcount output number of fetched rows
+ * @param rowstatus array for row stati
+ * @result ODBC error code
+ */
+
+SQLRETURN SQL_API
+SQLExtendedFetch(SQLHSTMT stmt, SQLUSMALLINT orient, SQLLEN offset,
+                 SQLULEN *rowcount, SQLUSMALLINT *rowstatus)
+{
+    SQLRETURN ret;
+
+    HSTMT_LOCK(stmt);
+    ret = drvfetchscroll(stmt, (SQLSMALLINT)orient, (SQLINTEGER)offset);
+    if (rowcount)
+    {
+        *rowcount = SQL_SUCCEEDED(ret) ? 1 : 0;
+    }
+    if (rowstatus)
+    {
+        *rowstatus = SQL_SUCCEEDED(ret) ? SQL_ROW_SUCCESS : SQL_ROW_NOROW;
+    }
+    HSTMT_UNLOCK(stmt);
+    return ret;
+}
+
 /**
  * Perform bulk operation on HSTMT.
  * @param stmt statement handle
@@ -3242,6 +4062,266 @@ SQLSetScrollOptions(SQLHSTMT stmt, SQLUSMALLINT concur, SQLLEN rowkeyset,
     return ret;
 }
 
+/**
+ * Internal get statement attribute.
+ * @param stmt statement handle
+ * @param attr attribute to be retrieved
+ * @param val output buffer
+ * @param bufmax length of output buffer
+ * @param buflen output length
+ * @result ODBC error code
+ */
+
+static SQLRETURN
+drvgetstmtattr(SQLHSTMT stmt, SQLINTEGER attr, SQLPOINTER val,
+               SQLINTEGER bufmax, SQLINTEGER *buflen)
+{
+    STMT *s;
+    SQLULEN dummy;
+
+    if (stmt == SQL_NULL_HSTMT)
+    {
+        return SQL_INVALID_HANDLE;
+    }
+    s = (STMT *)stmt;
+    if (!val)
+    {
+        val = (SQLPOINTER)&dummy;
+    }
+    switch (attr)
+    {
+    case SQL_ATTR_MAX_ROWS:
+        *((SQLULEN *)val) = s->max_rows;
+        break;
+    case SQL_ATTR_QUERY_TIMEOUT:
+        *((SQLULEN *)val) = s->query_timeout;
+        break;
+    case SQL_ATTR_PRESTO_PRIORITY:
+        *((SQLLEN *)val) = s->priority;
+        break;
+    case SQL_ATTR_PRESTO_PARALLELISM:
+        *((SQLULEN *)val) = s->parallelism;
+        break;
+    case SQL_ATTR_PRESTO_WIRE_BYTES:
+    case SQL_ATTR_PRESTO_BODY_BYTES:
+    {
+        size_t wirebytes, bodybytes;
+
+        prestoclient_getbytes(s->presto_stmt, &wirebytes, &bodybytes);
+        *((SQLULEN *)val) = (attr == SQL_ATTR_PRESTO_WIRE_BYTES) ? wirebytes : bodybytes;
+        break;
+    }
+    case SQL_ATTR_PRESTO_PARTITION_COLUMN:
+    {
+        const char *column = s->partcolumn ? s->partcolumn : "";
+        SQLINTEGER len = strlen(column);
+
+        if (bufmax > 0)
+        {
+            strncpy((char *)val, column, bufmax);
+            ((char *)val)[bufmax - 1] = '\0';
+        }
+        if (buflen)
+        {
+            *buflen = len;
+        }
+        return (bufmax > len) ? SQL_SUCCESS : SQL_SUCCESS_WITH_INFO;
+    }
+    case SQL_ATTR_CURSOR_TYPE:
+        *((SQLULEN *)val) = s->curtype;
+        break;
+    case SQL_ATTR_ROW_ARRAY_SIZE:
+        *((SQLULEN *)val) = s->rowset_size;
+        break;
+    default:
+        return drvunimplstmt(stmt);
+    }
+    if (buflen)
+    {
+        *buflen = sizeof(SQLULEN);
+    }
+    return SQL_SUCCESS;
+}
+
+/**
+ * Get statement attribute.
+ * @param stmt statement handle
+ * @param attr attribute to be retrieved
+ * @param val output buffer
+ * @param bufmax length of output buffer
+ * @param buflen output length
+ * @result ODBC error code
+ */
+
+#ifndef WINTERFACE
+SQLRETURN SQL_API
+SQLGetStmtAttr(SQLHSTMT stmt, SQLINTEGER attr, SQLPOINTER val,
+               SQLINTEGER bufmax, SQLINTEGER *buflen)
+{
+    SQLRETURN ret;
+
+    HSTMT_LOCK(stmt);
+    ret = drvgetstmtattr(stmt, attr, val, bufmax, buflen);
+    HSTMT_UNLOCK(stmt);
+    return ret;
+}
+#endif
+
+#ifdef WINTERFACE
+/**
+ * Get statement attribute (UNICODE version).
+ * @param stmt statement handle
+ * @param attr attribute to be retrieved
+ * @param val output buffer
+ * @param bufmax length of output buffer
+ * @param buflen output length
+ * @result ODBC error code
+ */
+
+SQLRETURN SQL_API
+SQLGetStmtAttrW(SQLHSTMT stmt, SQLINTEGER attr, SQLPOINTER val,
+                SQLINTEGER bufmax, SQLINTEGER *buflen)
+{
+    SQLRETURN ret;
+
+    HSTMT_LOCK(stmt);
+    ret = drvgetstmtattr(stmt, attr, val, bufmax, buflen);
+    HSTMT_UNLOCK(stmt);
+    return ret;
+}
+#endif
+
+/**
+ * Internal set statement attribute.
+ * SQL_ATTR_MAX_ROWS limits the rows of the following queries,
+ * see drvexecutedirect() and prestoclient_setmaxrows().
+ * SQL_ATTR_QUERY_TIMEOUT limits their run time, see setqueryattrs().
+ * SQL_ATTR_PRESTO_PRIORITY orders their pages, see pagescheduler.h.
+ * SQL_ATTR_PRESTO_PARTITION_COLUMN and SQL_ATTR_PRESTO_PARALLELISM split
+ * a SELECT into parallel range queries, see partitions.h.
+ * @param stmt statement handle
+ * @param attr attribute to be set
+ * @param val input buffer (attribute value)
+ * @param buflen length of input buffer
+ * @result ODBC error code
+ */
+
+static SQLRETURN
+drvsetstmtattr(SQLHSTMT stmt, SQLINTEGER attr, SQLPOINTER val,
+               SQLINTEGER buflen)
+{
+    STMT *s;
+
+    if (stmt == SQL_NULL_HSTMT)
+    {
+        return SQL_INVALID_HANDLE;
+    }
+    s = (STMT *)stmt;
+    switch (attr)
+    {
+    case SQL_ATTR_MAX_ROWS:
+        s->max_rows = (SQLULEN)val;
+        return SQL_SUCCESS;
+    case SQL_ATTR_QUERY_TIMEOUT:
+        s->query_timeout = (SQLULEN)val;
+        return SQL_SUCCESS;
+    case SQL_ATTR_PRESTO_PRIORITY:
+        s->priority = (SQLLEN)val;
+        return SQL_SUCCESS;
+    case SQL_ATTR_PRESTO_PARALLELISM:
+        s->parallelism = (SQLULEN)val;
+        return SQL_SUCCESS;
+    case SQL_ATTR_PRESTO_PARTITION_COLUMN:
+        freep(&s->partcolumn);
+        if (val && buflen != 0)
+        {
+            int len = (buflen == SQL_NTS) ? (int)strlen((char *)val) : (int)buflen;
+
+            s->partcolumn = xmalloc(len + 1);
+            if (!s->partcolumn)
+            {
+                return nomem(s);
+            }
+            memcpy(s->partcolumn, val, len);
+            s->partcolumn[len] = '\0';
+        }
+        return SQL_SUCCESS;
+    case SQL_ATTR_CURSOR_TYPE:
+        if ((SQLULEN)val == (SQLULEN)s->curtype)
+        {
+            return SQL_SUCCESS;
+        }
+        setstat(s, -1, "option value changed", "01S02");
+        return SQL_SUCCESS_WITH_INFO;
+    case SQL_ATTR_ROW_ARRAY_SIZE:
+        if ((SQLULEN)val == 1)
+        {
+            return SQL_SUCCESS;
+        }
+        setstat(s, -1, "option value changed", "01S02");
+        return SQL_SUCCESS_WITH_INFO;
+    }
+    return drvunimplstmt(stmt);
+}
+
+/**
+ * Set statement attribute.
+ * @param stmt statement handle
+ * @param attr attribute to be set
+ * @param val input buffer (attribute value)
+ * @param buflen length of input buffer
+ * @result ODBC error code
+ */
+
+#ifndef WINTERFACE
+SQLRETURN SQL_API
+SQLSetStmtAttr(SQLHSTMT stmt, SQLINTEGER attr, SQLPOINTER val,
+               SQLINTEGER buflen)
+{
+    SQLRETURN ret;
+
+    HSTMT_LOCK(stmt);
+    ret = drvsetstmtattr(stmt, attr, val, buflen);
+    HSTMT_UNLOCK(stmt);
+    return ret;
+}
+#endif
+
+#ifdef WINTERFACE
+/**
+ * Set statement attribute (UNICODE version).
+ * @param stmt statement handle
+ * @param attr attribute to be set
+ * @param val input buffer (attribute value)
+ * @param buflen length of input buffer
+ * @result ODBC error code
+ */
+
+SQLRETURN SQL_API
+SQLSetStmtAttrW(SQLHSTMT stmt, SQLINTEGER attr, SQLPOINTER val,
+                SQLINTEGER buflen)
+{
+    SQLRETURN ret;
+    char *column = NULL;
+
+    if (attr == SQL_ATTR_PRESTO_PARTITION_COLUMN && val)
+    {
+        column = uc_to_utf((SQLWCHAR *)val, (buflen == SQL_NTS) ? SQL_NTS : (int)(buflen / sizeof(SQLWCHAR)));
+        if (!column)
+        {
+            return nomem((STMT *)stmt);
+        }
+        val = (SQLPOINTER)column;
+        buflen = SQL_NTS;
+    }
+    HSTMT_LOCK(stmt);
+    ret = drvsetstmtattr(stmt, attr, val, buflen);
+    HSTMT_UNLOCK(stmt);
+    uc_free(column);
+    return ret;
+}
+#endif
+
 #define strmak(dst, src, max, lenp)      \
     {                                    \
         int len = strlen(src);           \
@@ -3384,7 +4464,8 @@ drvgetinfo(SQLHDBC dbc, SQLUSMALLINT type, SQLPOINTER val, SQLSMALLINT valMax,
         break;
     case SQL_FETCH_DIRECTION:
         *((SQLUINTEGER *)val) = SQL_FD_FETCH_NEXT | SQL_FD_FETCH_FIRST |
-                                SQL_FD_FETCH_LAST | SQL_FD_FETCH_PRIOR | SQL_FD_FETCH_ABSOLUTE;
+                                SQL_FD_FETCH_LAST | SQL_FD_FETCH_PRIOR | SQL_FD_FETCH_ABSOLUTE |
+                                SQL_FD_FETCH_RELATIVE;
         *valLen = sizeof(SQLUINTEGER);
         break;
     case SQL_ODBC_VER:
@@ -4203,6 +5284,18 @@ SQLFreeStmt(SQLHSTMT stmt, SQLUSMALLINT opt)
     return drvfreestmt(stmt, opt);
 }
 
+/**
+ * Close open cursor.
+ * @param stmt statement handle
+ * @result ODBC error code
+ */
+
+SQLRETURN SQL_API
+SQLCloseCursor(SQLHSTMT stmt)
+{
+    return drvfreestmt(stmt, SQL_CLOSE);
+}
+
 /**
  * Internal disconnect given HDBC.
  * @param dbc database connection handle
@@ -4230,11 +5323,20 @@ drvdisconnect(SQLHDBC dbc)
     }   
     if (d->presto_client)
     {
-        prestoclient_close(d->presto_client);        
-        d->presto_client = NULL;
+        STMT *s;
+
+        /* a client goes back to the pool only without open results */
+        for (s = d->stmt; s; s = s->next)
+        {
+            freeresult(s, -1);
+        }
+        dbclose(d);
     }
     freep(&d->dbname);
     freep(&d->dsn);
+    freep(&d->cachedir);
+    freep(&d->encoding);
+    freep(&d->compression);
     return SQL_SUCCESS;
 }
 
@@ -4273,7 +5375,7 @@ static SQLRETURN
 getrowdata(STMT *s, SQLUSMALLINT col, SQLSMALLINT otype,
 		   SQLPOINTER val, SQLINTEGER len, SQLLEN *lenp, int partial)
 {
-	char *data, valdummy[16];
+	char *data, **row, valdummy[16];
 	SQLLEN dummy;
 	SQLINTEGER *ilenp = NULL;
 	int valnull = 0;
@@ -4304,7 +5406,7 @@ getrowdata(STMT *s, SQLUSMALLINT col, SQLSMALLINT otype,
 		*lenp = SQL_NULL_DATA;
 		goto done;
 	}
-	if (s->presto_stmt->tablebuff->rowidx > (s->presto_stmt->tablebuff->nrow-1))
+	if (s->presto_stmt->rowidx > (s->presto_stmt->tablebuff->nrow-1))
 	{
 		*lenp = SQL_NULL_DATA;
 		goto done;
@@ -4334,8 +5436,9 @@ getrowdata(STMT *s, SQLUSMALLINT col, SQLSMALLINT otype,
 		type = SQL_C_CHAR;
 	}
 #endif
-    // calc the array offset of the column
-	data = (char*)s->presto_stmt->tablebuff->rowbuff[ (s->presto_stmt->tablebuff->ncol* s->presto_stmt->tablebuff->rowidx + col) ];
+    // the row may be decompressed first, see prestoclient_sethotpages
+	row = prestoclient_getrow(s->presto_stmt, (size_t)s->presto_stmt->rowidx);
+	data = row ? row[col] : NULL;
     // printf("\nparams %s %i %i %i %i %i\n", data, type, col, otype, len, *lenp);
 	if (!val)
 	{
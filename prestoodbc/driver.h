@@ -16,6 +16,17 @@
 #include "../prestoclient/prestoclient.h"
 #include "../prestoclient/prestoclienttypes.h"
 #include "../prestoclient/sqlparser.h"
+#include "../prestoclient/resultcache.h"
+#include "../prestoclient/diskcache.h"
+#include "../prestoclient/clientpool.h"
+#include "../prestoclient/curlshare.h"
+#include "../prestoclient/retrypolicy.h"
+#include "../prestoclient/endpoints.h"
+#include "../prestoclient/admission.h"
+#include "../prestoclient/pagescheduler.h"
+#include "../prestoclient/partitions.h"
+#include "../prestoclient/parsepool.h"
+#include "../prestoclient/multiplexer.h"
 
 #include "wcutils.h"
 #include "str2odbc.h"
@@ -25,6 +36,32 @@
     #define USE_DLOPEN_FOR_GPPS
 #endif
 
+/**
+ * Driver specific statement attribute: priority of the queries of a
+ * statement, positive values are interactive and get their pages
+ * before bulk statements, see pagescheduler.h.
+ */
+#ifndef SQL_DRIVER_STMT_ATTR_BASE
+#define SQL_DRIVER_STMT_ATTR_BASE 0x00004000
+#endif
+#define SQL_ATTR_PRESTO_PRIORITY (SQL_DRIVER_STMT_ATTR_BASE + 1)
+
+/**
+ * Driver specific statement attributes: a SELECT of a statement with an
+ * integer partition column and a parallelism above 1 runs as that many
+ * range queries at the same time, see partitions.h.
+ */
+#define SQL_ATTR_PRESTO_PARTITION_COLUMN (SQL_DRIVER_STMT_ATTR_BASE + 2)
+#define SQL_ATTR_PRESTO_PARALLELISM (SQL_DRIVER_STMT_ATTR_BASE + 3)
+
+/**
+ * Driver specific read only statement attributes: response body bytes
+ * of the last query of a statement as received and after decompression,
+ * see prestoclient_getbytes().
+ */
+#define SQL_ATTR_PRESTO_WIRE_BYTES (SQL_DRIVER_STMT_ATTR_BASE + 4)
+#define SQL_ATTR_PRESTO_BODY_BYTES (SQL_DRIVER_STMT_ATTR_BASE + 5)
+
 struct dbc;
 struct stmt;
 
@@ -42,6 +79,15 @@ typedef struct {
     CRITICAL_SECTION cs;	/**< For serializing most APIs */
 #endif
     struct dbc *dbcs;		/**< Pointer to first DBC */
+    RESULTCACHE *resultcache;	/**< Query results shared by all DBCs */
+    CLIENTPOOL *clientpool;	/**< Idle presto clients shared by all DBCs */
+    CURLSHARE *curlshare;	/**< DNS, TLS session and connection cache of all DBCs */
+    RETRYPOLICY *retrypolicy;	/**< Retry budget and circuit breakers of all DBCs */
+    ENDPOINTS *endpoints;	/**< Load and health of the coordinators of all DBCs */
+    ADMISSION *admission;	/**< Limit of the queries running per coordinator of all DBCs */
+    PAGESCHEDULER *scheduler;	/**< Page requests of all DBCs, interactive first */
+    PARSEPOOL *parsepool;	/**< Workers parsing the pages of all DBCs */
+    MULTIPLEXER *multiplexer;	/**< HTTP/2 connections shared by the statements of all DBCs */
 } ENV;
 
 #endif
@@ -84,6 +130,19 @@ typedef struct dbc {
     int trans_disable;		/**< True for no transaction support */
     int oemcp;			/**< True for Win32 OEM CP translation */
     int jdconv;			/**< True for julian day conversion */
+    long long cachettl;		/**< Result cache time to live in ms, 0 = off */
+    int coalesce;		/**< Share identical running queries in ENV */
+    SQLULEN querytimeout;	/**< Default SQL_ATTR_QUERY_TIMEOUT of new STMTs */
+    SQLLEN priority;		/**< Default SQL_ATTR_PRESTO_PRIORITY of new STMTs */
+    char *cachedir;		/**< Directory of the on-disk result cache or NULL */
+    char *encoding;		/**< Page encodings asked from the server or NULL */
+    long spooling;		/**< Spooled segments downloaded at a time, 0 = off */
+    char *compression;		/**< Accept-Encoding of the responses or NULL */
+    long firstpagesize;		/**< Target kB of the first page, 0 = server's */
+    long maxpagesize;		/**< kB the pages may grow to, 0 = server's */
+    long hotpages;		/**< Uncompressed pages of static cursors, 0 = all */
+    int pooling;		/**< Take presto_client from ENV client pool */
+    int pooled;			/**< presto_client belongs to ENV client pool */
     struct stmt *cur_s3stmt;	/**< Current STMT executing sqlite statement */
     int s3stmt_needmeta;	/**< True to get meta data in s3stmt_step(). */
     FILE *trace;		/**< sqlite3_trace() file pointer or NULL */
@@ -218,6 +277,10 @@ typedef struct stmt {
     SQLULEN paramset_count;	/**< Internal for paramset */
     SQLUINTEGER paramset_nrows;	/**< Row count for paramset handling */
     SQLULEN max_rows;		/**< SQL_ATTR_MAX_ROWS */
+    SQLULEN query_timeout;	/**< SQL_ATTR_QUERY_TIMEOUT in seconds */
+    SQLLEN priority;		/**< SQL_ATTR_PRESTO_PRIORITY */
+    char *partcolumn;		/**< SQL_ATTR_PRESTO_PARTITION_COLUMN */
+    SQLULEN parallelism;	/**< SQL_ATTR_PRESTO_PARALLELISM */
     SQLULEN bind_type;		/**< SQL_ATTR_ROW_BIND_TYPE */
     SQLULEN *bind_offs;		/**< SQL_ATTR_ROW_BIND_OFFSET_PTR */
     /* Dummies to make ADO happy */
@@ -229,6 +292,8 @@ typedef struct stmt {
     int curtype;		/**< Cursor type */
     // sqlite3_stmt *s3stmt;	/**< SQLite statement handle or NULL */
     PRESTOCLIENT_RESULT *presto_stmt; /**< Presto statement handle or NULL */
+    volatile int executing;	/**< True while a query runs, see SQLCancel() */
+    volatile bool cancelwait;	/**< Set by SQLCancel() to end a wait for a coalesced query */
     int s3stmt_noreset;		/**< False when sqlite3_reset() needed. */
     int presto_stmt_rownum;		/**< Current row number */
     char *bincell;		/**< Cache for blob data */